@@ -0,0 +1,700 @@
+#pragma once
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <gli/gli.hpp>
+#include <ThreadPool.hpp>
+
+namespace vk229
+{
+/////////////////////////////////////////
+/// CPU block compression of 4 x 8-bit textures:
+/// * BC5 (two BC4 channels) - tangent space normal maps, only X and Y are kept (Z = sqrt(1 - X^2 - Y^2) in shader)
+/// * BC7 mode 6 - RGBA colors, single subset, 7.7.7.7 endpoints + p-bit, 4-bit indices
+/// Blocks are independent, block rows are encoded on multiple threads.
+/// BC1, BC3 and BC4 can be decoded back, e.g. to repack baked maps (preparePackedTexture() in TextureProcessing.hpp).
+/// Source textures can be BGRA or RGBA, output is always in RGBA channel order.
+/////////////////////////////////////////
+
+/// Endpoint insets tried by the BC4 encoder, per endpoint.
+#define BC4_REFINE_STEPS  4
+
+// BC4_BC5 {
+
+/// Palette of a BC4 block in 8-value mode (endpoint0 > endpoint1), indexed by BC4 index.
+void getBC4Palette(uint8_t endpoint0, uint8_t endpoint1, uint8_t outPalette[8])
+{
+    outPalette[0] = endpoint0;
+    outPalette[1] = endpoint1;
+    for (uint32_t i = 2; i < 8u; i++)
+    {
+        outPalette[i] = uint8_t(((8u - i)*endpoint0 + (i - 1u)*endpoint1) / 7u);
+    }
+}
+
+/// Squared error of the block with given endpoints (hi > lo), indices are written if outIndices != nullptr.
+uint32_t fitBC4Indices(const uint8_t values[16], uint8_t hi, uint8_t lo, uint8_t* outIndices)
+{
+    uint8_t palette[8];
+    getBC4Palette(hi, lo, palette);
+
+    // Step 0 is lo (index 1), step 7 is hi (index 0), step s in between is index 8 - s.
+    static const uint8_t stepToIndex[8] = {1, 7, 6, 5, 4, 3, 2, 0};
+
+    const float    scale = 7.0f / float(hi - lo);
+    uint32_t       error = 0u;
+    for (uint32_t i = 0; i < 16u; i++)
+    {
+        const float   t    = (float(values[i]) - float(lo)) * scale;
+        const int32_t step = std::min(7, std::max(0, int32_t(t + 0.5f)));
+
+        // Rounding of palette values can make a neighbour step closer.
+        uint8_t  bestIndex = stepToIndex[step];
+        int32_t  bestDiff  = abs(int32_t(values[i]) - int32_t(palette[bestIndex]));
+        for (int32_t neighbour = std::max(0, step - 1); neighbour <= std::min(7, step + 1); neighbour++)
+        {
+            const int32_t diff = abs(int32_t(values[i]) - int32_t(palette[stepToIndex[neighbour]]));
+            if (diff < bestDiff)
+            {
+                bestDiff  = diff;
+                bestIndex = stepToIndex[neighbour];
+            }
+        }
+
+        error += uint32_t(bestDiff * bestDiff);
+        if (outIndices != nullptr)
+        {
+            outIndices[i] = bestIndex;
+        }
+    }
+    return error;
+}
+
+/// Single channel block -> 8 bytes. Endpoints start at min/max and are moved inwards while the error drops.
+void encodeBC4Block(const uint8_t values[16], uint8_t outBlock[8])
+{
+    uint8_t minValue = 255u;
+    uint8_t maxValue = 0u;
+    for (uint32_t i = 0; i < 16u; i++)
+    {
+        minValue = std::min(minValue, values[i]);
+        maxValue = std::max(maxValue, values[i]);
+    }
+
+    uint8_t indices[16] = {};
+    uint8_t hi = maxValue;
+    uint8_t lo = minValue;
+
+    if (maxValue > minValue)
+    {
+        uint32_t bestError = fitBC4Indices(values, hi, lo, nullptr);
+        for (int32_t hiInset = 0; hiInset < BC4_REFINE_STEPS; hiInset++)
+        {
+            for (int32_t loInset = 0; loInset < BC4_REFINE_STEPS; loInset++)
+            {
+                const int32_t candHi = int32_t(maxValue) - hiInset;
+                const int32_t candLo = int32_t(minValue) + loInset;
+                if (candHi <= candLo)
+                {
+                    continue;
+                }
+                const uint32_t error = fitBC4Indices(values, uint8_t(candHi), uint8_t(candLo), nullptr);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    hi = uint8_t(candHi);
+                    lo = uint8_t(candLo);
+                }
+            }
+        }
+        fitBC4Indices(values, hi, lo, indices);
+    }
+    // else: hi == lo selects 6-value mode, index 0 is still endpoint0 - all indices 0.
+
+    outBlock[0] = hi;
+    outBlock[1] = lo;
+    uint64_t bits = 0u;
+    for (uint32_t i = 0; i < 16u; i++)
+    {
+        bits |= uint64_t(indices[i]) << (3u*i);
+    }
+    for (uint32_t b = 0; b < 6u; b++)
+    {
+        outBlock[2u + b] = uint8_t(bits >> (8u*b));
+    }
+}
+
+/// 4x4 RGBA texels -> 16 bytes of BC5 (red and green).
+void encodeBC5Block(const uint8_t rgba[64], uint8_t outBlock[16])
+{
+    uint8_t red[16];
+    uint8_t green[16];
+    for (uint32_t i = 0; i < 16u; i++)
+    {
+        red[i]   = rgba[4u*i];
+        green[i] = rgba[4u*i + 1u];
+    }
+    encodeBC4Block(red,   outBlock);
+    encodeBC4Block(green, outBlock + 8u);
+}
+
+// } // BC4_BC5
+
+// BC7 {
+
+/// Interpolation weights of 4-bit BC7 indices.
+static const uint32_t BC7_WEIGHTS4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+/// Writes bits LSB first, as BC7 expects.
+struct BlockBitWriter
+{
+    uint8_t* data;
+    uint32_t pos;
+
+    void write(uint32_t value, uint32_t bitCount)
+    {
+        for (uint32_t b = 0; b < bitCount; b++, this->pos++)
+        {
+            if (value & (1u << b))
+            {
+                this->data[this->pos >> 3u] |= uint8_t(1u << (this->pos & 7u));
+            }
+        }
+    }
+};
+
+/// 8-bit endpoint from 7-bit value and p-bit.
+uint32_t getBC7Mode6Endpoint(uint32_t quantized, uint32_t pBit)
+{
+    return (quantized << 1u) | pBit;
+}
+
+/// Quantizes RGBA endpoint to 7 bits per channel, picks p-bit with lower error.
+void quantizeBC7Mode6Endpoint(const float endpoint[4], uint32_t outQuantized[4], uint32_t& outPBit)
+{
+    float bestError = INFINITY;
+    for (uint32_t pBit = 0; pBit < 2u; pBit++)
+    {
+        uint32_t quantized[4];
+        float    error = 0.0f;
+        for (uint32_t c = 0; c < 4u; c++)
+        {
+            const float q = (endpoint[c] - float(pBit)) * 0.5f;
+            quantized[c]  = uint32_t(std::min(127.0f, std::max(0.0f, q + 0.5f)));
+            const float d = float(getBC7Mode6Endpoint(quantized[c], pBit)) - endpoint[c];
+            error += d*d;
+        }
+        if (error < bestError)
+        {
+            bestError = error;
+            outPBit   = pBit;
+            memcpy(outQuantized, quantized, sizeof(quantized));
+        }
+    }
+}
+
+/// Squared error of the block with given 8-bit endpoints, indices are written if outIndices != nullptr.
+uint32_t fitBC7Mode6Indices(const uint8_t rgba[64], const uint32_t e0[4], const uint32_t e1[4], uint8_t* outIndices)
+{
+    uint32_t palette[16][4];
+    for (uint32_t i = 0; i < 16u; i++)
+    {
+        for (uint32_t c = 0; c < 4u; c++)
+        {
+            palette[i][c] = ((64u - BC7_WEIGHTS4[i])*e0[c] + BC7_WEIGHTS4[i]*e1[c] + 32u) >> 6u;
+        }
+    }
+
+    // Projection on the endpoint line gives the index up to weight rounding, neighbours are checked.
+    float axis[4];
+    float axisLenSq = 0.0f;
+    for (uint32_t c = 0; c < 4u; c++)
+    {
+        axis[c]    = float(e1[c]) - float(e0[c]);
+        axisLenSq += axis[c]*axis[c];
+    }
+    const float projScale = axisLenSq > 0.0f ? 15.0f / axisLenSq : 0.0f;
+
+    uint32_t error = 0u;
+    for (uint32_t i = 0; i < 16u; i++)
+    {
+        const uint8_t* px = rgba + 4u*i;
+
+        float t = 0.0f;
+        for (uint32_t c = 0; c < 4u; c++)
+        {
+            t += (float(px[c]) - float(e0[c])) * axis[c];
+        }
+        const int32_t guess = std::min(15, std::max(0, int32_t(t * projScale + 0.5f)));
+
+        uint32_t bestError = UINT32_MAX;
+        uint8_t  bestIndex = 0u;
+        for (int32_t idx = std::max(0, guess - 1); idx <= std::min(15, guess + 1); idx++)
+        {
+            uint32_t e = 0u;
+            for (uint32_t c = 0; c < 4u; c++)
+            {
+                const int32_t d = int32_t(px[c]) - int32_t(palette[idx][c]);
+                e += uint32_t(d*d);
+            }
+            if (e < bestError)
+            {
+                bestError = e;
+                bestIndex = uint8_t(idx);
+            }
+        }
+
+        error += bestError;
+        if (outIndices != nullptr)
+        {
+            outIndices[i] = bestIndex;
+        }
+    }
+    return error;
+}
+
+/// Endpoints along the principal axis of the block's colors (power iteration on covariance).
+void getPrincipalAxisEndpoints(const uint8_t rgba[64], float outE0[4], float outE1[4])
+{
+    float mean[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (uint32_t i = 0; i < 16u; i++)
+    {
+        for (uint32_t c = 0; c < 4u; c++)
+        {
+            mean[c] += rgba[4u*i + c];
+        }
+    }
+    for (uint32_t c = 0; c < 4u; c++)
+    {
+        mean[c] /= 16.0f;
+    }
+
+    float cov[4][4] = {};
+    for (uint32_t i = 0; i < 16u; i++)
+    {
+        float d[4];
+        for (uint32_t c = 0; c < 4u; c++)
+        {
+            d[c] = rgba[4u*i + c] - mean[c];
+        }
+        for (uint32_t r = 0; r < 4u; r++)
+        {
+            for (uint32_t c = 0; c < 4u; c++)
+            {
+                cov[r][c] += d[r]*d[c];
+            }
+        }
+    }
+
+    float axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    for (uint32_t iter = 0; iter < 8u; iter++)
+    {
+        float next[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (uint32_t r = 0; r < 4u; r++)
+        {
+            for (uint32_t c = 0; c < 4u; c++)
+            {
+                next[r] += cov[r][c]*axis[c];
+            }
+        }
+        const float len = sqrtf(next[0]*next[0] + next[1]*next[1] + next[2]*next[2] + next[3]*next[3]);
+        if (len < 1e-6f)
+        {
+            break; // Flat block - any axis is fine.
+        }
+        for (uint32_t c = 0; c < 4u; c++)
+        {
+            axis[c] = next[c] / len;
+        }
+    }
+
+    float tMin = INFINITY;
+    float tMax = -INFINITY;
+    for (uint32_t i = 0; i < 16u; i++)
+    {
+        float t = 0.0f;
+        for (uint32_t c = 0; c < 4u; c++)
+        {
+            t += (rgba[4u*i + c] - mean[c]) * axis[c];
+        }
+        tMin = fminf(tMin, t);
+        tMax = fmaxf(tMax, t);
+    }
+
+    for (uint32_t c = 0; c < 4u; c++)
+    {
+        outE0[c] = fminf(255.0f, fmaxf(0.0f, mean[c] + tMin*axis[c]));
+        outE1[c] = fminf(255.0f, fmaxf(0.0f, mean[c] + tMax*axis[c]));
+    }
+}
+
+/// Least squares endpoints for fixed indices. Returns false if all indices are equal.
+bool refitBC7Mode6Endpoints(const uint8_t rgba[64], const uint8_t indices[16], float outE0[4], float outE1[4])
+{
+    // Minimize sum |(1-w)*e0 + w*e1 - p|^2 -> 2x2 normal equations per channel.
+    float a00 = 0.0f, a01 = 0.0f, a11 = 0.0f;
+    float b0[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    float b1[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (uint32_t i = 0; i < 16u; i++)
+    {
+        const float w  = BC7_WEIGHTS4[indices[i]] / 64.0f;
+        const float iw = 1.0f - w;
+        a00 += iw*iw;
+        a01 += iw*w;
+        a11 += w*w;
+        for (uint32_t c = 0; c < 4u; c++)
+        {
+            b0[c] += iw * rgba[4u*i + c];
+            b1[c] += w  * rgba[4u*i + c];
+        }
+    }
+
+    const float det = a00*a11 - a01*a01;
+    if (fabsf(det) < 1e-6f)
+    {
+        return false;
+    }
+    for (uint32_t c = 0; c < 4u; c++)
+    {
+        outE0[c] = fminf(255.0f, fmaxf(0.0f, (a11*b0[c] - a01*b1[c]) / det));
+        outE1[c] = fminf(255.0f, fmaxf(0.0f, (a00*b1[c] - a01*b0[c]) / det));
+    }
+    return true;
+}
+
+/// 4x4 RGBA texels -> 16 bytes of BC7 mode 6.
+void encodeBC7Block(const uint8_t rgba[64], uint8_t outBlock[16])
+{
+    float e0f[4];
+    float e1f[4];
+    getPrincipalAxisEndpoints(rgba, e0f, e1f);
+
+    uint32_t q0[4], q1[4], p0, p1;
+    uint32_t e0[4], e1[4];
+    uint8_t  indices[16];
+
+    auto quantizeEndpoints = [&](const float* a, const float* b, uint32_t* outQ0, uint32_t* outQ1, uint32_t& outP0, uint32_t& outP1, uint32_t* outE0, uint32_t* outE1)
+    {
+        quantizeBC7Mode6Endpoint(a, outQ0, outP0);
+        quantizeBC7Mode6Endpoint(b, outQ1, outP1);
+        for (uint32_t c = 0; c < 4u; c++)
+        {
+            outE0[c] = getBC7Mode6Endpoint(outQ0[c], outP0);
+            outE1[c] = getBC7Mode6Endpoint(outQ1[c], outP1);
+        }
+    };
+
+    quantizeEndpoints(e0f, e1f, q0, q1, p0, p1, e0, e1);
+    uint32_t error = fitBC7Mode6Indices(rgba, e0, e1, indices);
+
+    // One least squares pass - keep it only if it helps after quantization.
+    float r0f[4];
+    float r1f[4];
+    if (error > 0u && refitBC7Mode6Endpoints(rgba, indices, r0f, r1f))
+    {
+        uint32_t rq0[4], rq1[4], rp0, rp1;
+        uint32_t re0[4], re1[4];
+        uint8_t  rIndices[16];
+        quantizeEndpoints(r0f, r1f, rq0, rq1, rp0, rp1, re0, re1);
+        const uint32_t refitError = fitBC7Mode6Indices(rgba, re0, re1, rIndices);
+        if (refitError < error)
+        {
+            memcpy(q0, rq0, sizeof(q0));
+            memcpy(q1, rq1, sizeof(q1));
+            p0 = rp0;
+            p1 = rp1;
+            memcpy(indices, rIndices, sizeof(indices));
+        }
+    }
+
+    // Anchor (texel 0) index has implicit MSB 0 - swap endpoints if needed.
+    if (indices[0] & 8u)
+    {
+        std::swap(q0, q1);
+        std::swap(p0, p1);
+        for (uint32_t i = 0; i < 16u; i++)
+        {
+            indices[i] = uint8_t(15u - indices[i]);
+        }
+    }
+
+    memset(outBlock, 0, 16u);
+    BlockBitWriter writer = {outBlock, 0u};
+    writer.write(1u << 6u, 7u); // Mode 6.
+    for (uint32_t c = 0; c < 4u; c++)
+    {
+        writer.write(q0[c], 7u);
+        writer.write(q1[c], 7u);
+    }
+    writer.write(p0, 1u);
+    writer.write(p1, 1u);
+    writer.write(indices[0], 3u);
+    for (uint32_t i = 1; i < 16u; i++)
+    {
+        writer.write(indices[i], 4u);
+    }
+}
+
+// } // BC7
+
+// DECODING {
+
+/// 8 bytes of BC4 -> 16 single channel values. Both 8-value (endpoint0 > endpoint1) and 6-value modes.
+void decodeBC4Block(const uint8_t block[8], uint8_t outValues[16])
+{
+    const uint8_t e0 = block[0];
+    const uint8_t e1 = block[1];
+
+    uint8_t palette[8];
+    if (e0 > e1)
+    {
+        getBC4Palette(e0, e1, palette);
+    }
+    else
+    {
+        palette[0] = e0;
+        palette[1] = e1;
+        for (uint32_t i = 2; i < 6u; i++)
+        {
+            palette[i] = uint8_t(((6u - i)*e0 + (i - 1u)*e1) / 5u);
+        }
+        palette[6] = 0u;
+        palette[7] = 255u;
+    }
+
+    uint64_t bits = 0u;
+    for (uint32_t b = 0; b < 6u; b++)
+    {
+        bits |= uint64_t(block[2u + b]) << (8u*b);
+    }
+    for (uint32_t i = 0; i < 16u; i++)
+    {
+        outValues[i] = palette[(bits >> (3u*i)) & 7u];
+    }
+}
+
+/// 8 bytes of BC1 color -> 4x4 RGBA texels. forceFourColors is set for BC2/BC3 color blocks.
+void decodeBC1Block(const uint8_t block[8], bool forceFourColors, uint8_t outRgba[64])
+{
+    const uint32_t c0 = uint32_t(block[0]) | (uint32_t(block[1]) << 8u);
+    const uint32_t c1 = uint32_t(block[2]) | (uint32_t(block[3]) << 8u);
+
+    uint8_t palette[4][4];
+    auto unpack565 = [](uint32_t c, uint8_t out[4])
+    {
+        out[0] = uint8_t(((c >> 11u) & 31u) * 255u / 31u);
+        out[1] = uint8_t(((c >> 5u)  & 63u) * 255u / 63u);
+        out[2] = uint8_t(( c         & 31u) * 255u / 31u);
+        out[3] = 255u;
+    };
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+
+    for (uint32_t c = 0; c < 4u; c++)
+    {
+        if (forceFourColors || c0 > c1)
+        {
+            palette[2][c] = uint8_t((2u*palette[0][c] +    palette[1][c]) / 3u);
+            palette[3][c] = uint8_t((   palette[0][c] + 2u*palette[1][c]) / 3u);
+        }
+        else
+        {
+            palette[2][c] = uint8_t((palette[0][c] + palette[1][c]) / 2u);
+            palette[3][c] = 0u; // Transparent black.
+        }
+    }
+
+    const uint32_t bits = uint32_t(block[4]) | (uint32_t(block[5]) << 8u) | (uint32_t(block[6]) << 16u) | (uint32_t(block[7]) << 24u);
+    for (uint32_t i = 0; i < 16u; i++)
+    {
+        memcpy(outRgba + 4u*i, palette[(bits >> (2u*i)) & 3u], 4u);
+    }
+}
+
+/// 16 bytes of BC3 -> 4x4 RGBA texels (BC4 alpha block, then BC1 color block).
+void decodeBC3Block(const uint8_t block[16], uint8_t outRgba[64])
+{
+    uint8_t alpha[16];
+    decodeBC4Block(block, alpha);
+    decodeBC1Block(block + 8u, true, outRgba);
+    for (uint32_t i = 0; i < 16u; i++)
+    {
+        outRgba[4u*i + 3u] = alpha[i];
+    }
+}
+
+// } // DECODING
+
+// IMAGES {
+
+using block_encoder_t = void (*)(const uint8_t rgba[64], uint8_t outBlock[16]);
+
+/// Encodes one 4 x 8-bit image level to 16-byte blocks. Edge blocks of sizes not divisible by 4 repeat the last texel.
+void encodeImageBlocks(const uint8_t* src, uint32_t width, uint32_t height, bool srcIsBgra, block_encoder_t encodeBlock, uint8_t* dst)
+{
+    const uint32_t blocksX = (width  + 3u) / 4u;
+    const uint32_t blocksY = (height + 3u) / 4u;
+
+    parallelFor(blocksY, [&](uint32_t begin, uint32_t end)
+    {
+        uint8_t rgba[64];
+        for (uint32_t by = begin; by < end; by++)
+        {
+            for (uint32_t bx = 0; bx < blocksX; bx++)
+            {
+                for (uint32_t i = 0; i < 16u; i++)
+                {
+                    const uint32_t x = std::min(bx*4u + (i & 3u), width  - 1u);
+                    const uint32_t y = std::min(by*4u + (i >> 2u), height - 1u);
+                    const uint8_t* texel = src + 4u*(y*width + x);
+
+                    rgba[4u*i + 0u] = texel[srcIsBgra ? 2u : 0u];
+                    rgba[4u*i + 1u] = texel[1u];
+                    rgba[4u*i + 2u] = texel[srcIsBgra ? 0u : 2u];
+                    rgba[4u*i + 3u] = texel[3u];
+                }
+                encodeBlock(rgba, dst + 16u*(by*blocksX + bx));
+            }
+        }
+    });
+}
+
+bool isBgraFormat(gli::format format)
+{
+    return format == gli::FORMAT_BGRA8_UNORM_PACK8 || format == gli::FORMAT_BGRA8_SRGB_PACK8;
+}
+
+/// One level of BC1, BC3, BC4 or 4 x 8-bit texture -> RGBA8, as the sampler would return it
+/// (BC4 gives (R, 0, 0, 255)). Other formats are not supported.
+std::vector<uint8_t> decodeTextureLevel(const gli::texture2d& src, size_t level)
+{
+    const uint32_t width   = src.extent(level).x;
+    const uint32_t height  = src.extent(level).y;
+    const uint8_t* srcData = static_cast<const uint8_t*>(src.data(0, 0, level));
+    const gli::format format = src.format();
+
+    std::vector<uint8_t> rgba(4u*width*height);
+
+    if (gli::is_compressed(format) == false)
+    {
+        assert(gli::block_size(format) == 4u);
+        const bool bgra = isBgraFormat(format);
+        for (uint32_t i = 0; i < width*height; i++)
+        {
+            rgba[4u*i + 0u] = srcData[4u*i + (bgra ? 2u : 0u)];
+            rgba[4u*i + 1u] = srcData[4u*i + 1u];
+            rgba[4u*i + 2u] = srcData[4u*i + (bgra ? 0u : 2u)];
+            rgba[4u*i + 3u] = srcData[4u*i + 3u];
+        }
+        return rgba;
+    }
+
+    const bool isBC3 = format == gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16 || format == gli::FORMAT_RGBA_DXT5_SRGB_BLOCK16;
+    const bool isBC4 = format == gli::FORMAT_R_ATI1N_UNORM_BLOCK8;
+    const bool isBC1 = format == gli::FORMAT_RGB_DXT1_UNORM_BLOCK8  || format == gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8
+                    || format == gli::FORMAT_RGB_DXT1_SRGB_BLOCK8   || format == gli::FORMAT_RGBA_DXT1_SRGB_BLOCK8;
+    assert(isBC1 || isBC3 || isBC4);
+
+    const uint32_t blocksX   = (width  + 3u) / 4u;
+    const uint32_t blocksY   = (height + 3u) / 4u;
+    const uint32_t blockSize = isBC3 ? 16u : 8u;
+
+    parallelFor(blocksY, [&](uint32_t begin, uint32_t end)
+    {
+        uint8_t texels[64];
+        for (uint32_t by = begin; by < end; by++)
+        {
+            for (uint32_t bx = 0; bx < blocksX; bx++)
+            {
+                const uint8_t* block = srcData + blockSize*(by*blocksX + bx);
+                if (isBC3)
+                {
+                    decodeBC3Block(block, texels);
+                }
+                else if (isBC1)
+                {
+                    decodeBC1Block(block, false, texels);
+                }
+                else
+                {
+                    uint8_t values[16];
+                    decodeBC4Block(block, values);
+                    for (uint32_t i = 0; i < 16u; i++)
+                    {
+                        texels[4u*i + 0u] = values[i];
+                        texels[4u*i + 1u] = 0u;
+                        texels[4u*i + 2u] = 0u;
+                        texels[4u*i + 3u] = 255u;
+                    }
+                }
+
+                for (uint32_t i = 0; i < 16u; i++)
+                {
+                    const uint32_t x = bx*4u + (i & 3u);
+                    const uint32_t y = by*4u + (i >> 2u);
+                    if (x < width && y < height)
+                    {
+                        memcpy(&rgba[4u*(y*width + x)], texels + 4u*i, 4u);
+                    }
+                }
+            }
+        }
+    });
+
+    return rgba;
+}
+
+/// All levels of 4 x 8-bit texture -> BC5 (RG of the source).
+gli::texture2d compressTextureBC5(const gli::texture2d& src)
+{
+    assert(gli::block_size(src.format()) == 4u);
+
+    gli::texture2d dst(gli::FORMAT_RG_ATI2N_UNORM_BLOCK16, src.extent(0), src.levels());
+    for (size_t level = 0; level < src.levels(); level++)
+    {
+        encodeImageBlocks(static_cast<const uint8_t*>(src.data(0, 0, level)), src.extent(level).x, src.extent(level).y,
+                          isBgraFormat(src.format()), encodeBC5Block, static_cast<uint8_t*>(dst.data(0, 0, level)));
+    }
+    return dst;
+}
+
+/// All levels of 4 x 8-bit texture -> BC7.
+gli::texture2d compressTextureBC7(const gli::texture2d& src)
+{
+    assert(gli::block_size(src.format()) == 4u);
+
+    const bool srgb = src.format() == gli::FORMAT_BGRA8_SRGB_PACK8 || src.format() == gli::FORMAT_RGBA8_SRGB_PACK8;
+    gli::texture2d dst(srgb ? gli::FORMAT_RGBA_BP_SRGB_BLOCK16 : gli::FORMAT_RGBA_BP_UNORM_BLOCK16, src.extent(0), src.levels());
+    for (size_t level = 0; level < src.levels(); level++)
+    {
+        encodeImageBlocks(static_cast<const uint8_t*>(src.data(0, 0, level)), src.extent(level).x, src.extent(level).y,
+                          isBgraFormat(src.format()), encodeBC7Block, static_cast<uint8_t*>(dst.data(0, 0, level)));
+    }
+    return dst;
+}
+
+/// All faces and levels of 4 x 8-bit cubemap -> BC7.
+gli::texture_cube compressTextureBC7(const gli::texture_cube& src)
+{
+    assert(gli::block_size(src.format()) == 4u);
+
+    const bool srgb = src.format() == gli::FORMAT_BGRA8_SRGB_PACK8 || src.format() == gli::FORMAT_RGBA8_SRGB_PACK8;
+    gli::texture_cube dst(srgb ? gli::FORMAT_RGBA_BP_SRGB_BLOCK16 : gli::FORMAT_RGBA_BP_UNORM_BLOCK16, src.extent(0), src.levels());
+    for (size_t face = 0; face < src.faces(); face++)
+    {
+        for (size_t level = 0; level < src.levels(); level++)
+        {
+            encodeImageBlocks(static_cast<const uint8_t*>(src.data(0, face, level)), src.extent(level).x, src.extent(level).y,
+                              isBgraFormat(src.format()), encodeBC7Block, static_cast<uint8_t*>(dst.data(0, face, level)));
+        }
+    }
+    return dst;
+}
+
+// } // IMAGES
+
+} // namespace vk229
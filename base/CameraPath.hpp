@@ -0,0 +1,481 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+/// Recorded keyframes closer than this (s) to the previous one are dropped.
+#define CAMERA_PATH_MIN_INTERVAL    (1.0f / 120.0f)
+/// Frames rendered from the first keyframe before playback starts measuring - pipelines, caches and clocks settle.
+#define CAMERA_PATH_WARMUP_FRAMES   30
+/// Simulated time step of playback (s), unless set with --camera-step.
+#define CAMERA_PATH_TIME_STEP       (1.0f / 60.0f)
+
+namespace vk229
+{
+
+//////////////////////////////////////
+/// Camera state the examples are driven by - position and Euler rotation (degrees) of the base class
+/// camera, zoom of examples which orbit (unused by first person ones).
+struct CameraPose
+{
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 rotation = glm::vec3(0.0f);
+    float     zoom     = 0.0f;
+};
+
+//////////////////////////////////////
+/// Timestamped camera poses, split into segments (ie. "fly over the rings", "close to the planet") -
+/// playback reports frame times per segment. Saved as text, one keyframe per line:
+/// time segment position.xyz rotation.xyz zoom
+class CameraPath
+{
+public:
+    struct Keyframe
+    {
+        float      time    = 0.0f;
+        uint32_t   segment = 0u;
+        CameraPose pose;
+    };
+
+    void clear()
+    {
+        this->keyframes.clear();
+        this->currentSegment = 0u;
+    }
+
+    /// Appends a pose at time (s, not earlier than the last keyframe), in the current segment.
+    void addKeyframe(float time, const CameraPose& pose)
+    {
+        if (false == this->keyframes.empty())
+        {
+            const Keyframe& last = this->keyframes.back();
+            assert(time >= last.time);
+            if (time - last.time < CAMERA_PATH_MIN_INTERVAL && last.segment == this->currentSegment)
+            {
+                return;
+            }
+        }
+
+        Keyframe keyframe;
+        keyframe.time    = time;
+        keyframe.segment = this->currentSegment;
+        keyframe.pose    = pose;
+        this->keyframes.push_back(keyframe);
+    }
+
+    /// Keyframes added from now on belong to a new segment.
+    void startSegment()
+    {
+        if (false == this->keyframes.empty() && this->keyframes.back().segment == this->currentSegment)
+        {
+            this->currentSegment++;
+        }
+    }
+
+    /// Pose at time, linearly interpolated between keyframes (clamped to the path). Segment of the keyframe before it.
+    void evaluate(float time, CameraPose& outPose, uint32_t& outSegment) const
+    {
+        assert(false == this->keyframes.empty());
+
+        const auto next = std::upper_bound(this->keyframes.begin(), this->keyframes.end(), time,
+                                           [](float t, const Keyframe& keyframe) { return t < keyframe.time; });
+        if (next == this->keyframes.begin())
+        {
+            outPose    = next->pose;
+            outSegment = next->segment;
+            return;
+        }
+        if (next == this->keyframes.end())
+        {
+            outPose    = this->keyframes.back().pose;
+            outSegment = this->keyframes.back().segment;
+            return;
+        }
+
+        const Keyframe& a = *(next - 1);
+        const Keyframe& b = *next;
+        const float     k = (b.time > a.time) ? (time - a.time) / (b.time - a.time) : 0.0f;
+
+        outPose.position = glm::mix(a.pose.position, b.pose.position, k);
+        outPose.rotation = glm::mix(a.pose.rotation, b.pose.rotation, k);
+        outPose.zoom     = a.pose.zoom + (b.pose.zoom - a.pose.zoom) * k;
+        outSegment       = a.segment;
+    }
+
+    bool isEmpty() const
+    {
+        return this->keyframes.empty();
+    }
+
+    float getDuration() const
+    {
+        return this->keyframes.empty() ? 0.0f : this->keyframes.back().time - this->keyframes.front().time;
+    }
+
+    float getStartTime() const
+    {
+        return this->keyframes.empty() ? 0.0f : this->keyframes.front().time;
+    }
+
+    uint32_t getSegmentCount() const
+    {
+        return this->keyframes.empty() ? 0u : this->keyframes.back().segment + 1u;
+    }
+
+    const std::vector<Keyframe>& getKeyframes() const
+    {
+        return this->keyframes;
+    }
+
+    bool save(const std::string& filename) const
+    {
+        std::ofstream file(filename.c_str());
+        if (!file)
+        {
+            std::cout << " >>> CameraPath::save: could not open " << filename << "\n";
+            return false;
+        }
+
+        file << "# time segment position.x position.y position.z rotation.x rotation.y rotation.z zoom\n";
+        file << std::setprecision(9);
+        for (const Keyframe& keyframe : this->keyframes)
+        {
+            const CameraPose& pose = keyframe.pose;
+            file << keyframe.time << " " << keyframe.segment << " "
+                 << pose.position.x << " " << pose.position.y << " " << pose.position.z << " "
+                 << pose.rotation.x << " " << pose.rotation.y << " " << pose.rotation.z << " " << pose.zoom << "\n";
+        }
+
+        std::cout << " >>> CameraPath::save: " << this->keyframes.size() << " keyframes, " << this->getSegmentCount() << " segments, "
+                  << this->getDuration() << " s written to " << filename << "\n";
+        return true;
+    }
+
+    bool load(const std::string& filename)
+    {
+        std::ifstream file(filename.c_str());
+        if (!file)
+        {
+            std::cout << " >>> CameraPath::load: could not open " << filename << "\n";
+            return false;
+        }
+
+        this->clear();
+
+        std::string line;
+        uint32_t    lineNumber = 0u;
+        while (std::getline(file, line))
+        {
+            lineNumber++;
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+
+            std::istringstream ss(line);
+            Keyframe keyframe;
+            CameraPose& pose = keyframe.pose;
+            ss >> keyframe.time >> keyframe.segment
+               >> pose.position.x >> pose.position.y >> pose.position.z
+               >> pose.rotation.x >> pose.rotation.y >> pose.rotation.z >> pose.zoom;
+            if (ss.fail() || (false == this->keyframes.empty() && keyframe.time < this->keyframes.back().time))
+            {
+                std::cout << " >>> CameraPath::load: bad keyframe at " << filename << ":" << lineNumber << "\n";
+                this->clear();
+                return false;
+            }
+            this->keyframes.push_back(keyframe);
+        }
+        this->currentSegment = this->keyframes.empty() ? 0u : this->keyframes.back().segment;
+
+        std::cout << " >>> CameraPath::load: " << this->keyframes.size() << " keyframes, " << this->getSegmentCount() << " segments, "
+                  << this->getDuration() << " s from " << filename << "\n";
+        return false == this->keyframes.empty();
+    }
+
+private:
+    std::vector<Keyframe> keyframes;
+    uint32_t              currentSegment = 0u;
+};
+
+//////////////////////////////////////
+/// Replays a CameraPath at a fixed simulated time step - every run renders the same poses, however fast
+/// the frames are, so runs before and after an optimisation can be compared frame by frame.
+/// step() is called once per frame, for the pose of the next frame - the wall time between two calls is the
+/// frame time of the pose of the first one (whole loop iteration: update, record, submit, wait, present).
+/// Results - frame time stats per segment and the slowest frames with their poses.
+class CameraPathPlayback
+{
+public:
+    struct Frame
+    {
+        uint32_t   index   = 0u;
+        float      time    = 0.0f; // On the path.
+        uint32_t   segment = 0u;
+        float      ms      = 0.0f;
+        CameraPose pose;
+    };
+
+    struct SegmentStats
+    {
+        uint32_t frameCount = 0u;
+        float    avgMs      = 0.0f;
+        float    p95Ms      = 0.0f;
+        float    maxMs      = 0.0f;
+    };
+
+    /// Path has to stay alive during playback.
+    void start(const CameraPath* path, float timeStep = CAMERA_PATH_TIME_STEP, uint32_t warmupFrames = CAMERA_PATH_WARMUP_FRAMES)
+    {
+        assert(path != nullptr && false == path->isEmpty() && timeStep > 0.0f);
+
+        this->path         = path;
+        this->timeStep     = timeStep;
+        this->stepIndex    = 0u;
+        this->warmupFrames = warmupFrames;
+        this->frames.clear();
+        this->playing      = true;
+        this->hasPending   = false;
+    }
+
+    /// Pose of the next frame, false past the end of the path (playback stops).
+    bool step(CameraPose& outPose)
+    {
+        if (false == this->playing)
+        {
+            return false;
+        }
+
+        // Frame of the previous pose is done.
+        const steady_clock_t::time_point now = steady_clock_t::now();
+        if (this->hasPending)
+        {
+            this->pending.ms = std::chrono::duration<float, std::milli>(now - this->lastStep).count();
+            this->frames.push_back(this->pending);
+        }
+        this->lastStep = now;
+
+        // Warm-up frames stay on the first keyframe and are not measured.
+        const bool  warmup = this->stepIndex < this->warmupFrames;
+        const float time   = warmup ? 0.0f : float(this->stepIndex - this->warmupFrames) * this->timeStep;
+        if (time > this->path->getDuration())
+        {
+            this->playing = false;
+            return false;
+        }
+
+        uint32_t segment;
+        this->path->evaluate(this->path->getStartTime() + time, outPose, segment);
+        this->stepIndex++;
+
+        this->hasPending = (false == warmup);
+        if (this->hasPending)
+        {
+            this->pending.index   = this->frames.size();
+            this->pending.time    = time;
+            this->pending.segment = segment;
+            this->pending.pose    = outPose;
+        }
+        return true;
+    }
+
+    bool isPlaying() const
+    {
+        return this->playing;
+    }
+
+    bool isWarmingUp() const
+    {
+        return this->playing && this->stepIndex <= this->warmupFrames;
+    }
+
+    float getTimeStep() const
+    {
+        return this->timeStep;
+    }
+
+    /// Progress on the path (s).
+    float getTime() const
+    {
+        return this->frames.empty() ? 0.0f : this->frames.back().time;
+    }
+
+    uint32_t getCurrentSegment() const
+    {
+        return this->frames.empty() ? 0u : this->frames.back().segment;
+    }
+
+    const std::vector<Frame>& getFrames() const
+    {
+        return this->frames;
+    }
+
+    SegmentStats getSegmentStats(uint32_t segment) const
+    {
+        std::vector<float> frameMs;
+        for (const Frame& frame : this->frames)
+        {
+            if (frame.segment == segment)
+            {
+                frameMs.push_back(frame.ms);
+            }
+        }
+        return computeStats(frameMs);
+    }
+
+    SegmentStats getTotalStats() const
+    {
+        std::vector<float> frameMs;
+        for (const Frame& frame : this->frames)
+        {
+            frameMs.push_back(frame.ms);
+        }
+        return computeStats(frameMs);
+    }
+
+    /// Slowest frames, slowest first.
+    std::vector<Frame> getWorstFrames(uint32_t count) const
+    {
+        std::vector<Frame> worst = this->frames;
+        count = std::min<size_t>(count, worst.size());
+        std::partial_sort(worst.begin(), worst.begin() + count, worst.end(), [](const Frame& a, const Frame& b) { return a.ms > b.ms; });
+        worst.resize(count);
+        return worst;
+    }
+
+    /// Stats per segment and the worstCount slowest frames, for the console and text overlays.
+    std::vector<std::string> getReportLines(uint32_t worstCount) const
+    {
+        std::vector<std::string> lines;
+        std::ostringstream ss;
+
+        const SegmentStats total = this->getTotalStats();
+        ss << std::fixed << std::setprecision(2) << "Camera path: " << total.frameCount << " frames, step " << this->timeStep * 1000.0f
+           << " ms - avg " << total.avgMs << " ms, p95 " << total.p95Ms << " ms, max " << total.maxMs << " ms";
+        lines.push_back(ss.str());
+
+        for (uint32_t segment = 0; segment < this->path->getSegmentCount(); segment++)
+        {
+            const SegmentStats stats = this->getSegmentStats(segment);
+            ss.str("");
+            ss << std::fixed << std::setprecision(2) << "  segment " << segment << ": " << stats.frameCount << " frames, avg "
+               << stats.avgMs << " ms, p95 " << stats.p95Ms << " ms, max " << stats.maxMs << " ms";
+            lines.push_back(ss.str());
+        }
+
+        for (const Frame& frame : this->getWorstFrames(worstCount))
+        {
+            ss.str("");
+            ss << std::fixed << std::setprecision(2) << "  worst: " << frame.ms << " ms, frame " << frame.index << " (" << frame.time
+               << " s, segment " << frame.segment << "), pos " << frame.pose.position.x << " " << frame.pose.position.y << " " << frame.pose.position.z
+               << ", rot " << frame.pose.rotation.x << " " << frame.pose.rotation.y << " " << frame.pose.rotation.z << ", zoom " << frame.pose.zoom;
+            lines.push_back(ss.str());
+        }
+        return lines;
+    }
+
+    /// Every measured frame with its pose, as CSV - runs can be diffed frame by frame.
+    bool exportCsv(const std::string& filename) const
+    {
+        std::ofstream file(filename.c_str());
+        if (!file)
+        {
+            std::cout << " >>> CameraPathPlayback::exportCsv: could not open " << filename << "\n";
+            return false;
+        }
+
+        file << "frame,time_s,segment,frame_ms,position_x,position_y,position_z,rotation_x,rotation_y,rotation_z,zoom\n";
+        for (const Frame& frame : this->frames)
+        {
+            const CameraPose& pose = frame.pose;
+            file << frame.index << "," << frame.time << "," << frame.segment << "," << frame.ms << ","
+                 << pose.position.x << "," << pose.position.y << "," << pose.position.z << ","
+                 << pose.rotation.x << "," << pose.rotation.y << "," << pose.rotation.z << "," << pose.zoom << "\n";
+        }
+
+        std::cout << " >>> CameraPathPlayback::exportCsv: " << this->frames.size() << " frames written to " << filename << "\n";
+        return true;
+    }
+
+private:
+    using steady_clock_t = std::chrono::steady_clock;
+
+    static SegmentStats computeStats(std::vector<float>& frameMs)
+    {
+        SegmentStats stats;
+        stats.frameCount = frameMs.size();
+        if (frameMs.empty())
+        {
+            return stats;
+        }
+
+        double sum = 0.0;
+        for (float ms : frameMs)
+        {
+            sum += ms;
+            stats.maxMs = std::max(stats.maxMs, ms);
+        }
+        stats.avgMs = float(sum / frameMs.size());
+
+        const size_t p95 = std::min(frameMs.size() - 1u, size_t(frameMs.size() * 0.95f));
+        std::nth_element(frameMs.begin(), frameMs.begin() + p95, frameMs.end());
+        stats.p95Ms = frameMs[p95];
+        return stats;
+    }
+
+    const CameraPath*   path         = nullptr;
+    float               timeStep     = CAMERA_PATH_TIME_STEP;
+    uint32_t            stepIndex    = 0u;
+    uint32_t            warmupFrames = 0u;
+    bool                playing      = false;
+    bool                hasPending   = false;
+    Frame               pending;
+    steady_clock_t::time_point lastStep;
+    std::vector<Frame>  frames;
+};
+
+//////////////////////////////////////
+/// Command line of examples:
+/// --camera-record <file> - camera is recorded while flying around and saved at exit
+/// --camera-play <file>   - camera follows the path, the report is printed and exported when it ends
+/// --camera-step <s>      - simulated time step of playback
+struct CameraPathOptions
+{
+    std::string recordFile;
+    std::string playFile;
+    float       timeStep = CAMERA_PATH_TIME_STEP;
+};
+
+CameraPathOptions parseCameraPathOptions(const std::vector<const char*>& args)
+{
+    CameraPathOptions options;
+    for (size_t i = 0; i + 1 < args.size(); i++)
+    {
+        if (strcmp(args[i], "--camera-record") == 0)
+        {
+            options.recordFile = args[++i];
+        }
+        else if (strcmp(args[i], "--camera-play") == 0)
+        {
+            options.playFile = args[++i];
+        }
+        else if (strcmp(args[i], "--camera-step") == 0)
+        {
+            options.timeStep = std::max(1e-4f, float(atof(args[++i])));
+        }
+    }
+    return options;
+}
+
+} // namespace vk229
@@ -0,0 +1,492 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <VulkanTools.h>
+#include <VulkanInitializers.hpp>
+#include <VulkanDevice.hpp>
+
+#define DESCRIPTOR_ALLOCATOR_FIRST_POOL_SETS 16     // Sets in the first pool of a layout, every next pool of it is twice as big...
+#define DESCRIPTOR_ALLOCATOR_MAX_POOL_SETS   1024   // ...up to this.
+
+namespace vk229
+{
+
+//////////////////////////////////////
+/// Descriptor sets without descriptor pools sized up front.
+/// * getLayout() creates set layouts - one per distinct list of bindings - and owns them
+/// * every layout has its own chains of pools, sized for exactly its bindings; when a pool is full, the next one
+///   is created twice as big (up to DESCRIPTOR_ALLOCATOR_MAX_POOL_SETS sets), so allocation never runs out
+/// * allocate() - sets living until destroy()
+/// * getCachedSet() - immutable sets, looked up by layout and contents (hash of bindings and their buffers / images);
+///   users with the same resources share one set, which is allocated and written only the first time
+/// * allocateFrame() - sets of one frame (ie. of the command buffer of swapchain image i); resetFrame(i) releases
+///   all of them at once by resetting pools of that frame, which are kept for the next allocations
+/// * replaceCachedSet() - cached set with some bindings changed; the old set is retired and reused only
+///   after resetFrame() of every frame, so frames in flight keep reading it unchanged
+class DescriptorAllocator
+{
+public:
+    /// Contents of one binding of a cached set - buffer or image, depending on the descriptor type.
+    struct Binding
+    {
+        uint32_t               binding    = 0u;
+        VkDescriptorType       type       = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        VkDescriptorBufferInfo bufferInfo = {};
+        VkDescriptorImageInfo  imageInfo  = {};
+
+        static Binding buffer(uint32_t binding, VkDescriptorType type, const VkDescriptorBufferInfo& info)
+        {
+            Binding b;
+            b.binding    = binding;
+            b.type       = type;
+            b.bufferInfo = info;
+            return b;
+        }
+
+        static Binding image(uint32_t binding, VkDescriptorType type, const VkDescriptorImageInfo& info)
+        {
+            Binding b;
+            b.binding   = binding;
+            b.type      = type;
+            b.imageInfo = info;
+            return b;
+        }
+
+        bool isImage() const
+        {
+            return this->type == VK_DESCRIPTOR_TYPE_SAMPLER                || this->type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+                || this->type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE          || this->type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+                || this->type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+        }
+
+        bool operator==(const Binding& other) const
+        {
+            if (this->binding != other.binding || this->type != other.type)
+            {
+                return false;
+            }
+            if (this->isImage())
+            {
+                return this->imageInfo.sampler     == other.imageInfo.sampler
+                    && this->imageInfo.imageView   == other.imageInfo.imageView
+                    && this->imageInfo.imageLayout == other.imageInfo.imageLayout;
+            }
+            return this->bufferInfo.buffer == other.bufferInfo.buffer
+                && this->bufferInfo.offset == other.bufferInfo.offset
+                && this->bufferInfo.range  == other.bufferInfo.range;
+        }
+    };
+
+    struct Stats
+    {
+        uint32_t layoutCount     = 0u;
+        uint32_t poolCount       = 0u;
+        uint32_t setCount        = 0u; ///< Allocated now - sets released by resetFrame() are not counted.
+        uint32_t cachedSetCount  = 0u;
+        uint32_t retiredSetCount = 0u; ///< Replaced cached sets, waiting for frames in flight or for reuse.
+        uint64_t cacheHits       = 0u;
+        uint64_t cacheMisses     = 0u;
+    };
+
+    /// frameCount - number of frames with their own pools for allocateFrame(), 0 if not used.
+    void prepare(vks::VulkanDevice* dev, uint32_t frameCount = 0u)
+    {
+        this->device     = dev;
+        this->frameCount = frameCount;
+
+        std::cout << " >>> DescriptorAllocator::prepare: " << frameCount << " frames, first pool of a layout: "
+                  << DESCRIPTOR_ALLOCATOR_FIRST_POOL_SETS << " sets\n";
+    }
+
+    void destroy()
+    {
+        if (this->device == nullptr)
+        {
+            return;
+        }
+
+        VkDevice dev = this->device->logicalDevice;
+
+        for (auto& layoutIt : this->layouts)
+        {
+            destroyChain(dev, layoutIt.second.persistent);
+            for (PoolChain& frameChain : layoutIt.second.frames)
+            {
+                destroyChain(dev, frameChain);
+            }
+            vkDestroyDescriptorSetLayout(dev, layoutIt.first, nullptr);
+        }
+
+        this->layouts.clear();
+        this->cachedSets.clear();
+        this->cacheIndex.clear();
+        this->cachedSetIds.clear();
+        this->retiredSets.clear();
+        this->stats = Stats();
+        this->device = nullptr;
+    }
+
+    /// Layout with given bindings - created the first time, the same handle for identical bindings afterwards.
+    VkDescriptorSetLayout getLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+    {
+        assert(this->device != nullptr);
+
+        for (auto& layoutIt : this->layouts)
+        {
+            if (isSameLayout(layoutIt.second.bindings, bindings))
+            {
+                return layoutIt.first;
+            }
+        }
+
+        VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(bindings.data(), bindings.size());
+        VkDescriptorSetLayout layout;
+        VK_CHECK_RESULT(vkCreateDescriptorSetLayout(this->device->logicalDevice, &descriptorLayout, nullptr, &layout));
+
+        LayoutInfo& info = this->layouts[layout];
+        info.bindings = bindings;
+        info.frames.resize(this->frameCount);
+
+        // Descriptors of one set, by type - pools of the layout hold them times their set count.
+        for (const VkDescriptorSetLayoutBinding& b : bindings)
+        {
+            auto sizeIt = std::find_if(info.setSizes.begin(), info.setSizes.end(),
+                                       [&b](const VkDescriptorPoolSize& s) { return s.type == b.descriptorType; });
+            if (sizeIt == info.setSizes.end())
+            {
+                info.setSizes.push_back(vks::initializers::descriptorPoolSize(b.descriptorType, b.descriptorCount));
+            }
+            else
+            {
+                sizeIt->descriptorCount += b.descriptorCount;
+            }
+        }
+
+        this->stats.layoutCount++;
+        return layout;
+    }
+
+    /// Set living until destroy(), contents are up to the caller.
+    VkDescriptorSet allocate(VkDescriptorSetLayout layout)
+    {
+        LayoutInfo& info = this->getLayoutInfo(layout);
+        if (false == info.freeSets.empty())
+        {
+            const VkDescriptorSet set = info.freeSets.back();
+            info.freeSets.pop_back();
+            this->stats.retiredSetCount--;
+            return set;
+        }
+        return this->allocateFromChain(layout, info, info.persistent);
+    }
+
+    /// Set valid until resetFrame(frameIndex).
+    VkDescriptorSet allocateFrame(VkDescriptorSetLayout layout, uint32_t frameIndex)
+    {
+        assert(frameIndex < this->frameCount);
+
+        LayoutInfo& info = this->getLayoutInfo(layout);
+        return this->allocateFromChain(layout, info, info.frames[frameIndex]);
+    }
+
+    /// Releases all sets of the frame - the GPU must not use them anymore.
+    /// Cached sets retired by replaceCachedSet() can be reused once this has been called for every frame.
+    void resetFrame(uint32_t frameIndex)
+    {
+        assert(frameIndex < this->frameCount);
+
+        for (auto retiredIt = this->retiredSets.begin(); retiredIt != this->retiredSets.end(); )
+        {
+            retiredIt->pendingFrames &= ~(1u << frameIndex);
+            if (retiredIt->pendingFrames == 0u)
+            {
+                this->getLayoutInfo(retiredIt->layout).freeSets.push_back(retiredIt->set);
+                retiredIt = this->retiredSets.erase(retiredIt);
+            }
+            else
+            {
+                ++retiredIt;
+            }
+        }
+
+        for (auto& layoutIt : this->layouts)
+        {
+            PoolChain& chain = layoutIt.second.frames[frameIndex];
+            for (Pool& pool : chain.pools)
+            {
+                if (pool.usedSets > 0u)
+                {
+                    VK_CHECK_RESULT(vkResetDescriptorPool(this->device->logicalDevice, pool.pool, 0));
+                    this->stats.setCount -= pool.usedSets;
+                    pool.usedSets = 0u;
+                }
+            }
+            chain.current = 0u;
+        }
+    }
+
+    /// Immutable set with given contents - allocated and written only if there is no such set yet.
+    /// Bindings must cover the whole layout - users of the same contents list them in the same order.
+    VkDescriptorSet getCachedSet(VkDescriptorSetLayout layout, const std::vector<Binding>& bindings)
+    {
+        const uint64_t hash = hashContents(layout, bindings);
+
+        auto indexIt = this->cacheIndex.find(hash);
+        if (indexIt != this->cacheIndex.end())
+        {
+            for (uint32_t id : indexIt->second)
+            {
+                const CachedSet& cached = this->cachedSets[id];
+                if (cached.layout == layout && cached.bindings == bindings)
+                {
+                    this->stats.cacheHits++;
+                    return cached.set;
+                }
+            }
+        }
+
+        CachedSet cached;
+        cached.layout   = layout;
+        cached.bindings = bindings;
+        cached.set      = this->allocate(layout);
+        this->writeSet(cached.set, bindings);
+
+        const uint32_t id = this->cachedSets.size();
+        this->cachedSets.push_back(cached);
+        this->cacheIndex[hash].push_back(id);
+        this->cachedSetIds[cached.set] = id;
+
+        this->stats.cacheMisses++;
+        this->stats.cachedSetCount++;
+        return cached.set;
+    }
+
+    /// Cached set with contents of given one, except for changedBindings (ie. a texture has been replaced) -
+    /// for all its users, the caller switches them to the returned set. The old set is no longer returned
+    /// by getCachedSet() and is reused only after resetFrame() of every frame, as frames in flight may read it.
+    /// Requires prepare() with frameCount > 0.
+    VkDescriptorSet replaceCachedSet(VkDescriptorSet set, const std::vector<Binding>& changedBindings)
+    {
+        assert(this->frameCount > 0u && this->frameCount <= 32u);
+
+        auto idIt = this->cachedSetIds.find(set);
+        assert(idIt != this->cachedSetIds.end());
+        const uint32_t id = idIt->second;
+        this->cachedSetIds.erase(idIt);
+
+        const VkDescriptorSetLayout layout   = this->cachedSets[id].layout;
+        std::vector<Binding>        bindings = this->cachedSets[id].bindings;
+        for (const Binding& changed : changedBindings)
+        {
+            auto bindingIt = std::find_if(bindings.begin(), bindings.end(),
+                                          [&changed](const Binding& b) { return b.binding == changed.binding; });
+            assert(bindingIt != bindings.end());
+            *bindingIt = changed;
+        }
+
+        // Out of the cache - never returned for its (old) contents again.
+        std::vector<uint32_t>& oldBucket = this->cacheIndex[hashContents(layout, this->cachedSets[id].bindings)];
+        oldBucket.erase(std::remove(oldBucket.begin(), oldBucket.end(), id), oldBucket.end());
+        this->cachedSets[id].set = VK_NULL_HANDLE;
+        this->stats.cachedSetCount--;
+
+        RetiredSet retired;
+        retired.layout        = layout;
+        retired.set           = set;
+        retired.pendingFrames = (this->frameCount == 32u) ? ~0u : ((1u << this->frameCount) - 1u);
+        this->retiredSets.push_back(retired);
+        this->stats.retiredSetCount++;
+
+        return this->getCachedSet(layout, bindings);
+    }
+
+    const Stats& getStats() const
+    {
+        return this->stats;
+    }
+
+private:
+    struct Pool
+    {
+        VkDescriptorPool pool     = VK_NULL_HANDLE;
+        uint32_t         maxSets  = 0u;
+        uint32_t         usedSets = 0u;
+    };
+
+    /// Pools of one lifetime - allocation goes on from pools[current], full pools are skipped.
+    struct PoolChain
+    {
+        std::vector<Pool> pools;
+        uint32_t          current = 0u;
+    };
+
+    struct LayoutInfo
+    {
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        std::vector<VkDescriptorPoolSize>         setSizes; // Descriptors of one set, by type.
+        PoolChain                                 persistent;
+        std::vector<PoolChain>                    frames;
+        std::vector<VkDescriptorSet>              freeSets; // Retired persistent sets no frame uses anymore.
+    };
+
+    struct CachedSet
+    {
+        VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+        std::vector<Binding>  bindings;
+        VkDescriptorSet       set    = VK_NULL_HANDLE;
+    };
+
+    struct RetiredSet
+    {
+        VkDescriptorSetLayout layout        = VK_NULL_HANDLE;
+        VkDescriptorSet       set           = VK_NULL_HANDLE;
+        uint32_t              pendingFrames = 0u; // Bit i - resetFrame(i) not called since the set was retired.
+    };
+
+    LayoutInfo& getLayoutInfo(VkDescriptorSetLayout layout)
+    {
+        auto layoutIt = this->layouts.find(layout);
+        assert(layoutIt != this->layouts.end()); // Layouts have to come from getLayout().
+        return layoutIt->second;
+    }
+
+    /// Pools are never fragmented (sets are not freed one by one) and sized for exactly their layout,
+    /// so a pool with a free set always has descriptors for it.
+    VkDescriptorSet allocateFromChain(VkDescriptorSetLayout layout, LayoutInfo& info, PoolChain& chain)
+    {
+        while (chain.current < chain.pools.size() && chain.pools[chain.current].usedSets == chain.pools[chain.current].maxSets)
+        {
+            chain.current++;
+        }
+
+        if (chain.current == chain.pools.size())
+        {
+            const uint32_t maxSets = chain.pools.empty()
+                ? DESCRIPTOR_ALLOCATOR_FIRST_POOL_SETS
+                : std::min(2u * chain.pools.back().maxSets, (uint32_t)DESCRIPTOR_ALLOCATOR_MAX_POOL_SETS);
+            chain.pools.push_back(this->createPool(info, maxSets));
+        }
+
+        Pool& pool = chain.pools[chain.current];
+
+        VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(pool.pool, &layout, 1);
+        VkDescriptorSet set;
+        VK_CHECK_RESULT(vkAllocateDescriptorSets(this->device->logicalDevice, &allocInfo, &set));
+
+        pool.usedSets++;
+        this->stats.setCount++;
+        return set;
+    }
+
+    Pool createPool(const LayoutInfo& info, uint32_t maxSets)
+    {
+        std::vector<VkDescriptorPoolSize> poolSizes = info.setSizes;
+        for (VkDescriptorPoolSize& size : poolSizes)
+        {
+            size.descriptorCount *= maxSets;
+        }
+
+        Pool pool;
+        pool.maxSets = maxSets;
+
+        VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes.size(), poolSizes.data(), maxSets);
+        VK_CHECK_RESULT(vkCreateDescriptorPool(this->device->logicalDevice, &descriptorPoolInfo, nullptr, &pool.pool));
+
+        std::cout << " >>> DescriptorAllocator::createPool: " << maxSets << " sets of a layout with " << info.bindings.size() << " bindings\n";
+
+        this->stats.poolCount++;
+        return pool;
+    }
+
+    void writeSet(VkDescriptorSet set, const std::vector<Binding>& bindings)
+    {
+        std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+        writeDescriptorSets.reserve(bindings.size());
+        for (const Binding& b : bindings)
+        {
+            writeDescriptorSets.push_back(b.isImage()
+                ? vks::initializers::writeDescriptorSet(set, b.type, b.binding, &b.imageInfo)
+                : vks::initializers::writeDescriptorSet(set, b.type, b.binding, &b.bufferInfo));
+        }
+        vkUpdateDescriptorSets(this->device->logicalDevice, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+    }
+
+    void destroyChain(VkDevice dev, PoolChain& chain)
+    {
+        for (Pool& pool : chain.pools)
+        {
+            vkDestroyDescriptorPool(dev, pool.pool, nullptr);
+        }
+        chain.pools.clear();
+        chain.current = 0u;
+    }
+
+    static bool isSameLayout(const std::vector<VkDescriptorSetLayoutBinding>& a, const std::vector<VkDescriptorSetLayoutBinding>& b)
+    {
+        if (a.size() != b.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            if (a[i].binding != b[i].binding || a[i].descriptorType != b[i].descriptorType || a[i].descriptorCount != b[i].descriptorCount
+                || a[i].stageFlags != b[i].stageFlags || a[i].pImmutableSamplers != b[i].pImmutableSamplers)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// FNV-1a over the layout and every binding's type and resources.
+    static uint64_t hashContents(VkDescriptorSetLayout layout, const std::vector<Binding>& bindings)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](uint64_t value) {
+            for (uint32_t byte = 0; byte < 8u; byte++)
+            {
+                hash ^= (value >> (8u * byte)) & 0xffu;
+                hash *= 1099511628211ull;
+            }
+        };
+
+        mix((uint64_t)layout);
+        for (const Binding& b : bindings)
+        {
+            mix(b.binding);
+            mix(b.type);
+            if (b.isImage())
+            {
+                mix((uint64_t)b.imageInfo.sampler);
+                mix((uint64_t)b.imageInfo.imageView);
+                mix(b.imageInfo.imageLayout);
+            }
+            else
+            {
+                mix((uint64_t)b.bufferInfo.buffer);
+                mix(b.bufferInfo.offset);
+                mix(b.bufferInfo.range);
+            }
+        }
+        return hash;
+    }
+
+    vks::VulkanDevice* device     = nullptr;
+    uint32_t           frameCount = 0u;
+
+    std::map<VkDescriptorSetLayout, LayoutInfo>           layouts;
+    std::vector<CachedSet>                                cachedSets;
+    std::unordered_map<uint64_t, std::vector<uint32_t>>   cacheIndex;   // Hash of contents -> cachedSets.
+    std::map<VkDescriptorSet, uint32_t>                   cachedSetIds; // For replaceCachedSet().
+    std::vector<RetiredSet>                               retiredSets;
+    Stats                                                 stats;
+};
+
+} // namespace vk229
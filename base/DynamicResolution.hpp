@@ -0,0 +1,251 @@
+#pragma once
+
+#include <assert.h>
+#include <math.h>
+#include <vulkan/vulkan.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <VulkanTools.h>
+#include <VulkanInitializers.hpp>
+#include <VulkanDevice.hpp>
+
+/// Limits of the internal resolution scale (per axis).
+#define DYNRES_MIN_SCALE        0.5f
+#define DYNRES_MAX_SCALE        1.0f
+/// Applied scale changes only in steps of this size - every change rebuilds command buffers.
+#define DYNRES_SCALE_STEP       0.05f
+/// Weight of the newest sample in the smoothed GPU frame time.
+#define DYNRES_SMOOTHING        0.2f
+
+namespace vk229
+{
+
+//////////////////////////////////////
+/// PID controller of the internal resolution scale.
+/// Input is the GPU frame time, error is the relative headroom against the target:
+///     e = (target - measured) / target     (> 0 - there is time left, scale can grow)
+/// Controller works in the incremental (velocity) form, so output clamping is its own anti-windup:
+///     rawScale += kp*(e - e[-1]) + ki*e + kd*(e - 2*e[-1] + e[-2])
+/// Applied scale follows rawScale in DYNRES_SCALE_STEP steps only, which keeps rebuilds rare
+/// and acts as hysteresis against timing noise.
+class FrameTimeController
+{
+public:
+    struct State
+    {
+        float measuredMs = 0.0f; // Smoothed
+        float error      = 0.0f; // P input
+        float derivative = 0.0f; // D input - e - e[-1]
+        float rawScale   = DYNRES_MAX_SCALE; // Output, before quantization - integrates the increments
+    };
+
+    void setTarget(float targetMs, float kp = 0.25f, float ki = 0.05f, float kd = 0.05f)
+    {
+        assert(targetMs > 0.0f);
+
+        this->targetMs = targetMs;
+        this->kp       = kp;
+        this->ki       = ki;
+        this->kd       = kd;
+    }
+
+    /// Starts again from full scale, with no history.
+    void reset()
+    {
+        this->state         = State();
+        this->prevError     = 0.0f;
+        this->prevPrevError = 0.0f;
+        this->appliedScale  = DYNRES_MAX_SCALE;
+    }
+
+    /// Feeds GPU time of the last frame, rendered at getScale().
+    /// Returns true if getScale() has changed.
+    bool update(float frameMs)
+    {
+        State& s = this->state;
+
+        s.measuredMs = (s.measuredMs > 0.0f)
+            ? DYNRES_SMOOTHING*frameMs + (1.0f - DYNRES_SMOOTHING)*s.measuredMs
+            : frameMs;
+
+        const float e = (this->targetMs - s.measuredMs) / this->targetMs;
+
+        const float delta =
+              this->kp * (e - this->prevError)
+            + this->ki * e
+            + this->kd * (e - 2.0f*this->prevError + this->prevPrevError);
+
+        s.error      = e;
+        s.derivative = e - this->prevError;
+        s.rawScale   = std::max(DYNRES_MIN_SCALE, std::min(DYNRES_MAX_SCALE, s.rawScale + delta));
+
+        this->prevPrevError = this->prevError;
+        this->prevError     = e;
+
+        // Quantized - moves only when raw scale is a full step away; limits stay reachable.
+        float newScale = this->appliedScale;
+        if (fabsf(s.rawScale - this->appliedScale) >= DYNRES_SCALE_STEP
+            || (s.rawScale == DYNRES_MIN_SCALE || s.rawScale == DYNRES_MAX_SCALE))
+        {
+            newScale = DYNRES_MIN_SCALE + roundf((s.rawScale - DYNRES_MIN_SCALE) / DYNRES_SCALE_STEP) * DYNRES_SCALE_STEP;
+            newScale = std::max(DYNRES_MIN_SCALE, std::min(DYNRES_MAX_SCALE, newScale));
+        }
+
+        if (newScale == this->appliedScale)
+        {
+            return false;
+        }
+
+        this->appliedScale = newScale;
+        return true;
+    }
+
+    float getScale() const
+    {
+        return this->appliedScale;
+    }
+
+    float getTargetMs() const
+    {
+        return this->targetMs;
+    }
+
+    const State& getState() const
+    {
+        return this->state;
+    }
+
+private:
+    float targetMs = 1000.0f / 60.0f;
+    float kp       = 0.25f;
+    float ki       = 0.05f;
+    float kd       = 0.05f;
+
+    State state;
+    float prevError     = 0.0f;
+    float prevPrevError = 0.0f;
+    float appliedScale  = DYNRES_MAX_SCALE;
+};
+
+//////////////////////////////////////
+/// GPU time of whole frame command buffers, from two timestamps per command buffer.
+/// Queries of a command buffer are reset by itself, so no host side reset is needed.
+/// Results are read after the frame has been waited for (see VulkanExampleBase::submitFrame).
+class GpuFrameTimer
+{
+public:
+    void prepare(vks::VulkanDevice* dev, uint32_t frameCount)
+    {
+        this->device     = dev;
+        this->frameCount = frameCount;
+
+        const uint32_t validBits = dev->queueFamilyProperties[dev->queueFamilyIndices.graphics].timestampValidBits;
+        this->supported     = (validBits > 0u) && (dev->properties.limits.timestampComputeAndGraphics == VK_TRUE);
+        this->timestampMask = (validBits >= 64u) ? ~0ull : ((1ull << validBits) - 1ull);
+        this->periodNs      = dev->properties.limits.timestampPeriod;
+
+        std::cout << " >>> GpuFrameTimer::prepare: timestamps " << (this->supported ? "supported" : "not supported")
+                  << ", " << validBits << " valid bits, period " << this->periodNs << " ns\n";
+
+        if (!this->supported)
+        {
+            return;
+        }
+
+        VkQueryPoolCreateInfo queryPoolCI = {};
+        queryPoolCI.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolCI.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolCI.queryCount = 2u * frameCount;
+        VK_CHECK_RESULT(vkCreateQueryPool(dev->logicalDevice, &queryPoolCI, nullptr, &this->queryPool));
+    }
+
+    void destroy()
+    {
+        if (this->device != nullptr && this->queryPool != VK_NULL_HANDLE)
+        {
+            vkDestroyQueryPool(this->device->logicalDevice, this->queryPool, nullptr);
+        }
+        this->queryPool = VK_NULL_HANDLE;
+        this->device    = nullptr;
+    }
+
+    bool isSupported() const
+    {
+        return this->supported;
+    }
+
+    /// First command of the frame's command buffer, outside of any render pass.
+    void writeBegin(VkCommandBuffer cmd, uint32_t frameIndex)
+    {
+        if (!this->supported)
+        {
+            return;
+        }
+        vkCmdResetQueryPool(cmd, this->queryPool, 2u*frameIndex, 2u);
+        vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, this->queryPool, 2u*frameIndex);
+    }
+
+    /// Last command of the frame's command buffer, outside of any render pass.
+    void writeEnd(VkCommandBuffer cmd, uint32_t frameIndex)
+    {
+        if (!this->supported)
+        {
+            return;
+        }
+        vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, this->queryPool, 2u*frameIndex + 1u);
+    }
+
+    /// False if timestamps are not supported or the frame has not been completed yet.
+    bool getFrameMs(uint32_t frameIndex, float& outMs)
+    {
+        if (!this->supported)
+        {
+            return false;
+        }
+
+        uint64_t timestamps[2];
+        const VkResult result = vkGetQueryPoolResults(this->device->logicalDevice, this->queryPool, 2u*frameIndex, 2u,
+            sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if (result != VK_SUCCESS)
+        {
+            return false;
+        }
+
+        const uint64_t ticks = (timestamps[1] - timestamps[0]) & this->timestampMask;
+        outMs = float(double(ticks) * double(this->periodNs) * 1e-6);
+        return true;
+    }
+
+private:
+    vks::VulkanDevice* device        = nullptr;
+    VkQueryPool        queryPool     = VK_NULL_HANDLE;
+    uint32_t           frameCount    = 0u;
+    bool               supported     = false;
+    uint64_t           timestampMask = ~0ull;
+    float              periodNs      = 1.0f;
+};
+
+//////////////////////////////////////
+/// Scaled rendering into full window size targets (ie. RenderGraph transients):
+/// only the top-left scaled area is rendered, so changing the scale is just a different
+/// viewport / scissor - no reallocation.
+
+/// Rendered area of a width x height target for given scale, at least 1x1.
+inline VkExtent2D getScaledExtent(uint32_t width, uint32_t height, float scale)
+{
+    VkExtent2D extent;
+    extent.width  = std::max(1u, std::min(width,  uint32_t(roundf(width  * scale))));
+    extent.height = std::max(1u, std::min(height, uint32_t(roundf(height * scale))));
+    return extent;
+}
+
+/// Part of the target covered by the scaled area - for the upscale shader.
+inline void getUvScale(uint32_t width, uint32_t height, float scale, float outUvScale[2])
+{
+    const VkExtent2D extent = getScaledExtent(width, height, scale);
+    outUvScale[0] = float(extent.width)  / float(width);
+    outUvScale[1] = float(extent.height) / float(height);
+}
+
+} // namespace vk229
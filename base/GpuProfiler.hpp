@@ -0,0 +1,423 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <VulkanTools.h>
+#include <VulkanDevice.hpp>
+
+/// Queries per frame (per command buffer) - scopes past it are not measured.
+#define GPU_PROFILER_MAX_SCOPES     256
+/// Table is averaged over this many frames, then replaced.
+#define GPU_PROFILER_WINDOW         60
+
+namespace vk229
+{
+
+//////////////////////////////////////
+/// GPU cost of named scopes (draws or groups of draws, dispatches) of prebuilt command buffers:
+/// * timestamps - both at BOTTOM_OF_PIPE, so a scope takes the time from the end of the work before it
+///   to its own end; overlapping draws are not counted twice and scopes of a frame sum up to its GPU time
+/// * pipeline statistics (if the pipelineStatisticsQuery feature is enabled) - vertex, clipping,
+///   fragment and compute invocations
+/// Every command buffer has its own slice of both query pools (a ring of frameCount slices), reset by
+/// the command buffer itself. Results of a slice are read without waiting, after its frame has been
+/// waited for (see VulkanExampleBase::submitFrame) - a slice that is not ready is skipped.
+/// Scopes with the same name (ie. depth pre-pass and shading of an entity) are summed up per frame.
+class GpuProfiler
+{
+public:
+    /// Pipeline statistics of a scope, per frame.
+    struct Stats
+    {
+        double vertexInvocations   = 0.0;
+        double clippingInvocations = 0.0; // Primitives which reached the clipping stage.
+        double clippingPrimitives  = 0.0; // Primitives which left it - clipped away ones are not counted.
+        double fragmentInvocations = 0.0;
+        double computeInvocations  = 0.0;
+    };
+
+    /// Row of the table - average per frame over the last GPU_PROFILER_WINDOW frames.
+    struct ScopeCost
+    {
+        std::string name;
+        double      gpuMs      = 0.0;
+        double      scopeCount = 0.0;
+        Stats       stats;
+    };
+
+    void prepare(vks::VulkanDevice* dev, uint32_t frameCount, bool enabled = true)
+    {
+        this->device     = dev;
+        this->frameCount = frameCount;
+        this->enabled    = enabled;
+
+        const uint32_t validBits = dev->queueFamilyProperties[dev->queueFamilyIndices.graphics].timestampValidBits;
+        this->timestampsSupported = (validBits > 0u) && (dev->properties.limits.timestampComputeAndGraphics == VK_TRUE);
+        this->statsSupported      = (dev->enabledFeatures.pipelineStatisticsQuery == VK_TRUE);
+        this->timestampMask       = (validBits >= 64u) ? ~0ull : ((1ull << validBits) - 1ull);
+        this->periodNs            = dev->properties.limits.timestampPeriod;
+
+        std::cout << " >>> GpuProfiler::prepare: timestamps " << (this->timestampsSupported ? "supported" : "not supported")
+                  << ", pipeline statistics " << (this->statsSupported ? "enabled" : "not enabled") << "\n";
+
+        if (this->timestampsSupported)
+        {
+            VkQueryPoolCreateInfo queryPoolCI = {};
+            queryPoolCI.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            queryPoolCI.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+            queryPoolCI.queryCount = 2u * GPU_PROFILER_MAX_SCOPES * frameCount;
+            VK_CHECK_RESULT(vkCreateQueryPool(dev->logicalDevice, &queryPoolCI, nullptr, &this->timestampPool));
+        }
+
+        if (this->statsSupported)
+        {
+            VkQueryPoolCreateInfo queryPoolCI = {};
+            queryPoolCI.sType              = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            queryPoolCI.queryType          = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+            queryPoolCI.queryCount         = GPU_PROFILER_MAX_SCOPES * frameCount;
+            queryPoolCI.pipelineStatistics = STATS_FLAGS;
+            VK_CHECK_RESULT(vkCreateQueryPool(dev->logicalDevice, &queryPoolCI, nullptr, &this->statsPool));
+        }
+
+        this->frameScopes.assign(frameCount, std::vector<std::string>());
+        this->scopeOpen.assign(frameCount, false);
+    }
+
+    void destroy()
+    {
+        if (this->device != nullptr)
+        {
+            if (this->timestampPool != VK_NULL_HANDLE)
+            {
+                vkDestroyQueryPool(this->device->logicalDevice, this->timestampPool, nullptr);
+            }
+            if (this->statsPool != VK_NULL_HANDLE)
+            {
+                vkDestroyQueryPool(this->device->logicalDevice, this->statsPool, nullptr);
+            }
+        }
+        this->timestampPool = VK_NULL_HANDLE;
+        this->statsPool     = VK_NULL_HANDLE;
+        this->device        = nullptr;
+    }
+
+    bool isSupported() const
+    {
+        return this->timestampsSupported || this->statsSupported;
+    }
+
+    bool hasTimestamps() const
+    {
+        return this->timestampsSupported;
+    }
+
+    bool hasPipelineStatistics() const
+    {
+        return this->statsSupported;
+    }
+
+    /// Takes effect when command buffers are rebuilt.
+    void setEnabled(bool enabled)
+    {
+        this->enabled = enabled;
+        this->resetWindow();
+        this->table.clear();
+    }
+
+    bool isEnabled() const
+    {
+        return this->enabled;
+    }
+
+    // RECORDING {
+
+    /// First command of the frame's command buffer (after GpuFrameTimer::writeBegin), outside of any render pass.
+    void beginFrame(VkCommandBuffer cmd, uint32_t frameIndex)
+    {
+        assert(frameIndex < this->frameCount);
+
+        this->frameScopes[frameIndex].clear();
+        this->scopeOpen[frameIndex] = false;
+
+        if (!this->isRecording())
+        {
+            return;
+        }
+        if (this->timestampsSupported)
+        {
+            vkCmdResetQueryPool(cmd, this->timestampPool, 2u * this->getFirstScope(frameIndex), 2u * GPU_PROFILER_MAX_SCOPES);
+        }
+        if (this->statsSupported)
+        {
+            vkCmdResetQueryPool(cmd, this->statsPool, this->getFirstScope(frameIndex), GPU_PROFILER_MAX_SCOPES);
+        }
+    }
+
+    /// Scopes of a frame can not be nested (pipeline statistics queries can not overlap),
+    /// a scope inside a render pass has to end in the same subpass.
+    void beginScope(VkCommandBuffer cmd, uint32_t frameIndex, const std::string& name)
+    {
+        if (!this->isRecording())
+        {
+            return;
+        }
+        assert(!this->scopeOpen[frameIndex]);
+
+        std::vector<std::string>& scopes = this->frameScopes[frameIndex];
+        if (scopes.size() >= GPU_PROFILER_MAX_SCOPES)
+        {
+            this->droppedScopes++;
+            return;
+        }
+
+        const uint32_t query = this->getFirstScope(frameIndex) + scopes.size();
+        if (this->timestampsSupported)
+        {
+            vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, this->timestampPool, 2u * query);
+        }
+        if (this->statsSupported)
+        {
+            vkCmdBeginQuery(cmd, this->statsPool, query, 0);
+        }
+
+        scopes.push_back(name);
+        this->scopeOpen[frameIndex] = true;
+    }
+
+    void endScope(VkCommandBuffer cmd, uint32_t frameIndex)
+    {
+        if (!this->isRecording() || !this->scopeOpen[frameIndex])
+        {
+            return; // Not recording, or dropped in beginScope().
+        }
+
+        const uint32_t query = this->getFirstScope(frameIndex) + this->frameScopes[frameIndex].size() - 1u;
+        if (this->statsSupported)
+        {
+            vkCmdEndQuery(cmd, this->statsPool, query);
+        }
+        if (this->timestampsSupported)
+        {
+            vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, this->timestampPool, 2u * query + 1u);
+        }
+
+        this->scopeOpen[frameIndex] = false;
+    }
+
+    // } // RECORDING
+
+    // RESULTS {
+
+    /// Reads results of the frame's command buffer, call after it has been waited for.
+    /// Returns true if the table has been replaced.
+    bool collect(uint32_t frameIndex)
+    {
+        const std::vector<std::string>& scopes = this->frameScopes[frameIndex];
+        if (!this->isRecording() || scopes.empty())
+        {
+            return false;
+        }
+
+        const uint32_t scopeCount = scopes.size();
+        const uint32_t firstQuery = this->getFirstScope(frameIndex);
+
+        std::vector<uint64_t> timestamps;
+        if (this->timestampsSupported)
+        {
+            timestamps.resize(2u * scopeCount);
+            if (VK_SUCCESS != vkGetQueryPoolResults(this->device->logicalDevice, this->timestampPool, 2u * firstQuery, 2u * scopeCount,
+                timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT))
+            {
+                return false;
+            }
+        }
+
+        std::vector<uint64_t> stats;
+        if (this->statsSupported)
+        {
+            stats.resize(STATS_COUNT * scopeCount);
+            if (VK_SUCCESS != vkGetQueryPoolResults(this->device->logicalDevice, this->statsPool, firstQuery, scopeCount,
+                stats.size() * sizeof(uint64_t), stats.data(), STATS_COUNT * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT))
+            {
+                return false;
+            }
+        }
+
+        for (uint32_t s = 0; s < scopeCount; s++)
+        {
+            ScopeCost& cost = this->windowSums[scopes[s]];
+            cost.scopeCount += 1.0;
+            if (this->timestampsSupported)
+            {
+                const uint64_t ticks = (timestamps[2u*s + 1u] - timestamps[2u*s]) & this->timestampMask;
+                cost.gpuMs += double(ticks) * double(this->periodNs) * 1e-6;
+            }
+            if (this->statsSupported)
+            {
+                // In the order of STATS_FLAGS bits.
+                const uint64_t* values = &stats[STATS_COUNT * s];
+                cost.stats.vertexInvocations   += double(values[0]);
+                cost.stats.clippingInvocations += double(values[1]);
+                cost.stats.clippingPrimitives  += double(values[2]);
+                cost.stats.fragmentInvocations += double(values[3]);
+                cost.stats.computeInvocations  += double(values[4]);
+            }
+        }
+
+        this->windowFrames++;
+        if (this->windowFrames < GPU_PROFILER_WINDOW)
+        {
+            return false;
+        }
+
+        this->publishWindow();
+        return true;
+    }
+
+    /// Averages per frame, most expensive first (by GPU time, or fragment invocations without timestamps).
+    const std::vector<ScopeCost>& getTable() const
+    {
+        return this->table;
+    }
+
+    uint32_t getDroppedScopeCount() const
+    {
+        return this->droppedScopes;
+    }
+
+    /// Header and up to maxRows rows of the table, for text overlays.
+    std::vector<std::string> getTableLines(uint32_t maxRows) const
+    {
+        std::vector<std::string> lines;
+        lines.push_back("GPU cost per frame (avg of " + std::to_string(GPU_PROFILER_WINDOW) + " frames): ms, VS / clip in / clip out / FS invocations");
+
+        for (uint32_t row = 0; row < std::min<size_t>(maxRows, this->table.size()); row++)
+        {
+            const ScopeCost& cost = this->table[row];
+
+            std::ostringstream ss;
+            ss << std::fixed << std::setprecision(3) << cost.name << ": " << cost.gpuMs << " ms" << std::setprecision(0);
+            if (this->statsSupported)
+            {
+                ss << ", " << cost.stats.vertexInvocations << " / " << cost.stats.clippingInvocations << " / " << cost.stats.clippingPrimitives
+                   << " / " << cost.stats.fragmentInvocations;
+                if (cost.stats.computeInvocations > 0.0)
+                {
+                    ss << ", CS " << cost.stats.computeInvocations;
+                }
+            }
+            lines.push_back(ss.str());
+        }
+
+        if (this->table.size() > maxRows)
+        {
+            lines.push_back("... " + std::to_string(this->table.size() - maxRows) + " more, F4 exports all");
+        }
+        return lines;
+    }
+
+    /// Writes the table as CSV.
+    bool exportCsv(const std::string& filename) const
+    {
+        std::ofstream file(filename.c_str());
+        if (!file)
+        {
+            std::cout << " >>> GpuProfiler::exportCsv: could not open " << filename << "\n";
+            return false;
+        }
+
+        file << "name,gpu_ms,scopes,vertex_invocations,clipping_invocations,clipping_primitives,fragment_invocations,compute_invocations\n";
+        for (const ScopeCost& cost : this->table)
+        {
+            file << cost.name << "," << cost.gpuMs << "," << cost.scopeCount << ","
+                 << cost.stats.vertexInvocations << "," << cost.stats.clippingInvocations << "," << cost.stats.clippingPrimitives << ","
+                 << cost.stats.fragmentInvocations << "," << cost.stats.computeInvocations << "\n";
+        }
+
+        std::cout << " >>> GpuProfiler::exportCsv: " << this->table.size() << " rows written to " << filename << "\n";
+        return true;
+    }
+
+    // } // RESULTS
+
+private:
+    static const VkQueryPipelineStatisticFlags STATS_FLAGS =
+        VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+    static const uint32_t STATS_COUNT = 5u;
+
+    bool isRecording() const
+    {
+        return this->enabled && this->isSupported();
+    }
+
+    uint32_t getFirstScope(uint32_t frameIndex) const
+    {
+        return frameIndex * GPU_PROFILER_MAX_SCOPES;
+    }
+
+    void resetWindow()
+    {
+        this->windowSums.clear();
+        this->windowFrames = 0u;
+    }
+
+    void publishWindow()
+    {
+        const double invFrames = 1.0 / double(this->windowFrames);
+
+        this->table.clear();
+        for (auto& [name, sum] : this->windowSums)
+        {
+            ScopeCost cost;
+            cost.name                      = name;
+            cost.gpuMs                     = sum.gpuMs * invFrames;
+            cost.scopeCount                = sum.scopeCount * invFrames;
+            cost.stats.vertexInvocations   = sum.stats.vertexInvocations * invFrames;
+            cost.stats.clippingInvocations = sum.stats.clippingInvocations * invFrames;
+            cost.stats.clippingPrimitives  = sum.stats.clippingPrimitives * invFrames;
+            cost.stats.fragmentInvocations = sum.stats.fragmentInvocations * invFrames;
+            cost.stats.computeInvocations  = sum.stats.computeInvocations * invFrames;
+            this->table.push_back(cost);
+        }
+
+        const bool byTime = this->timestampsSupported;
+        std::sort(this->table.begin(), this->table.end(), [byTime](const ScopeCost& a, const ScopeCost& b) {
+            return byTime ? (a.gpuMs > b.gpuMs) : (a.stats.fragmentInvocations > b.stats.fragmentInvocations);
+        });
+
+        this->resetWindow();
+    }
+
+    vks::VulkanDevice* device              = nullptr;
+    VkQueryPool        timestampPool       = VK_NULL_HANDLE;
+    VkQueryPool        statsPool           = VK_NULL_HANDLE;
+    uint32_t           frameCount          = 0u;
+    bool               enabled             = true;
+    bool               timestampsSupported = false;
+    bool               statsSupported      = false;
+    uint64_t           timestampMask       = ~0ull;
+    float              periodNs            = 1.0f;
+
+    std::vector<std::vector<std::string>> frameScopes; // Names of scopes recorded into every command buffer.
+    std::vector<bool>                     scopeOpen;
+    uint32_t                              droppedScopes = 0u;
+
+    std::map<std::string, ScopeCost> windowSums;
+    uint32_t                         windowFrames = 0u;
+    std::vector<ScopeCost>           table;
+};
+
+} // namespace vk229
@@ -3,9 +3,24 @@
 #include <assert.h>
 #include <vulkan/vulkan.h>
 #include <iostream>
+#include <sstream>
+#include <stddef.h>
 #include <map>
+#include <set>
+#include <algorithm>
+#include <memory>
 #include <VulkanTexture.hpp>
 #include <VulkanModel.hpp>
+#include <PipelineCompiler.hpp>
+#include <TextureProcessing.hpp>
+#include <MeshData.hpp>
+#include <MeshOptimizer.hpp>
+#include <MeshSimplifier.hpp>
+#include <SceneBvh.hpp>
+#include <TextureResidency.hpp>
+#include <GpuProfiler.hpp>
+#include <TransformHierarchy.hpp>
+#include <DescriptorAllocator.hpp>
 
 namespace vk229
 {
@@ -27,7 +42,8 @@ enum class TexT
     AO,
     EMIT,
     NORMAL,
-    REFLECTION
+    REFLECTION,
+    PACKED      // Channels of other textures merged at load time, see PackedTextureInfo.
 };
 std::map<TexT, std::string> TexTDesc
 {
@@ -37,6 +53,36 @@ std::map<TexT, std::string> TexTDesc
     {TexT::EMIT,       "EMIT"},
     {TexT::NORMAL,     "NORMAL"},
     {TexT::REFLECTION, "REFLECTION"},
+    {TexT::PACKED,     "PACKED"},
+};
+/// Part of equirectangular reflection maps covered by their content (rest is padding),
+/// used when converting them to cubemaps.
+#define REFLECTION_MAP_UV_SCALE 0.9375f
+/// Front-to-back draw order only has to be roughly right for early-Z, and every new order is a re-recorded
+/// command buffer - it is re-sorted when more than this part of neighbouring pairs is out of order...
+#define DRAW_ORDER_RESORT_THRESHOLD 0.1f
+/// ...and at most once per this many frames. Newly visible entities are merged in by distance meanwhile.
+#define DRAW_ORDER_RESORT_FRAMES    15u
+/// Visible entities are culled only once they are this far (world units) outside the frustum,
+/// so a turning camera does not change the visible set - and re-record command buffers - at both of its sides.
+#define CULL_KEEP_MARGIN            1.0f
+/// Optional terms of default_material.frag.
+/// Every used combination of these (and material coefficients) gets its own pipeline,
+/// so the driver can drop unused texture samples and math.
+enum MaterialFeature : uint32_t
+{
+    MAT_NORMAL_MAP = 1u << 0,
+    MAT_REFLECTION = 1u << 1,
+    MAT_EMISSION   = 1u << 2,
+    MAT_AO         = 1u << 3,
+    MAT_ALL        = MAT_NORMAL_MAP | MAT_REFLECTION | MAT_EMISSION | MAT_AO,
+};
+std::map<MaterialFeature, std::string> MatFDesc
+{
+    {MAT_NORMAL_MAP, "NORMAL_MAP"},
+    {MAT_REFLECTION, "REFLECTION"},
+    {MAT_EMISSION,   "EMISSION"},
+    {MAT_AO,         "AO"},
 };
 std::map<VkShaderStageFlagBits, std::string> ShadTDesc
 {
@@ -51,12 +97,12 @@ std::map<VkShaderStageFlagBits, std::string> ShadTDesc
 using texture_name_t     = std::string;
 using texture_filename_t = std::string;
 using texture_type_t     = TexT;
-using texture_objtype_t  = vks::Texture2D;
+using texture_objtype_t  = vks::Texture; // Texture2D or TextureCubeMap (REFLECTION), both only fill base members.
 using texture_form_t     = VkFormat;
 
 using mesh_name_t     = std::string;
 using mesh_filename_t = std::string;
-using mesh_objtype_t  = vks::Model;
+using mesh_objtype_t  = GpuMesh;
 
 using shader_name_t      = std::string;
 using shader_filename_t  = std::string;
@@ -69,6 +115,10 @@ using textures_set_name_t = std::string;
 using shaders_set_name_t  = std::string;
 
 using entity_name_t   = std::string;
+using node_name_t     = std::string; // Transform node - TransformNodeInfo or entity.
+
+using material_name_t = std::string;
+using pipeline_key_t  = std::string; // Shaders set + material permutation.
 
 
 VkPipelineShaderStageCreateInfo loadShader(VkDevice& dev, std::string fileName, VkShaderStageFlagBits stage, std::vector<VkShaderModule>& shaderModules)
@@ -94,8 +144,16 @@ struct UniformBufferVS {
 //    glm::vec4 camPos;
 };
 
+/// Push constants of entity's draw. Order of members has to match push_constant block of the vertex shaders.
+struct EntityPushConstants {
+    MeshDequant dequant;        // Per-mesh position dequantization - ignored by the full vertex format shader.
+    uint32_t    transformIndex; // Entity's world matrix in DeviceSideBuffers::transforms.
+};
+
 struct DeviceSideBuffers {
-    vks::Buffer scene; // Scene buffer - device's side mapped memory.
+    vks::Buffer scene;      // Scene buffer - device's side mapped memory.
+    vks::Buffer transforms; // World matrices of transform nodes (TransformHierarchy order) - mapped storage buffer,
+                            // a region per swapchain image, see SceneData::flushTransforms().
 };
 
 //////////////////////////////////////
@@ -113,17 +171,119 @@ struct TextureInfo
     texture_filename_t textureFilename;
 };
 
+//////////////////////////////////////
+/// Information about one channel of a packed texture.
+/// Properties:
+/// * role              - what the shader reads from this channel
+/// * sourceTextureName - TextureInfo the channel is taken from (it is not loaded to GPU on its own)
+/// * sourceChannel     - 0..3, R, G, B, A of the source as sampled (BC4 is (R, 0, 0, 1))
+struct PackedChannelInfo
+{
+    texture_type_t role;
+    texture_name_t sourceTextureName;
+    uint32_t       sourceChannel;
+};
+
+//////////////////////////////////////
+/// Information about texture packed from channels of other textures.
+/// Low-frequency baked maps sampled at the same UVs (e.g. diffuse DI + AO) share one texture,
+/// so the fragment shader does one fetch and uses one sampler less for them.
+/// Properties:
+/// * textureName - used in TextureSetInfo like any other texture
+/// * channels    - R, G, B, A (up to 4)
+struct PackedTextureInfo
+{
+    texture_name_t                 textureName;
+    std::vector<PackedChannelInfo> channels;
+};
+
+//////////////////////////////////////
+/// Where a TexT role is found in a texture set.
+/// Properties:
+/// * slot     - index in TextureSetInfo::texturesNames, sampler binding is slot + 1 (binding 0 is UBO)
+/// * swizzle  - channels of the role, "rgba" for textures which are not packed
+struct TexRoleBinding
+{
+    uint32_t    slot;
+    std::string swizzle;
+};
+
+bool operator==(const TexRoleBinding& a, const TexRoleBinding& b)
+{
+    return a.slot == b.slot && a.swizzle == b.swizzle;
+}
+
+/// Roles default_material.frag reads - its samplers (slot + 1) and channels. The shader is written against this table,
+/// so rolesMap of every texture set has to be exactly this, SceneInfo::fillTexturesSetInfoMap() exits otherwise.
+const std::map<texture_type_t, TexRoleBinding> DEFAULT_MATERIAL_TEXTURE_ROLES = {
+    {TexT::COLOR,      {0u, "rgba"}},
+    {TexT::DIFFUSE_DI, {1u, "rgb"}},
+    {TexT::AO,         {1u, "a"}},
+    {TexT::EMIT,       {2u, "rgba"}},
+    {TexT::NORMAL,     {3u, "rgba"}},
+    {TexT::REFLECTION, {4u, "rgba"}},
+};
+
+/// "COLOR:0.rgba DIFFUSE_DI:1.rgb ..." - for logs.
+std::string getTextureRolesDesc(const std::map<texture_type_t, TexRoleBinding>& rolesMap)
+{
+    std::string desc;
+    for (const auto& role : rolesMap)
+    {
+        desc += (desc.empty() ? "" : " ") + TexTDesc[role.first] + ":" + std::to_string(role.second.slot) + "." + role.second.swizzle;
+    }
+    return desc;
+}
+
 //////////////////////////////////////
 /// Information about mesh.
 /// Properties:
 /// * meshName
 /// * meshFilename
+/// * lods           - filled by loadModels(), LOD 0 is full detail
+/// * boundingSphere - filled by loadModels(), for LOD selection
+/// * bounds         - filled by loadModels(), for SceneData::bvh
 struct MeshInfo
 {
-    mesh_name_t     meshName;
-    mesh_filename_t meshFilename;
+    mesh_name_t          meshName;
+    mesh_filename_t      meshFilename;
+    std::vector<MeshLod> lods;
+    BoundingSphere       boundingSphere;
+    Aabb                 bounds;
 };
 
+/// Projected bounding sphere radius (relative to half of viewport height) below which LOD 1 is used.
+/// Halved for every next LOD - triangle count halves with every LOD too.
+#define LOD_SCREEN_RADIUS_LOD1  0.25f
+/// Relative margin around LOD thresholds, prevents LOD flickering at the threshold.
+#define LOD_HYSTERESIS          0.2f
+
+/// Screen radius below which LOD lodId (or coarser) is used, lodId >= 1.
+float getLodScreenRadiusThreshold(uint32_t lodId)
+{
+    return LOD_SCREEN_RADIUS_LOD1 / float(1u << (lodId - 1u));
+}
+
+/// Picks LOD for given projected radius, current LOD is kept until the radius gets past the threshold by LOD_HYSTERESIS.
+uint32_t selectLod(uint32_t currentLod, uint32_t lodCount, float screenRadius)
+{
+    uint32_t lod = 0u;
+    while (lod + 1u < lodCount && screenRadius < getLodScreenRadiusThreshold(lod + 1u))
+    {
+        lod++;
+    }
+
+    if (lod > currentLod && screenRadius > getLodScreenRadiusThreshold(currentLod + 1u) * (1.0f - LOD_HYSTERESIS))
+    {
+        return currentLod;
+    }
+    if (lod < currentLod && screenRadius < getLodScreenRadiusThreshold(currentLod) * (1.0f + LOD_HYSTERESIS))
+    {
+        return currentLod;
+    }
+    return lod;
+}
+
 //////////////////////////////////////
 /// Information about fingle shader.
 /// Properties:
@@ -142,11 +302,12 @@ struct ShaderInfo
 /// Properties:
 /// * textures_set_name
 /// * textures_names_vector
+/// * rolesMap - filled by SceneInfo::fillTexturesSetInfoMap(), TexT role -> slot and channels (also of packed textures)
 struct TextureSetInfo
 {
     textures_set_name_t         texturesSetName;
     std::vector<texture_name_t> texturesNames;
-//    std::map<texture_type_t, TextureInfo> texturesInfoMap; // By tex type;
+    std::map<texture_type_t, TexRoleBinding> rolesMap;
 };
 
 //////////////////////////////////////
@@ -171,6 +332,96 @@ struct ShaderSetInfo
     std::vector<shader_name_t> shadersNames;
 };
 
+//////////////////////////////////////
+/// Coefficients of default_material.frag.
+/// Order of members is the order of specialization constants (constant_id 4..9).
+struct MaterialCoeffs
+{
+    float aoCoeff;
+    float emitCoeff;
+    float diffDiCoeff;
+    float reflCoeff;
+    float roughness;   // Selects mip level of reflection cubemap - GGX roughness if maps are prefiltered.
+    float metalness;
+};
+
+//////////////////////////////////////
+/// Information about material.
+/// Properties:
+/// * material_name
+/// * features      // MaterialFeature bits
+/// * coefficients
+struct MaterialInfo
+{
+    material_name_t materialName;
+    uint32_t        features;
+    MaterialCoeffs  coeffs;
+};
+
+/// Material used by entities which do not name one - everything enabled, values from before permutations existed.
+MaterialInfo getDefaultMaterial()
+{
+    return {"", MAT_ALL, {0.25f, 1.0f, 3.0f, 2.0f, 0.0f, 0.25f}};
+}
+
+//////////////////////////////////////
+/// Data of specialization constants of default_material.frag.
+/// Layout of this struct is described by getMaterialSpecMapEntries().
+struct MaterialSpecData
+{
+    VkBool32       useNormalMap;   // constant_id = 0
+    VkBool32       useReflection;  // constant_id = 1
+    VkBool32       useEmission;    // constant_id = 2
+    VkBool32       useAO;          // constant_id = 3
+    MaterialCoeffs coeffs;         // constant_id = 4..9
+
+    explicit MaterialSpecData(const MaterialInfo& mi) :
+        useNormalMap( (mi.features & MAT_NORMAL_MAP) ? VK_TRUE : VK_FALSE),
+        useReflection((mi.features & MAT_REFLECTION) ? VK_TRUE : VK_FALSE),
+        useEmission(  (mi.features & MAT_EMISSION)   ? VK_TRUE : VK_FALSE),
+        useAO(        (mi.features & MAT_AO)         ? VK_TRUE : VK_FALSE),
+        coeffs(mi.coeffs)
+    {
+    }
+};
+
+std::vector<VkSpecializationMapEntry> getMaterialSpecMapEntries()
+{
+    std::vector<VkSpecializationMapEntry> mapEntries;
+    auto addEntry = [&mapEntries](size_t offset, size_t size)
+    {
+        VkSpecializationMapEntry entry;
+        entry.constantID = mapEntries.size();
+        entry.offset     = offset;
+        entry.size       = size;
+        mapEntries.push_back(entry);
+    };
+
+    addEntry(offsetof(MaterialSpecData, useNormalMap),  sizeof(VkBool32));
+    addEntry(offsetof(MaterialSpecData, useReflection), sizeof(VkBool32));
+    addEntry(offsetof(MaterialSpecData, useEmission),   sizeof(VkBool32));
+    addEntry(offsetof(MaterialSpecData, useAO),         sizeof(VkBool32));
+    addEntry(offsetof(MaterialSpecData, coeffs) + offsetof(MaterialCoeffs, aoCoeff),     sizeof(float));
+    addEntry(offsetof(MaterialSpecData, coeffs) + offsetof(MaterialCoeffs, emitCoeff),   sizeof(float));
+    addEntry(offsetof(MaterialSpecData, coeffs) + offsetof(MaterialCoeffs, diffDiCoeff), sizeof(float));
+    addEntry(offsetof(MaterialSpecData, coeffs) + offsetof(MaterialCoeffs, reflCoeff),   sizeof(float));
+    addEntry(offsetof(MaterialSpecData, coeffs) + offsetof(MaterialCoeffs, roughness),   sizeof(float));
+    addEntry(offsetof(MaterialSpecData, coeffs) + offsetof(MaterialCoeffs, metalness),   sizeof(float));
+
+    return mapEntries;
+}
+
+/// Key identifying a pipeline: shaders set + everything that goes into specialization constants.
+/// Materials with equal content share a pipeline regardless of their names.
+pipeline_key_t getPipelineKey(const shaders_set_name_t& shadersSetName, const MaterialInfo& mi)
+{
+    std::ostringstream key;
+    key << shadersSetName << "|f" << (mi.features & MAT_ALL)
+        << "|" << mi.coeffs.aoCoeff   << "," << mi.coeffs.emitCoeff << "," << mi.coeffs.diffDiCoeff
+        << "," << mi.coeffs.reflCoeff << "," << mi.coeffs.roughness << "," << mi.coeffs.metalness;
+    return key.str();
+}
+
 //////////////////////////////////////
 /// Element of scene definition.
 /// Properties:
@@ -179,7 +430,9 @@ struct ShaderSetInfo
 /// * textures_set_name
 /// * shaders_set_name
 /// * model_matrix_name
-/// * parent_model_name - TODO
+/// * material_name     - optional, empty means getDefaultMaterial()
+/// * parent_name       - optional, transform node (TransformNodeInfo or other entity) the entity moves with
+/// Every entity is a transform node named after it, see SceneData::prepareTransforms().
 struct Entity3dInfo
 {
     entity_name_t       entityName;
@@ -187,37 +440,72 @@ struct Entity3dInfo
     matrix_name_t       matrixName;
     textures_set_name_t texturesSetName;
     shaders_set_name_t  shadersSetName;
-    // TODO: transform matrix - part of one big dynamic UBO (or not).
-    // TODO: parent/child ptr - to apply parent's transforms to a child.
+    material_name_t     materialName;
+    node_name_t         parentName;
+};
+
+//////////////////////////////////////
+/// Transform node without a mesh - pivot which entities and other nodes are attached to.
+/// Properties:
+/// * node_name
+/// * parent_name - optional, empty means a root
+/// * translation - initial, relative to the parent
+struct TransformNodeInfo
+{
+    node_name_t nodeName;
+    node_name_t parentName;
+    glm::vec3   translation;
 };
 
 // Used for init.
 struct SceneInfo
 {
-    // Vertex layout for the models.
-    vks::VertexLayout vertexLayout;
+    // Vertex format for the models: MeshVertex (68 B) or CompactVertex (20 B).
+    // Vertex shader has to match - see COMPACT_VERTEX in default_transforms.vert.
+    bool useCompactVertices;
+
+    // Shaders set of depth-only pre-pass (position-only vertex shader), empty - no pre-pass.
+    // With pre-pass, material pipelines test depth with VK_COMPARE_OP_EQUAL and do not write it,
+    // so every pixel is shaded once.
+    shaders_set_name_t depthPrepassShadersSetName;
+
+    // REFLECTION maps are GGX prefiltered (roughness per mip level, RGB9E5, HDR sources supported)
+    // instead of box filtered 8-bit (BC7 if supported). See prepareEquirectAsPrefilteredCubemap().
+    bool prefilterReflectionMaps;
 
     std::map<mesh_name_t,       MeshInfo>       meshesInfoMap;
     std::map<shader_name_t,     ShaderInfo>     shadersInfoMap;
     std::map<texture_name_t,    TextureInfo>    texturesInfoMap;
+    std::map<texture_name_t,    PackedTextureInfo> packedTexturesInfoMap;
     std::map<matrix_name_t,     MatrixInfo>     matriciesInfoMap;
 
     std::map<textures_set_name_t, TextureSetInfo> texturesSetInfoMap;
     std::map<shaders_set_name_t,  ShaderSetInfo>  shadersSetInfoMap;
+    std::map<material_name_t,     MaterialInfo>   materialsInfoMap;
 
     std::map<entity_name_t, Entity3dInfo>   entities3dInfoMap;
+    std::map<node_name_t,   TransformNodeInfo> transformNodesInfoMap;
 
 
     SceneInfo() :
-        vertexLayout({
-            vks::VERTEX_COMPONENT_POSITION,
-            vks::VERTEX_COMPONENT_NORMAL,
-            vks::VERTEX_COMPONENT_TANGENT,
-            vks::VERTEX_COMPONENT_BITANGENT,
-            vks::VERTEX_COMPONENT_UV,
-            vks::VERTEX_COMPONENT_COLOR,
-        })
+        useCompactVertices(false),
+        prefilterReflectionMaps(false)
+    {
+    }
+
+    uint32_t getVertexStride() const
     {
+        return this->useCompactVertices ? sizeof(CompactVertex) : sizeof(MeshVertex);
+    }
+
+    uint32_t getPositionStride() const
+    {
+        return this->useCompactVertices ? sizeof(CompactPositionVertex) : sizeof(PositionVertex);
+    }
+
+    bool isDepthPrepassEnabled() const
+    {
+        return false == this->depthPrepassShadersSetName.empty();
     }
 
     void fillMeshesInfoMap(const std::vector<MeshInfo>& modInfVec)
@@ -247,6 +535,25 @@ struct SceneInfo
         }
     }
 
+    /// Has to be called after fillTexturesInfoMap() and before fillTexturesSetInfoMap().
+    /// Every packed texture gets its TextureInfo (TexT::PACKED), file name is the name of packing cache.
+    void fillPackedTexturesInfoMap(const std::vector<PackedTextureInfo>& packInfVec)
+    {
+        for (const PackedTextureInfo& pi : packInfVec)
+        {
+            assert(pi.channels.size() <= 4u);
+            for (const PackedChannelInfo& ch : pi.channels)
+            {
+                assert(this->texturesInfoMap.count(ch.sourceTextureName) > 0);
+                assert(ch.sourceChannel < 4u);
+            }
+
+            texture_name_t tName = pi.textureName;
+            this->packedTexturesInfoMap[tName] = pi;
+            this->texturesInfoMap[tName] = {tName, VK_FORMAT_R8G8B8A8_UNORM, TexT::PACKED, tName + "_packed.dds"};
+        }
+    }
+
     void fillMatricesInfoMap(const std::vector<MatrixInfo>& matInfVec)
     {
         for (const MatrixInfo& mi : matInfVec)
@@ -256,12 +563,44 @@ struct SceneInfo
         }
     }
 
+    /// Resolves TexT roles of every set - from texture types, or from channels for packed textures.
+    /// All sets share one descriptor set layout and fragment shader, so their roles have to be
+    /// DEFAULT_MATERIAL_TEXTURE_ROLES - exits if a set does not match it.
     void fillTexturesSetInfoMap(const std::vector<TextureSetInfo>& texSetInfVec)
     {
         for (const TextureSetInfo& tsi : texSetInfVec)
         {
             textures_set_name_t tsName = tsi.texturesSetName;
-            this->texturesSetInfoMap[tsName] = tsi;
+            TextureSetInfo& setInfo = this->texturesSetInfoMap[tsName];
+            setInfo = tsi;
+            setInfo.rolesMap.clear();
+
+            for (uint32_t slot = 0; slot < setInfo.texturesNames.size(); slot++)
+            {
+                const texture_name_t& texName = setInfo.texturesNames[slot];
+                auto packIt = this->packedTexturesInfoMap.find(texName);
+                if (packIt == this->packedTexturesInfoMap.end())
+                {
+                    assert(this->texturesInfoMap.count(texName) > 0);
+                    setInfo.rolesMap[this->texturesInfoMap[texName].textureType] = {slot, "rgba"};
+                    continue;
+                }
+
+                const std::vector<PackedChannelInfo>& channels = packIt->second.channels;
+                for (uint32_t c = 0; c < channels.size(); c++)
+                {
+                    TexRoleBinding& roleBinding = setInfo.rolesMap[channels[c].role];
+                    roleBinding.slot     = slot;
+                    roleBinding.swizzle += "rgba"[c];
+                }
+            }
+
+            if (false == (setInfo.rolesMap == DEFAULT_MATERIAL_TEXTURE_ROLES))
+            {
+                vks::tools::exitFatal("Texture set " + tsName + " does not match default_material.frag: "
+                                      + getTextureRolesDesc(setInfo.rolesMap) + " instead of "
+                                      + getTextureRolesDesc(DEFAULT_MATERIAL_TEXTURE_ROLES), "Error");
+            }
         }
     }
 
@@ -274,6 +613,15 @@ struct SceneInfo
         }
     }
 
+    void fillMaterialsInfoMap(const std::vector<MaterialInfo>& matInfVec)
+    {
+        for (const MaterialInfo& mi : matInfVec)
+        {
+            material_name_t mName = mi.materialName;
+            this->materialsInfoMap[mName] = mi;
+        }
+    }
+
     void fillEntities3dInfoMap(const std::vector<Entity3dInfo>& entInfVec)
     {
         for (const Entity3dInfo& ei : entInfVec)
@@ -283,22 +631,56 @@ struct SceneInfo
         }
     }
 
+    void fillTransformNodesInfoMap(const std::vector<TransformNodeInfo>& nodeInfVec)
+    {
+        for (const TransformNodeInfo& ni : nodeInfVec)
+        {
+            node_name_t nName = ni.nodeName;
+            assert(this->entities3dInfoMap.find(nName) == this->entities3dInfoMap.end()); // Entities are nodes too.
+            this->transformNodesInfoMap[nName] = ni;
+        }
+    }
+
+    MaterialInfo getEntityMaterial(const Entity3dInfo& ei) const
+    {
+        if (ei.materialName.empty())
+        {
+            return getDefaultMaterial();
+        }
+
+        auto matIt = this->materialsInfoMap.find(ei.materialName);
+        assert(matIt != this->materialsInfoMap.end());
+        return matIt->second;
+    }
+
     uint32_t getTextureSetSize() const
     {
         return this->texturesSetInfoMap.begin()->second.texturesNames.size();
     }
 
-    uint32_t getNeededDescriptorCount() const
+    /// "DIFFUSE_DI.rgb AO.a" - roles read from given slot of texture sets, for logs.
+    std::string getTextureSlotRolesDesc(uint32_t slot) const
     {
-        return this->entities3dInfoMap.size();
+        std::string desc;
+        for (const auto& role : this->texturesSetInfoMap.begin()->second.rolesMap)
+        {
+            if (role.second.slot == slot)
+            {
+                desc += (desc.empty() ? "" : " ") + TexTDesc[role.first] + "." + role.second.swizzle;
+            }
+        }
+        return desc;
     }
 };
 
 // Used to store assets data.
 struct SceneData
 {
-    VkPipelineLayout      pipelineLayout;
-    VkDescriptorSetLayout descriptorSetLayout;
+    VkPipelineLayout             pipelineLayout;
+    VkDescriptorSetLayout        descriptorSetLayout;
+    VkDescriptorSetLayout        transformsSetLayout; // Set 1 - world matrices, bound once per command buffer.
+    std::vector<VkDescriptorSet> transformsSets;      // One per transforms region - command buffer i reads region i.
+    DescriptorAllocator          descriptorAllocator; // Owns layouts and sets above, entities with the same textures share a set.
     SceneInfo sceneInfo;
 
     UniformBufferVS uboVS;
@@ -309,9 +691,30 @@ struct SceneData
     std::map<shader_name_t,  VkPipelineShaderStageCreateInfo>   shadersMap;
     std::map<texture_name_t, texture_objtype_t>                 texturesMap;
 //    std::map<matrix_name_t,  matrix_content_t>                  matriciesMap;
-    std::map<entity_name_t,  VkPipeline>                        pipelinesMap;
+    std::map<pipeline_key_t, VkPipeline>                        pipelinesMap;        // One per used material permutation.
+    std::map<entity_name_t,  pipeline_key_t>                    entityPipelineKeyMap;
+    std::map<entity_name_t,  uint32_t>                          entityLodMap;        // Current LOD, see updateEntityLods().
+    std::vector<entity_name_t>                                  entityDrawOrder;     // Visible entities, front-to-back, see updateDrawOrder().
+    std::vector<uint32_t>                                       drawOrderIds;        // entityDrawOrder as indices of bvhEntityNames.
+    uint32_t                                                    drawOrderAge = 0u;   // Frames since the last full sort.
     std::map<entity_name_t,  VkDescriptorSet>                   descriptorSetsMap;
 
+    std::unique_ptr<PipelineCompiler>           pipelineCompiler;
+    std::map<pipeline_key_t, compile_ticket_t>  pendingPipelinesMap; // Permutations drawn with a placeholder pipeline.
+
+    DynamicBvh                          bvh;             // World bounds of entities, see prepareBvh().
+    std::map<entity_name_t, int32_t>    entityProxyMap;  // Entity -> BVH proxy.
+    std::vector<entity_name_t>          bvhEntityNames;  // BVH user data -> entity.
+
+    TextureResidencyManager             textureResidency; // Mip levels of textures not visible lately are evicted under memory pressure.
+    uint64_t                            residencyFrame = 0u;
+
+    TransformHierarchy                  transforms;           // Entities and TransformNodeInfo nodes, see prepareTransforms().
+    std::map<node_name_t, transform_node_t> transformNodeMap;
+    std::vector<entity_name_t>          transformEntityNames; // Node -> entity, empty for nodes without a mesh.
+    VkDeviceSize                        transformsRegionStride = 0u;
+    std::vector<std::pair<uint32_t, uint32_t>> transformsPendingRanges; // Per region [begin, end) not copied yet.
+
     SceneData()
     {
     }
@@ -337,9 +740,9 @@ struct SceneData
         return this->texturesMap.find(_tex) != this->texturesMap.end();
     }
 
-    bool isPipelineAlreadyCreated(entity_name_t _ent) const
+    bool isPipelineAlreadyCreated(pipeline_key_t _pk) const
     {
-        return this->pipelinesMap.find(_ent) != this->pipelinesMap.end();
+        return this->pipelinesMap.find(_pk) != this->pipelinesMap.end();
     }
 
     bool isDescriptorSetAlreadyCreated(entity_name_t _ds) const
@@ -351,12 +754,31 @@ struct SceneData
 
 // PREPARE {
 
+    /// Memory budget tracking for textures loaded by loadTextures().
+    /// frameCount - command buffers which can be in flight, see completeFrame().
+    /// textureBudget > 0 - textures have to fit in it too (bytes), to see eviction on GPUs with plenty of memory.
+    /// instanceApiVersion and instanceExtensions - as the instance was created with, see vk229::MemoryBudget::prepare().
+    void prepareTextureResidency(vks::VulkanDevice* dev, VkQueue& queue, uint32_t frameCount, VkInstance instance, uint32_t instanceApiVersion,
+                                 const std::vector<const char*>& instanceExtensions, VkDeviceSize textureBudget)
+    {
+        this->textureResidency.prepare(dev, queue, frameCount, instance, instanceApiVersion, instanceExtensions, textureBudget);
+    }
+
     /// Loading textures from files and putting them into GPU's memory.
-    /// A vks::Texture2D object acts as a handle to this memory.
-    /// It creates image, image view and sampler.
+    /// A vks::Texture object acts as a handle to this memory.
+    /// textureResidency creates image, image view and sampler - with the mip levels which fit in the memory budget.
     /// It requires texture filename, texture format, vks::VulkanDevice and queue.
+    /// REFLECTION textures are equirectangular on disk - they are converted to
+    /// vks::TextureCubeMap once and the result is cached (see TextureProcessing.hpp).
+    /// With sceneInfo.prefilterReflectionMaps they are GGX prefiltered instead (mip level per roughness).
+    /// If the device supports BC formats, uncompressed B8G8R8A8 textures are block compressed
+    /// and cached too: NORMAL -> BC5, REFLECTION -> BC7 (if not prefiltered).
+    /// PACKED textures are merged from channels of their sources (PackedTextureInfo) and cached (BC7 if supported).
+    /// Every texture is owned by textureResidency - prepareTextureResidency() has to be called first.
     void loadTextures(vks::VulkanDevice* dev, VkQueue& queue, std::string assetsPath)
     {
+        const bool compressBC = dev->features.textureCompressionBC;
+
         auto& entities3dInfo = this->sceneInfo.entities3dInfoMap;
         for (auto& ent3dCreInf : entities3dInfo) // <entity_name, Entity3dInfo>
         {
@@ -379,16 +801,51 @@ struct SceneData
 //                        vks::tools::exitFatal("Device does not support needed compressed texture format!", "Error");
 //                    }
 
-                    vks::Texture2D tex;
-                    tex.loadFromFile(assetsPath + "textures/my_new_scene1/"+texFName, texFormat, dev, queue);
-                    this->texturesMap[texName] = std::move(tex);
+                    const std::string texPath = assetsPath + "textures/my_new_scene1/"+texFName;
+                    const bool compressTex    = compressBC && texFormat == VK_FORMAT_B8G8R8A8_UNORM;
+                    const bool isCube         = texInfo.textureType == TexT::REFLECTION;
+                    std::string loadedFilename = texPath;   // DDS actually uploaded - a cache for processed textures.
+                    VkFormat    loadedFormat   = texFormat;
+                    if (texInfo.textureType == TexT::REFLECTION && this->sceneInfo.prefilterReflectionMaps)
+                    {
+                        loadedFilename = prepareEquirectAsPrefilteredCubemap(texPath, REFLECTION_MAP_UV_SCALE);
+                        loadedFormat   = VK_FORMAT_E5B9G9R9_UFLOAT_PACK32;
+                    }
+                    else if (texInfo.textureType == TexT::REFLECTION)
+                    {
+                        loadedFilename = prepareEquirectAsCubemap(texPath, REFLECTION_MAP_UV_SCALE, 0u, compressTex);
+                        loadedFormat   = compressTex ? VK_FORMAT_BC7_UNORM_BLOCK : texFormat;
+                    }
+                    else if (texInfo.textureType == TexT::PACKED)
+                    {
+                        std::vector<PackedChannelSource> channelSources;
+                        for (const PackedChannelInfo& ch : this->sceneInfo.packedTexturesInfoMap[texName].channels)
+                        {
+                            const TextureInfo& srcInfo = this->sceneInfo.texturesInfoMap[ch.sourceTextureName];
+                            channelSources.push_back({assetsPath + "textures/my_new_scene1/" + srcInfo.textureFilename, ch.sourceChannel});
+                        }
+
+                        loadedFilename = preparePackedTexture(texPath, channelSources, compressBC);
+                        loadedFormat   = compressBC ? VK_FORMAT_BC7_UNORM_BLOCK : VK_FORMAT_R8G8B8A8_UNORM;
+                    }
+                    else if (texInfo.textureType == TexT::NORMAL && compressTex)
+                    {
+                        loadedFilename = prepareNormalMapAsBC5(texPath);
+                        loadedFormat   = VK_FORMAT_BC5_UNORM_BLOCK;
+                    }
+
+                    // Upload is left to textureResidency - only mip levels which fit in the budget are uploaded,
+                    // the rest is streamed in when the texture becomes visible.
+                    this->textureResidency.loadTexture(texName, loadedFilename, loadedFormat, isCube, this->texturesMap[texName]);
                 }
             }
         }
     }
 
     /// Loading meshes from file.
-    /// It requires model filename, vertex layout, model scale, vks::VulkanDevice and queue.
+    /// Meshes are loaded to MeshData, optimized for vertex cache, overdraw and vertex fetch (MeshOptimizer.hpp),
+    /// encoded to CompactVertex if sceneInfo.useCompactVertices and uploaded to device local buffers.
+    /// It requires model filename, vks::VulkanDevice and queue.
     void loadModels(vks::VulkanDevice* dev, VkQueue& queue, std::string assetsPath)
     {
         auto& entities3dInfo = this->sceneInfo.entities3dInfoMap;
@@ -398,7 +855,7 @@ struct SceneData
             Entity3dInfo  entityInfo = ent3dCreInf.second;
 
             mesh_name_t meshName = entityInfo.meshName;
-            MeshInfo    modelInfo = this->sceneInfo.meshesInfoMap[meshName];
+            MeshInfo&   modelInfo = this->sceneInfo.meshesInfoMap[meshName];
 
             mesh_filename_t& modelFName = modelInfo.meshFilename;
 
@@ -406,14 +863,131 @@ struct SceneData
 
             if (false == this->isMeshAlreadyCreated(meshName))
             {
-                vks::Model model;
-                model.loadFromFile(assetsPath + "models/my_new_scene1/"+modelFName, this->sceneInfo.vertexLayout, 1.0f, dev, queue);
-                this->meshesMap[meshName] = std::move(model);
+                MeshData meshData;
+                if (false == loadMeshData(assetsPath + "models/my_new_scene1/"+modelFName, meshData))
+                {
+                    vks::tools::exitFatal("Could not load mesh: " + modelFName, "Error");
+                }
+                optimizeMesh(meshData, meshName);
+                buildLodChain(meshData, meshName, modelInfo.lods);
+                modelInfo.boundingSphere = computeBoundingSphere(meshData.vertices);
+                modelInfo.bounds         = computeMeshAabb(meshData.vertices);
+
+                GpuMesh gpuMesh;
+                if (this->sceneInfo.useCompactVertices)
+                {
+                    std::vector<CompactVertex> compactVertices;
+                    encodeCompactVertices(meshData, compactVertices, gpuMesh.dequant);
+                    uploadMesh(dev, queue, compactVertices, meshData.indices, gpuMesh);
+                    if (this->sceneInfo.isDepthPrepassEnabled())
+                    {
+                        uploadPositions<CompactPositionVertex>(dev, queue, compactVertices, gpuMesh);
+                    }
+                }
+                else
+                {
+                    uploadMesh(dev, queue, meshData.vertices, meshData.indices, gpuMesh);
+                    if (this->sceneInfo.isDepthPrepassEnabled())
+                    {
+                        uploadPositions<PositionVertex>(dev, queue, meshData.vertices, gpuMesh);
+                    }
+                }
+
+                std::cout << " >>> loadModels: " << meshName << ": " << meshData.vertices.size() << " vertices, "
+                          << meshData.vertices.size() * this->sceneInfo.getVertexStride() << " B of vertex data"
+                          << " (full: " << meshData.vertices.size() * sizeof(MeshVertex) << " B)\n";
+
+                this->meshesMap[meshName] = gpuMesh;
             }
         }
 
     }
 
+    /// Puts world bounds of all entities into the BVH, requires loadModels().
+    /// Meshes are in world space, so mesh bounds are entity bounds until updateTransforms() moves them.
+    void prepareBvh()
+    {
+        for (auto& [entityName, entity3dInfo] : this->sceneInfo.entities3dInfoMap)
+        {
+            const Aabb& bounds = this->sceneInfo.meshesInfoMap[entity3dInfo.meshName].bounds;
+            this->entityProxyMap[entityName] = this->bvh.createProxy(bounds, this->bvhEntityNames.size());
+            this->bvhEntityNames.push_back(entityName);
+        }
+
+        std::cout << " >>> prepareBvh: " << this->bvhEntityNames.size() << " entities, tree height " << this->bvh.getHeight() << "\n";
+    }
+
+    /// Transform node of given name - created with its ancestors if needed.
+    transform_node_t getOrCreateTransformNode(const node_name_t& nodeName)
+    {
+        auto nodeIt = this->transformNodeMap.find(nodeName);
+        if (nodeIt != this->transformNodeMap.end())
+        {
+            return nodeIt->second;
+        }
+
+        auto entityIt = this->sceneInfo.entities3dInfoMap.find(nodeName);
+        auto pivotIt  = this->sceneInfo.transformNodesInfoMap.find(nodeName);
+        assert(entityIt != this->sceneInfo.entities3dInfoMap.end() || pivotIt != this->sceneInfo.transformNodesInfoMap.end());
+
+        const node_name_t& parentName = (entityIt != this->sceneInfo.entities3dInfoMap.end()) ? entityIt->second.parentName : pivotIt->second.parentName;
+        const transform_node_t parent = parentName.empty() ? TRANSFORM_NULL_NODE : this->getOrCreateTransformNode(parentName);
+        const transform_node_t node   = this->transforms.createNode(parent);
+        this->transformNodeMap[nodeName] = node;
+
+        this->transformEntityNames.resize(node + 1u);
+        if (entityIt != this->sceneInfo.entities3dInfoMap.end())
+        {
+            this->transformEntityNames[node] = nodeName;
+        }
+        else
+        {
+            this->transforms.setTranslation(node, pivotIt->second.translation);
+        }
+        return node;
+    }
+
+    /// Builds the transform hierarchy - a node for every entity and every TransformNodeInfo, all at their initial
+    /// positions (identity for entities, meshes are in world space) - and a storage buffer for its world matrices,
+    /// read by the vertex shaders at EntityPushConstants::transformIndex.
+    /// The buffer has regionCount regions (one per swapchain image), so the CPU never writes matrices a frame
+    /// in flight may still be reading - see flushTransforms().
+    /// Requires prepareBvh(), entity bounds follow their nodes in updateTransforms().
+    void prepareTransforms(vks::VulkanDevice* dev, uint32_t regionCount)
+    {
+        assert(regionCount > 0u);
+
+        for (auto& [nodeName, nodeInfo] : this->sceneInfo.transformNodesInfoMap)
+        {
+            this->getOrCreateTransformNode(nodeName);
+        }
+        for (auto& [entityName, entity3dInfo] : this->sceneInfo.entities3dInfoMap)
+        {
+            this->getOrCreateTransformNode(entityName);
+        }
+
+        // Regions are bound at descriptor offsets - aligned as InstanceRing slots.
+        const VkDeviceSize alignment  = std::max<VkDeviceSize>(dev->properties.limits.minStorageBufferOffsetAlignment, 16u);
+        const VkDeviceSize regionSize = this->transforms.getNodeCount() * sizeof(glm::mat4);
+        this->transformsRegionStride = (regionSize + alignment - 1u) / alignment * alignment;
+
+        VK_CHECK_RESULT(dev->createBuffer(
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            &this->uniformBuffers.transforms,
+            this->transformsRegionStride * regionCount));
+
+        // Map persistent
+        VK_CHECK_RESULT(this->uniformBuffers.transforms.map());
+
+        // Every region is filled whole by its first flushTransforms().
+        this->transformsPendingRanges.assign(regionCount, std::make_pair(0u, this->transforms.getNodeCount()));
+        this->updateTransforms();
+
+        std::cout << " >>> prepareTransforms: " << this->transforms.getNodeCount() << " nodes, "
+                  << this->transforms.getStats().levelCount << " levels\n";
+    }
+
     void loadSingleShader(vks::VulkanDevice* dev,
                        VkQueue& queue,
                        std::string assetsPath,
@@ -437,10 +1011,18 @@ struct SceneData
                      std::string assetsPath,
                      std::vector<VkShaderModule>& shaderModules)
     {
-        auto& entities3dInfo = this->sceneInfo.entities3dInfoMap;
-        for (auto& [entityName, entity3dInfo] : entities3dInfo) // <entity_name, Entity3dInfo>
+        std::vector<shaders_set_name_t> usedShaderSets;
+        for (auto& [entityName, entity3dInfo] : this->sceneInfo.entities3dInfoMap) // <entity_name, Entity3dInfo>
+        {
+            usedShaderSets.push_back(entity3dInfo.shadersSetName);
+        }
+        if (this->sceneInfo.isDepthPrepassEnabled())
+        {
+            usedShaderSets.push_back(this->sceneInfo.depthPrepassShadersSetName);
+        }
+
+        for (const shaders_set_name_t& shaderSetName : usedShaderSets)
         {
-            shaders_set_name_t& shaderSetName   = entity3dInfo.shadersSetName;
             vk229::ShaderSetInfo& shaderSetInfo = this->sceneInfo.shadersSetInfoMap[shaderSetName];
             for (const vk229::shader_name_t& shadName : shaderSetInfo.shadersNames)
             {
@@ -506,7 +1088,8 @@ struct SceneData
         // Putting samplers for all types of textures used in this scene
         for (int i = 0; i < this->sceneInfo.getTextureSetSize(); i++)
         {
-            std::cout << " >>> setupDescriptorSetLayout: adding bind of id: " << bindId << " - FragS samplers - one for every texture in TexSet\n";
+            std::cout << " >>> setupDescriptorSetLayout: adding bind of id: " << bindId << " - FragS sampler - "
+                      << this->sceneInfo.getTextureSlotRolesDesc(i) << "\n";
             setLayoutBindings.push_back(
                 // Binding: Fragment shader combined sampler
                 vks::initializers::descriptorSetLayoutBinding( VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
@@ -515,68 +1098,40 @@ struct SceneData
         }
     // } // SCENE_SPECIFIC
 
-        VkDescriptorSetLayoutCreateInfo descriptorLayout =
-            vks::initializers::descriptorSetLayoutCreateInfo( setLayoutBindings.data(), setLayoutBindings.size());
+        this->descriptorSetLayout = this->descriptorAllocator.getLayout(setLayoutBindings);
 
-        VkDescriptorSetLayout descSetLayout;
-        VK_CHECK_RESULT(vkCreateDescriptorSetLayout(dev->logicalDevice, &descriptorLayout, nullptr, &descSetLayout));
-        this->descriptorSetLayout = descSetLayout;
-    }
-
-    /// In this method we setup a pool for allocating shaders bindings.
-    /// We must specify here how much bindings there will be of any VkDescriptorType.
-    /// It requires:
-    /// * vks::VulkanDevice*
-    /// * descriptorCount   // how much descriptors do we need = no more than number of distinct entities
-    /// * VkDescriptorType  // just as in descriptor set layout = in { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER }
-    /// * relation between: VkDescriptorType and number of descriptors of this type.
-    void setupDescriptorPool(vks::VulkanDevice* dev, VkDescriptorPool& descPool)
-    { // This is fully scene specific.
-        // One descriptor set per drawable object.
-        const uint32_t descriptorCount = this->sceneInfo.getNeededDescriptorCount(); // Max number of sets - one for each distinct drawable entity.
-
-        // Example uses one ubo
-        std::vector<VkDescriptorPoolSize> poolSizes =
+        // Set 1, binding 0 : Vertex shader storage buffer - world matrices of all entities.
+        std::cout << " >>> setupDescriptorSetLayout: adding set 1 bind of id: 0 - VertS SSBO - transforms\n";
+        const std::vector<VkDescriptorSetLayoutBinding> transformsBindings =
         {
-            vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, descriptorCount),
+            vks::initializers::descriptorSetLayoutBinding( VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                           VK_SHADER_STAGE_VERTEX_BIT,
+                                                           0),
         };
+        this->transformsSetLayout = this->descriptorAllocator.getLayout(transformsBindings);
+    }
 
-///        THIS WORKS AS WELL
-//        poolSizes.push_back(
-//            vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, descriptorCount*this->sceneInfo.getTextureSetSize())
-//        );
-
-        for (int i = 0; i < this->sceneInfo.getTextureSetSize(); i++)
-        {
-            poolSizes.push_back(
-                vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, descriptorCount)
-            );
-        }
-
-        VkDescriptorPoolCreateInfo descriptorPoolInfo =
-            vks::initializers::descriptorPoolCreateInfo(
-                poolSizes.size(), // uint32_t poolSizeCount
-                poolSizes.data(), // VkDescriptorPoolSize* pPoolSizes
-                descriptorCount); // uint32_t maxSets
-
-        VK_CHECK_RESULT(vkCreateDescriptorPool(dev->logicalDevice, &descriptorPoolInfo, nullptr, &descPool));
+    /// Descriptor pools are not sized up front - vk229::DescriptorAllocator grows them per layout on demand,
+    /// so texture sets of any size and any number of entities fit. Has to precede setupDescriptorSetLayout().
+    /// frameCount - command buffers which can be in flight, sets replaced by updateTextureDescriptors() are
+    /// reused after completeFrame() of each of them.
+    void prepareDescriptorAllocator(vks::VulkanDevice* dev, uint32_t frameCount)
+    {
+        this->descriptorAllocator.prepare(dev, frameCount);
     }
 
-    /// In this method we create VkDescriptorSet objects and allocate them in the pool.
-    /// Then every created descriptor set is filled with its bind id, VkDescriptorType and VkDescriptorBufferInfo (a descriptor of buffer, ie. image or UBO, etc...).
+    /// In this method we get a VkDescriptorSet for every drawable entity.
+    /// Every set is filled with its bind id, VkDescriptorType and VkDescriptorBufferInfo (a descriptor of buffer, ie. image or UBO, etc...).
     /// In this case we do this for {every {texture and ubo} of every drawable entity}.
+    /// Sets are cached by contents - entities with the same texture set share one, which is allocated and written once.
     /// It requires:
     /// * vks::VulkanDevice*
-    /// * VkDescriptorType  // just as in descriptor set layout and descriptor pool
+    /// * VkDescriptorType  // just as in descriptor set layout
     /// * bind id
     /// * VkDescriptorBufferInfo*
-    /// * descriptor pool.
-    void setupDescriptorSets(vks::VulkanDevice* dev, VkDescriptorPool& descPool)
+    void setupDescriptorSets(vks::VulkanDevice* dev)
     { // This is fully scene specific.
-        VkDescriptorSetAllocateInfo descripotrSetAllocInfo;
-        std::vector<VkWriteDescriptorSet> writeDescriptorSets;
-
-        descripotrSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(descPool, &this->descriptorSetLayout, 1);
+        std::vector<DescriptorAllocator::Binding> bindings;
 
         auto& entities3dInfoMap = this->sceneInfo.entities3dInfoMap;
         for (auto& ent3dCreInf : entities3dInfoMap) // For all 3D entities.
@@ -586,35 +1141,44 @@ struct SceneData
 
             if (false == this->isDescriptorSetAlreadyCreated(entityName)) // If not already created.
             {
-                std::cout << "  >>> setupDescriptorSet: adding descriptor sets for entity: " << entityName << "\n";
-
-                VkDescriptorSet descSet;
-                VK_CHECK_RESULT(vkAllocateDescriptorSets(dev->logicalDevice, &descripotrSetAllocInfo, &descSet));
-                std::cout << "  >>> setupDescriptorSet: adding write descriptor set for UBO " << writeDescriptorSets.size() << "\n";
-                writeDescriptorSets = {
-                    // Binding 0 - unifirm buffer.
-                    vks::initializers::writeDescriptorSet(descSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,	0, &this->uniformBuffers.scene.descriptor), // Binding 0 : Vertex shader uniform buffer
+                bindings = {
+                    // Binding 0 : Vertex shader uniform buffer
+                    DescriptorAllocator::Binding::buffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, this->uniformBuffers.scene.descriptor),
                 };
 
                 textures_set_name_t& texSetName = entity3dInfo.texturesSetName;
                 TextureSetInfo& texSetInfo = this->sceneInfo.texturesSetInfoMap[texSetName];
-                auto& texturesNames = texSetInfo.texturesNames;
 
-                for (texture_name_t& texName : texturesNames)
+                for (texture_name_t& texName : texSetInfo.texturesNames)
                 {
-                    auto& textureDescriptor = this->texturesMap[texName].descriptor;
-                    std::cout << "  >>> setupDescriptorSet: adding write descriptor set for sampler " << writeDescriptorSets.size() << ": " << texSetName << "/" << texName << "\n";
-                    writeDescriptorSets.push_back(
+                    bindings.push_back(
                         // Binding i : Fragment shader combined sampler - for every texture
-                        vks::initializers::writeDescriptorSet(descSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, writeDescriptorSets.size(), &textureDescriptor)
+                        DescriptorAllocator::Binding::image(bindings.size(), VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, this->texturesMap[texName].descriptor)
                     );
                 }
 
-                vkUpdateDescriptorSets(dev->logicalDevice, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
-
-                this->descriptorSetsMap[entityName] = std::move(descSet);
+                this->descriptorSetsMap[entityName] = this->descriptorAllocator.getCachedSet(this->descriptorSetLayout, bindings);
             }
         }
+
+        const DescriptorAllocator::Stats& stats = this->descriptorAllocator.getStats();
+        std::cout << "  >>> setupDescriptorSet: " << this->descriptorSetsMap.size() << " entities share " << stats.cachedSetCount
+                  << " descriptor sets\n";
+
+        // Transforms sets, one per region - requires prepareTransforms().
+        this->transformsSets.resize(this->transformsPendingRanges.size());
+        for (uint32_t region = 0; region < this->transformsSets.size(); region++)
+        {
+            VkDescriptorBufferInfo regionDescriptor = {};
+            regionDescriptor.buffer = this->uniformBuffers.transforms.buffer;
+            regionDescriptor.offset = region * this->transformsRegionStride;
+            regionDescriptor.range  = this->transforms.getNodeCount() * sizeof(glm::mat4);
+
+            this->transformsSets[region] = this->descriptorAllocator.allocate(this->transformsSetLayout);
+            VkWriteDescriptorSet transformsWrite =
+                vks::initializers::writeDescriptorSet(this->transformsSets[region], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &regionDescriptor);
+            vkUpdateDescriptorSets(dev->logicalDevice, 1, &transformsWrite, 0, NULL);
+        }
     }
 
     // } // PREPARING_DESCRIPTOR_SETS
@@ -631,160 +1195,195 @@ struct SceneData
     {
         VkPipelineLayout pipLayout;
 
+        const VkDescriptorSetLayout setLayouts[2] = { this->descriptorSetLayout, this->transformsSetLayout };
         VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo =
-            vks::initializers::pipelineLayoutCreateInfo( &this->descriptorSetLayout, 1); // 1 -> layout count.
+            vks::initializers::pipelineLayoutCreateInfo( setLayouts, 2); // 2 -> layout count: per-entity set, transforms set.
+
+        // Per-mesh position dequantization and entity's transform index, see EntityPushConstants.
+        VkPushConstantRange pushConstantRange =
+            vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(EntityPushConstants), 0);
+        pPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+        pPipelineLayoutCreateInfo.pPushConstantRanges    = &pushConstantRange;
 
         VK_CHECK_RESULT(vkCreatePipelineLayout(dev->logicalDevice, &pPipelineLayoutCreateInfo, nullptr, &pipLayout));
 
         this->pipelineLayout = pipLayout;
     }
 
-    /// In this method we create pipeline - one pipeline per drawable entity.
+    /// In this method we describe pipeline - one pipeline per used material permutation.
     /// We define:
-    /// * each step of the pipeline,
+    /// * each step of the pipeline (defaults of GraphicsPipelineDesc),
     /// * shader stages and its count,
     /// * vertex shader geometry input,
     /// * vertex shader attributes location, binding, format, offset,
-    /// * shader programs and its shader stages.
+    /// * shader programs and its shader stages,
+    /// * material's specialization constants for fragment shader.
+    /// Actual vkCreateGraphicsPipelines happens on PipelineCompiler's worker threads.
     /// It requires:
-    /// * vks::VulkanDevice*
     /// * VkRenderPass       // for VkPipelineCreateInfo
-    /// * VkPipelineCache    // for vkCreateGraphicsPipelines
     /// * vertex bind id
-    void prepareSinglePipeline(vks::VulkanDevice* dev,
-                         VkRenderPass renderPass,
-                         VkPipelineCache pipelineCache,
+    void prepareSinglePipelineDesc(VkRenderPass renderPass,
                          std::vector<shader_name_t>& shaderNamesVec,
+                         const MaterialInfo& materialInfo,
                          std::vector<VkVertexInputBindingDescription>&   bindingDescriptions,
                          std::vector<VkVertexInputAttributeDescription>& attributeDescriptions,
-                         VkPipeline& pipelineToPrep)
-    {
-        VkPipelineInputAssemblyStateCreateInfo inputAssemblyState =
-            vks::initializers::pipelineInputAssemblyStateCreateInfo(
-                VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-                0,
-                VK_FALSE);
-
-        VkPipelineRasterizationStateCreateInfo rasterizationState =
-            vks::initializers::pipelineRasterizationStateCreateInfo(
-                VK_POLYGON_MODE_FILL,
-                VK_CULL_MODE_BACK_BIT,
-                VK_FRONT_FACE_CLOCKWISE,
-                0);
-
-        VkPipelineColorBlendAttachmentState blendAttachmentState =
-            vks::initializers::pipelineColorBlendAttachmentState(
-                0xf,
-                VK_FALSE);
-
-        VkPipelineColorBlendStateCreateInfo colorBlendState =
-            vks::initializers::pipelineColorBlendStateCreateInfo(
-                1,
-                &blendAttachmentState);
-
-        VkPipelineDepthStencilStateCreateInfo depthStencilState =
-            vks::initializers::pipelineDepthStencilStateCreateInfo(
-                VK_TRUE,
-                VK_TRUE,
-                VK_COMPARE_OP_LESS_OR_EQUAL);
-
-        VkPipelineViewportStateCreateInfo viewportState =
-            vks::initializers::pipelineViewportStateCreateInfo(1, 1, 0);
-
-        VkPipelineMultisampleStateCreateInfo multisampleState =
-            vks::initializers::pipelineMultisampleStateCreateInfo(
-                VK_SAMPLE_COUNT_1_BIT,
-                0);
-
-        std::vector<VkDynamicState> dynamicStateEnables = {
-            VK_DYNAMIC_STATE_VIEWPORT,
-            VK_DYNAMIC_STATE_SCISSOR
-        };
-        VkPipelineDynamicStateCreateInfo dynamicState =
-            vks::initializers::pipelineDynamicStateCreateInfo(
-                dynamicStateEnables.data(),
-                dynamicStateEnables.size(),
-                0);
-
-        // Load shaders
-        std::vector<VkPipelineShaderStageCreateInfo> shaderStages(shaderNamesVec.size());
-
-        VkGraphicsPipelineCreateInfo pipelineCreateInfo =
-            vks::initializers::pipelineCreateInfo(
-                this->pipelineLayout,
-                renderPass,
-                0);
-
-        pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
-        pipelineCreateInfo.pRasterizationState = &rasterizationState;
-        pipelineCreateInfo.pColorBlendState    = &colorBlendState;
-        pipelineCreateInfo.pMultisampleState   = &multisampleState;
-        pipelineCreateInfo.pViewportState      = &viewportState;
-        pipelineCreateInfo.pDepthStencilState  = &depthStencilState;
-        pipelineCreateInfo.pDynamicState       = &dynamicState;
-        pipelineCreateInfo.stageCount          = shaderStages.size();
-        pipelineCreateInfo.pStages             = shaderStages.data();
-
-        // This example uses one input state - for non-instanced rendering
-        VkPipelineVertexInputStateCreateInfo inputState = vks::initializers::pipelineVertexInputStateCreateInfo();
-
-        inputState.vertexBindingDescriptionCount = bindingDescriptions.size();
-        inputState.pVertexBindingDescriptions    = bindingDescriptions.data();
+                         GraphicsPipelineDesc& pipelineDescToPrep)
+    {
+        pipelineDescToPrep = GraphicsPipelineDesc(this->pipelineLayout, renderPass);
 
-        inputState.vertexAttributeDescriptionCount = attributeDescriptions.size();
-        inputState.pVertexAttributeDescriptions    = attributeDescriptions.data();
+        if (this->sceneInfo.isDepthPrepassEnabled()) // Depth is complete after the pre-pass - shade only the visible surface.
+        {
+            pipelineDescToPrep.depthStencilState.depthWriteEnable = VK_FALSE;
+            pipelineDescToPrep.depthStencilState.depthCompareOp   = VK_COMPARE_OP_EQUAL;
+        }
 
-        pipelineCreateInfo.pVertexInputState = &inputState;
+        // This example uses one input state - for non-instanced rendering
+        pipelineDescToPrep.bindingDescriptions   = bindingDescriptions;
+        pipelineDescToPrep.attributeDescriptions = attributeDescriptions;
 
         // SCENE_SPECIFIC {
 
-        uint8_t shadStCounter = 0u;
         for (const shader_name_t& shadName : shaderNamesVec) // Order is not relevant.
         {
-            shaderStages[shadStCounter++] = this->shadersMap[shadName];
+            pipelineDescToPrep.shaderStages.push_back(this->shadersMap[shadName]);
         }
 
-        VK_CHECK_RESULT(vkCreateGraphicsPipelines(dev->logicalDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelineToPrep));
+        MaterialSpecData specData(materialInfo);
+        pipelineDescToPrep.setSpecialization(VK_SHADER_STAGE_FRAGMENT_BIT, getMaterialSpecMapEntries(), &specData, sizeof(specData));
 
         // } // SCENE_SPECIFIC
     }
 
+    /// Depth-only pipeline of the pre-pass: position-only vertex stream, no fragment shader, no color writes.
+    void prepareDepthPrepassPipelineDesc(VkRenderPass renderPass, uint32_t vertedBindId, GraphicsPipelineDesc& pipelineDescToPrep)
+    {
+        pipelineDescToPrep = GraphicsPipelineDesc(this->pipelineLayout, renderPass);
+
+        pipelineDescToPrep.bindingDescriptions = {
+            vks::initializers::vertexInputBindingDescription(vertedBindId, this->sceneInfo.getPositionStride(), VK_VERTEX_INPUT_RATE_VERTEX),
+        };
+        pipelineDescToPrep.attributeDescriptions = {
+            vks::initializers::vertexInputAttributeDescription(vertedBindId, 0,
+                this->sceneInfo.useCompactVertices ? VK_FORMAT_R16G16B16A16_SNORM : VK_FORMAT_R32G32B32_SFLOAT, 0), // Location 0: Position
+        };
+
+        pipelineDescToPrep.blendAttachmentStates[0].colorWriteMask = 0;
+
+        ShaderSetInfo& shadSetInfo = this->sceneInfo.shadersSetInfoMap[this->sceneInfo.depthPrepassShadersSetName];
+        for (const shader_name_t& shadName : shadSetInfo.shadersNames)
+        {
+            pipelineDescToPrep.shaderStages.push_back(this->shadersMap[shadName]);
+        }
+    }
+
+    /// Pipelines are created per used permutation (shaders set + material), not per entity.
+    /// All of them are compiled in parallel by PipelineCompiler.
+    /// The full-featured permutation (getDefaultMaterial()) of every shader set is compiled right away and it is a placeholder
+    /// for every other permutation of this shader set, which are compiled in the background.
+    /// Placeholders are replaced in updatePendingPipelines().
     void preparePipelines(vks::VulkanDevice* dev, VkRenderPass renderPass, VkPipelineCache pipelineCache, uint32_t vertedBindId, std::string assetsPath, std::vector<VkShaderModule> shaderModules)
     {
+        this->pipelineCompiler.reset(new PipelineCompiler(dev->logicalDevice, pipelineCache));
+
     // SCENE_SPECIFIC {
 
         std::vector<VkVertexInputBindingDescription> vertInputBindingDescriptions = {
             // Binding point: Mesh vertex layout description at per-vertex rate
-            vks::initializers::vertexInputBindingDescription(vertedBindId, this->sceneInfo.vertexLayout.stride(), VK_VERTEX_INPUT_RATE_VERTEX),
+            vks::initializers::vertexInputBindingDescription(vertedBindId, this->sceneInfo.getVertexStride(), VK_VERTEX_INPUT_RATE_VERTEX),
         };
 
-        std::vector<VkVertexInputAttributeDescription> vertInputAttributeDescriptions = {
-            // Per-vertex attributees
-            // These are advanced for each vertex fetched by the vertex shader
-            vks::initializers::vertexInputAttributeDescription(vertedBindId, 0, VK_FORMAT_R32G32B32_SFLOAT, 0),                     // Location 0: Position
-            vks::initializers::vertexInputAttributeDescription(vertedBindId, 1, VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 3),     // Location 1: Normal
-            vks::initializers::vertexInputAttributeDescription(vertedBindId, 2, VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 6),     // Location 2: Tangent
-            vks::initializers::vertexInputAttributeDescription(vertedBindId, 3, VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 9),     // Location 3: Bitangent
-            vks::initializers::vertexInputAttributeDescription(vertedBindId, 4, VK_FORMAT_R32G32_SFLOAT,    sizeof(float) * 12),    // Location 4: Texture coordinates
-            vks::initializers::vertexInputAttributeDescription(vertedBindId, 5, VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 14),    // Location 5: Color
-        };
+        std::vector<VkVertexInputAttributeDescription> vertInputAttributeDescriptions;
+        if (this->sceneInfo.useCompactVertices)
+        {
+            vertInputAttributeDescriptions = {
+                // CompactVertex - bitangent is reconstructed from normal, tangent and sign in Position.w, no color
+                vks::initializers::vertexInputAttributeDescription(vertedBindId, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(CompactVertex, pos)),     // Location 0: Position + bitangent sign
+                vks::initializers::vertexInputAttributeDescription(vertedBindId, 1, VK_FORMAT_R16G16_SNORM,       offsetof(CompactVertex, normal)),  // Location 1: Normal, octahedral
+                vks::initializers::vertexInputAttributeDescription(vertedBindId, 2, VK_FORMAT_R16G16_SNORM,       offsetof(CompactVertex, tangent)), // Location 2: Tangent, octahedral
+                vks::initializers::vertexInputAttributeDescription(vertedBindId, 4, VK_FORMAT_R16G16_SFLOAT,      offsetof(CompactVertex, uv)),      // Location 4: Texture coordinates
+            };
+        }
+        else
+        {
+            vertInputAttributeDescriptions = {
+                // Per-vertex attributees
+                // These are advanced for each vertex fetched by the vertex shader
+                vks::initializers::vertexInputAttributeDescription(vertedBindId, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(MeshVertex, pos)),       // Location 0: Position
+                vks::initializers::vertexInputAttributeDescription(vertedBindId, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(MeshVertex, normal)),    // Location 1: Normal
+                vks::initializers::vertexInputAttributeDescription(vertedBindId, 2, VK_FORMAT_R32G32B32_SFLOAT, offsetof(MeshVertex, tangent)),   // Location 2: Tangent
+                vks::initializers::vertexInputAttributeDescription(vertedBindId, 3, VK_FORMAT_R32G32B32_SFLOAT, offsetof(MeshVertex, bitangent)), // Location 3: Bitangent
+                vks::initializers::vertexInputAttributeDescription(vertedBindId, 4, VK_FORMAT_R32G32_SFLOAT,    offsetof(MeshVertex, uv)),        // Location 4: Texture coordinates
+                vks::initializers::vertexInputAttributeDescription(vertedBindId, 5, VK_FORMAT_R32G32B32_SFLOAT, offsetof(MeshVertex, color)),     // Location 5: Color
+            };
+        }
+
+        std::map<pipeline_key_t, GraphicsPipelineDesc> placeholderDescs; // Per shaders set, by pipeline key.
+        std::map<pipeline_key_t, GraphicsPipelineDesc> permutationDescs; // Per used permutation, by pipeline key.
+        std::map<pipeline_key_t, pipeline_key_t>       placeholderOfPermutation;
 
         for (auto& [entityName, entity3dInfo] : this->sceneInfo.entities3dInfoMap)
         {
-            if (false == this->isPipelineAlreadyCreated(entityName))
-            {
-                std::cout << " >>> preparePipelines: creating pipeline for entity: " << entityName << "\n";
+            shaders_set_name_t& shadSetName = entity3dInfo.shadersSetName;
+            ShaderSetInfo&      shadSetInfo = this->sceneInfo.shadersSetInfoMap[shadSetName];
+            auto& shaderNames = shadSetInfo.shadersNames;
+
+            const MaterialInfo   materialInfo   = this->sceneInfo.getEntityMaterial(entity3dInfo);
+            const pipeline_key_t pipelineKey    = getPipelineKey(shadSetName, materialInfo);
+            const pipeline_key_t placeholderKey = getPipelineKey(shadSetName, getDefaultMaterial());
+
+            this->entityPipelineKeyMap[entityName] = pipelineKey;
 
-                shaders_set_name_t& shadSetName = entity3dInfo.shadersSetName;
-                ShaderSetInfo&      shadSetInfo = this->sceneInfo.shadersSetInfoMap[shadSetName];
-                auto& shaderNames = shadSetInfo.shadersNames;
+            if (false == this->isPipelineAlreadyCreated(placeholderKey) && placeholderDescs.find(placeholderKey) == placeholderDescs.end())
+            {
+                std::cout << " >>> preparePipelines: creating placeholder pipeline: " << placeholderKey << "\n";
+                this->prepareSinglePipelineDesc(renderPass, shaderNames, getDefaultMaterial(), vertInputBindingDescriptions, vertInputAttributeDescriptions, placeholderDescs[placeholderKey]);
+            }
 
-                VkPipeline pip;
-                this->prepareSinglePipeline(dev, renderPass, pipelineCache, shaderNames, vertInputBindingDescriptions, vertInputAttributeDescriptions, pip);
-                this->pipelinesMap[entityName] = std::move(pip);
+            if (pipelineKey != placeholderKey && false == this->isPipelineAlreadyCreated(pipelineKey) && permutationDescs.find(pipelineKey) == permutationDescs.end())
+            {
+                this->prepareSinglePipelineDesc(renderPass, shaderNames, materialInfo, vertInputBindingDescriptions, vertInputAttributeDescriptions, permutationDescs[pipelineKey]);
+                placeholderOfPermutation[pipelineKey] = placeholderKey;
             }
         }
 
+        // Permutations - in the background.
+        for (auto& [pipelineKey, pipDesc] : permutationDescs)
+        {
+            this->pendingPipelinesMap[pipelineKey] = this->pipelineCompiler->compileAsync(pipDesc);
+        }
+
+        // Placeholders - right away, in parallel.
+        std::vector<pipeline_key_t>       immediateKeys;
+        std::vector<GraphicsPipelineDesc> immediateDescs;
+        for (auto& [pipelineKey, pipDesc] : placeholderDescs)
+        {
+            immediateKeys.push_back(pipelineKey);
+            immediateDescs.push_back(std::move(pipDesc));
+        }
+
+        if (this->sceneInfo.isDepthPrepassEnabled()) // Stored in pipelinesMap by its shaders set name.
+        {
+            immediateKeys.push_back(this->sceneInfo.depthPrepassShadersSetName);
+            immediateDescs.emplace_back();
+            this->prepareDepthPrepassPipelineDesc(renderPass, vertedBindId, immediateDescs.back());
+        }
+
+        std::vector<VkPipeline> immediatePipelines;
+        this->pipelineCompiler->compile(immediateDescs, immediatePipelines);
+
+        for (size_t i = 0; i < immediateKeys.size(); i++)
+        {
+            this->pipelinesMap[immediateKeys[i]] = immediatePipelines[i];
+        }
+
+        // Placeholders until background pipelines are ready - same layout, render pass and vertex input.
+        for (auto& [pipelineKey, placeholderKey] : placeholderOfPermutation)
+        {
+            this->pipelinesMap[pipelineKey] = this->pipelinesMap[placeholderKey];
+        }
+
+        std::cout << " >>> preparePipelines: " << immediateKeys.size() << " placeholder(s), " << permutationDescs.size() << " permutation(s) in background\n";
+
     // } // SCENE_SPECIFIC
     }
 
@@ -798,6 +1397,8 @@ struct SceneData
     /// * VertexBuffers
     /// * IndexBuffer
     /// Then we insert draw command with: vkCmdDrawIndexed.
+    /// Entities are drawn front-to-back (entityDrawOrder), with depth pre-pass enabled
+    /// all of them are drawn with the depth-only pipeline first.
     /// It requires:
     /// * VkCommandBuffer
     /// * VkPipelineBindPoint
@@ -809,26 +1410,58 @@ struct SceneData
     /// * VkBuffer*              // buffer with index data
     /// * VkIndexType
     /// * index count
-    void recordDrawCommandsForEntities(VkCommandBuffer& drawCmdBuffer, uint32_t vertexBufferBindId, const VkDeviceSize* offsets)
+    /// Every draw is a profiler scope named after its entity (pre-pass and shading draws are summed up),
+    /// frameIndex is the index of the command buffer.
+    void recordDrawCommandsForEntities(VkCommandBuffer& drawCmdBuffer, uint32_t vertexBufferBindId, const VkDeviceSize* offsets,
+                                       GpuProfiler& profiler, uint32_t frameIndex)
     { // This is fully scene specific.
-        for (auto& entCreInfMap : this->sceneInfo.entities3dInfoMap)
+        // World matrices of this command buffer's region - set 1 stays bound while per-entity sets (set 0) change.
+        vkCmdBindDescriptorSets(drawCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipelineLayout, 1, 1, &this->transformsSets[frameIndex], 0, NULL);
+
+        // Depth pre-pass - same entities, same order, same LODs.
+        if (this->sceneInfo.isDepthPrepassEnabled())
         {
-            entity_name_t entName   = entCreInfMap.first;
-            Entity3dInfo& entCreInf = entCreInfMap.second;
+            vkCmdBindPipeline(drawCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipelinesMap[this->sceneInfo.depthPrepassShadersSetName]);
+
+            for (const entity_name_t& entName : this->entityDrawOrder)
+            {
+                mesh_name_t& modelName = this->sceneInfo.entities3dInfoMap[entName].meshName;
+
+                auto& descrSet = this->descriptorSetsMap[entName];
+                auto& model    = this->meshesMap[modelName];
+                auto& lod      = this->sceneInfo.meshesInfoMap[modelName].lods[this->entityLodMap[entName]];
+                const EntityPushConstants pushConstants = { model.dequant, this->getEntityTransformIndex(entName) };
+
+                vkCmdBindDescriptorSets(drawCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipelineLayout, 0, 1, &descrSet, 0, NULL);
+                vkCmdPushConstants(drawCmdBuffer,      this->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(EntityPushConstants), &pushConstants);
+                vkCmdBindVertexBuffers(drawCmdBuffer,  vertexBufferBindId, 1, &(model.positions.buffer), offsets);
+                vkCmdBindIndexBuffer(drawCmdBuffer,    model.indices.buffer,  0, VK_INDEX_TYPE_UINT32);
+                profiler.beginScope(drawCmdBuffer, frameIndex, entName);
+                vkCmdDrawIndexed(drawCmdBuffer,        lod.indexCount,        1, lod.firstIndex, 0, 0);
+                profiler.endScope(drawCmdBuffer, frameIndex);
+            }
+        }
+
+        for (const entity_name_t& entName : this->entityDrawOrder)
+        {
+            Entity3dInfo& entCreInf = this->sceneInfo.entities3dInfoMap[entName];
 
             mesh_name_t& modelName = entCreInf.meshName;
 
             auto& descrSet = this->descriptorSetsMap[entName];
-            auto& pipeline = this->pipelinesMap[entName];
+            auto& pipeline = this->pipelinesMap[this->entityPipelineKeyMap[entName]];
             auto& model    = this->meshesMap[modelName];
-
-            std::cout << " >>> buildCommandBuffer: building draw command buffer for entity: " << entName << "\n";
+            auto& lod      = this->sceneInfo.meshesInfoMap[modelName].lods[this->entityLodMap[entName]];
+            const EntityPushConstants pushConstants = { model.dequant, this->getEntityTransformIndex(entName) };
 
             vkCmdBindDescriptorSets(drawCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipelineLayout, 0, 1, &descrSet, 0, NULL);
             vkCmdBindPipeline(drawCmdBuffer,       VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+            vkCmdPushConstants(drawCmdBuffer,      this->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(EntityPushConstants), &pushConstants);
             vkCmdBindVertexBuffers(drawCmdBuffer,  vertexBufferBindId, 1, &(model.vertices.buffer), offsets);
             vkCmdBindIndexBuffer(drawCmdBuffer,    model.indices.buffer,  0, VK_INDEX_TYPE_UINT32);
-            vkCmdDrawIndexed(drawCmdBuffer,        model.indexCount,      1, 0, 0, 0);
+            profiler.beginScope(drawCmdBuffer, frameIndex, entName);
+            vkCmdDrawIndexed(drawCmdBuffer,        lod.indexCount,        1, lod.firstIndex, 0, 0);
+            profiler.endScope(drawCmdBuffer, frameIndex);
         }
     }
 
@@ -836,6 +1469,392 @@ struct SceneData
 
 // RUNTIME {
 
+    /// Swaps placeholder pipelines for the ones finished in the background.
+    /// Returns true if any pipeline was swapped - command buffers have to be rebuilt then.
+    bool updatePendingPipelines()
+    {
+        if (this->pendingPipelinesMap.empty())
+        {
+            return false;
+        }
+
+        uint32_t swappedCount = 0u;
+        for (auto it = this->pendingPipelinesMap.begin(); it != this->pendingPipelinesMap.end(); )
+        {
+            VkPipeline pip;
+            if (this->pipelineCompiler->tryGetResult(it->second, pip))
+            {
+                this->pipelinesMap[it->first] = pip;
+                it = this->pendingPipelinesMap.erase(it);
+                swappedCount++;
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        if (swappedCount > 0u) // One line per call - it runs in the frame loop.
+        {
+            std::cout << " >>> updatePendingPipelines: " << swappedCount << " pipeline(s) ready, " << this->pendingPipelinesMap.size() << " pending\n";
+        }
+
+        if (swappedCount > 0u && this->pendingPipelinesMap.empty())
+        {
+            this->pipelineCompiler->mergeCaches();
+        }
+
+        return swappedCount > 0u;
+    }
+
+    /// Recomputes world matrices of moved transform nodes (see TransformHierarchy), marks the changed range
+    /// pending in every region of the transforms buffer and refits BVH leaves of entities that moved.
+    /// Call before updateDrawOrder(). Command buffers read matrices from the buffer, so they do not have to be rebuilt.
+    /// Returns true if anything moved.
+    bool updateTransforms()
+    {
+        if (false == this->transforms.update())
+        {
+            return false;
+        }
+
+        uint32_t first, count;
+        this->transforms.getUpdatedRange(first, count);
+        for (std::pair<uint32_t, uint32_t>& pending : this->transformsPendingRanges)
+        {
+            pending = (pending.first == pending.second) ? std::make_pair(first, first + count)
+                                                        : std::make_pair(std::min(pending.first, first), std::max(pending.second, first + count));
+        }
+
+        for (uint32_t index = first; index < first + count; index++)
+        {
+            const transform_node_t node = this->transforms.getNode(index);
+            if (this->transforms.wasUpdated(node) && false == this->transformEntityNames[node].empty())
+            {
+                this->updateEntityBounds(this->transformEntityNames[node], this->transforms.getWorld(node));
+            }
+        }
+        return true;
+    }
+
+    /// Copies matrices changed since the last flush of the region to it.
+    /// The last submit of command buffer `region` has to be finished (ie. its fence waited for), so no frame reads it.
+    void flushTransforms(uint32_t region)
+    {
+        std::pair<uint32_t, uint32_t>& pending = this->transformsPendingRanges[region];
+        if (pending.first == pending.second)
+        {
+            return;
+        }
+
+        glm::mat4* regionMapped = reinterpret_cast<glm::mat4*>(static_cast<uint8_t*>(this->uniformBuffers.transforms.mapped) + region * this->transformsRegionStride);
+        memcpy(regionMapped + pending.first, &this->transforms.getWorldMatrices()[pending.first], (pending.second - pending.first) * sizeof(glm::mat4));
+        pending = std::make_pair(0u, 0u);
+    }
+
+    /// Index of entity's world matrix in the transforms buffer.
+    uint32_t getEntityTransformIndex(const entity_name_t& entityName) const
+    {
+        return this->transforms.getIndex(this->transformNodeMap.at(entityName));
+    }
+
+    /// Mesh's bounding sphere moved by entity's world matrix - as is without prepareTransforms().
+    BoundingSphere getEntityBoundingSphere(const entity_name_t& entityName)
+    {
+        BoundingSphere sphere = this->sceneInfo.meshesInfoMap[this->sceneInfo.entities3dInfoMap[entityName].meshName].boundingSphere;
+
+        auto nodeIt = this->transformNodeMap.find(entityName);
+        if (nodeIt != this->transformNodeMap.end())
+        {
+            const glm::mat4& world  = this->transforms.getWorld(nodeIt->second);
+            const glm::vec4  center = world * glm::vec4(sphere.center[0], sphere.center[1], sphere.center[2], 1.0f);
+            const float      scale  = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+            sphere.center[0] = center.x;
+            sphere.center[1] = center.y;
+            sphere.center[2] = center.z;
+            sphere.radius   *= scale;
+        }
+        return sphere;
+    }
+
+    /// Picks LOD of every visible entity (entityDrawOrder) from projected size of its bounding sphere, see getEntityBoundingSphere().
+    /// Returns true if any LOD changed - command buffers have to be rebuilt then.
+    bool updateEntityLods(const glm::mat4& viewMat, const glm::mat4& perspMat)
+    {
+        const glm::vec4 camPos = glm::inverse(viewMat) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        const float     projScale = fabsf(perspMat[1][1]); // 1 / tan(fovY / 2)
+
+        bool anyChanged = false;
+        for (const entity_name_t& entityName : this->entityDrawOrder)
+        {
+            const Entity3dInfo&   entity3dInfo = this->sceneInfo.entities3dInfoMap[entityName];
+            const MeshInfo&       meshInfo = this->sceneInfo.meshesInfoMap[entity3dInfo.meshName];
+            const BoundingSphere  sphere   = this->getEntityBoundingSphere(entityName);
+
+            const glm::vec3 toCenter(sphere.center[0] - camPos.x, sphere.center[1] - camPos.y, sphere.center[2] - camPos.z);
+            const float     distance     = std::max(glm::length(toCenter), sphere.radius); // Inside the sphere -> full detail.
+            const float     screenRadius = distance > 0.0f ? sphere.radius * projScale / distance : 1.0f;
+
+            uint32_t& currentLod = this->entityLodMap[entityName];
+            const uint32_t newLod = selectLod(currentLod, meshInfo.lods.size(), screenRadius);
+            if (newLod != currentLod)
+            {
+                currentLod = newLod;
+                anyChanged = true;
+            }
+        }
+
+        return anyChanged;
+    }
+
+    /// Frustum culls entities with the BVH and keeps visible ones roughly front-to-back
+    /// by distance from the camera to their bounding spheres, so hidden fragments fail the depth test early:
+    /// * entities become visible in the frustum, but stay visible until CULL_KEEP_MARGIN outside of it
+    /// * entities which stay visible keep their place, newly visible ones are merged in by distance
+    /// * whole order is re-sorted only when it gets too far off, see DRAW_ORDER_RESORT_THRESHOLD
+    /// so a moving camera does not change the order (and re-record command buffers) every frame.
+    /// Returns true if the visible set or the order changed - command buffers have to be rebuilt then.
+    bool updateDrawOrder(const glm::mat4& viewMat, const glm::mat4& perspMat)
+    {
+        const glm::vec4 camPos = glm::inverse(viewMat) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        this->drawOrderAge++;
+
+        FrustumPlanes frustumPlanes;
+        extractFrustumPlanes(perspMat * viewMat, frustumPlanes);
+        FrustumPlanes keepPlanes = frustumPlanes; // Planes are normalized - d moves them outwards in world units.
+        for (uint32_t i = 0; i < 6u; i++)
+        {
+            keepPlanes.d[i] += CULL_KEEP_MARGIN;
+        }
+
+        std::vector<uint32_t> visibleIds;
+        this->bvh.queryFrustum(frustumPlanes, visibleIds);
+
+        std::vector<float>   distances(this->bvhEntityNames.size(), 0.0f);
+        std::vector<uint8_t> visible(this->bvhEntityNames.size(), 0u);
+        for (uint32_t visibleId : visibleIds)
+        {
+            const BoundingSphere sphere = this->getEntityBoundingSphere(this->bvhEntityNames[visibleId]);
+            const glm::vec3 toCenter(sphere.center[0] - camPos.x, sphere.center[1] - camPos.y, sphere.center[2] - camPos.z);
+            distances[visibleId] = glm::length(toCenter) - sphere.radius; // Nearest point - big entities (floor) go first.
+            visible[visibleId]   = 1u;
+        }
+
+        // Visible ones just outside of the frustum stay visible.
+        std::vector<uint32_t> keptIds;
+        if (false == this->drawOrderIds.empty())
+        {
+            this->bvh.queryFrustum(keepPlanes, keptIds);
+        }
+        std::vector<uint8_t> wasVisible(this->bvhEntityNames.size(), 0u);
+        for (uint32_t id : this->drawOrderIds)
+        {
+            wasVisible[id] = 1u;
+        }
+        for (uint32_t keptId : keptIds)
+        {
+            if (wasVisible[keptId] == 1u && visible[keptId] == 0u)
+            {
+                const BoundingSphere sphere = this->getEntityBoundingSphere(this->bvhEntityNames[keptId]);
+                const glm::vec3 toCenter(sphere.center[0] - camPos.x, sphere.center[1] - camPos.y, sphere.center[2] - camPos.z);
+                distances[keptId] = glm::length(toCenter) - sphere.radius;
+                visible[keptId]   = 1u;
+            }
+        }
+        auto isNearer = [&distances](uint32_t a, uint32_t b) { return distances[a] < distances[b]; };
+
+        // Still visible ones in their current order...
+        keptIds.clear();
+        for (uint32_t id : this->drawOrderIds)
+        {
+            if (visible[id] == 1u)
+            {
+                keptIds.push_back(id);
+                visible[id] = 2u;
+            }
+        }
+        // ...merged with newly visible ones, sorted.
+        std::vector<uint32_t> addedIds;
+        for (uint32_t visibleId : visibleIds)
+        {
+            if (visible[visibleId] == 1u)
+            {
+                addedIds.push_back(visibleId);
+            }
+        }
+        std::sort(addedIds.begin(), addedIds.end(), isNearer);
+
+        std::vector<uint32_t> newIds;
+        newIds.reserve(keptIds.size() + addedIds.size());
+        size_t addedPos = 0u;
+        for (uint32_t keptId : keptIds) // Kept ones are only roughly sorted - no std::merge.
+        {
+            while (addedPos < addedIds.size() && isNearer(addedIds[addedPos], keptId))
+            {
+                newIds.push_back(addedIds[addedPos++]);
+            }
+            newIds.push_back(keptId);
+        }
+        newIds.insert(newIds.end(), addedIds.begin() + addedPos, addedIds.end());
+        bool changed = keptIds.size() != this->drawOrderIds.size() || false == addedIds.empty();
+
+        uint32_t outOfOrder = 0u;
+        for (size_t i = 1; i < newIds.size(); i++)
+        {
+            outOfOrder += isNearer(newIds[i], newIds[i - 1u]) ? 1u : 0u;
+        }
+        if (this->drawOrderAge >= DRAW_ORDER_RESORT_FRAMES && float(outOfOrder) > DRAW_ORDER_RESORT_THRESHOLD * float(newIds.size()))
+        {
+            std::stable_sort(newIds.begin(), newIds.end(), isNearer);
+            this->drawOrderAge = 0u;
+            changed = true;
+        }
+
+        if (false == changed)
+        {
+            return false;
+        }
+
+        this->drawOrderIds.swap(newIds);
+        this->entityDrawOrder.clear();
+        for (uint32_t id : this->drawOrderIds)
+        {
+            this->entityDrawOrder.push_back(this->bvhEntityNames[id]);
+        }
+        return true;
+    }
+
+    /// Next updateDrawOrder() starts from scratch - nothing visible, order sorted anew.
+    void resetDrawOrder()
+    {
+        this->entityDrawOrder.clear();
+        this->drawOrderIds.clear();
+        this->drawOrderAge = 0u;
+    }
+
+    /// Marks textures of visible entities (entityDrawOrder) as used, lets textureResidency evict or reload mip levels
+    /// and points descriptor sets to the textures it replaced. Call after updateDrawOrder().
+    /// Returns true if any texture was replaced - command buffers have to be rebuilt then.
+    bool updateTextureResidency(vks::VulkanDevice* dev)
+    {
+        this->residencyFrame++;
+        for (const entity_name_t& entityName : this->entityDrawOrder)
+        {
+            const textures_set_name_t& texSetName = this->sceneInfo.entities3dInfoMap[entityName].texturesSetName;
+            for (const texture_name_t& texName : this->sceneInfo.texturesSetInfoMap[texSetName].texturesNames)
+            {
+                this->textureResidency.touch(texName, this->residencyFrame);
+            }
+        }
+
+        if (false == this->textureResidency.update(this->residencyFrame))
+        {
+            return false;
+        }
+
+        // Frames in flight keep reading the replaced images and old descriptor sets, both go in completeFrame().
+        const std::vector<texture_name_t> changed = this->textureResidency.applyChanges();
+        if (changed.empty())
+        {
+            return false;
+        }
+
+        this->updateTextureDescriptors(dev, changed);
+        return true;
+    }
+
+    /// Switches entities whose descriptor sets use any of given textures to sets with the new sampler bindings -
+    /// once per shared set. Old sets are not rewritten, frames in flight may still use them.
+    void updateTextureDescriptors(vks::VulkanDevice* dev, const std::vector<texture_name_t>& changedTextures)
+    {
+        std::map<VkDescriptorSet, VkDescriptorSet> replacedSets; // Old -> new, for entities sharing a set.
+        for (auto& descSetIt : this->descriptorSetsMap)
+        {
+            auto replacedIt = replacedSets.find(descSetIt.second);
+            if (replacedIt != replacedSets.end())
+            {
+                descSetIt.second = replacedIt->second;
+                continue;
+            }
+
+            std::vector<DescriptorAllocator::Binding> changedBindings;
+            const textures_set_name_t& texSetName = this->sceneInfo.entities3dInfoMap[descSetIt.first].texturesSetName;
+            const auto& texturesNames = this->sceneInfo.texturesSetInfoMap[texSetName].texturesNames;
+            for (uint32_t slot = 0; slot < texturesNames.size(); slot++)
+            {
+                if (std::find(changedTextures.begin(), changedTextures.end(), texturesNames[slot]) != changedTextures.end())
+                {
+                    changedBindings.push_back(
+                        // Binding slot + 1 : Fragment shader combined sampler, as in setupDescriptorSets()
+                        DescriptorAllocator::Binding::image(slot + 1u, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                            this->texturesMap[texturesNames[slot]].descriptor));
+                }
+            }
+
+            const VkDescriptorSet oldSet = descSetIt.second;
+            if (false == changedBindings.empty())
+            {
+                descSetIt.second = this->descriptorAllocator.replaceCachedSet(oldSet, changedBindings);
+            }
+            replacedSets[oldSet] = descSetIt.second;
+        }
+    }
+
+    /// The last submit of command buffer frameIndex is done - images and descriptor sets replaced by
+    /// updateTextureResidency() which no other frame in flight can use are released.
+    void completeFrame(uint32_t frameIndex)
+    {
+        this->textureResidency.completeFrame(frameIndex);
+        this->descriptorAllocator.resetFrame(frameIndex);
+    }
+
+    /// Refits entity's BVH leaf after its model matrix changed. Cheap unless bounds leave the leaf's fat AABB.
+    void updateEntityBounds(const entity_name_t& entityName, const glm::mat4& modelMat)
+    {
+        const Aabb& meshBounds = this->sceneInfo.meshesInfoMap[this->sceneInfo.entities3dInfoMap[entityName].meshName].bounds;
+        this->bvh.moveProxy(this->entityProxyMap[entityName], transformAabb(meshBounds, modelMat));
+    }
+
+    /// Nearest entity whose bounds are hit by the ray. Returns false if nothing was hit.
+    bool pickEntity(const glm::vec3& rayOrigin, const glm::vec3& rayDir, entity_name_t& outEntityName, float& outDistance)
+    {
+        const float origin[3] = {rayOrigin.x, rayOrigin.y, rayOrigin.z};
+        const float dir[3]    = {rayDir.x,    rayDir.y,    rayDir.z};
+
+        uint32_t hitId;
+        if (false == this->bvh.raycast(origin, dir, INFINITY, hitId, outDistance))
+        {
+            return false;
+        }
+        outEntityName = this->bvhEntityNames[hitId];
+        return true;
+    }
+
+    /// Entity with bounds nearest to the point. Returns false for an empty scene.
+    bool findNearestEntity(const glm::vec3& point, entity_name_t& outEntityName, float& outDistance)
+    {
+        const float p[3] = {point.x, point.y, point.z};
+
+        uint32_t nearestId;
+        if (false == this->bvh.queryNearest(p, nearestId, outDistance))
+        {
+            return false;
+        }
+        outEntityName = this->bvhEntityNames[nearestId];
+        return true;
+    }
+
+    /// Triangles drawn with current LODs.
+    uint32_t getDrawnTriangleCount()
+    {
+        uint32_t triangles = 0u;
+        for (const entity_name_t& entityName : this->entityDrawOrder)
+        {
+            triangles += this->sceneInfo.meshesInfoMap[this->sceneInfo.entities3dInfoMap[entityName].meshName].lods[this->entityLodMap[entityName]].indexCount / 3u;
+        }
+        return triangles;
+    }
+
     void updateUniformBuffers(bool viewChanged, glm::mat4& viewMat, glm::mat4& perspMat)
     {
         if (viewChanged)
@@ -859,14 +1878,22 @@ struct SceneData
 
     void destroy(VkDevice& dev)
     {
+        this->pipelineCompiler.reset(); // Joins workers, destroys pipelines nobody picked up.
+
+        std::set<VkPipeline> uniquePipelines; // Placeholders are shared between entities.
         for (auto& pipM : this->pipelinesMap)
         {
-            vkDestroyPipeline(dev, pipM.second, nullptr); // Here we have segfault when validation layers are active, probably driver bug.
+            uniquePipelines.insert(pipM.second);
+        }
+        for (VkPipeline pip : uniquePipelines)
+        {
+            vkDestroyPipeline(dev, pip, nullptr); // Here we have segfault when validation layers are active, probably driver bug.
         }
 
         vkDestroyPipelineLayout(dev, this->pipelineLayout, nullptr);
 
-        vkDestroyDescriptorSetLayout(dev, this->descriptorSetLayout, nullptr);
+        this->descriptorAllocator.destroy(); // Layouts, pools - and all sets with them.
+        this->textureResidency.destroy();    // Images replaced while frames were in flight.
 
         for (auto& modM : this->meshesMap)
         {
@@ -879,6 +1906,7 @@ struct SceneData
         }
 
         this->uniformBuffers.scene.destroy();
+        this->uniformBuffers.transforms.destroy();
     }
 
 // } // DESTROY
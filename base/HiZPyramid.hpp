@@ -0,0 +1,317 @@
+#pragma once
+
+#include <assert.h>
+#include <vulkan/vulkan.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <VulkanTools.h>
+#include <VulkanInitializers.hpp>
+#include <VulkanDevice.hpp>
+
+namespace vk229
+{
+
+//////////////////////////////////////
+/// Hierarchical depth buffer for GPU occlusion culling.
+/// Frame usage:
+/// * draw occluders depth-only into a depth image owned by the caller (ie. RenderGraph transient),
+///   which is in DEPTH_STENCIL_READ_ONLY_OPTIMAL layout and visible to compute shaders before the build
+/// * recordBuild()  - max-reduction of occluder depth into R32_SFLOAT mip chain
+/// * sample getDescriptor() in a compute shader (texelFetch, nearest sampler) after a barrier
+/// Level 0 of the pyramid is half resolution of the occluder depth,
+/// every texel keeps the farthest depth of the area it covers, so tests against it are conservative.
+/// Size independent objects are created in prepare(), size dependent ones in resize().
+class HiZPyramid
+{
+public:
+    /// Work group size of hiz_reduce.comp.
+    static const uint32_t REDUCE_GROUP_SIZE = 8u;
+
+    void prepare(vks::VulkanDevice* dev, VkQueue queue, VkPipelineCache pipelineCache, const VkPipelineShaderStageCreateInfo& reduceShaderStage)
+    {
+        this->device = dev;
+        this->queue  = queue;
+
+        // Sampler - nearest, no filtering between depth texels.
+        VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+        samplerCI.magFilter    = VK_FILTER_NEAREST;
+        samplerCI.minFilter    = VK_FILTER_NEAREST;
+        samplerCI.mipmapMode   = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerCI.minLod       = 0.0f;
+        samplerCI.maxLod       = 16.0f;
+        samplerCI.borderColor  = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+        VK_CHECK_RESULT(vkCreateSampler(dev->logicalDevice, &samplerCI, nullptr, &this->sampler));
+
+        // Reduce pipeline: binding 0 - source level (sampled), binding 1 - destination level (storage).
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+            vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+            vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          VK_SHADER_STAGE_COMPUTE_BIT, 1),
+        };
+        VkDescriptorSetLayoutCreateInfo descriptorLayout =
+            vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), setLayoutBindings.size());
+        VK_CHECK_RESULT(vkCreateDescriptorSetLayout(dev->logicalDevice, &descriptorLayout, nullptr, &this->reduceDescriptorSetLayout));
+
+        VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&this->reduceDescriptorSetLayout, 1);
+        VK_CHECK_RESULT(vkCreatePipelineLayout(dev->logicalDevice, &pipelineLayoutCI, nullptr, &this->reducePipelineLayout));
+
+        VkComputePipelineCreateInfo computePipelineCI = vks::initializers::computePipelineCreateInfo(this->reducePipelineLayout, 0);
+        computePipelineCI.stage = reduceShaderStage;
+        VK_CHECK_RESULT(vkCreateComputePipelines(dev->logicalDevice, pipelineCache, 1, &computePipelineCI, nullptr, &this->reducePipeline));
+    }
+
+    /// (Re)creates the pyramid for occluder depth of given size. setOccluderDepth() has to follow before recordBuild().
+    void resize(uint32_t width, uint32_t height)
+    {
+        this->destroySizeDependent();
+
+        this->width     = width;
+        this->height    = height;
+        this->depthView = VK_NULL_HANDLE;
+
+        this->pyramidWidth  = std::max(1u, (width  + 1u) / 2u);
+        this->pyramidHeight = std::max(1u, (height + 1u) / 2u);
+        this->mipCount      = 1u;
+        while ((std::max(this->pyramidWidth, this->pyramidHeight) >> this->mipCount) > 0u)
+        {
+            this->mipCount++;
+        }
+
+        std::cout << " >>> HiZPyramid::resize: " << width << "x" << height << " -> pyramid " << this->pyramidWidth << "x" << this->pyramidHeight << ", " << this->mipCount << " mips\n";
+
+        this->preparePyramid();
+        this->prepareReduceDescriptorSets();
+    }
+
+    void destroy()
+    {
+        if (this->device == nullptr)
+        {
+            return;
+        }
+
+        this->destroySizeDependent();
+
+        VkDevice dev = this->device->logicalDevice;
+        vkDestroyPipeline(dev, this->reducePipeline, nullptr);
+        vkDestroyPipelineLayout(dev, this->reducePipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(dev, this->reduceDescriptorSetLayout, nullptr);
+        vkDestroySampler(dev, this->sampler, nullptr);
+
+        this->device = nullptr;
+    }
+
+    /// Source of level 0 - view of a width x height depth image, whenever it is (re)created.
+    void setOccluderDepth(VkImageView occluderDepthView)
+    {
+        this->depthView = occluderDepthView;
+
+        VkDescriptorImageInfo srcInfo = vks::initializers::descriptorImageInfo(this->sampler, this->depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+        VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(this->reduceDescriptorSets[0], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &srcInfo);
+        vkUpdateDescriptorSets(this->device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+    }
+
+    /// Builds all pyramid levels from occluder depth. Readers of the last level need a barrier.
+    void recordBuild(VkCommandBuffer cmd)
+    {
+        assert(this->depthView != VK_NULL_HANDLE);
+
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, this->reducePipeline);
+
+        for (uint32_t level = 0; level < this->mipCount; level++)
+        {
+            const uint32_t levelWidth  = std::max(1u, this->pyramidWidth  >> level);
+            const uint32_t levelHeight = std::max(1u, this->pyramidHeight >> level);
+
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, this->reducePipelineLayout, 0, 1, &this->reduceDescriptorSets[level], 0, nullptr);
+            vkCmdDispatch(cmd, (levelWidth + REDUCE_GROUP_SIZE - 1u) / REDUCE_GROUP_SIZE, (levelHeight + REDUCE_GROUP_SIZE - 1u) / REDUCE_GROUP_SIZE, 1);
+
+            if (level + 1u == this->mipCount)
+            {
+                break;
+            }
+
+            // Level is the source of the next one.
+            VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+            memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+        }
+    }
+
+    /// Whole pyramid, VK_IMAGE_LAYOUT_GENERAL, nearest sampler.
+    VkDescriptorImageInfo getDescriptor() const
+    {
+        return vks::initializers::descriptorImageInfo(this->sampler, this->pyramidView, VK_IMAGE_LAYOUT_GENERAL);
+    }
+
+    uint32_t getMipCount() const
+    {
+        return this->mipCount;
+    }
+
+    /// For RenderGraph::importImage() - whole pyramid, R32_SFLOAT.
+    VkImage getImage() const
+    {
+        return this->pyramidImage;
+    }
+
+    VkImageView getView() const
+    {
+        return this->pyramidView;
+    }
+
+    uint32_t getPyramidWidth() const
+    {
+        return this->pyramidWidth;
+    }
+
+    uint32_t getPyramidHeight() const
+    {
+        return this->pyramidHeight;
+    }
+
+private:
+    void allocateImageMemory(VkImage image, VkDeviceMemory& outMemory)
+    {
+        VkMemoryRequirements memReqs;
+        vkGetImageMemoryRequirements(this->device->logicalDevice, image, &memReqs);
+
+        VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+        memAlloc.allocationSize  = memReqs.size;
+        memAlloc.memoryTypeIndex = this->device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        VK_CHECK_RESULT(vkAllocateMemory(this->device->logicalDevice, &memAlloc, nullptr, &outMemory));
+        VK_CHECK_RESULT(vkBindImageMemory(this->device->logicalDevice, image, outMemory, 0));
+    }
+
+    void preparePyramid()
+    {
+        VkDevice dev = this->device->logicalDevice;
+
+        VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+        imageCI.imageType   = VK_IMAGE_TYPE_2D;
+        imageCI.format      = VK_FORMAT_R32_SFLOAT;
+        imageCI.extent      = { this->pyramidWidth, this->pyramidHeight, 1 };
+        imageCI.mipLevels   = this->mipCount;
+        imageCI.arrayLayers = 1;
+        imageCI.samples     = VK_SAMPLE_COUNT_1_BIT;
+        imageCI.tiling      = VK_IMAGE_TILING_OPTIMAL;
+        imageCI.usage       = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        VK_CHECK_RESULT(vkCreateImage(dev, &imageCI, nullptr, &this->pyramidImage));
+        this->allocateImageMemory(this->pyramidImage, this->pyramidMemory);
+
+        VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+        viewCI.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
+        viewCI.format                          = VK_FORMAT_R32_SFLOAT;
+        viewCI.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewCI.subresourceRange.baseMipLevel   = 0;
+        viewCI.subresourceRange.levelCount     = this->mipCount;
+        viewCI.subresourceRange.baseArrayLayer = 0;
+        viewCI.subresourceRange.layerCount     = 1;
+        viewCI.image                           = this->pyramidImage;
+        VK_CHECK_RESULT(vkCreateImageView(dev, &viewCI, nullptr, &this->pyramidView));
+
+        this->pyramidMipViews.resize(this->mipCount);
+        for (uint32_t level = 0; level < this->mipCount; level++)
+        {
+            viewCI.subresourceRange.baseMipLevel = level;
+            viewCI.subresourceRange.levelCount   = 1;
+            VK_CHECK_RESULT(vkCreateImageView(dev, &viewCI, nullptr, &this->pyramidMipViews[level]));
+        }
+
+        // Pyramid stays in GENERAL - written as storage image, read by texelFetch.
+        VkCommandBuffer layoutCmd = this->device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+        VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, this->mipCount, 0, 1 };
+        vks::tools::setImageLayout(layoutCmd, this->pyramidImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, range);
+        this->device->flushCommandBuffer(layoutCmd, this->queue);
+    }
+
+    void prepareReduceDescriptorSets()
+    {
+        VkDevice dev = this->device->logicalDevice;
+
+        std::vector<VkDescriptorPoolSize> poolSizes = {
+            vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, this->mipCount),
+            vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          this->mipCount),
+        };
+        VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes.size(), poolSizes.data(), this->mipCount);
+        VK_CHECK_RESULT(vkCreateDescriptorPool(dev, &descriptorPoolInfo, nullptr, &this->reduceDescriptorPool));
+
+        this->reduceDescriptorSets.resize(this->mipCount);
+        for (uint32_t level = 0; level < this->mipCount; level++)
+        {
+            VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(this->reduceDescriptorPool, &this->reduceDescriptorSetLayout, 1);
+            VK_CHECK_RESULT(vkAllocateDescriptorSets(dev, &allocInfo, &this->reduceDescriptorSets[level]));
+
+            // Level 0 reduces occluder depth (see setOccluderDepth()), every next level reduces the previous one.
+            VkDescriptorImageInfo srcInfo = (level == 0u)
+                ? VkDescriptorImageInfo()
+                : vks::initializers::descriptorImageInfo(this->sampler, this->pyramidMipViews[level - 1u], VK_IMAGE_LAYOUT_GENERAL);
+            VkDescriptorImageInfo dstInfo = vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, this->pyramidMipViews[level], VK_IMAGE_LAYOUT_GENERAL);
+
+            std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                vks::initializers::writeDescriptorSet(this->reduceDescriptorSets[level], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          1, &dstInfo),
+            };
+            if (level > 0u)
+            {
+                writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(this->reduceDescriptorSets[level], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &srcInfo));
+            }
+            vkUpdateDescriptorSets(dev, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, nullptr);
+        }
+    }
+
+    void destroySizeDependent()
+    {
+        if (this->pyramidImage == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        VkDevice dev = this->device->logicalDevice;
+
+        vkDestroyDescriptorPool(dev, this->reduceDescriptorPool, nullptr); // Frees reduceDescriptorSets.
+        this->reduceDescriptorSets.clear();
+
+        for (VkImageView view : this->pyramidMipViews)
+        {
+            vkDestroyImageView(dev, view, nullptr);
+        }
+        this->pyramidMipViews.clear();
+        vkDestroyImageView(dev, this->pyramidView, nullptr);
+        vkDestroyImage(dev, this->pyramidImage, nullptr);
+        vkFreeMemory(dev, this->pyramidMemory, nullptr);
+
+        this->pyramidImage = VK_NULL_HANDLE;
+    }
+
+    vks::VulkanDevice* device = nullptr;
+    VkQueue            queue  = VK_NULL_HANDLE;
+
+    uint32_t width         = 0u;
+    uint32_t height        = 0u;
+    uint32_t pyramidWidth  = 0u;
+    uint32_t pyramidHeight = 0u;
+    uint32_t mipCount      = 0u;
+
+    // Occluder depth - not owned.
+    VkImageView depthView = VK_NULL_HANDLE;
+
+    // Pyramid.
+    VkImage                  pyramidImage  = VK_NULL_HANDLE;
+    VkDeviceMemory           pyramidMemory = VK_NULL_HANDLE;
+    VkImageView              pyramidView   = VK_NULL_HANDLE;
+    std::vector<VkImageView> pyramidMipViews;
+    VkSampler                sampler       = VK_NULL_HANDLE;
+
+    // Reduction.
+    VkDescriptorSetLayout        reduceDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout             reducePipelineLayout      = VK_NULL_HANDLE;
+    VkPipeline                   reducePipeline            = VK_NULL_HANDLE;
+    VkDescriptorPool             reduceDescriptorPool      = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> reduceDescriptorSets;
+};
+
+} // namespace vk229
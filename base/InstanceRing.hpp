@@ -0,0 +1,357 @@
+#pragma once
+
+#include <assert.h>
+#include <string.h>
+#include <vulkan/vulkan.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <VulkanTools.h>
+#include <VulkanInitializers.hpp>
+#include <VulkanDevice.hpp>
+
+namespace vk229
+{
+
+//////////////////////////////////////
+/// Per-instance data which can change at runtime - a ring of slotCount copies of it in one VkBuffer.
+/// Frames using slot i (ie. the command buffer of swapchain image i) only read slot i, so the CPU never
+/// overwrites data the GPU may still be reading, however many frames are in flight:
+/// * write() updates the CPU copy and marks the range pending in every slot
+/// * flush(slot) waits for the last submit which used the slot (it has to signal getFence(slot)),
+///   then brings only the pending ranges of that slot up to date
+/// * with a DEVICE_LOCAL | HOST_VISIBLE memory type (integrated GPUs, resizable BAR) slots are written
+///   directly through a persistent mapping; otherwise they are device-local and filled from a persistently
+///   mapped staging ring by the command buffer flush() returns, which has to be submitted before the frame
+/// Slots are getSlotStride() apart - a multiple of minStorageBufferOffsetAlignment, so a slot can be bound
+/// with a dynamic storage buffer offset as well as with a vertex buffer offset.
+class InstanceRing
+{
+public:
+    struct Stats
+    {
+        uint32_t     uploadedRanges     = 0u; ///< By the last flush().
+        VkDeviceSize uploadedBytes      = 0u; ///< By the last flush().
+        uint64_t     totalUploadedBytes = 0u;
+    };
+
+    /// usage - how frames read the slots (ie. VERTEX_BUFFER | STORAGE_BUFFER), transfer usage is added if needed.
+    /// allowDirect = false forces the staged path, for testing it on GPUs which do not need it.
+    void prepare(vks::VulkanDevice* dev, uint32_t slotCount, uint32_t elementSize, uint32_t elementCount,
+                 VkBufferUsageFlags usage, bool allowDirect = true)
+    {
+        assert(slotCount > 0u && elementSize > 0u && elementCount > 0u);
+
+        this->device       = dev;
+        this->elementSize  = elementSize;
+        this->elementCount = elementCount;
+        this->slotSize     = VkDeviceSize(elementSize) * elementCount;
+
+        const VkDeviceSize alignment = std::max<VkDeviceSize>(dev->properties.limits.minStorageBufferOffsetAlignment, 16u);
+        this->slotStride = (this->slotSize + alignment - 1u) / alignment * alignment;
+
+        this->data.assign(this->slotSize, 0u);
+        this->pendingRanges.assign(slotCount, std::vector<Range>());
+
+        const VkMemoryPropertyFlags directFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        const VkMemoryPropertyFlags hostFlags   = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+        this->direct = allowDirect && this->createBuffer(usage, directFlags, this->buffer, this->memory);
+        if (this->direct)
+        {
+            VK_CHECK_RESULT(vkMapMemory(dev->logicalDevice, this->memory, 0, VK_WHOLE_SIZE, 0, &this->mapped));
+        }
+        else
+        {
+            const bool created = this->createBuffer(usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->buffer, this->memory)
+                              && this->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, hostFlags, this->stagingBuffer, this->stagingMemory);
+            if (false == created)
+            {
+                vks::tools::exitFatal("No memory type for the instance ring!", "Error");
+            }
+            VK_CHECK_RESULT(vkMapMemory(dev->logicalDevice, this->stagingMemory, 0, VK_WHOLE_SIZE, 0, &this->mapped));
+
+            VkCommandPoolCreateInfo cmdPoolInfo = {};
+            cmdPoolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            cmdPoolInfo.queueFamilyIndex = dev->queueFamilyIndices.graphics;
+            cmdPoolInfo.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+            VK_CHECK_RESULT(vkCreateCommandPool(dev->logicalDevice, &cmdPoolInfo, nullptr, &this->cmdPool));
+
+            this->uploadCmdBuffers.resize(slotCount);
+            VkCommandBufferAllocateInfo cmdBufAllocateInfo =
+                vks::initializers::commandBufferAllocateInfo(this->cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, slotCount);
+            VK_CHECK_RESULT(vkAllocateCommandBuffers(dev->logicalDevice, &cmdBufAllocateInfo, this->uploadCmdBuffers.data()));
+        }
+
+        // Signalled - first flush() of every slot does not wait.
+        this->fences.resize(slotCount);
+        VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+        for (VkFence& fence : this->fences)
+        {
+            VK_CHECK_RESULT(vkCreateFence(dev->logicalDevice, &fenceCreateInfo, nullptr, &fence));
+        }
+
+        std::cout << " >>> InstanceRing::prepare: " << slotCount << " slots of " << elementCount << " x " << elementSize << " B, "
+                  << (this->direct ? "device local + host visible, written directly" : "device local, staged copies") << "\n";
+    }
+
+    void destroy()
+    {
+        if (this->device == nullptr)
+        {
+            return;
+        }
+
+        VkDevice dev = this->device->logicalDevice;
+
+        vkWaitForFences(dev, this->fences.size(), this->fences.data(), VK_TRUE, UINT64_MAX);
+        for (VkFence fence : this->fences)
+        {
+            vkDestroyFence(dev, fence, nullptr);
+        }
+
+        if (this->cmdPool != VK_NULL_HANDLE)
+        {
+            vkDestroyCommandPool(dev, this->cmdPool, nullptr); // Frees upload command buffers.
+        }
+        if (this->stagingBuffer != VK_NULL_HANDLE)
+        {
+            vkUnmapMemory(dev, this->stagingMemory);
+            vkDestroyBuffer(dev, this->stagingBuffer, nullptr);
+            vkFreeMemory(dev, this->stagingMemory, nullptr);
+        }
+        else
+        {
+            vkUnmapMemory(dev, this->memory);
+        }
+        vkDestroyBuffer(dev, this->buffer, nullptr);
+        vkFreeMemory(dev, this->memory, nullptr);
+
+        this->device = nullptr;
+    }
+
+    /// Elements [first, first + count) - visible to frames of a slot after its next flush().
+    void write(uint32_t first, uint32_t count, const void* elements)
+    {
+        assert(first + count <= this->elementCount);
+        if (count == 0u)
+        {
+            return;
+        }
+
+        memcpy(&this->data[VkDeviceSize(first) * this->elementSize], elements, VkDeviceSize(count) * this->elementSize);
+        for (std::vector<Range>& slotRanges : this->pendingRanges)
+        {
+            slotRanges.push_back({first, first + count});
+        }
+    }
+
+    /// Current contents (CPU copy), elementCount elements.
+    const void* getData() const
+    {
+        return this->data.data();
+    }
+
+    /// Waits until the GPU is done with the slot, then uploads its pending ranges.
+    /// Returns a command buffer with the copies (staged path) which has to be submitted before anything
+    /// reading the slot, VK_NULL_HANDLE if there is nothing to submit.
+    /// The submit of the frame using the slot has to signal getFence(slot) - the fence is reset here.
+    VkCommandBuffer flush(uint32_t slot)
+    {
+        assert(slot < this->fences.size());
+
+        VK_CHECK_RESULT(vkWaitForFences(this->device->logicalDevice, 1, &this->fences[slot], VK_TRUE, UINT64_MAX));
+        VK_CHECK_RESULT(vkResetFences(this->device->logicalDevice, 1, &this->fences[slot]));
+
+        this->stats.uploadedRanges = 0u;
+        this->stats.uploadedBytes  = 0u;
+
+        std::vector<Range>& slotRanges = this->pendingRanges[slot];
+        if (slotRanges.empty())
+        {
+            return VK_NULL_HANDLE;
+        }
+
+        // Sorted and coalesced - overlapping writes are uploaded once.
+        std::sort(slotRanges.begin(), slotRanges.end(), [](const Range& a, const Range& b) { return a.begin < b.begin; });
+        std::vector<Range> merged;
+        for (const Range& range : slotRanges)
+        {
+            if (false == merged.empty() && range.begin <= merged.back().end)
+            {
+                merged.back().end = std::max(merged.back().end, range.end);
+            }
+            else
+            {
+                merged.push_back(range);
+            }
+        }
+        slotRanges.clear();
+
+        std::vector<VkBufferCopy> copyRegions;
+        uint8_t* slotMapped = static_cast<uint8_t*>(this->mapped) + this->getSlotOffset(slot);
+        for (const Range& range : merged)
+        {
+            const VkDeviceSize offset = VkDeviceSize(range.begin) * this->elementSize;
+            const VkDeviceSize size   = VkDeviceSize(range.end - range.begin) * this->elementSize;
+            memcpy(slotMapped + offset, &this->data[offset], size);
+
+            VkBufferCopy copyRegion = {};
+            copyRegion.srcOffset = this->getSlotOffset(slot) + offset;
+            copyRegion.dstOffset = copyRegion.srcOffset;
+            copyRegion.size      = size;
+            copyRegions.push_back(copyRegion);
+
+            this->stats.uploadedBytes += size;
+        }
+        this->stats.uploadedRanges      = merged.size();
+        this->stats.totalUploadedBytes += this->stats.uploadedBytes;
+
+        if (this->direct)
+        {
+            return VK_NULL_HANDLE; // Coherent host writes are visible to the submit which follows.
+        }
+
+        VkCommandBuffer cmd = this->uploadCmdBuffers[slot];
+        VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+        cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        VK_CHECK_RESULT(vkBeginCommandBuffer(cmd, &cmdBufInfo));
+
+        vkCmdCopyBuffer(cmd, this->stagingBuffer, this->buffer, copyRegions.size(), copyRegions.data());
+
+        // Copies before reads of the frame - as vertex attributes or from shaders.
+        VkBufferMemoryBarrier barrier = vks::initializers::bufferMemoryBarrier();
+        barrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask       = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer              = this->buffer;
+        barrier.offset              = this->getSlotOffset(slot);
+        barrier.size                = this->slotSize;
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+        VK_CHECK_RESULT(vkEndCommandBuffer(cmd));
+        return cmd;
+    }
+
+    /// Has to be signalled by the submit of the frame which reads the slot, after flush(slot).
+    VkFence getFence(uint32_t slot) const
+    {
+        return this->fences[slot];
+    }
+
+    VkBuffer getBuffer() const
+    {
+        return this->buffer;
+    }
+
+    VkDeviceSize getSlotOffset(uint32_t slot) const
+    {
+        return VkDeviceSize(slot) * this->slotStride;
+    }
+
+    VkDeviceSize getSlotStride() const
+    {
+        return this->slotStride;
+    }
+
+    VkDeviceSize getSlotSize() const
+    {
+        return this->slotSize;
+    }
+
+    uint32_t getSlotCount() const
+    {
+        return this->fences.size();
+    }
+
+    uint32_t getElementCount() const
+    {
+        return this->elementCount;
+    }
+
+    /// Slot 0 - for dynamic storage buffer descriptors, getSlotOffset() is the dynamic offset.
+    VkDescriptorBufferInfo getDescriptor() const
+    {
+        VkDescriptorBufferInfo descriptor = {};
+        descriptor.buffer = this->buffer;
+        descriptor.offset = 0;
+        descriptor.range  = this->slotSize;
+        return descriptor;
+    }
+
+    bool isDirect() const
+    {
+        return this->direct;
+    }
+
+    const Stats& getStats() const
+    {
+        return this->stats;
+    }
+
+private:
+    struct Range
+    {
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    /// Buffer of all slots in memory with given properties, false if there is no such memory type.
+    bool createBuffer(VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryFlags, VkBuffer& outBuffer, VkDeviceMemory& outMemory)
+    {
+        VkDevice dev = this->device->logicalDevice;
+
+        VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo(usage, this->slotStride * this->pendingRanges.size());
+        VK_CHECK_RESULT(vkCreateBuffer(dev, &bufferCreateInfo, nullptr, &outBuffer));
+
+        VkMemoryRequirements memReqs;
+        vkGetBufferMemoryRequirements(dev, outBuffer, &memReqs);
+
+        const VkPhysicalDeviceMemoryProperties& memProps = this->device->memoryProperties;
+        for (uint32_t type = 0; type < memProps.memoryTypeCount; type++)
+        {
+            if ((memReqs.memoryTypeBits & (1u << type)) && (memProps.memoryTypes[type].propertyFlags & memoryFlags) == memoryFlags)
+            {
+                VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+                memAlloc.allocationSize  = memReqs.size;
+                memAlloc.memoryTypeIndex = type;
+                if (vkAllocateMemory(dev, &memAlloc, nullptr, &outMemory) != VK_SUCCESS)
+                {
+                    continue; // ie. small BAR heap exhausted - next type, or the staged path.
+                }
+                VK_CHECK_RESULT(vkBindBufferMemory(dev, outBuffer, outMemory, 0));
+                return true;
+            }
+        }
+
+        vkDestroyBuffer(dev, outBuffer, nullptr);
+        outBuffer = VK_NULL_HANDLE;
+        return false;
+    }
+
+    vks::VulkanDevice* device       = nullptr;
+    uint32_t           elementSize  = 0u;
+    uint32_t           elementCount = 0u;
+    VkDeviceSize       slotSize     = 0u;
+    VkDeviceSize       slotStride   = 0u;
+    bool               direct       = false;
+
+    VkBuffer       buffer        = VK_NULL_HANDLE; // All slots, read by frames.
+    VkDeviceMemory memory        = VK_NULL_HANDLE;
+    VkBuffer       stagingBuffer = VK_NULL_HANDLE; // Staged path only - same layout as buffer.
+    VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+    void*          mapped        = nullptr;        // buffer (direct) or stagingBuffer, whole.
+
+    VkCommandPool                cmdPool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> uploadCmdBuffers; // Per slot, staged path only.
+    std::vector<VkFence>         fences;           // Per slot - signalled when the last frame using it is done.
+
+    std::vector<uint8_t>            data;          // CPU copy.
+    std::vector<std::vector<Range>> pendingRanges; // Per slot - written since its last flush().
+    Stats                           stats;
+};
+
+} // namespace vk229
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <VulkanBuffer.hpp>
+#include <VulkanDevice.hpp>
+
+namespace vk229
+{
+/////////////////////////////////////////
+/// Mesh data on the CPU side, between file and GPU:
+/// * loading with Assimp (same conventions as vks::Model)
+/// * compact vertex encoding
+/// * upload to device local buffers
+/////////////////////////////////////////
+
+//////////////////////////////////////
+/// Full precision vertex, same layout as former vks::VertexLayout of SceneInfo:
+/// POSITION, NORMAL, TANGENT, BITANGENT, UV, COLOR - 68 bytes.
+struct MeshVertex
+{
+    float pos[3];
+    float normal[3];
+    float tangent[3];
+    float bitangent[3];
+    float uv[2];
+    float color[3];
+};
+static_assert(sizeof(MeshVertex) == 17u * sizeof(float), "MeshVertex has to be tightly packed");
+
+//////////////////////////////////////
+/// Compact vertex - 20 bytes:
+/// * pos       - SNORM16 xyz, dequantized with per-mesh MeshDequant, w = bitangent sign
+/// * normal    - octahedral SNORM16
+/// * tangent   - octahedral SNORM16
+/// * uv        - half float
+/// Bitangent is cross(normal, tangent) * pos.w, color is dropped (unused by default_material.frag).
+struct CompactVertex
+{
+    int16_t  pos[4];
+    int16_t  normal[2];
+    int16_t  tangent[2];
+    uint16_t uv[2];
+};
+static_assert(sizeof(CompactVertex) == 20u, "CompactVertex has to be tightly packed");
+
+//////////////////////////////////////
+/// Position-only vertices for depth-only passes.
+/// Bits are the same as in position of MeshVertex / CompactVertex, so both passes compute the same depth.
+struct PositionVertex
+{
+    float pos[3];
+};
+
+struct CompactPositionVertex
+{
+    int16_t pos[4];
+};
+
+//////////////////////////////////////
+/// Per-mesh position dequantization: pos = posScale * snormPos + posOffset.
+/// Pushed as vertex stage push constant, vec4s to match std430 layout.
+struct MeshDequant
+{
+    float posScale[4];
+    float posOffset[4];
+};
+
+struct MeshData
+{
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t>   indices;
+};
+
+// LOADING {
+
+/// Same post processing as vks::Model::defaultFlags.
+const int MESH_DEFAULT_ASSIMP_FLAGS = aiProcess_FlipWindingOrder | aiProcess_Triangulate | aiProcess_PreTransformVertices | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals;
+
+/// Loads all meshes of the file into one vertex and index array.
+/// Y axis is flipped for position and for the whole tangent frame (vks::Model flipped only position and normal).
+bool loadMeshData(const std::string& filename, MeshData& outMesh)
+{
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(filename.c_str(), MESH_DEFAULT_ASSIMP_FLAGS);
+    if (scene == nullptr)
+    {
+        std::cout << " >>> loadMeshData: could not load " << filename << ": " << importer.GetErrorString() << "\n";
+        return false;
+    }
+
+    outMesh.vertices.clear();
+    outMesh.indices.clear();
+
+    const aiVector3D zero3D(0.0f, 0.0f, 0.0f);
+
+    for (uint32_t m = 0; m < scene->mNumMeshes; m++)
+    {
+        const aiMesh* mesh = scene->mMeshes[m];
+
+        aiColor3D color(0.0f, 0.0f, 0.0f);
+        scene->mMaterials[mesh->mMaterialIndex]->Get(AI_MATKEY_COLOR_DIFFUSE, color);
+
+        const uint32_t vertexBase = outMesh.vertices.size();
+
+        for (uint32_t v = 0; v < mesh->mNumVertices; v++)
+        {
+            const aiVector3D& pos  = mesh->mVertices[v];
+            const aiVector3D& norm = mesh->mNormals[v];
+            const aiVector3D& uv   = mesh->HasTextureCoords(0)       ? mesh->mTextureCoords[0][v] : zero3D;
+            const aiVector3D& tan  = mesh->HasTangentsAndBitangents() ? mesh->mTangents[v]         : zero3D;
+            const aiVector3D& btan = mesh->HasTangentsAndBitangents() ? mesh->mBitangents[v]       : zero3D;
+
+            MeshVertex vert;
+            vert.pos[0]       =  pos.x;  vert.pos[1]       = -pos.y;  vert.pos[2]       =  pos.z;
+            vert.normal[0]    =  norm.x; vert.normal[1]    = -norm.y; vert.normal[2]    =  norm.z;
+            vert.tangent[0]   =  tan.x;  vert.tangent[1]   = -tan.y;  vert.tangent[2]   =  tan.z;
+            vert.bitangent[0] =  btan.x; vert.bitangent[1] = -btan.y; vert.bitangent[2] =  btan.z;
+            vert.uv[0]        =  uv.x;   vert.uv[1]        =  uv.y;
+            vert.color[0]     =  color.r; vert.color[1]    =  color.g; vert.color[2]    =  color.b;
+
+            outMesh.vertices.push_back(vert);
+        }
+
+        for (uint32_t f = 0; f < mesh->mNumFaces; f++)
+        {
+            const aiFace& face = mesh->mFaces[f];
+            if (face.mNumIndices != 3)
+            {
+                continue; // Points and lines left after triangulation.
+            }
+            outMesh.indices.push_back(vertexBase + face.mIndices[0]);
+            outMesh.indices.push_back(vertexBase + face.mIndices[1]);
+            outMesh.indices.push_back(vertexBase + face.mIndices[2]);
+        }
+    }
+
+    return true;
+}
+
+// } // LOADING
+
+// COMPACT_ENCODING {
+
+int16_t floatToSnorm16(float v)
+{
+    v = fmaxf(-1.0f, fminf(1.0f, v));
+    return int16_t(roundf(v * 32767.0f));
+}
+
+/// IEEE 754 binary16, round to nearest, denormals flushed to zero.
+uint16_t floatToHalf(float v)
+{
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+
+    const uint32_t sign     = (bits >> 16) & 0x8000u;
+    int32_t        exponent = int32_t((bits >> 23) & 0xffu) - 127 + 15;
+    uint32_t       mantissa = bits & 0x7fffffu;
+
+    if (((bits >> 23) & 0xffu) == 0xffu) // Inf, NaN.
+    {
+        return uint16_t(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+    }
+    if (exponent <= 0)
+    {
+        return uint16_t(sign);
+    }
+
+    mantissa += 0x1000u; // Rounding.
+    if (mantissa & 0x800000u) // Mantissa overflow.
+    {
+        mantissa = 0u;
+        exponent++;
+    }
+    if (exponent >= 31)
+    {
+        return uint16_t(sign | 0x7c00u);
+    }
+    return uint16_t(sign | (uint32_t(exponent) << 10) | (mantissa >> 13));
+}
+
+/// Octahedral encoding of unit vector, result in -1..1 as SNORM16.
+/// Decoded by octDecode() in default_transforms.vert.
+void octEncode(const float v[3], int16_t out[2])
+{
+    const float l1 = fabsf(v[0]) + fabsf(v[1]) + fabsf(v[2]);
+    if (l1 == 0.0f)
+    {
+        out[0] = 0;
+        out[1] = 0;
+        return;
+    }
+
+    float x = v[0] / l1;
+    float y = v[1] / l1;
+    if (v[2] < 0.0f) // Lower hemisphere folded over the diagonals.
+    {
+        const float fx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        const float fy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = fx;
+        y = fy;
+    }
+
+    out[0] = floatToSnorm16(x);
+    out[1] = floatToSnorm16(y);
+}
+
+/// Encodes vertices of the mesh to CompactVertex, quantizing positions to the mesh's bounding box.
+void encodeCompactVertices(const MeshData& mesh, std::vector<CompactVertex>& outVertices, MeshDequant& outDequant)
+{
+    float bbMin[3] = { INFINITY,  INFINITY,  INFINITY};
+    float bbMax[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (const MeshVertex& v : mesh.vertices)
+    {
+        for (uint32_t c = 0; c < 3u; c++)
+        {
+            bbMin[c] = fminf(bbMin[c], v.pos[c]);
+            bbMax[c] = fmaxf(bbMax[c], v.pos[c]);
+        }
+    }
+
+    for (uint32_t c = 0; c < 3u; c++)
+    {
+        const float halfExtent = 0.5f * (bbMax[c] - bbMin[c]);
+        outDequant.posOffset[c] = mesh.vertices.empty() ? 0.0f : 0.5f * (bbMax[c] + bbMin[c]);
+        outDequant.posScale[c]  = (halfExtent > 0.0f) ? halfExtent : 1.0f;
+    }
+    outDequant.posOffset[3] = 0.0f;
+    outDequant.posScale[3]  = 1.0f;
+
+    outVertices.resize(mesh.vertices.size());
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        const MeshVertex& v = mesh.vertices[i];
+        CompactVertex&    o = outVertices[i];
+
+        for (uint32_t c = 0; c < 3u; c++)
+        {
+            o.pos[c] = floatToSnorm16((v.pos[c] - outDequant.posOffset[c]) / outDequant.posScale[c]);
+        }
+
+        // Handedness of the tangent frame: bitangent ~ sign * cross(normal, tangent).
+        const float nxt[3] = {
+            v.normal[1]*v.tangent[2] - v.normal[2]*v.tangent[1],
+            v.normal[2]*v.tangent[0] - v.normal[0]*v.tangent[2],
+            v.normal[0]*v.tangent[1] - v.normal[1]*v.tangent[0],
+        };
+        const float handedness = nxt[0]*v.bitangent[0] + nxt[1]*v.bitangent[1] + nxt[2]*v.bitangent[2];
+        o.pos[3] = (handedness < 0.0f) ? -32767 : 32767;
+
+        octEncode(v.normal,  o.normal);
+        octEncode(v.tangent, o.tangent);
+
+        o.uv[0] = floatToHalf(v.uv[0]);
+        o.uv[1] = floatToHalf(v.uv[1]);
+    }
+}
+
+// } // COMPACT_ENCODING
+
+// GPU_UPLOAD {
+
+//////////////////////////////////////
+/// Mesh in device local memory, drawn with one vkCmdDrawIndexed.
+/// Replaces vks::Model so the vertex format is not tied to vks::VertexLayout.
+struct GpuMesh
+{
+    vks::Buffer vertices;
+    vks::Buffer indices;
+    vks::Buffer positions;      // Optional position-only stream, see uploadPositions().
+    uint32_t    vertexCount = 0u;
+    uint32_t    indexCount  = 0u;
+    MeshDequant dequant     = {{1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 0.0f}};
+
+    void destroy()
+    {
+        this->vertices.destroy();
+        this->indices.destroy();
+        this->positions.destroy();
+    }
+};
+
+/// Copies data to a new device local buffer through a staging buffer.
+void uploadToDeviceLocalBuffer(vks::VulkanDevice* dev, VkQueue& queue, VkBufferUsageFlags usage, const void* data, VkDeviceSize size, vks::Buffer& outBuffer)
+{
+    vks::Buffer staging;
+    VK_CHECK_RESULT(dev->createBuffer(
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &staging,
+        size,
+        const_cast<void*>(data)));
+
+    VK_CHECK_RESULT(dev->createBuffer(
+        usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &outBuffer,
+        size));
+
+    dev->copyBuffer(&staging, &outBuffer, queue);
+
+    staging.destroy();
+}
+
+/// Uploads vertices (any vertex struct) and indices of a mesh.
+template <typename VertexT>
+void uploadMesh(vks::VulkanDevice* dev, VkQueue& queue, const std::vector<VertexT>& vertices, const std::vector<uint32_t>& indices, GpuMesh& outMesh)
+{
+    assert(!vertices.empty() && !indices.empty());
+
+    uploadToDeviceLocalBuffer(dev, queue, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertices.data(), vertices.size() * sizeof(VertexT), outMesh.vertices);
+    uploadToDeviceLocalBuffer(dev, queue, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,  indices.data(),  indices.size()  * sizeof(uint32_t), outMesh.indices);
+
+    outMesh.vertexCount = vertices.size();
+    outMesh.indexCount  = indices.size();
+}
+
+/// Uploads position-only copy of vertices (PositionVertex or CompactPositionVertex) taken from the full vertices.
+template <typename PositionVertexT, typename VertexT>
+void uploadPositions(vks::VulkanDevice* dev, VkQueue& queue, const std::vector<VertexT>& vertices, GpuMesh& outMesh)
+{
+    static_assert(sizeof(PositionVertexT::pos) <= sizeof(VertexT::pos), "Position has to be a prefix of the vertex position");
+
+    std::vector<PositionVertexT> positions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        memcpy(positions[i].pos, vertices[i].pos, sizeof(positions[i].pos));
+    }
+
+    uploadToDeviceLocalBuffer(dev, queue, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, positions.data(), positions.size() * sizeof(PositionVertexT), outMesh.positions);
+}
+
+// } // GPU_UPLOAD
+
+} // namespace vk229
@@ -0,0 +1,414 @@
+#pragma once
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <MeshData.hpp>
+
+namespace vk229
+{
+/////////////////////////////////////////
+/// Load-time optimizations of MeshData, in this order:
+/// * vertex welding                  - removes duplicated vertices
+/// * vertex cache optimization       - Forsyth's linear-speed triangle reordering
+/// * overdraw optimization           - cluster reordering, outward facing clusters first
+/// * vertex fetch optimization       - vertices in order of first use
+/////////////////////////////////////////
+
+/// Size of FIFO post-transform cache used for ACMR/ATVR statistics.
+#define MESH_STATS_FIFO_CACHE_SIZE 16u
+/// Size of LRU cache modelled by the Forsyth's algorithm.
+#define MESH_FORSYTH_CACHE_SIZE    32u
+/// Max allowed ACMR ratio (after / before) of overdraw optimization.
+#define MESH_OVERDRAW_ACMR_THRESHOLD 1.05f
+
+struct MeshCacheStats
+{
+    float acmr; // Average cache miss ratio - transformed vertices per triangle (0.5 .. 3.0).
+    float atvr; // Average transformed vertex ratio - transformed vertices per vertex (1.0 is optimal).
+};
+
+// STATS {
+
+/// Simulates FIFO post-transform cache.
+MeshCacheStats computeCacheStats(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = MESH_STATS_FIFO_CACHE_SIZE)
+{
+    std::vector<uint32_t> timestamps(vertexCount, 0u);
+    uint32_t time   = cacheSize + 1u;
+    uint32_t misses = 0u;
+
+    for (uint32_t idx : indices)
+    {
+        if (time - timestamps[idx] > cacheSize)
+        {
+            timestamps[idx] = time++;
+            misses++;
+        }
+    }
+
+    MeshCacheStats stats;
+    stats.acmr = indices.empty() ? 0.0f : float(misses) / float(indices.size() / 3u);
+    stats.atvr = vertexCount == 0u ? 0.0f : float(misses) / float(vertexCount);
+    return stats;
+}
+
+// } // STATS
+
+// WELD {
+
+/// Merges bitwise identical vertices.
+void weldVertices(MeshData& mesh)
+{
+    const uint32_t vertexCount = mesh.vertices.size();
+
+    std::vector<uint32_t> order(vertexCount);
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&mesh](uint32_t a, uint32_t b)
+    {
+        return memcmp(&mesh.vertices[a], &mesh.vertices[b], sizeof(MeshVertex)) < 0;
+    });
+
+    std::vector<uint32_t>   remap(vertexCount);
+    std::vector<MeshVertex> welded;
+    welded.reserve(vertexCount);
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        const MeshVertex& v = mesh.vertices[order[i]];
+        if (welded.empty() || memcmp(&welded.back(), &v, sizeof(MeshVertex)) != 0)
+        {
+            welded.push_back(v);
+        }
+        remap[order[i]] = welded.size() - 1u;
+    }
+
+    for (uint32_t& idx : mesh.indices)
+    {
+        idx = remap[idx];
+    }
+    mesh.vertices.swap(welded);
+}
+
+// } // WELD
+
+// VERTEX_CACHE {
+
+float getForsythVertexScore(int32_t cachePos, uint32_t remainingValence)
+{
+    if (remainingValence == 0u)
+    {
+        return -1.0f; // Vertex is not used anymore.
+    }
+
+    float score = 0.0f;
+    if (cachePos >= 0)
+    {
+        if (cachePos < 3)
+        {
+            score = 0.75f; // Vertices of the last triangle - fixed score, so strips are not preferred over fans.
+        }
+        else
+        {
+            score = powf(1.0f - float(cachePos - 3) / float(MESH_FORSYTH_CACHE_SIZE - 3u), 1.5f);
+        }
+    }
+
+    return score + 2.0f / sqrtf(float(remainingValence)); // Boost for vertices with few triangles left.
+}
+
+/// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+void optimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+    const uint32_t triangleCount = indices.size() / 3u;
+    if (triangleCount == 0u)
+    {
+        return;
+    }
+
+    // Vertex -> triangles adjacency.
+    std::vector<uint32_t> valence(vertexCount, 0u);
+    for (uint32_t idx : indices)
+    {
+        valence[idx]++;
+    }
+    std::vector<uint32_t> adjOffsets(vertexCount + 1u, 0u);
+    for (uint32_t v = 0; v < vertexCount; v++)
+    {
+        adjOffsets[v + 1u] = adjOffsets[v] + valence[v];
+    }
+    std::vector<uint32_t> adjTriangles(indices.size());
+    {
+        std::vector<uint32_t> fill(adjOffsets.begin(), adjOffsets.end() - 1);
+        for (uint32_t t = 0; t < triangleCount; t++)
+        {
+            for (uint32_t c = 0; c < 3u; c++)
+            {
+                const uint32_t v = indices[3u*t + c];
+                adjTriangles[fill[v]++] = t;
+            }
+        }
+    }
+
+    std::vector<float> vertexScore(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++)
+    {
+        vertexScore[v] = getForsythVertexScore(-1, valence[v]);
+    }
+
+    std::vector<bool> triangleAdded(triangleCount, false);
+
+    std::vector<uint32_t> cache;    // LRU, most recent first.
+    std::vector<uint32_t> newCache;
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    uint32_t scanCursor   = 0u;
+    int64_t  bestTriangle = -1;
+
+    for (uint32_t emitted = 0; emitted < triangleCount; emitted++)
+    {
+        if (bestTriangle < 0) // Nothing adjacent to the cache - take next free triangle.
+        {
+            while (triangleAdded[scanCursor])
+            {
+                scanCursor++;
+            }
+            bestTriangle = scanCursor;
+        }
+
+        const uint32_t t = uint32_t(bestTriangle);
+        triangleAdded[t] = true;
+
+        // Emit, move vertices to the cache front, remove triangle from adjacency.
+        newCache.clear();
+        for (uint32_t c = 0; c < 3u; c++)
+        {
+            const uint32_t v = indices[3u*t + c];
+            result.push_back(v);
+            newCache.push_back(v);
+
+            uint32_t* adjBegin = &adjTriangles[adjOffsets[v]];
+            uint32_t* adjEnd   = adjBegin + valence[v];
+            std::remove(adjBegin, adjEnd, t);
+            valence[v]--;
+        }
+        for (uint32_t v : cache)
+        {
+            if (v != newCache[0] && v != newCache[1] && v != newCache[2])
+            {
+                newCache.push_back(v);
+            }
+        }
+        for (size_t i = MESH_FORSYTH_CACHE_SIZE; i < newCache.size(); i++)
+        {
+            vertexScore[newCache[i]] = getForsythVertexScore(-1, valence[newCache[i]]); // Pushed out.
+        }
+        if (newCache.size() > MESH_FORSYTH_CACHE_SIZE)
+        {
+            newCache.resize(MESH_FORSYTH_CACHE_SIZE);
+        }
+        cache.swap(newCache);
+
+        // Rescore cached vertices and their triangles, pick the best one among them.
+        for (uint32_t i = 0; i < cache.size(); i++)
+        {
+            vertexScore[cache[i]] = getForsythVertexScore(i, valence[cache[i]]);
+        }
+
+        bestTriangle = -1;
+        float bestScore = -1.0f;
+        for (uint32_t v : cache)
+        {
+            for (uint32_t a = adjOffsets[v]; a < adjOffsets[v] + valence[v]; a++)
+            {
+                const uint32_t at = adjTriangles[a];
+                const float score = vertexScore[indices[3u*at]] + vertexScore[indices[3u*at + 1u]] + vertexScore[indices[3u*at + 2u]];
+                if (score > bestScore)
+                {
+                    bestScore    = score;
+                    bestTriangle = at;
+                }
+            }
+        }
+    }
+
+    indices.swap(result);
+}
+
+// } // VERTEX_CACHE
+
+// OVERDRAW {
+
+/// Sander et al. "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", simplified:
+/// the cache optimized order is split into clusters where the FIFO cache restarts (triangle with 3 misses),
+/// clusters are sorted by how much they face outwards from the mesh centroid, so occluders are drawn first.
+/// Result is rejected if ACMR grows more than MESH_OVERDRAW_ACMR_THRESHOLD times.
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<MeshVertex>& vertices)
+{
+    const uint32_t triangleCount = indices.size() / 3u;
+    const uint32_t vertexCount   = vertices.size();
+    if (triangleCount < 2u)
+    {
+        return;
+    }
+
+    // Cluster boundaries.
+    std::vector<uint32_t> clusterStarts;
+    {
+        std::vector<uint32_t> timestamps(vertexCount, 0u);
+        uint32_t time = MESH_STATS_FIFO_CACHE_SIZE + 1u;
+        for (uint32_t t = 0; t < triangleCount; t++)
+        {
+            uint32_t misses = 0u;
+            for (uint32_t c = 0; c < 3u; c++)
+            {
+                const uint32_t idx = indices[3u*t + c];
+                if (time - timestamps[idx] > MESH_STATS_FIFO_CACHE_SIZE)
+                {
+                    timestamps[idx] = time++;
+                    misses++;
+                }
+            }
+            if (misses == 3u)
+            {
+                clusterStarts.push_back(t);
+            }
+        }
+    }
+    if (clusterStarts.size() < 2u)
+    {
+        return;
+    }
+    clusterStarts.push_back(triangleCount);
+
+    float meshCentroid[3] = {0.0f, 0.0f, 0.0f};
+    for (const MeshVertex& v : vertices)
+    {
+        for (uint32_t c = 0; c < 3u; c++)
+        {
+            meshCentroid[c] += v.pos[c] / float(vertexCount);
+        }
+    }
+
+    // Sort key: dot(clusterCentroid - meshCentroid, clusterNormal), area weighted.
+    const uint32_t clusterCount = clusterStarts.size() - 1u;
+    std::vector<float> clusterSortKey(clusterCount);
+    for (uint32_t cl = 0; cl < clusterCount; cl++)
+    {
+        float centroid[3] = {0.0f, 0.0f, 0.0f};
+        float normal[3]   = {0.0f, 0.0f, 0.0f};
+        float area        = 0.0f;
+
+        for (uint32_t t = clusterStarts[cl]; t < clusterStarts[cl + 1u]; t++)
+        {
+            const float* p0 = vertices[indices[3u*t]].pos;
+            const float* p1 = vertices[indices[3u*t + 1u]].pos;
+            const float* p2 = vertices[indices[3u*t + 2u]].pos;
+
+            const float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            const float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            const float n[3]  = {e1[1]*e2[2] - e1[2]*e2[1], e1[2]*e2[0] - e1[0]*e2[2], e1[0]*e2[1] - e1[1]*e2[0]};
+            const float a     = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+
+            for (uint32_t c = 0; c < 3u; c++)
+            {
+                centroid[c] += (p0[c] + p1[c] + p2[c]) / 3.0f * a;
+                normal[c]   += n[c];
+            }
+            area += a;
+        }
+
+        if (area > 0.0f)
+        {
+            for (uint32_t c = 0; c < 3u; c++)
+            {
+                centroid[c] /= area;
+            }
+        }
+        const float normalLen = sqrtf(normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2]);
+        const float invLen    = normalLen > 0.0f ? 1.0f / normalLen : 0.0f;
+
+        clusterSortKey[cl] = ((centroid[0] - meshCentroid[0]) * normal[0]
+                            + (centroid[1] - meshCentroid[1]) * normal[1]
+                            + (centroid[2] - meshCentroid[2]) * normal[2]) * invLen;
+    }
+
+    std::vector<uint32_t> clusterOrder(clusterCount);
+    for (uint32_t cl = 0; cl < clusterCount; cl++)
+    {
+        clusterOrder[cl] = cl;
+    }
+    std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&clusterSortKey](uint32_t a, uint32_t b)
+    {
+        return clusterSortKey[a] > clusterSortKey[b];
+    });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (uint32_t cl : clusterOrder)
+    {
+        result.insert(result.end(), indices.begin() + 3u*clusterStarts[cl], indices.begin() + 3u*clusterStarts[cl + 1u]);
+    }
+
+    const float acmrBefore = computeCacheStats(indices, vertexCount).acmr;
+    const float acmrAfter  = computeCacheStats(result,  vertexCount).acmr;
+    if (acmrAfter <= acmrBefore * MESH_OVERDRAW_ACMR_THRESHOLD)
+    {
+        indices.swap(result);
+    }
+}
+
+// } // OVERDRAW
+
+// VERTEX_FETCH {
+
+/// Reorders vertices in order of first use by the index buffer, drops unused ones.
+void optimizeVertexFetch(MeshData& mesh)
+{
+    const uint32_t unused = ~0u;
+    std::vector<uint32_t>   remap(mesh.vertices.size(), unused);
+    std::vector<MeshVertex> reordered;
+    reordered.reserve(mesh.vertices.size());
+
+    for (uint32_t& idx : mesh.indices)
+    {
+        if (remap[idx] == unused)
+        {
+            remap[idx] = reordered.size();
+            reordered.push_back(mesh.vertices[idx]);
+        }
+        idx = remap[idx];
+    }
+
+    mesh.vertices.swap(reordered);
+}
+
+// } // VERTEX_FETCH
+
+/// Runs all the optimizations and prints cache statistics before and after.
+void optimizeMesh(MeshData& mesh, const std::string& meshName)
+{
+    const uint32_t       vertexCountBefore = mesh.vertices.size();
+    const MeshCacheStats statsBefore       = computeCacheStats(mesh.indices, vertexCountBefore);
+
+    weldVertices(mesh);
+    optimizeVertexCache(mesh.indices, mesh.vertices.size());
+    optimizeOverdraw(mesh.indices, mesh.vertices);
+    optimizeVertexFetch(mesh);
+
+    const MeshCacheStats statsAfter = computeCacheStats(mesh.indices, mesh.vertices.size());
+
+    std::cout << " >>> optimizeMesh: " << meshName
+              << ": vertices " << vertexCountBefore << " -> " << mesh.vertices.size()
+              << ", ACMR " << statsBefore.acmr << " -> " << statsAfter.acmr
+              << ", ATVR " << statsBefore.atvr << " -> " << statsAfter.atvr << "\n";
+}
+
+} // namespace vk229
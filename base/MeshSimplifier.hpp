@@ -0,0 +1,441 @@
+#pragma once
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+#include <MeshData.hpp>
+#include <MeshOptimizer.hpp>
+
+namespace vk229
+{
+/////////////////////////////////////////
+/// Mesh simplification and LOD chain generation.
+/// Half-edge collapses ordered by quadric error (Garland, Heckbert) with normal deviation penalty.
+/// Vertices are never moved or created, so all LODs share the vertex buffer
+/// and every LOD is just a range of the index buffer.
+/// Vertices on UV seams, hard edges (more vertices at one position) and open borders are locked.
+/////////////////////////////////////////
+
+/// Max number of LODs including full detail one.
+#define MESH_LOD_MAX_COUNT        5u
+/// Triangle count of a LOD relative to the previous one.
+#define MESH_LOD_REDUCTION        0.5f
+/// Max geometric error of LOD 1 relative to bounding sphere radius, doubled with every next LOD.
+#define MESH_LOD_BASE_ERROR       0.01f
+/// Weight of normal deviation in collapse cost, relative to bounding sphere radius.
+#define MESH_LOD_NORMAL_WEIGHT    0.05f
+
+//////////////////////////////////////
+/// Range of LOD's triangles in the mesh's index buffer.
+struct MeshLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float    error;      // Max collapse error, in mesh units.
+};
+
+struct BoundingSphere
+{
+    float center[3];
+    float radius;
+};
+
+BoundingSphere computeBoundingSphere(const std::vector<MeshVertex>& vertices)
+{
+    float bbMin[3] = { INFINITY,  INFINITY,  INFINITY};
+    float bbMax[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (const MeshVertex& v : vertices)
+    {
+        for (uint32_t c = 0; c < 3u; c++)
+        {
+            bbMin[c] = fminf(bbMin[c], v.pos[c]);
+            bbMax[c] = fmaxf(bbMax[c], v.pos[c]);
+        }
+    }
+
+    BoundingSphere sphere = {{0.0f, 0.0f, 0.0f}, 0.0f};
+    if (vertices.empty())
+    {
+        return sphere;
+    }
+
+    for (uint32_t c = 0; c < 3u; c++)
+    {
+        sphere.center[c] = 0.5f * (bbMin[c] + bbMax[c]);
+    }
+    for (const MeshVertex& v : vertices)
+    {
+        const float d[3] = {v.pos[0] - sphere.center[0], v.pos[1] - sphere.center[1], v.pos[2] - sphere.center[2]};
+        sphere.radius = fmaxf(sphere.radius, sqrtf(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]));
+    }
+    return sphere;
+}
+
+// QUADRIC {
+
+/// Symmetric 4x4 matrix: a2 ab ac ad b2 bc bd c2 cd d2.
+struct Quadric
+{
+    double q[10];
+};
+
+void addPlaneToQuadric(Quadric& quadric, const double n[3], double d, double weight)
+{
+    const double p[4] = {n[0], n[1], n[2], d};
+    uint32_t k = 0u;
+    for (uint32_t i = 0; i < 4u; i++)
+    {
+        for (uint32_t j = i; j < 4u; j++)
+        {
+            quadric.q[k++] += weight * p[i] * p[j];
+        }
+    }
+}
+
+void addQuadric(Quadric& dst, const Quadric& src)
+{
+    for (uint32_t k = 0; k < 10u; k++)
+    {
+        dst.q[k] += src.q[k];
+    }
+}
+
+/// Sum of squared distances to the quadric's planes.
+double evaluateQuadric(const Quadric& quadric, const float pos[3])
+{
+    const double p[4] = {pos[0], pos[1], pos[2], 1.0};
+    double   result = 0.0;
+    uint32_t k      = 0u;
+    for (uint32_t i = 0; i < 4u; i++)
+    {
+        for (uint32_t j = i; j < 4u; j++)
+        {
+            result += (i == j ? 1.0 : 2.0) * quadric.q[k++] * p[i] * p[j];
+        }
+    }
+    return fmax(result, 0.0);
+}
+
+// } // QUADRIC
+
+// SIMPLIFY {
+
+struct EdgeCollapse
+{
+    float    cost;
+    uint32_t from;
+    uint32_t to;
+    uint32_t fromVersion;
+    uint32_t toVersion;
+
+    bool operator>(const EdgeCollapse& other) const
+    {
+        return this->cost > other.cost;
+    }
+};
+
+/// Triangle normal, not normalized (length = 2 * area).
+void getTriangleNormal(const float* p0, const float* p1, const float* p2, double outN[3])
+{
+    const double e1[3] = {double(p1[0]) - p0[0], double(p1[1]) - p0[1], double(p1[2]) - p0[2]};
+    const double e2[3] = {double(p2[0]) - p0[0], double(p2[1]) - p0[1], double(p2[2]) - p0[2]};
+    outN[0] = e1[1]*e2[2] - e1[2]*e2[1];
+    outN[1] = e1[2]*e2[0] - e1[0]*e2[2];
+    outN[2] = e1[0]*e2[1] - e1[1]*e2[0];
+}
+
+/// Simplifies triangles given by indices down to targetIndexCount, stops earlier when
+/// the cheapest collapse exceeds maxError (squared distance, mesh units).
+/// Returns the largest error of performed collapses.
+float simplifyMesh(const std::vector<MeshVertex>& vertices,
+                   const std::vector<uint32_t>&   indices,
+                   uint32_t                       targetIndexCount,
+                   float                          maxError,
+                   float                          normalWeight,
+                   std::vector<uint32_t>&         outIndices)
+{
+    const uint32_t vertexCount   = vertices.size();
+    const uint32_t triangleCount = indices.size() / 3u;
+
+    // Vertices sharing position - seams and hard edges.
+    std::vector<uint32_t> positionId(vertexCount);
+    std::vector<uint32_t> positionUseCount;
+    {
+        std::vector<uint32_t> order(vertexCount);
+        for (uint32_t i = 0; i < vertexCount; i++)
+        {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&vertices](uint32_t a, uint32_t b)
+        {
+            return memcmp(vertices[a].pos, vertices[b].pos, sizeof(vertices[a].pos)) < 0;
+        });
+        for (uint32_t i = 0; i < vertexCount; i++)
+        {
+            if (i == 0u || memcmp(vertices[order[i]].pos, vertices[order[i - 1u]].pos, sizeof(vertices[0].pos)) != 0)
+            {
+                positionUseCount.push_back(0u);
+            }
+            positionId[order[i]] = positionUseCount.size() - 1u;
+            positionUseCount.back()++;
+        }
+    }
+
+    std::vector<bool> locked(vertexCount, false);
+    for (uint32_t v = 0; v < vertexCount; v++)
+    {
+        locked[v] = positionUseCount[positionId[v]] > 1u;
+    }
+
+    // Open borders - edges used by one triangle only (in position space, so seams are not borders).
+    {
+        std::map<uint64_t, uint32_t> edgeUseCount;
+        for (uint32_t t = 0; t < triangleCount; t++)
+        {
+            for (uint32_t c = 0; c < 3u; c++)
+            {
+                const uint64_t pa = positionId[indices[3u*t + c]];
+                const uint64_t pb = positionId[indices[3u*t + (c + 1u) % 3u]];
+                edgeUseCount[pa < pb ? (pa << 32 | pb) : (pb << 32 | pa)]++;
+            }
+        }
+        for (uint32_t t = 0; t < triangleCount; t++)
+        {
+            for (uint32_t c = 0; c < 3u; c++)
+            {
+                const uint32_t a  = indices[3u*t + c];
+                const uint32_t b  = indices[3u*t + (c + 1u) % 3u];
+                const uint64_t pa = positionId[a];
+                const uint64_t pb = positionId[b];
+                if (edgeUseCount[pa < pb ? (pa << 32 | pb) : (pb << 32 | pa)] == 1u)
+                {
+                    locked[a] = true;
+                    locked[b] = true;
+                }
+            }
+        }
+    }
+
+    // Quadrics and vertex -> triangles adjacency.
+    std::vector<Quadric>               quadrics(vertexCount);
+    std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+    memset(quadrics.data(), 0, quadrics.size() * sizeof(Quadric));
+
+    std::vector<uint32_t> triangles(indices);
+    std::vector<bool>     triangleRemoved(triangleCount, false);
+    uint32_t              liveTriangles = triangleCount;
+
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        double n[3];
+        getTriangleNormal(vertices[triangles[3u*t]].pos, vertices[triangles[3u*t + 1u]].pos, vertices[triangles[3u*t + 2u]].pos, n);
+        const double len = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        if (len > 0.0)
+        {
+            const double un[3] = {n[0]/len, n[1]/len, n[2]/len};
+            const float* p0    = vertices[triangles[3u*t]].pos;
+            const double d     = -(un[0]*p0[0] + un[1]*p0[1] + un[2]*p0[2]);
+            for (uint32_t c = 0; c < 3u; c++)
+            {
+                addPlaneToQuadric(quadrics[triangles[3u*t + c]], un, d, 0.5 * len); // Area weighted.
+            }
+        }
+        for (uint32_t c = 0; c < 3u; c++)
+        {
+            vertexTriangles[triangles[3u*t + c]].push_back(t);
+        }
+    }
+
+    std::vector<uint32_t> version(vertexCount, 0u);
+    std::vector<bool>     collapsed(vertexCount, false);
+
+    auto getCost = [&](uint32_t from, uint32_t to)
+    {
+        const float* nf = vertices[from].normal;
+        const float* nt = vertices[to].normal;
+        const float  normalDeviation = 1.0f - (nf[0]*nt[0] + nf[1]*nt[1] + nf[2]*nt[2]);
+        return float(evaluateQuadric(quadrics[from], vertices[to].pos)) + normalDeviation * normalWeight * normalWeight;
+    };
+
+    std::priority_queue<EdgeCollapse, std::vector<EdgeCollapse>, std::greater<EdgeCollapse>> heap;
+    auto pushCollapse = [&](uint32_t from, uint32_t to)
+    {
+        if (!locked[from] && !collapsed[from] && !collapsed[to] && from != to)
+        {
+            heap.push({getCost(from, to), from, to, version[from], version[to]});
+        }
+    };
+
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        for (uint32_t c = 0; c < 3u; c++)
+        {
+            pushCollapse(triangles[3u*t + c], triangles[3u*t + (c + 1u) % 3u]);
+            pushCollapse(triangles[3u*t + (c + 1u) % 3u], triangles[3u*t + c]);
+        }
+    }
+
+    float resultError = 0.0f;
+    const uint32_t targetTriangles = targetIndexCount / 3u;
+
+    while (liveTriangles > targetTriangles && !heap.empty())
+    {
+        const EdgeCollapse ec = heap.top();
+        heap.pop();
+
+        if (collapsed[ec.from] || collapsed[ec.to] || version[ec.from] != ec.fromVersion || version[ec.to] != ec.toVersion)
+        {
+            continue; // Stale.
+        }
+        if (ec.cost > maxError)
+        {
+            break;
+        }
+
+        // Collapse must not flip or degenerate any remaining triangle.
+        bool valid = true;
+        for (uint32_t t : vertexTriangles[ec.from])
+        {
+            if (triangleRemoved[t])
+            {
+                continue;
+            }
+            const uint32_t* tri = &triangles[3u*t];
+            if (tri[0] == ec.to || tri[1] == ec.to || tri[2] == ec.to)
+            {
+                continue; // Removed by this collapse.
+            }
+
+            const float* before[3];
+            const float* after[3];
+            for (uint32_t c = 0; c < 3u; c++)
+            {
+                before[c] = vertices[tri[c]].pos;
+                after[c]  = vertices[tri[c] == ec.from ? ec.to : tri[c]].pos;
+            }
+            double nb[3], na[3];
+            getTriangleNormal(before[0], before[1], before[2], nb);
+            getTriangleNormal(after[0],  after[1],  after[2],  na);
+            const double dotBA = nb[0]*na[0] + nb[1]*na[1] + nb[2]*na[2];
+            const double lenB  = sqrt(nb[0]*nb[0] + nb[1]*nb[1] + nb[2]*nb[2]);
+            const double lenA  = sqrt(na[0]*na[0] + na[1]*na[1] + na[2]*na[2]);
+            if (lenA <= 0.0 || dotBA < 0.25 * lenB * lenA)
+            {
+                valid = false;
+                break;
+            }
+        }
+        if (!valid)
+        {
+            continue;
+        }
+
+        // Apply.
+        std::vector<uint32_t> neighbours;
+        for (uint32_t t : vertexTriangles[ec.from])
+        {
+            if (triangleRemoved[t])
+            {
+                continue;
+            }
+            uint32_t* tri = &triangles[3u*t];
+            if (tri[0] == ec.to || tri[1] == ec.to || tri[2] == ec.to)
+            {
+                triangleRemoved[t] = true;
+                liveTriangles--;
+                continue;
+            }
+            for (uint32_t c = 0; c < 3u; c++)
+            {
+                if (tri[c] == ec.from)
+                {
+                    tri[c] = ec.to;
+                }
+                else
+                {
+                    neighbours.push_back(tri[c]);
+                }
+            }
+            vertexTriangles[ec.to].push_back(t);
+        }
+
+        collapsed[ec.from] = true;
+        addQuadric(quadrics[ec.to], quadrics[ec.from]);
+        version[ec.to]++;
+        resultError = fmaxf(resultError, ec.cost);
+
+        for (uint32_t n : neighbours)
+        {
+            pushCollapse(n, ec.to);
+            pushCollapse(ec.to, n);
+        }
+    }
+
+    outIndices.clear();
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        if (!triangleRemoved[t])
+        {
+            outIndices.insert(outIndices.end(), triangles.begin() + 3u*t, triangles.begin() + 3u*t + 3u);
+        }
+    }
+
+    return resultError;
+}
+
+// } // SIMPLIFY
+
+// LOD_CHAIN {
+
+/// Appends LODs 1..n to mesh.indices, mesh.indices on input is LOD 0.
+/// Every LOD is simplified from the previous one and optimized for vertex cache.
+/// Chain ends when simplification can not reach noticeably fewer triangles.
+void buildLodChain(MeshData& mesh, const std::string& meshName, std::vector<MeshLod>& outLods)
+{
+    outLods.clear();
+    outLods.push_back({0u, uint32_t(mesh.indices.size()), 0.0f});
+
+    const float radius = computeBoundingSphere(mesh.vertices).radius;
+
+    std::vector<uint32_t> prevLodIndices(mesh.indices);
+    std::vector<uint32_t> lodIndices;
+    float relativeError = MESH_LOD_BASE_ERROR;
+
+    while (outLods.size() < MESH_LOD_MAX_COUNT)
+    {
+        const uint32_t targetIndexCount = uint32_t(prevLodIndices.size() * MESH_LOD_REDUCTION) / 3u * 3u;
+        const float    maxError         = (relativeError * radius) * (relativeError * radius);
+
+        const float error = simplifyMesh(mesh.vertices, prevLodIndices, targetIndexCount, maxError, MESH_LOD_NORMAL_WEIGHT * radius, lodIndices);
+        if (lodIndices.empty() || lodIndices.size() > prevLodIndices.size() * 0.9f)
+        {
+            break;
+        }
+
+        optimizeVertexCache(lodIndices, mesh.vertices.size());
+
+        outLods.push_back({uint32_t(mesh.indices.size()), uint32_t(lodIndices.size()), sqrtf(error)});
+        mesh.indices.insert(mesh.indices.end(), lodIndices.begin(), lodIndices.end());
+
+        prevLodIndices.swap(lodIndices);
+        relativeError *= 2.0f;
+    }
+
+    std::cout << " >>> buildLodChain: " << meshName << ": triangles per LOD:";
+    for (const MeshLod& lod : outLods)
+    {
+        std::cout << " " << lod.indexCount / 3u;
+    }
+    std::cout << "\n";
+}
+
+// } // LOD_CHAIN
+
+} // namespace vk229
@@ -0,0 +1,338 @@
+#pragma once
+
+#include <assert.h>
+#include <vulkan/vulkan.h>
+#include <iostream>
+#include <string.h>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <VulkanTools.h>
+#include <VulkanInitializers.hpp>
+#include <ThreadPool.hpp>
+
+namespace vk229
+{
+
+using compile_ticket_t = uint32_t;
+
+//////////////////////////////////////
+/// Self-contained description of a graphics pipeline.
+/// All the state pointed to by VkGraphicsPipelineCreateInfo lives inside,
+/// so a descriptor can be handed over to another thread and compiled there.
+/// Defaults are the ones used by all the pipelines in this repo:
+/// * triangle list,
+/// * back face culling, clockwise front face,
+/// * depth test and write with VK_COMPARE_OP_LESS_OR_EQUAL,
+/// * one color attachment without blending,
+/// * dynamic viewport and scissor.
+/// Specialization constants can be given per shader stage with setSpecialization().
+struct GraphicsPipelineDesc
+{
+    struct StageSpecialization
+    {
+        std::vector<VkSpecializationMapEntry> mapEntries;
+        std::vector<uint8_t>                  data;
+        VkSpecializationInfo                  info;
+    };
+
+    VkPipelineLayout layout     = VK_NULL_HANDLE;
+    VkRenderPass     renderPass = VK_NULL_HANDLE;
+    uint32_t         subpass    = 0u;
+
+    std::vector<VkPipelineShaderStageCreateInfo>     shaderStages;
+    std::vector<VkVertexInputBindingDescription>     bindingDescriptions;
+    std::vector<VkVertexInputAttributeDescription>   attributeDescriptions;
+    std::vector<VkPipelineColorBlendAttachmentState> blendAttachmentStates;
+    std::vector<VkDynamicState>                      dynamicStateEnables;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyState;
+    VkPipelineTessellationStateCreateInfo  tessellationState;  // Used if patchControlPoints > 0 (VK_PRIMITIVE_TOPOLOGY_PATCH_LIST).
+    VkPipelineRasterizationStateCreateInfo rasterizationState;
+    VkPipelineColorBlendStateCreateInfo    colorBlendState;
+    VkPipelineDepthStencilStateCreateInfo  depthStencilState;
+    VkPipelineViewportStateCreateInfo      viewportState;
+    VkPipelineMultisampleStateCreateInfo   multisampleState;
+    VkPipelineDynamicStateCreateInfo       dynamicState;
+    VkPipelineVertexInputStateCreateInfo   vertexInputState;
+
+    std::map<VkShaderStageFlagBits, StageSpecialization> stageSpecializations;
+
+    GraphicsPipelineDesc() :
+        GraphicsPipelineDesc(VK_NULL_HANDLE, VK_NULL_HANDLE)
+    {
+    }
+
+    GraphicsPipelineDesc(VkPipelineLayout pipLayout, VkRenderPass rPass) :
+        layout(pipLayout),
+        renderPass(rPass)
+    {
+        this->inputAssemblyState =
+            vks::initializers::pipelineInputAssemblyStateCreateInfo(
+                VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+                0,
+                VK_FALSE);
+
+        this->tessellationState = vks::initializers::pipelineTessellationStateCreateInfo(0);
+
+        this->rasterizationState =
+            vks::initializers::pipelineRasterizationStateCreateInfo(
+                VK_POLYGON_MODE_FILL,
+                VK_CULL_MODE_BACK_BIT,
+                VK_FRONT_FACE_CLOCKWISE,
+                0);
+
+        this->blendAttachmentStates = {
+            vks::initializers::pipelineColorBlendAttachmentState(
+                0xf,
+                VK_FALSE),
+        };
+
+        this->colorBlendState =
+            vks::initializers::pipelineColorBlendStateCreateInfo(
+                this->blendAttachmentStates.size(),
+                this->blendAttachmentStates.data());
+
+        this->depthStencilState =
+            vks::initializers::pipelineDepthStencilStateCreateInfo(
+                VK_TRUE,
+                VK_TRUE,
+                VK_COMPARE_OP_LESS_OR_EQUAL);
+
+        this->viewportState =
+            vks::initializers::pipelineViewportStateCreateInfo(1, 1, 0);
+
+        this->multisampleState =
+            vks::initializers::pipelineMultisampleStateCreateInfo(
+                VK_SAMPLE_COUNT_1_BIT,
+                0);
+
+        this->dynamicStateEnables = {
+            VK_DYNAMIC_STATE_VIEWPORT,
+            VK_DYNAMIC_STATE_SCISSOR
+        };
+
+        this->dynamicState =
+            vks::initializers::pipelineDynamicStateCreateInfo(
+                this->dynamicStateEnables.data(),
+                this->dynamicStateEnables.size(),
+                0);
+
+        this->vertexInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
+    }
+
+    /// Stores a copy of specialization constants for the stage - they are applied to the shader stage of given type.
+    void setSpecialization(VkShaderStageFlagBits stage, const std::vector<VkSpecializationMapEntry>& mapEntries, const void* data, size_t dataSize)
+    {
+        StageSpecialization& spec = this->stageSpecializations[stage];
+        spec.mapEntries = mapEntries;
+        spec.data.resize(dataSize);
+        memcpy(spec.data.data(), data, dataSize);
+    }
+
+    /// Points nested create infos at this object's own storage and returns create info ready for vkCreateGraphicsPipelines.
+    /// Pointers are refreshed on every call, so it has to be called on the final copy of the descriptor.
+    VkGraphicsPipelineCreateInfo getCreateInfo()
+    {
+        this->colorBlendState.attachmentCount = this->blendAttachmentStates.size();
+        this->colorBlendState.pAttachments    = this->blendAttachmentStates.data();
+
+        this->dynamicState.dynamicStateCount = this->dynamicStateEnables.size();
+        this->dynamicState.pDynamicStates    = this->dynamicStateEnables.data();
+
+        this->vertexInputState.vertexBindingDescriptionCount   = this->bindingDescriptions.size();
+        this->vertexInputState.pVertexBindingDescriptions      = this->bindingDescriptions.data();
+        this->vertexInputState.vertexAttributeDescriptionCount = this->attributeDescriptions.size();
+        this->vertexInputState.pVertexAttributeDescriptions    = this->attributeDescriptions.data();
+
+        for (VkPipelineShaderStageCreateInfo& shaderStage : this->shaderStages)
+        {
+            auto specIt = this->stageSpecializations.find(shaderStage.stage);
+            if (specIt == this->stageSpecializations.end())
+            {
+                continue;
+            }
+
+            StageSpecialization& spec = specIt->second;
+            spec.info.mapEntryCount = spec.mapEntries.size();
+            spec.info.pMapEntries   = spec.mapEntries.data();
+            spec.info.dataSize      = spec.data.size();
+            spec.info.pData         = spec.data.data();
+
+            shaderStage.pSpecializationInfo = &spec.info;
+        }
+
+        VkGraphicsPipelineCreateInfo pipelineCreateInfo =
+            vks::initializers::pipelineCreateInfo(
+                this->layout,
+                this->renderPass,
+                0);
+
+        pipelineCreateInfo.subpass             = this->subpass;
+        pipelineCreateInfo.pInputAssemblyState = &this->inputAssemblyState;
+        pipelineCreateInfo.pTessellationState  = (this->tessellationState.patchControlPoints > 0u) ? &this->tessellationState : nullptr;
+        pipelineCreateInfo.pRasterizationState = &this->rasterizationState;
+        pipelineCreateInfo.pColorBlendState    = &this->colorBlendState;
+        pipelineCreateInfo.pMultisampleState   = &this->multisampleState;
+        pipelineCreateInfo.pViewportState      = &this->viewportState;
+        pipelineCreateInfo.pDepthStencilState  = &this->depthStencilState;
+        pipelineCreateInfo.pDynamicState       = &this->dynamicState;
+        pipelineCreateInfo.pVertexInputState   = &this->vertexInputState;
+        pipelineCreateInfo.stageCount          = this->shaderStages.size();
+        pipelineCreateInfo.pStages             = this->shaderStages.data();
+
+        return pipelineCreateInfo;
+    }
+};
+
+//////////////////////////////////////
+/// Compiles graphics pipelines on a pool of worker threads.
+/// Every worker owns its VkPipelineCache, so workers never contend on a cache lock.
+/// Worker caches are merged into the target cache (the one saved/used by the example)
+/// with vkMergePipelineCaches when work is finished.
+/// Two modes:
+/// * compile()      - batch of pipelines spread across workers, blocks until all are ready,
+/// * compileAsync() - background compilation, result is polled with tryGetResult().
+/// Everything except the worker jobs themselves has to be called from one (main) thread.
+class PipelineCompiler
+{
+public:
+    PipelineCompiler(VkDevice dev, VkPipelineCache targetCache, uint32_t workerCount = 0u) :
+        device(dev),
+        targetPipelineCache(targetCache),
+        pool(workerCount)
+    {
+        VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
+        pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+        this->workerCaches.resize(this->pool.getWorkerCount());
+        for (VkPipelineCache& workerCache : this->workerCaches)
+        {
+            VK_CHECK_RESULT(vkCreatePipelineCache(this->device, &pipelineCacheCreateInfo, nullptr, &workerCache));
+        }
+    }
+
+    ~PipelineCompiler()
+    {
+        this->pool.stop(); // Finishes queued jobs.
+
+        for (auto& [ticket, job] : this->asyncJobs) // Results nobody asked for.
+        {
+            vkDestroyPipeline(this->device, job->pipeline, nullptr);
+        }
+        this->asyncJobs.clear();
+
+        this->mergeCaches();
+
+        for (VkPipelineCache& workerCache : this->workerCaches)
+        {
+            vkDestroyPipelineCache(this->device, workerCache, nullptr);
+        }
+    }
+
+    PipelineCompiler(const PipelineCompiler&) = delete;
+    PipelineCompiler& operator=(const PipelineCompiler&) = delete;
+
+    /// Compiles all given pipelines in parallel and waits for them.
+    /// Output pipelines are in the same order as descriptors.
+    void compile(std::vector<GraphicsPipelineDesc>& descs, std::vector<VkPipeline>& outPipelines)
+    {
+        outPipelines.assign(descs.size(), VK_NULL_HANDLE);
+
+        for (size_t i = 0; i < descs.size(); i++)
+        {
+            GraphicsPipelineDesc* desc = &descs[i];
+            VkPipeline*           out  = &outPipelines[i];
+            this->pool.push([this, desc, out](uint32_t workerId)
+            {
+                this->createPipeline(workerId, *desc, *out);
+            });
+        }
+
+        this->pool.waitIdle();
+        this->mergeCaches();
+    }
+
+    /// Queues a pipeline for background compilation. Descriptor is copied.
+    compile_ticket_t compileAsync(const GraphicsPipelineDesc& desc)
+    {
+        const compile_ticket_t ticket = this->nextTicket++;
+
+        std::unique_ptr<AsyncJob> job(new AsyncJob());
+        job->desc = desc;
+
+        AsyncJob* jobPtr = job.get();
+        this->asyncJobs[ticket] = std::move(job);
+
+        this->pool.push([this, jobPtr](uint32_t workerId)
+        {
+            this->createPipeline(workerId, jobPtr->desc, jobPtr->pipeline);
+            jobPtr->done.store(true, std::memory_order_release);
+        });
+
+        return ticket;
+    }
+
+    /// Non-blocking. Returns true and hands over the pipeline if ticket is finished.
+    bool tryGetResult(compile_ticket_t ticket, VkPipeline& outPipeline)
+    {
+        auto jobIt = this->asyncJobs.find(ticket);
+        assert(jobIt != this->asyncJobs.end());
+
+        if (false == jobIt->second->done.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        outPipeline = jobIt->second->pipeline;
+        this->asyncJobs.erase(jobIt);
+        return true;
+    }
+
+    uint32_t getPendingCount() const
+    {
+        return this->asyncJobs.size();
+    }
+
+    uint32_t getWorkerCount() const
+    {
+        return this->workerCaches.size();
+    }
+
+    /// Merges all worker caches into the target cache.
+    /// Target cache must not be used by anything else meanwhile.
+    void mergeCaches()
+    {
+        if (this->targetPipelineCache == VK_NULL_HANDLE || this->workerCaches.empty())
+        {
+            return;
+        }
+        VK_CHECK_RESULT(vkMergePipelineCaches(this->device, this->targetPipelineCache, this->workerCaches.size(), this->workerCaches.data()));
+    }
+
+private:
+    struct AsyncJob
+    {
+        GraphicsPipelineDesc desc;
+        VkPipeline           pipeline = VK_NULL_HANDLE;
+        std::atomic<bool>    done{false};
+    };
+
+    void createPipeline(uint32_t workerId, GraphicsPipelineDesc& desc, VkPipeline& outPipeline)
+    {
+        VkGraphicsPipelineCreateInfo pipelineCreateInfo = desc.getCreateInfo();
+        VK_CHECK_RESULT(vkCreateGraphicsPipelines(this->device, this->workerCaches[workerId], 1, &pipelineCreateInfo, nullptr, &outPipeline));
+    }
+
+    VkDevice                     device;
+    VkPipelineCache              targetPipelineCache;
+    std::vector<VkPipelineCache> workerCaches;
+
+    std::map<compile_ticket_t, std::unique_ptr<AsyncJob>> asyncJobs; // Touched only by main thread.
+    compile_ticket_t                                      nextTicket = 0u;
+
+    ThreadPool pool; // Last member - workers go away before the rest.
+};
+
+} // namespace vk229
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+#define SPHERE_PATCH_VERTEX_COUNT    60u     // Icosahedron - 20 patches of 3 vertices, taken from a table in sphere.vert (no vertex buffer).
+#define SPHERE_MAX_TESS_LEVEL        64.0f   // Minimum of maxTessellationGenerationLevel guaranteed by Vulkan.
+#define SPHERE_ERROR_PIXELS          0.5f    // Largest distance of tessellated sphere from the ideal one, in pixels...
+#define SPHERE_DISPLACED_EDGE_PIXELS 8.0f    // ...and longest edge of a displaced one - it has detail of the texture.
+
+namespace vk229
+{
+
+//////////////////////////////////////
+/// Spheres without meshes - icosahedron patches refined by sphere.tesc / sphere.tese:
+/// * level of every patch edge is the number of segments which keeps the chord off the arc by at most
+///   errorPixels on screen, so triangle count follows projected size of the sphere
+/// * patches behind the horizon (displaced heights included) get level 0 and are dropped
+/// * displacement moves vertices along the normal by the texture's red channel - 0.5 is the radius,
+///   0 and 1 are radius * (1 -/+ displacement)
+/// Every edge's level depends only on its two corners, so neighbouring patches always agree and there are no cracks.
+/// getSphereEdgeTessLevel() and estimateSphereTriangles() mirror the shaders on the CPU.
+
+/// Push constants of sphere.tesc / sphere.tese, std430.
+struct SpherePushConstants
+{
+    glm::vec4 centerRadius;                         // xyz - center (offset from the light if followsLight), w - radius
+    float     displacement   = 0.0f;                // Relative to the radius, 0 - texture is not read
+    uint32_t  followsLight   = 0u;                  // 1 - center is added to UBO's lightPos
+    float     errorPixels    = SPHERE_ERROR_PIXELS;
+    float     viewportHeight = 0.0f;                // Pixels of the render target - of the scaled extent with dynamic resolution
+};
+
+/// Unit vectors of icosahedron's corners, (0, +-1, +-phi) and its cyclic permutations normalized. Same as in sphere.vert.
+const glm::vec3 ICOSAHEDRON_VERTICES[12] = {
+    {-0.525731f,  0.850651f,  0.0f}, { 0.525731f,  0.850651f,  0.0f}, {-0.525731f, -0.850651f,  0.0f}, { 0.525731f, -0.850651f,  0.0f},
+    { 0.0f,      -0.525731f,  0.850651f}, { 0.0f,  0.525731f,  0.850651f}, { 0.0f, -0.525731f, -0.850651f}, { 0.0f,  0.525731f, -0.850651f},
+    { 0.850651f,  0.0f,      -0.525731f}, { 0.850651f,  0.0f,  0.525731f}, {-0.850651f,  0.0f, -0.525731f}, {-0.850651f,  0.0f,  0.525731f},
+};
+
+/// Patches, counter-clockwise seen from outside. Same as in sphere.vert.
+const uint32_t ICOSAHEDRON_INDICES[SPHERE_PATCH_VERTEX_COUNT] = {
+    0, 11,  5,   0,  5,  1,   0,  1,  7,   0,  7, 10,   0, 10, 11,
+    1,  5,  9,   5, 11,  4,  11, 10,  2,  10,  7,  6,   7,  1,  8,
+    3,  9,  4,   3,  4,  2,   3,  2,  6,   3,  6,  8,   3,  8,  9,
+    4,  9,  5,   2,  4, 11,   6,  2, 10,   8,  6,  7,   9,  8,  1,
+};
+
+/// Level of the patch edge between unit directions d0 and d1 - getEdgeLevel() of sphere.tesc.
+/// projScaleY is projection[1][1].
+float getSphereEdgeTessLevel(const glm::vec3& d0, const glm::vec3& d1, const glm::vec3& center, const glm::vec3& camPos,
+                             const SpherePushConstants& sphere, float projScaleY)
+{
+    const float radius    = sphere.centerRadius.w;
+    const glm::vec3 mid   = center + radius * glm::normalize(d0 + d1);
+    const float dist      = std::max(glm::length(camPos - mid), 0.001f * radius);
+    const float pixelSize = dist / (0.5f * sphere.viewportHeight * fabsf(projScaleY)); // World units per pixel at the edge.
+    const float angle     = acosf(std::min(1.0f, std::max(-1.0f, glm::dot(d0, d1))));
+
+    // Chord of an arc of angle a is off the arc by radius * (1 - cos(a / 2)).
+    const float segmentAngle = 2.0f * acosf(std::min(1.0f, std::max(-1.0f, 1.0f - sphere.errorPixels * pixelSize / radius)));
+    float level = angle / std::max(segmentAngle, 0.0001f);
+    if (sphere.displacement > 0.0f)
+    {
+        level = std::max(level, radius * angle / (pixelSize * SPHERE_DISPLACED_EDGE_PIXELS));
+    }
+    return std::min(SPHERE_MAX_TESS_LEVEL, std::max(1.0f, ceilf(level)));
+}
+
+/// True if no point of the patch (displaced heights included) can be seen from camPos - isPatchHidden() of sphere.tesc.
+bool isSpherePatchHidden(const glm::vec3& d0, const glm::vec3& d1, const glm::vec3& d2, const glm::vec3& center, const glm::vec3& camPos,
+                         const SpherePushConstants& sphere)
+{
+    const float     innerRadius = sphere.centerRadius.w * (1.0f - sphere.displacement);
+    const glm::vec3 toCam       = camPos - center;
+    const float     camDist     = glm::length(toCam);
+    if (camDist <= innerRadius)
+    {
+        return false;
+    }
+
+    // Bounding cone of the patch against the horizon of the inner sphere, widened by how far the highest points see over it.
+    const glm::vec3 axis      = glm::normalize(d0 + d1 + d2);
+    const float     coneAngle = acosf(std::min(1.0f, std::min(glm::dot(axis, d0), std::min(glm::dot(axis, d1), glm::dot(axis, d2)))));
+    const float     horizon   = acosf(innerRadius / camDist) + acosf((1.0f - sphere.displacement) / (1.0f + sphere.displacement));
+    const float     camAngle  = acosf(std::min(1.0f, std::max(-1.0f, glm::dot(axis, toCam / camDist))));
+    return camAngle - coneAngle > horizon;
+}
+
+/// Triangles sphere.tesc / sphere.tese generate for the camera - inner level of a patch is its largest edge level,
+/// a triangle patch of inner level n has about n^2 triangles.
+uint32_t estimateSphereTriangles(const glm::vec3& center, const glm::vec3& camPos, const SpherePushConstants& sphere, float projScaleY)
+{
+    uint32_t triangleCount = 0u;
+    for (uint32_t i = 0; i < SPHERE_PATCH_VERTEX_COUNT; i += 3u)
+    {
+        const glm::vec3& d0 = ICOSAHEDRON_VERTICES[ICOSAHEDRON_INDICES[i]];
+        const glm::vec3& d1 = ICOSAHEDRON_VERTICES[ICOSAHEDRON_INDICES[i + 1u]];
+        const glm::vec3& d2 = ICOSAHEDRON_VERTICES[ICOSAHEDRON_INDICES[i + 2u]];
+        if (isSpherePatchHidden(d0, d1, d2, center, camPos, sphere))
+        {
+            continue;
+        }
+
+        const float inner = std::max(getSphereEdgeTessLevel(d1, d2, center, camPos, sphere, projScaleY),
+                            std::max(getSphereEdgeTessLevel(d2, d0, center, camPos, sphere, projScaleY),
+                                     getSphereEdgeTessLevel(d0, d1, center, camPos, sphere, projScaleY)));
+        triangleCount += uint32_t(inner * inner);
+    }
+    return triangleCount;
+}
+
+} // namespace vk229
@@ -0,0 +1,1040 @@
+#pragma once
+
+#include <assert.h>
+#include <vulkan/vulkan.h>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+#include <VulkanTools.h>
+#include <VulkanInitializers.hpp>
+#include <VulkanDevice.hpp>
+
+namespace vk229
+{
+
+//////////////////////////////////////
+/// Frame as a list of passes which declare resources they read and write.
+/// Usage:
+/// * reset(), then createImage() (transient, owned by the graph) / import*() (owned by the caller)
+/// * addPass() in execution order, declare accesses on the returned PassBuilder
+/// * compile() - culls passes whose results are never used, allocates transient images
+///   (images with disjoint lifetimes share memory), creates render passes and framebuffers
+///   of raster passes and plans barriers
+/// * record() into a command buffer, as many times as needed
+/// Barriers are derived from the declared accesses: one batched vkCmdPipelineBarrier in front of a pass at most,
+/// read after read in the same layout needs none. Graph assumes the recorded frame is executed repeatedly,
+/// so the first access of a frame is synchronized against the last one of the previous frame.
+/// Raster passes get a render pass with attachments already in their layouts - all transitions are graph barriers.
+class RenderGraph
+{
+public:
+    using resource_id_t = uint32_t;
+    using pass_id_t     = uint32_t;
+    using execute_t     = std::function<void(VkCommandBuffer cmd, uint32_t frameIndex)>;
+
+    static const uint32_t INVALID_ID = ~0u;
+
+    enum class PassType
+    {
+        RASTER,   // Render pass is begun/ended by the graph, viewport and scissor cover the attachments.
+        COMPUTE,
+        TRANSFER,
+    };
+
+    enum class ResourceUsage
+    {
+        COLOR_ATTACHMENT,     // write
+        DEPTH_ATTACHMENT,     // write
+        SAMPLED_FRAGMENT,     // read, SHADER_READ_ONLY (DEPTH_STENCIL_READ_ONLY for depth)
+        SAMPLED_COMPUTE,      // read, SHADER_READ_ONLY (DEPTH_STENCIL_READ_ONLY for depth)
+        SHADER_READ_COMPUTE,  // read, storage buffers / images in GENERAL layout
+        SHADER_WRITE_COMPUTE, // write (read-modify-write), storage buffers / images in GENERAL layout
+        VERTEX_READ,          // read, vertex and index buffers
+        INDIRECT_READ,        // read, indirect draw / dispatch arguments
+        TRANSFER_READ,        // read
+        TRANSFER_WRITE,       // write
+    };
+
+    struct Stats
+    {
+        uint32_t     passCount        = 0u;
+        uint32_t     culledPassCount  = 0u;
+        uint32_t     barrierBatches   = 0u; // vkCmdPipelineBarrier calls per frame
+        uint32_t     imageBarriers    = 0u;
+        uint32_t     transientImages  = 0u;
+        uint32_t     memoryBlocks     = 0u;
+        VkDeviceSize transientBytes   = 0u; // Allocated
+        VkDeviceSize unaliasedBytes   = 0u; // Would be allocated without aliasing
+    };
+
+    class PassBuilder
+    {
+    public:
+        PassBuilder(RenderGraph* graph, pass_id_t pass) : graph(graph), pass(pass) {}
+
+        PassBuilder& read(resource_id_t resource, ResourceUsage usage)
+        {
+            this->graph->addAccess(this->pass, resource, usage, false);
+            return *this;
+        }
+
+        PassBuilder& write(resource_id_t resource, ResourceUsage usage)
+        {
+            this->graph->addAccess(this->pass, resource, usage, true);
+            return *this;
+        }
+
+        /// Raster passes only. Previous contents are kept if there is no clear value.
+        PassBuilder& colorAttachment(resource_id_t resource, const VkClearColorValue* clear = nullptr)
+        {
+            VkClearValue clearValue = {};
+            if (clear != nullptr)
+            {
+                clearValue.color = *clear;
+            }
+            this->graph->addAttachment(this->pass, resource, ResourceUsage::COLOR_ATTACHMENT, clear != nullptr, clearValue);
+            return *this;
+        }
+
+        /// Raster passes only. Previous contents are kept if there is no clear value.
+        PassBuilder& depthAttachment(resource_id_t resource, const VkClearDepthStencilValue* clear = nullptr)
+        {
+            VkClearValue clearValue = {};
+            if (clear != nullptr)
+            {
+                clearValue.depthStencil = *clear;
+            }
+            this->graph->addAttachment(this->pass, resource, ResourceUsage::DEPTH_ATTACHMENT, clear != nullptr, clearValue);
+            return *this;
+        }
+
+        /// Pass is never culled (ie. writes something read by the host).
+        PassBuilder& sideEffect()
+        {
+            this->graph->passes[this->pass].hasSideEffect = true;
+            return *this;
+        }
+
+        pass_id_t getId() const
+        {
+            return this->pass;
+        }
+
+    private:
+        RenderGraph* graph;
+        pass_id_t    pass;
+    };
+
+    ~RenderGraph()
+    {
+        this->reset();
+    }
+
+    /// Destroys compiled objects and forgets all declarations - device must not use them anymore.
+    void reset()
+    {
+        this->destroyCompiled();
+        this->resources.clear();
+        this->passes.clear();
+        this->device = nullptr;
+    }
+
+    /// Transient image - only lives within the frame, its memory can be shared with other transient images.
+    resource_id_t createImage(const std::string& name, VkFormat format, uint32_t width, uint32_t height)
+    {
+        Resource resource;
+        resource.name        = name;
+        resource.isImage     = true;
+        resource.isTransient = true;
+        resource.format      = format;
+        resource.width       = width;
+        resource.height      = height;
+        return this->addResource(resource);
+    }
+
+    /// Image owned by the caller. Its layout is kept between frames (the one of its last access).
+    resource_id_t importImage(const std::string& name, VkImage image, VkImageView view, VkFormat format, uint32_t width, uint32_t height)
+    {
+        Resource resource;
+        resource.name    = name;
+        resource.isImage = true;
+        resource.format  = format;
+        resource.width   = width;
+        resource.height  = height;
+        resource.images  = { image };
+        resource.views   = { view };
+        return this->addResource(resource);
+    }
+
+    /// Swapchain images, one per frame index of record(). Contents are discarded at the first access
+    /// (after the acquire semaphore wait at COLOR_ATTACHMENT_OUTPUT), frame ends with PRESENT_SRC_KHR layout.
+    /// Swapchain is an output - passes writing it are never culled.
+    resource_id_t importSwapchain(const std::string& name, const std::vector<VkImage>& images, const std::vector<VkImageView>& views, VkFormat format, uint32_t width, uint32_t height)
+    {
+        assert(images.size() == views.size() && !images.empty());
+
+        Resource resource;
+        resource.name                 = name;
+        resource.isImage              = true;
+        resource.isOutput             = true;
+        resource.format               = format;
+        resource.width                = width;
+        resource.height               = height;
+        resource.images               = images;
+        resource.views                = views;
+        resource.hasFixedInitialState = true;
+        resource.initialState         = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED };
+        resource.hasFinalState        = true;
+        resource.finalState           = { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR };
+        return this->addResource(resource);
+    }
+
+    /// Buffer owned by the caller.
+    resource_id_t importBuffer(const std::string& name, VkBuffer buffer)
+    {
+        Resource resource;
+        resource.name   = name;
+        resource.buffer = buffer;
+        return this->addResource(resource);
+    }
+
+    /// Passes writing it are kept, even if nothing in the graph reads it.
+    void markOutput(resource_id_t resource)
+    {
+        this->resources.at(resource).isOutput = true;
+    }
+
+    PassBuilder addPass(const std::string& name, PassType type, execute_t execute)
+    {
+        Pass pass;
+        pass.name    = name;
+        pass.type    = type;
+        pass.execute = execute;
+        this->passes.push_back(pass);
+        return PassBuilder(this, this->passes.size() - 1u);
+    }
+
+    void compile(vks::VulkanDevice* dev)
+    {
+        this->destroyCompiled();
+        this->device = dev;
+        this->stats  = Stats();
+        this->stats.passCount = this->passes.size();
+
+        this->cullPasses();
+        this->computeLifetimes();
+        this->allocateTransients();
+        this->createRenderPasses();
+        this->planBarriers();
+
+        std::cout << " >>> RenderGraph::compile: " << this->livePasses.size() << " of " << this->passes.size() << " passes, "
+                  << this->stats.barrierBatches << " barrier batches, " << this->stats.transientImages << " transient images in "
+                  << this->stats.memoryBlocks << " blocks, " << this->stats.transientBytes / 1024 << " KiB (" << this->stats.unaliasedBytes / 1024 << " KiB unaliased)\n";
+        for (pass_id_t p = 0; p < this->passes.size(); p++)
+        {
+            std::cout << " >>> RenderGraph::compile:   " << this->passes[p].name << (this->passes[p].isCulled ? " - culled" : "") << "\n";
+        }
+    }
+
+    /// Records all live passes with their barriers. frameIndex picks the swapchain image.
+    void record(VkCommandBuffer cmd, uint32_t frameIndex)
+    {
+        for (uint32_t i = 0; i < this->livePasses.size(); i++)
+        {
+            Pass& pass = this->passes[this->livePasses[i]];
+
+            this->recordBarriers(cmd, this->barrierBatches[i], frameIndex);
+
+            if (pass.type == PassType::RASTER)
+            {
+                VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+                renderPassBeginInfo.renderPass               = pass.renderPass;
+                renderPassBeginInfo.framebuffer              = pass.framebuffers[frameIndex % pass.framebuffers.size()];
+                renderPassBeginInfo.renderArea.extent.width  = pass.width;
+                renderPassBeginInfo.renderArea.extent.height = pass.height;
+                renderPassBeginInfo.clearValueCount          = pass.clearValues.size();
+                renderPassBeginInfo.pClearValues             = pass.clearValues.data();
+
+                vkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+                VkViewport viewport = vks::initializers::viewport((float)pass.width, (float)pass.height, 0.0f, 1.0f);
+                vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+                VkRect2D scissor = vks::initializers::rect2D(pass.width, pass.height, 0, 0);
+                vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+                pass.execute(cmd, frameIndex);
+
+                vkCmdEndRenderPass(cmd);
+            }
+            else
+            {
+                pass.execute(cmd, frameIndex);
+            }
+        }
+
+        this->recordBarriers(cmd, this->finalBarriers, frameIndex);
+    }
+
+    /// Render pass of a raster pass - for its pipelines. Valid for culled passes too.
+    VkRenderPass getRenderPass(pass_id_t pass) const
+    {
+        return this->passes.at(pass).renderPass;
+    }
+
+    /// VK_NULL_HANDLE for transient images which are not used by any live pass.
+    VkImageView getImageView(resource_id_t resource, uint32_t frameIndex = 0u) const
+    {
+        const Resource& res = this->resources.at(resource);
+        return res.views.empty() ? VK_NULL_HANDLE : res.views[frameIndex % res.views.size()];
+    }
+
+    bool isCulled(pass_id_t pass) const
+    {
+        return this->passes.at(pass).isCulled;
+    }
+
+    const Stats& getStats() const
+    {
+        return this->stats;
+    }
+
+private:
+    struct AccessState
+    {
+        VkPipelineStageFlags stages;
+        VkAccessFlags        access;
+        VkImageLayout        layout;
+    };
+
+    struct Access
+    {
+        resource_id_t resource;
+        ResourceUsage usage;
+        bool          isWrite;
+        bool          isAttachment;
+        bool          isCleared;
+        VkClearValue  clearValue;
+    };
+
+    struct Resource
+    {
+        std::string name;
+        bool        isImage     = false;
+        bool        isTransient = false;
+        bool        isOutput    = false;
+
+        // Image
+        VkFormat                 format = VK_FORMAT_UNDEFINED;
+        uint32_t                 width  = 0u;
+        uint32_t                 height = 0u;
+        VkImageUsageFlags        usage  = 0u; // Transient - gathered from accesses
+        std::vector<VkImage>     images;      // One per frame index for the swapchain
+        std::vector<VkImageView> views;
+
+        // Buffer
+        VkBuffer buffer = VK_NULL_HANDLE;
+
+        bool        hasFixedInitialState = false;
+        AccessState initialState         = { 0, 0, VK_IMAGE_LAYOUT_UNDEFINED };
+        bool        hasFinalState        = false;
+        AccessState finalState           = { 0, 0, VK_IMAGE_LAYOUT_UNDEFINED };
+
+        // Compiled
+        uint32_t firstUse    = INVALID_ID; // Index in livePasses
+        uint32_t lastUse     = INVALID_ID;
+        uint32_t memoryBlock = INVALID_ID;
+    };
+
+    struct Pass
+    {
+        std::string         name;
+        PassType            type;
+        execute_t           execute;
+        std::vector<Access> accesses;
+        bool                hasSideEffect = false;
+
+        // Compiled
+        bool                       isCulled   = false;
+        VkRenderPass               renderPass = VK_NULL_HANDLE;
+        std::vector<VkFramebuffer> framebuffers;
+        std::vector<VkClearValue>  clearValues;
+        uint32_t                   width  = 0u;
+        uint32_t                   height = 0u;
+    };
+
+    struct MemoryBlock
+    {
+        VkDeviceMemory             memory          = VK_NULL_HANDLE;
+        VkDeviceSize               size            = 0u;
+        uint32_t                   memoryTypeIndex = 0u;
+        std::vector<resource_id_t> occupants;      // Ordered by first use
+    };
+
+    struct ImageBarrier
+    {
+        resource_id_t resource;
+        VkImageLayout oldLayout;
+        VkImageLayout newLayout;
+        VkAccessFlags srcAccess;
+        VkAccessFlags dstAccess;
+    };
+
+    struct BarrierBatch
+    {
+        VkPipelineStageFlags      srcStages       = 0u;
+        VkPipelineStageFlags      dstStages       = 0u;
+        VkAccessFlags             memorySrcAccess = 0u; // Global memory barrier - buffers and images without transition
+        VkAccessFlags             memoryDstAccess = 0u;
+        bool                      hasMemory       = false;
+        std::vector<ImageBarrier> imageBarriers;
+    };
+
+    /// Hazard tracking of a resource while barriers are planned.
+    struct TrackState
+    {
+        VkImageLayout        layout        = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags writeStages   = 0u; // Last write (or layout transition)
+        VkAccessFlags        writeAccess   = 0u;
+        VkPipelineStageFlags readStages    = 0u; // Reads since the last write
+        VkPipelineStageFlags visibleStages = 0u; // Stages / accesses the last write is visible to
+        VkAccessFlags        visibleAccess = 0u;
+    };
+
+    static bool isDepthFormat(VkFormat format)
+    {
+        return format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_X8_D24_UNORM_PACK32 || format == VK_FORMAT_D32_SFLOAT
+            || format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+    }
+
+    static VkImageAspectFlags getBarrierAspect(VkFormat format)
+    {
+        if (!isDepthFormat(format))
+        {
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+        }
+        // Layouts of combined formats have to be transitioned for both aspects.
+        return (format >= VK_FORMAT_D16_UNORM_S8_UINT) ? (VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT) : VK_IMAGE_ASPECT_DEPTH_BIT;
+    }
+
+    static AccessState getUsageState(ResourceUsage usage, bool isDepth)
+    {
+        const VkImageLayout sampledLayout = isDepth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        switch (usage)
+        {
+        case ResourceUsage::COLOR_ATTACHMENT:
+            return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+        case ResourceUsage::DEPTH_ATTACHMENT:
+            return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                     VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+        case ResourceUsage::SAMPLED_FRAGMENT:
+            return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, sampledLayout };
+        case ResourceUsage::SAMPLED_COMPUTE:
+            return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, sampledLayout };
+        case ResourceUsage::SHADER_READ_COMPUTE:
+            return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL };
+        case ResourceUsage::SHADER_WRITE_COMPUTE:
+            return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+        case ResourceUsage::VERTEX_READ:
+            return { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED };
+        case ResourceUsage::INDIRECT_READ:
+            return { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED };
+        case ResourceUsage::TRANSFER_READ:
+            return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL };
+        case ResourceUsage::TRANSFER_WRITE:
+            return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL };
+        }
+        assert(false);
+        return { VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+    }
+
+    static VkImageUsageFlags getImageUsageFlags(ResourceUsage usage)
+    {
+        switch (usage)
+        {
+        case ResourceUsage::COLOR_ATTACHMENT:     return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        case ResourceUsage::DEPTH_ATTACHMENT:     return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        case ResourceUsage::SAMPLED_FRAGMENT:
+        case ResourceUsage::SAMPLED_COMPUTE:      return VK_IMAGE_USAGE_SAMPLED_BIT;
+        case ResourceUsage::SHADER_READ_COMPUTE:
+        case ResourceUsage::SHADER_WRITE_COMPUTE: return VK_IMAGE_USAGE_STORAGE_BIT;
+        case ResourceUsage::TRANSFER_READ:        return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        case ResourceUsage::TRANSFER_WRITE:       return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        default:                                  return 0u;
+        }
+    }
+
+    static bool isWriteUsage(ResourceUsage usage)
+    {
+        return usage == ResourceUsage::COLOR_ATTACHMENT || usage == ResourceUsage::DEPTH_ATTACHMENT
+            || usage == ResourceUsage::SHADER_WRITE_COMPUTE || usage == ResourceUsage::TRANSFER_WRITE;
+    }
+
+    resource_id_t addResource(const Resource& resource)
+    {
+        this->resources.push_back(resource);
+        return this->resources.size() - 1u;
+    }
+
+    void addAccess(pass_id_t pass, resource_id_t resource, ResourceUsage usage, bool isWrite)
+    {
+        assert(resource < this->resources.size());
+        assert(isWrite == isWriteUsage(usage));
+        assert(usage != ResourceUsage::COLOR_ATTACHMENT && usage != ResourceUsage::DEPTH_ATTACHMENT); // Use *Attachment()
+
+        Access access = {};
+        access.resource = resource;
+        access.usage    = usage;
+        access.isWrite  = isWrite;
+        this->passes[pass].accesses.push_back(access);
+        this->resources[resource].usage |= getImageUsageFlags(usage);
+    }
+
+    void addAttachment(pass_id_t pass, resource_id_t resource, ResourceUsage usage, bool isCleared, const VkClearValue& clearValue)
+    {
+        assert(resource < this->resources.size() && this->resources[resource].isImage);
+        assert(this->passes[pass].type == PassType::RASTER);
+
+        Access access = {};
+        access.resource     = resource;
+        access.usage        = usage;
+        access.isWrite      = true;
+        access.isAttachment = true;
+        access.isCleared    = isCleared;
+        access.clearValue   = clearValue;
+        this->passes[pass].accesses.push_back(access);
+        this->resources[resource].usage |= getImageUsageFlags(usage);
+    }
+
+    /// Backwards from outputs: pass is live if it has side effects or writes something read later by a live pass.
+    /// Cleared attachments are full overwrites - earlier writers of them are not needed by this pass.
+    void cullPasses()
+    {
+        std::set<resource_id_t> liveResources;
+        for (resource_id_t r = 0; r < this->resources.size(); r++)
+        {
+            if (this->resources[r].isOutput)
+            {
+                liveResources.insert(r);
+            }
+        }
+
+        for (pass_id_t p = this->passes.size(); p-- > 0u; )
+        {
+            Pass& pass = this->passes[p];
+
+            bool isLive = pass.hasSideEffect;
+            for (const Access& access : pass.accesses)
+            {
+                isLive = isLive || (access.isWrite && liveResources.count(access.resource) > 0u);
+            }
+
+            pass.isCulled = !isLive;
+            if (!isLive)
+            {
+                this->stats.culledPassCount++;
+                continue;
+            }
+
+            for (const Access& access : pass.accesses)
+            {
+                if (access.isAttachment && access.isCleared && !this->resources[access.resource].isOutput)
+                {
+                    liveResources.erase(access.resource);
+                }
+            }
+            for (const Access& access : pass.accesses)
+            {
+                if (!access.isWrite || (access.isAttachment && !access.isCleared) || access.usage == ResourceUsage::SHADER_WRITE_COMPUTE)
+                {
+                    liveResources.insert(access.resource);
+                }
+            }
+        }
+
+        this->livePasses.clear();
+        for (pass_id_t p = 0; p < this->passes.size(); p++)
+        {
+            if (!this->passes[p].isCulled)
+            {
+                this->livePasses.push_back(p);
+            }
+        }
+    }
+
+    void computeLifetimes()
+    {
+        for (uint32_t i = 0; i < this->livePasses.size(); i++)
+        {
+            for (const Access& access : this->passes[this->livePasses[i]].accesses)
+            {
+                Resource& res = this->resources[access.resource];
+                res.firstUse = std::min(res.firstUse, i);
+                res.lastUse  = (res.lastUse == INVALID_ID) ? i : std::max(res.lastUse, i);
+            }
+        }
+    }
+
+    /// Creates used transient images and places them into memory blocks - largest first,
+    /// into the first block whose occupants' lifetimes do not overlap.
+    void allocateTransients()
+    {
+        VkDevice dev = this->device->logicalDevice;
+
+        std::vector<resource_id_t>        transients;
+        std::vector<VkMemoryRequirements> memReqs(this->resources.size());
+
+        for (resource_id_t r = 0; r < this->resources.size(); r++)
+        {
+            Resource& res = this->resources[r];
+            if (!res.isTransient || res.firstUse == INVALID_ID)
+            {
+                continue;
+            }
+
+            VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+            imageCI.imageType   = VK_IMAGE_TYPE_2D;
+            imageCI.format      = res.format;
+            imageCI.extent      = { res.width, res.height, 1 };
+            imageCI.mipLevels   = 1;
+            imageCI.arrayLayers = 1;
+            imageCI.samples     = VK_SAMPLE_COUNT_1_BIT;
+            imageCI.tiling      = VK_IMAGE_TILING_OPTIMAL;
+            imageCI.usage       = res.usage;
+            res.images.resize(1);
+            VK_CHECK_RESULT(vkCreateImage(dev, &imageCI, nullptr, &res.images[0]));
+
+            vkGetImageMemoryRequirements(dev, res.images[0], &memReqs[r]);
+            transients.push_back(r);
+            this->stats.unaliasedBytes += memReqs[r].size;
+        }
+
+        std::sort(transients.begin(), transients.end(), [&memReqs](resource_id_t a, resource_id_t b) {
+            return memReqs[a].size > memReqs[b].size;
+        });
+
+        for (resource_id_t r : transients)
+        {
+            Resource& res = this->resources[r];
+
+            for (uint32_t b = 0; b < this->memoryBlocks.size() && res.memoryBlock == INVALID_ID; b++)
+            {
+                MemoryBlock& block = this->memoryBlocks[b];
+                if (block.size < memReqs[r].size || ((memReqs[r].memoryTypeBits >> block.memoryTypeIndex) & 1u) == 0u)
+                {
+                    continue;
+                }
+
+                bool overlaps = false;
+                for (resource_id_t occupant : block.occupants)
+                {
+                    const Resource& other = this->resources[occupant];
+                    overlaps = overlaps || !(res.lastUse < other.firstUse || other.lastUse < res.firstUse);
+                }
+                if (!overlaps)
+                {
+                    res.memoryBlock = b;
+                }
+            }
+
+            if (res.memoryBlock == INVALID_ID)
+            {
+                MemoryBlock block;
+                block.size            = memReqs[r].size;
+                block.memoryTypeIndex = this->device->getMemoryType(memReqs[r].memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+                this->memoryBlocks.push_back(block);
+                res.memoryBlock = this->memoryBlocks.size() - 1u;
+            }
+
+            std::vector<resource_id_t>& occupants = this->memoryBlocks[res.memoryBlock].occupants;
+            occupants.push_back(r);
+            std::sort(occupants.begin(), occupants.end(), [this](resource_id_t a, resource_id_t b) {
+                return this->resources[a].firstUse < this->resources[b].firstUse;
+            });
+        }
+
+        for (MemoryBlock& block : this->memoryBlocks)
+        {
+            VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+            memAlloc.allocationSize  = block.size;
+            memAlloc.memoryTypeIndex = block.memoryTypeIndex;
+            VK_CHECK_RESULT(vkAllocateMemory(dev, &memAlloc, nullptr, &block.memory));
+            this->stats.transientBytes += block.size;
+
+            for (resource_id_t occupant : block.occupants)
+            {
+                VK_CHECK_RESULT(vkBindImageMemory(dev, this->resources[occupant].images[0], block.memory, 0));
+            }
+        }
+
+        for (resource_id_t r : transients)
+        {
+            Resource& res = this->resources[r];
+
+            VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+            viewCI.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
+            viewCI.format                          = res.format;
+            viewCI.subresourceRange.aspectMask     = isDepthFormat(res.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+            viewCI.subresourceRange.baseMipLevel   = 0;
+            viewCI.subresourceRange.levelCount     = 1;
+            viewCI.subresourceRange.baseArrayLayer = 0;
+            viewCI.subresourceRange.layerCount     = 1;
+            viewCI.image                           = res.images[0];
+            res.views.resize(1);
+            VK_CHECK_RESULT(vkCreateImageView(dev, &viewCI, nullptr, &res.views[0]));
+        }
+
+        this->stats.transientImages = transients.size();
+        this->stats.memoryBlocks    = this->memoryBlocks.size();
+    }
+
+    /// Every raster pass gets a render pass (culled ones too - pipelines may be created for them),
+    /// live ones also framebuffers. Attachments stay in their layouts, contents are loaded only
+    /// if written before in the frame (or kept between frames), stored only if used later.
+    void createRenderPasses()
+    {
+        VkDevice dev = this->device->logicalDevice;
+
+        for (pass_id_t p = 0; p < this->passes.size(); p++)
+        {
+            Pass& pass = this->passes[p];
+            if (pass.type != PassType::RASTER)
+            {
+                continue;
+            }
+
+            const uint32_t livePassIndex = std::find(this->livePasses.begin(), this->livePasses.end(), p) - this->livePasses.begin();
+
+            std::vector<VkAttachmentDescription> attachments;
+            std::vector<VkAttachmentReference>   colorReferences;
+            VkAttachmentReference                depthReference = { VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED };
+            uint32_t                             variantCount = 1u;
+
+            pass.clearValues.clear();
+            for (const Access& access : pass.accesses)
+            {
+                if (!access.isAttachment)
+                {
+                    continue;
+                }
+
+                const Resource& res    = this->resources[access.resource];
+                const bool      isDepth = (access.usage == ResourceUsage::DEPTH_ATTACHMENT);
+                const AccessState state = getUsageState(access.usage, isDepth);
+
+                const bool isUsedBefore = !res.isTransient || (livePassIndex != res.firstUse);
+                const bool isUsedAfter  = !res.isTransient || (livePassIndex != res.lastUse);
+
+                VkAttachmentDescription attachment = {};
+                attachment.format         = res.format;
+                attachment.samples        = VK_SAMPLE_COUNT_1_BIT;
+                attachment.loadOp         = access.isCleared ? VK_ATTACHMENT_LOAD_OP_CLEAR : (isUsedBefore ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE);
+                attachment.storeOp        = isUsedAfter ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                attachment.stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                attachment.initialLayout  = state.layout;
+                attachment.finalLayout    = state.layout;
+
+                VkAttachmentReference reference = { (uint32_t)attachments.size(), state.layout };
+                if (isDepth)
+                {
+                    depthReference = reference;
+                }
+                else
+                {
+                    colorReferences.push_back(reference);
+                }
+                attachments.push_back(attachment);
+                pass.clearValues.push_back(access.clearValue);
+
+                pass.width   = res.width;
+                pass.height  = res.height;
+                variantCount = std::max(variantCount, (uint32_t)res.images.size());
+            }
+
+            VkSubpassDescription subpass = {};
+            subpass.pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
+            subpass.colorAttachmentCount    = colorReferences.size();
+            subpass.pColorAttachments       = colorReferences.data();
+            subpass.pDepthStencilAttachment = (depthReference.attachment != VK_ATTACHMENT_UNUSED) ? &depthReference : nullptr;
+
+            // No dependencies - graph barriers are recorded outside of the render pass.
+            VkRenderPassCreateInfo renderPassCI = vks::initializers::renderPassCreateInfo();
+            renderPassCI.attachmentCount = attachments.size();
+            renderPassCI.pAttachments    = attachments.data();
+            renderPassCI.subpassCount    = 1;
+            renderPassCI.pSubpasses      = &subpass;
+            VK_CHECK_RESULT(vkCreateRenderPass(dev, &renderPassCI, nullptr, &pass.renderPass));
+
+            if (pass.isCulled)
+            {
+                continue;
+            }
+
+            pass.framebuffers.resize(variantCount);
+            for (uint32_t variant = 0; variant < variantCount; variant++)
+            {
+                std::vector<VkImageView> views;
+                for (const Access& access : pass.accesses)
+                {
+                    if (access.isAttachment)
+                    {
+                        views.push_back(this->getImageView(access.resource, variant));
+                    }
+                }
+
+                VkFramebufferCreateInfo framebufferCI = vks::initializers::framebufferCreateInfo();
+                framebufferCI.renderPass      = pass.renderPass;
+                framebufferCI.attachmentCount = views.size();
+                framebufferCI.pAttachments    = views.data();
+                framebufferCI.width           = pass.width;
+                framebufferCI.height          = pass.height;
+                framebufferCI.layers          = 1;
+                VK_CHECK_RESULT(vkCreateFramebuffer(dev, &framebufferCI, nullptr, &pass.framebuffers[variant]));
+            }
+        }
+    }
+
+    /// Adds what is needed before the access to the batch of its pass and updates tracking.
+    void trackAccess(resource_id_t r, const AccessState& dst, bool isWrite, TrackState& track, BarrierBatch& batch)
+    {
+        const Resource& res = this->resources[r];
+        const bool isTransition = res.isImage && (dst.layout != track.layout);
+
+        if (isTransition || isWrite)
+        {
+            // Waits for the last write and for all reads since then.
+            const VkPipelineStageFlags srcStages = track.writeStages | track.readStages;
+            if (isTransition)
+            {
+                batch.imageBarriers.push_back({ r, track.layout, dst.layout, track.writeAccess, dst.access });
+            }
+            else if (track.writeAccess != 0u)
+            {
+                batch.hasMemory        = true;
+                batch.memorySrcAccess |= track.writeAccess;
+                batch.memoryDstAccess |= dst.access;
+            }
+            if (isTransition || srcStages != 0u)
+            {
+                batch.srcStages |= (srcStages != 0u) ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+                batch.dstStages |= dst.stages;
+            }
+
+            track.layout        = dst.layout;
+            track.writeStages   = dst.stages;
+            track.writeAccess   = isWrite ? (dst.access & (VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+                                                         | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT)) : 0u;
+            track.readStages    = isWrite ? 0u : dst.stages;
+            track.visibleStages = dst.stages;
+            track.visibleAccess = dst.access;
+            return;
+        }
+
+        // Read in the same layout - only the last write has to be made visible, once per stage / access.
+        if (track.writeStages != 0u && ((track.visibleStages & dst.stages) != dst.stages || (track.visibleAccess & dst.access) != dst.access))
+        {
+            batch.srcStages |= track.writeStages;
+            batch.dstStages |= dst.stages;
+            if (track.writeAccess != 0u)
+            {
+                batch.hasMemory        = true;
+                batch.memorySrcAccess |= track.writeAccess;
+                batch.memoryDstAccess |= dst.access;
+            }
+            track.visibleStages |= dst.stages;
+            track.visibleAccess |= dst.access;
+        }
+        track.readStages |= dst.stages;
+    }
+
+    /// Walks live passes with given initial tracking states, fills batches (one per live pass + final one).
+    void simulate(std::vector<TrackState>& tracks, std::vector<BarrierBatch>& batches, BarrierBatch& finalBatch)
+    {
+        batches.assign(this->livePasses.size(), BarrierBatch());
+        finalBatch = BarrierBatch();
+
+        for (uint32_t i = 0; i < this->livePasses.size(); i++)
+        {
+            const Pass& pass = this->passes[this->livePasses[i]];
+            for (const Access& access : pass.accesses)
+            {
+                const Resource& res = this->resources[access.resource];
+                const AccessState dst = getUsageState(access.usage, res.isImage && isDepthFormat(res.format));
+                this->trackAccess(access.resource, dst, access.isWrite, tracks[access.resource], batches[i]);
+            }
+        }
+
+        for (resource_id_t r = 0; r < this->resources.size(); r++)
+        {
+            const Resource& res = this->resources[r];
+            if (res.hasFinalState && res.firstUse != INVALID_ID)
+            {
+                this->trackAccess(r, res.finalState, false, tracks[r], finalBatch);
+            }
+        }
+    }
+
+    /// Frame is simulated twice - the second run starts from the states the first one ended with,
+    /// so accesses at the start are synchronized against the end of the previous frame
+    /// (and transient images against the previous occupant of their memory).
+    void planBarriers()
+    {
+        std::vector<TrackState> tracks(this->resources.size());
+        std::vector<TrackState> initial(this->resources.size());
+
+        // First run - from nothing, for end states.
+        for (resource_id_t r = 0; r < this->resources.size(); r++)
+        {
+            const Resource& res = this->resources[r];
+            if (res.hasFixedInitialState)
+            {
+                initial[r].layout      = res.initialState.layout;
+                initial[r].writeStages = res.initialState.stages;
+            }
+        }
+        tracks = initial;
+        this->simulate(tracks, this->barrierBatches, this->finalBarriers);
+        const std::vector<TrackState> endTracks = tracks;
+
+        // Second run.
+        for (resource_id_t r = 0; r < this->resources.size(); r++)
+        {
+            const Resource& res = this->resources[r];
+            if (res.hasFixedInitialState || res.firstUse == INVALID_ID)
+            {
+                continue;
+            }
+
+            if (!res.isTransient)
+            {
+                initial[r] = endTracks[r];
+                continue;
+            }
+
+            // Contents are discarded - only wait for the previous occupant of the memory (cyclic).
+            const std::vector<resource_id_t>& occupants = this->memoryBlocks[res.memoryBlock].occupants;
+            const uint32_t     index    = std::find(occupants.begin(), occupants.end(), r) - occupants.begin();
+            const resource_id_t previous = occupants[(index + occupants.size() - 1u) % occupants.size()];
+
+            initial[r] = TrackState();
+            initial[r].writeStages = endTracks[previous].writeStages | endTracks[previous].readStages;
+            initial[r].writeAccess = endTracks[previous].writeAccess;
+        }
+        tracks = initial;
+        this->simulate(tracks, this->barrierBatches, this->finalBarriers);
+
+        for (const BarrierBatch& batch : this->barrierBatches)
+        {
+            this->stats.barrierBatches += (batch.srcStages != 0u) ? 1u : 0u;
+            this->stats.imageBarriers  += batch.imageBarriers.size();
+        }
+        this->stats.barrierBatches += (this->finalBarriers.srcStages != 0u) ? 1u : 0u;
+        this->stats.imageBarriers  += this->finalBarriers.imageBarriers.size();
+    }
+
+    void recordBarriers(VkCommandBuffer cmd, const BarrierBatch& batch, uint32_t frameIndex)
+    {
+        if (batch.srcStages == 0u)
+        {
+            return;
+        }
+
+        VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+        memoryBarrier.srcAccessMask = batch.memorySrcAccess;
+        memoryBarrier.dstAccessMask = batch.memoryDstAccess;
+
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+        for (const ImageBarrier& barrier : batch.imageBarriers)
+        {
+            const Resource& res = this->resources[barrier.resource];
+
+            VkImageMemoryBarrier imageBarrier = vks::initializers::imageMemoryBarrier();
+            imageBarrier.srcAccessMask       = barrier.srcAccess;
+            imageBarrier.dstAccessMask       = barrier.dstAccess;
+            imageBarrier.oldLayout           = barrier.oldLayout;
+            imageBarrier.newLayout           = barrier.newLayout;
+            imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier.image               = res.images[frameIndex % res.images.size()];
+            imageBarrier.subresourceRange    = { getBarrierAspect(res.format), 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+            imageBarriers.push_back(imageBarrier);
+        }
+
+        vkCmdPipelineBarrier(cmd, batch.srcStages, batch.dstStages, 0,
+            batch.hasMemory ? 1u : 0u, &memoryBarrier,
+            0, nullptr,
+            imageBarriers.size(), imageBarriers.data());
+    }
+
+    void destroyCompiled()
+    {
+        if (this->device == nullptr)
+        {
+            return;
+        }
+
+        VkDevice dev = this->device->logicalDevice;
+
+        for (Pass& pass : this->passes)
+        {
+            for (VkFramebuffer framebuffer : pass.framebuffers)
+            {
+                vkDestroyFramebuffer(dev, framebuffer, nullptr);
+            }
+            pass.framebuffers.clear();
+            if (pass.renderPass != VK_NULL_HANDLE)
+            {
+                vkDestroyRenderPass(dev, pass.renderPass, nullptr);
+                pass.renderPass = VK_NULL_HANDLE;
+            }
+        }
+
+        for (Resource& res : this->resources)
+        {
+            if (res.isTransient)
+            {
+                for (VkImageView view : res.views)
+                {
+                    vkDestroyImageView(dev, view, nullptr);
+                }
+                for (VkImage image : res.images)
+                {
+                    vkDestroyImage(dev, image, nullptr);
+                }
+                res.views.clear();
+                res.images.clear();
+            }
+            res.firstUse    = INVALID_ID;
+            res.lastUse     = INVALID_ID;
+            res.memoryBlock = INVALID_ID;
+        }
+
+        for (MemoryBlock& block : this->memoryBlocks)
+        {
+            vkFreeMemory(dev, block.memory, nullptr);
+        }
+        this->memoryBlocks.clear();
+
+        this->livePasses.clear();
+        this->barrierBatches.clear();
+        this->finalBarriers = BarrierBatch();
+    }
+
+    vks::VulkanDevice* device = nullptr;
+
+    std::vector<Resource>     resources;
+    std::vector<Pass>         passes;
+
+    std::vector<pass_id_t>    livePasses;
+    std::vector<MemoryBlock>  memoryBlocks;
+    std::vector<BarrierBatch> barrierBatches; // One per live pass
+    BarrierBatch              finalBarriers;
+    Stats                     stats;
+};
+
+} // namespace vk229
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace vk229
+{
+/////////////////////////////////////////
+/// CPU side of instancing-229's scene, without any Vulkan objects
+/// (so vk229_bench can run it without a GPU):
+/// * rock instances distributed on rings around the planet
+/// * light orbiting the planet
+/////////////////////////////////////////
+
+// ROCKS {
+
+//////////////////////////////////////
+/// Per-instance vertex data of a rock, also read by cull_instances.comp.
+struct RockInstance
+{
+    glm::vec3 pos;
+    glm::vec3 rot;
+    float     scale;
+    uint32_t  texIndex;
+};
+
+/// Inner and outer radius of rings of rocks.
+const float ROCK_RINGS[][2] = {
+    {   5.0f,   7.0f },
+    {   8.0f,  11.0f },
+    {  13.0f,  17.0f },
+    {  20.0f,  26.0f },
+    {  30.0f,  40.0f },
+    {  48.0f,  60.0f },
+};
+const uint32_t ROCK_RING_COUNT = sizeof(ROCK_RINGS) / sizeof(ROCK_RINGS[0]);
+
+/// One rock at a random place of ring ringId, uniformly over its area.
+void generateRockInstance(uint32_t ringId, uint32_t textureLayerCount, std::mt19937& rndGenerator, RockInstance& outInstance)
+{
+    std::uniform_real_distribution<float> uniformDist(0.0, 1.0);
+
+    const float r0 = ROCK_RINGS[ringId][0];
+    const float r1 = ROCK_RINGS[ringId][1];
+
+    const float rho   = sqrtf((r1*r1 - r0*r0) * uniformDist(rndGenerator) + r0*r0);
+    const float theta = 2.0f * float(M_PI) * uniformDist(rndGenerator);
+
+    outInstance.pos      = glm::vec3(rho*cosf(theta), uniformDist(rndGenerator) * 0.05f - 0.25f, rho*sinf(theta));
+    outInstance.rot      = glm::vec3(M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator));
+    outInstance.scale    = (1.5f + uniformDist(rndGenerator) - uniformDist(rndGenerator)) * 0.75f;
+    outInstance.texIndex = std::min(textureLayerCount - 1u, uint32_t(textureLayerCount * uniformDist(rndGenerator)));
+}
+
+/// Distributes count rocks evenly on ROCK_RINGS, uniformly over the area of every ring.
+/// Rings get count / ROCK_RING_COUNT rocks each, the rest is left zeroed (zero scale - not visible).
+/// Same seed gives the same rocks.
+void generateRockInstances(uint32_t count, uint32_t textureLayerCount, uint32_t seed, std::vector<RockInstance>& outInstances)
+{
+    outInstances.assign(count, RockInstance());
+
+    std::mt19937 rndGenerator(seed);
+
+    const uint32_t numInChunk = count / ROCK_RING_COUNT;
+
+    for (uint32_t instIdInChunk = 0; instIdInChunk < numInChunk; instIdInChunk++)
+    {
+        for (uint32_t ringId = 0; ringId < ROCK_RING_COUNT; ringId++)
+        {
+            generateRockInstance(ringId, textureLayerCount, rndGenerator, outInstances[instIdInChunk + ringId*numInChunk]);
+        }
+    }
+}
+
+// } // ROCKS
+
+// LIGHT {
+
+//////////////////////////////////////
+/// Light orbiting the planet - point mass in planet's gravity, explicit Euler steps.
+class LightOrbit
+{
+public:
+    /// Advances the light by dt seconds.
+    void step(float dt)
+    {
+        const float     r      = glm::distance(this->lightPos, this->planetPos);
+        const glm::vec3 dirVec = glm::normalize(this->lightPos - this->planetPos);
+        const glm::vec3 force  = -dirVec * this->G*this->planetMass*this->lightMass/(r*r);
+        const glm::vec3 accel  = force/this->lightMass;
+
+        this->lightVel = this->lightVel + accel*dt;
+        this->lightPos = this->lightPos + this->lightVel*dt;
+    }
+
+    const glm::vec3& getPosition() const
+    {
+        return this->lightPos;
+    }
+
+private:
+    float     G          = 2.5f;
+    float     lightMass  = 10.0f;
+    float     planetMass = 100.0f;
+    glm::vec3 lightPos   = { 45.0f, 0.0f, 10.0f };
+    glm::vec3 planetPos  = { 0.0f,  0.0f, 0.0f };
+    glm::vec3 lightVel   = { -1.0f, -0.3f, 1.0f };
+};
+
+// } // LIGHT
+
+} // namespace vk229
@@ -0,0 +1,691 @@
+#pragma once
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <queue>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include <MeshData.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define BVH_USE_SSE 1
+#else
+#define BVH_USE_SSE 0
+#endif
+
+namespace vk229
+{
+/////////////////////////////////////////
+/// Dynamic bounding volume hierarchy over world space AABBs of scene objects.
+/// * leaves keep a fat AABB (tight one + BVH_AABB_MARGIN), moves inside it do not touch the tree
+/// * insertion picks the sibling by surface area cost, tree is kept balanced by AVL-like rotations
+/// * frustum culling, ray picking and nearest object queries are O(log n) for typical scenes
+/// AABB vs. frustum test checks 4 planes at once with SSE (scalar fallback otherwise).
+/////////////////////////////////////////
+
+#define BVH_NULL_NODE    -1
+/// Fat AABB margin in world units.
+#define BVH_AABB_MARGIN  0.1f
+
+// AABB {
+
+struct Aabb
+{
+    float min[3];
+    float max[3];
+};
+
+Aabb makeEmptyAabb()
+{
+    return {{ INFINITY,  INFINITY,  INFINITY}, {-INFINITY, -INFINITY, -INFINITY}};
+}
+
+Aabb computeMeshAabb(const std::vector<MeshVertex>& vertices)
+{
+    Aabb box = makeEmptyAabb();
+    for (const MeshVertex& v : vertices)
+    {
+        for (uint32_t c = 0; c < 3u; c++)
+        {
+            box.min[c] = fminf(box.min[c], v.pos[c]);
+            box.max[c] = fmaxf(box.max[c], v.pos[c]);
+        }
+    }
+    return box;
+}
+
+/// World AABB of a transformed AABB (Arvo).
+Aabb transformAabb(const Aabb& box, const glm::mat4& m)
+{
+    Aabb result;
+    for (uint32_t r = 0; r < 3u; r++)
+    {
+        result.min[r] = result.max[r] = m[3][r];
+        for (uint32_t c = 0; c < 3u; c++)
+        {
+            const float a = m[c][r] * box.min[c];
+            const float b = m[c][r] * box.max[c];
+            result.min[r] += fminf(a, b);
+            result.max[r] += fmaxf(a, b);
+        }
+    }
+    return result;
+}
+
+Aabb mergeAabb(const Aabb& a, const Aabb& b)
+{
+    Aabb result;
+    for (uint32_t c = 0; c < 3u; c++)
+    {
+        result.min[c] = fminf(a.min[c], b.min[c]);
+        result.max[c] = fmaxf(a.max[c], b.max[c]);
+    }
+    return result;
+}
+
+Aabb expandAabb(const Aabb& box, float margin)
+{
+    Aabb result;
+    for (uint32_t c = 0; c < 3u; c++)
+    {
+        result.min[c] = box.min[c] - margin;
+        result.max[c] = box.max[c] + margin;
+    }
+    return result;
+}
+
+bool containsAabb(const Aabb& outer, const Aabb& inner)
+{
+    for (uint32_t c = 0; c < 3u; c++)
+    {
+        if (inner.min[c] < outer.min[c] || inner.max[c] > outer.max[c])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+float getAabbSurfaceArea(const Aabb& box)
+{
+    const float dx = box.max[0] - box.min[0];
+    const float dy = box.max[1] - box.min[1];
+    const float dz = box.max[2] - box.min[2];
+    return 2.0f * (dx*dy + dy*dz + dz*dx);
+}
+
+/// Squared distance from point to the box, 0 inside.
+float getAabbDistanceSq(const Aabb& box, const float point[3])
+{
+    float distSq = 0.0f;
+    for (uint32_t c = 0; c < 3u; c++)
+    {
+        const float d = fmaxf(fmaxf(box.min[c] - point[c], point[c] - box.max[c]), 0.0f);
+        distSq += d*d;
+    }
+    return distSq;
+}
+
+/// Slab test. outT is the entry distance (0 if origin is inside).
+bool intersectRayAabb(const Aabb& box, const float origin[3], const float invDir[3], float maxT, float& outT)
+{
+    float tMin = 0.0f;
+    float tMax = maxT;
+    for (uint32_t c = 0; c < 3u; c++)
+    {
+        float t0 = (box.min[c] - origin[c]) * invDir[c];
+        float t1 = (box.max[c] - origin[c]) * invDir[c];
+        if (t0 > t1)
+        {
+            std::swap(t0, t1);
+        }
+        tMin = fmaxf(tMin, t0);
+        tMax = fminf(tMax, t1);
+        if (tMin > tMax)
+        {
+            return false;
+        }
+    }
+    outT = tMin;
+    return true;
+}
+
+// } // AABB
+
+// FRUSTUM {
+
+/// Planes in SoA layout, normals point inside. 6 planes padded to 8 with always-passing ones.
+struct FrustumPlanes
+{
+    alignas(16) float nx[8];
+    alignas(16) float ny[8];
+    alignas(16) float nz[8];
+    alignas(16) float d[8];
+};
+
+enum class CullResult
+{
+    OUTSIDE,
+    INTERSECTING,
+    INSIDE
+};
+
+/// Gribb-Hartmann extraction, depth range 0..1 (GLM_FORCE_DEPTH_ZERO_TO_ONE).
+void extractFrustumPlanes(const glm::mat4& viewProj, FrustumPlanes& outPlanes)
+{
+    const glm::vec4 row0(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]);
+    const glm::vec4 row1(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]);
+    const glm::vec4 row2(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]);
+    const glm::vec4 row3(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+
+    const glm::vec4 planes[8] = {
+        row3 + row0, row3 - row0, // left, right
+        row3 + row1, row3 - row1, // top, bottom
+        row2,        row3 - row2, // near, far
+        glm::vec4(0.0f, 0.0f, 0.0f, 1.0f),
+        glm::vec4(0.0f, 0.0f, 0.0f, 1.0f),
+    };
+
+    for (uint32_t i = 0; i < 8u; i++)
+    {
+        const float len = glm::length(glm::vec3(planes[i]));
+        const float scale = len > 0.0f ? 1.0f / len : 1.0f;
+        outPlanes.nx[i] = planes[i].x * scale;
+        outPlanes.ny[i] = planes[i].y * scale;
+        outPlanes.nz[i] = planes[i].z * scale;
+        outPlanes.d[i]  = planes[i].w * scale;
+    }
+}
+
+/// Box is outside if its most positive corner (along plane normal) is behind any plane,
+/// inside if even its most negative corner is in front of all planes.
+CullResult testAabbFrustum(const Aabb& box, const FrustumPlanes& planes)
+{
+#if BVH_USE_SSE
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 minX = _mm_set1_ps(box.min[0]);
+    const __m128 minY = _mm_set1_ps(box.min[1]);
+    const __m128 minZ = _mm_set1_ps(box.min[2]);
+    const __m128 maxX = _mm_set1_ps(box.max[0]);
+    const __m128 maxY = _mm_set1_ps(box.max[1]);
+    const __m128 maxZ = _mm_set1_ps(box.max[2]);
+
+    int intersecting = 0;
+    for (uint32_t i = 0; i < 8u; i += 4u)
+    {
+        const __m128 nx = _mm_load_ps(planes.nx + i);
+        const __m128 ny = _mm_load_ps(planes.ny + i);
+        const __m128 nz = _mm_load_ps(planes.nz + i);
+        const __m128 d  = _mm_load_ps(planes.d  + i);
+
+        const __m128 posX = _mm_cmpgt_ps(nx, zero);
+        const __m128 posY = _mm_cmpgt_ps(ny, zero);
+        const __m128 posZ = _mm_cmpgt_ps(nz, zero);
+
+        // Most positive corner.
+        const __m128 px = _mm_or_ps(_mm_and_ps(posX, maxX), _mm_andnot_ps(posX, minX));
+        const __m128 py = _mm_or_ps(_mm_and_ps(posY, maxY), _mm_andnot_ps(posY, minY));
+        const __m128 pz = _mm_or_ps(_mm_and_ps(posZ, maxZ), _mm_andnot_ps(posZ, minZ));
+        // Most negative corner.
+        const __m128 qx = _mm_or_ps(_mm_and_ps(posX, minX), _mm_andnot_ps(posX, maxX));
+        const __m128 qy = _mm_or_ps(_mm_and_ps(posY, minY), _mm_andnot_ps(posY, maxY));
+        const __m128 qz = _mm_or_ps(_mm_and_ps(posZ, minZ), _mm_andnot_ps(posZ, maxZ));
+
+        const __m128 distP = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, px), _mm_mul_ps(ny, py)), _mm_add_ps(_mm_mul_ps(nz, pz), d));
+        const __m128 distQ = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, qx), _mm_mul_ps(ny, qy)), _mm_add_ps(_mm_mul_ps(nz, qz), d));
+
+        if (_mm_movemask_ps(_mm_cmplt_ps(distP, zero)) != 0)
+        {
+            return CullResult::OUTSIDE;
+        }
+        intersecting |= _mm_movemask_ps(_mm_cmplt_ps(distQ, zero));
+    }
+    return intersecting != 0 ? CullResult::INTERSECTING : CullResult::INSIDE;
+#else
+    bool intersecting = false;
+    for (uint32_t i = 0; i < 6u; i++)
+    {
+        const float px = planes.nx[i] > 0.0f ? box.max[0] : box.min[0];
+        const float py = planes.ny[i] > 0.0f ? box.max[1] : box.min[1];
+        const float pz = planes.nz[i] > 0.0f ? box.max[2] : box.min[2];
+        const float qx = planes.nx[i] > 0.0f ? box.min[0] : box.max[0];
+        const float qy = planes.ny[i] > 0.0f ? box.min[1] : box.max[1];
+        const float qz = planes.nz[i] > 0.0f ? box.min[2] : box.max[2];
+
+        if (planes.nx[i]*px + planes.ny[i]*py + planes.nz[i]*pz + planes.d[i] < 0.0f)
+        {
+            return CullResult::OUTSIDE;
+        }
+        intersecting = intersecting || (planes.nx[i]*qx + planes.ny[i]*qy + planes.nz[i]*qz + planes.d[i] < 0.0f);
+    }
+    return intersecting ? CullResult::INTERSECTING : CullResult::INSIDE;
+#endif
+}
+
+// } // FRUSTUM
+
+//////////////////////////////////////
+/// Dynamic AABB tree. Proxy id is a leaf node id, stable until destroyProxy().
+/// userData identifies the object in queries (e.g. index of an entity).
+class DynamicBvh
+{
+public:
+    int32_t createProxy(const Aabb& box, uint32_t userData)
+    {
+        const int32_t leaf = this->allocateNode();
+        Node& node    = this->nodes[leaf];
+        node.box      = expandAabb(box, BVH_AABB_MARGIN);
+        node.tightBox = box;
+        node.userData = userData;
+        node.height   = 0;
+
+        this->insertLeaf(leaf);
+        return leaf;
+    }
+
+    void destroyProxy(int32_t proxyId)
+    {
+        assert(this->nodes[proxyId].isLeaf());
+        this->removeLeaf(proxyId);
+        this->freeNode(proxyId);
+    }
+
+    /// Refit after the object's bounds changed.
+    /// Returns true if the leaf had to be reinserted (bounds left its fat AABB).
+    bool moveProxy(int32_t proxyId, const Aabb& box)
+    {
+        assert(this->nodes[proxyId].isLeaf());
+
+        this->nodes[proxyId].tightBox = box;
+        if (containsAabb(this->nodes[proxyId].box, box))
+        {
+            return false;
+        }
+
+        this->removeLeaf(proxyId);
+        this->nodes[proxyId].box = expandAabb(box, BVH_AABB_MARGIN);
+        this->insertLeaf(proxyId);
+        return true;
+    }
+
+    uint32_t getUserData(int32_t proxyId) const
+    {
+        return this->nodes[proxyId].userData;
+    }
+
+    int32_t getHeight() const
+    {
+        return this->root == BVH_NULL_NODE ? 0 : this->nodes[this->root].height;
+    }
+
+    /// userData of all objects whose tight AABB is not outside the frustum.
+    void queryFrustum(const FrustumPlanes& planes, std::vector<uint32_t>& outUserData) const
+    {
+        outUserData.clear();
+        if (this->root == BVH_NULL_NODE)
+        {
+            return;
+        }
+
+        std::vector<int32_t> stack = { this->root };
+        while (false == stack.empty())
+        {
+            const int32_t nodeId = stack.back();
+            stack.pop_back();
+            const Node& node = this->nodes[nodeId];
+
+            const CullResult result = testAabbFrustum(node.isLeaf() ? node.tightBox : node.box, planes);
+            if (result == CullResult::OUTSIDE)
+            {
+                continue;
+            }
+            if (node.isLeaf())
+            {
+                outUserData.push_back(node.userData);
+            }
+            else if (result == CullResult::INSIDE)
+            {
+                this->collectLeaves(nodeId, outUserData); // Whole subtree visible, no more tests.
+            }
+            else
+            {
+                stack.push_back(node.child1);
+                stack.push_back(node.child2);
+            }
+        }
+    }
+
+    /// Nearest object whose tight AABB is hit by the ray within maxT. dir does not have to be normalized, outT is in its units.
+    bool raycast(const float origin[3], const float dir[3], float maxT, uint32_t& outUserData, float& outT) const
+    {
+        if (this->root == BVH_NULL_NODE)
+        {
+            return false;
+        }
+
+        const float invDir[3] = {1.0f / dir[0], 1.0f / dir[1], 1.0f / dir[2]}; // Infinity for 0 is fine for the slab test.
+
+        bool  hit   = false;
+        float bestT = maxT;
+
+        std::vector<int32_t> stack = { this->root };
+        while (false == stack.empty())
+        {
+            const int32_t nodeId = stack.back();
+            stack.pop_back();
+            const Node& node = this->nodes[nodeId];
+
+            float t;
+            if (false == intersectRayAabb(node.isLeaf() ? node.tightBox : node.box, origin, invDir, bestT, t))
+            {
+                continue;
+            }
+            if (node.isLeaf())
+            {
+                bestT       = t;
+                outUserData = node.userData;
+                hit         = true;
+                continue;
+            }
+
+            // Nearer child is popped first, so farther one is often skipped by bestT.
+            float t1 = INFINITY;
+            float t2 = INFINITY;
+            const bool hit1 = intersectRayAabb(this->nodes[node.child1].box, origin, invDir, bestT, t1);
+            const bool hit2 = intersectRayAabb(this->nodes[node.child2].box, origin, invDir, bestT, t2);
+            if (hit1 && hit2)
+            {
+                stack.push_back(t1 < t2 ? node.child2 : node.child1);
+                stack.push_back(t1 < t2 ? node.child1 : node.child2);
+            }
+            else if (hit1)
+            {
+                stack.push_back(node.child1);
+            }
+            else if (hit2)
+            {
+                stack.push_back(node.child2);
+            }
+        }
+
+        outT = bestT;
+        return hit;
+    }
+
+    /// Object with the nearest tight AABB (distance 0 if the point is inside it). Best-first search.
+    bool queryNearest(const float point[3], uint32_t& outUserData, float& outDistance) const
+    {
+        if (this->root == BVH_NULL_NODE)
+        {
+            return false;
+        }
+
+        using queue_entry_t = std::pair<float, int32_t>; // <squared distance, node>
+        std::priority_queue<queue_entry_t, std::vector<queue_entry_t>, std::greater<queue_entry_t>> queue;
+        queue.push({getAabbDistanceSq(this->nodes[this->root].box, point), this->root});
+
+        while (false == queue.empty())
+        {
+            const auto [distSq, nodeId] = queue.top();
+            queue.pop();
+            const Node& node = this->nodes[nodeId];
+
+            if (node.isLeaf())
+            {
+                outUserData = node.userData; // Nothing left in the queue can be nearer.
+                outDistance = sqrtf(distSq);
+                return true;
+            }
+
+            for (int32_t childId : { node.child1, node.child2 })
+            {
+                const Node& child = this->nodes[childId];
+                queue.push({getAabbDistanceSq(child.isLeaf() ? child.tightBox : child.box, point), childId});
+            }
+        }
+        return false;
+    }
+
+private:
+    struct Node
+    {
+        Aabb     box;      // Fat AABB for leaves.
+        Aabb     tightBox; // Leaves only.
+        int32_t  parent;   // Next free node when in the free list.
+        int32_t  child1;
+        int32_t  child2;
+        int32_t  height;   // Leaf = 0, free node = -1.
+        uint32_t userData;
+
+        bool isLeaf() const
+        {
+            return this->child1 == BVH_NULL_NODE;
+        }
+    };
+
+    int32_t allocateNode()
+    {
+        int32_t nodeId;
+        if (this->freeList != BVH_NULL_NODE)
+        {
+            nodeId = this->freeList;
+            this->freeList = this->nodes[nodeId].parent;
+        }
+        else
+        {
+            nodeId = int32_t(this->nodes.size());
+            this->nodes.push_back(Node());
+        }
+
+        Node& node    = this->nodes[nodeId];
+        node.parent   = BVH_NULL_NODE;
+        node.child1   = BVH_NULL_NODE;
+        node.child2   = BVH_NULL_NODE;
+        node.height   = 0;
+        node.userData = 0u;
+        return nodeId;
+    }
+
+    void freeNode(int32_t nodeId)
+    {
+        this->nodes[nodeId].parent = this->freeList;
+        this->nodes[nodeId].height = -1;
+        this->freeList = nodeId;
+    }
+
+    void collectLeaves(int32_t subtreeRoot, std::vector<uint32_t>& outUserData) const
+    {
+        std::vector<int32_t> stack = { subtreeRoot };
+        while (false == stack.empty())
+        {
+            const Node& node = this->nodes[stack.back()];
+            stack.pop_back();
+            if (node.isLeaf())
+            {
+                outUserData.push_back(node.userData);
+            }
+            else
+            {
+                stack.push_back(node.child1);
+                stack.push_back(node.child2);
+            }
+        }
+    }
+
+    /// Recomputes box and height of the node from its children.
+    void refitNode(int32_t nodeId)
+    {
+        Node& node = this->nodes[nodeId];
+        node.box    = mergeAabb(this->nodes[node.child1].box, this->nodes[node.child2].box);
+        node.height = 1 + std::max(this->nodes[node.child1].height, this->nodes[node.child2].height);
+    }
+
+    void replaceChild(int32_t parentId, int32_t oldChild, int32_t newChild)
+    {
+        if (parentId == BVH_NULL_NODE)
+        {
+            this->root = newChild;
+        }
+        else if (this->nodes[parentId].child1 == oldChild)
+        {
+            this->nodes[parentId].child1 = newChild;
+        }
+        else
+        {
+            this->nodes[parentId].child2 = newChild;
+        }
+    }
+
+    /// Cost of making the leaf a sibling of the node, without the inherited part.
+    float getDescendCost(int32_t nodeId, const Aabb& leafBox) const
+    {
+        const Node& node = this->nodes[nodeId];
+        const float mergedArea = getAabbSurfaceArea(mergeAabb(leafBox, node.box));
+        return node.isLeaf() ? mergedArea : mergedArea - getAabbSurfaceArea(node.box);
+    }
+
+    void insertLeaf(int32_t leaf)
+    {
+        if (this->root == BVH_NULL_NODE)
+        {
+            this->root = leaf;
+            this->nodes[leaf].parent = BVH_NULL_NODE;
+            return;
+        }
+
+        // Find the best sibling by surface area heuristic.
+        const Aabb leafBox = this->nodes[leaf].box;
+        int32_t sibling = this->root;
+        while (false == this->nodes[sibling].isLeaf())
+        {
+            const Node& node = this->nodes[sibling];
+
+            const float area         = getAabbSurfaceArea(node.box);
+            const float combinedArea = getAabbSurfaceArea(mergeAabb(node.box, leafBox));
+
+            const float cost            = 2.0f * combinedArea;          // New parent here.
+            const float inheritanceCost = 2.0f * (combinedArea - area); // Going deeper grows this node anyway.
+
+            const float cost1 = this->getDescendCost(node.child1, leafBox) + inheritanceCost;
+            const float cost2 = this->getDescendCost(node.child2, leafBox) + inheritanceCost;
+
+            if (cost < cost1 && cost < cost2)
+            {
+                break;
+            }
+            sibling = cost1 < cost2 ? node.child1 : node.child2;
+        }
+
+        // New parent of the sibling and the leaf.
+        const int32_t oldParent = this->nodes[sibling].parent;
+        const int32_t newParent = this->allocateNode(); // May reallocate nodes - no references kept above.
+        this->nodes[newParent].parent = oldParent;
+        this->nodes[newParent].child1 = sibling;
+        this->nodes[newParent].child2 = leaf;
+        this->nodes[sibling].parent   = newParent;
+        this->nodes[leaf].parent      = newParent;
+        this->replaceChild(oldParent, sibling, newParent);
+
+        this->refitAncestors(newParent);
+    }
+
+    void removeLeaf(int32_t leaf)
+    {
+        if (leaf == this->root)
+        {
+            this->root = BVH_NULL_NODE;
+            return;
+        }
+
+        const int32_t parent      = this->nodes[leaf].parent;
+        const int32_t grandParent = this->nodes[parent].parent;
+        const int32_t sibling     = this->nodes[parent].child1 == leaf ? this->nodes[parent].child2 : this->nodes[parent].child1;
+
+        this->replaceChild(grandParent, parent, sibling);
+        this->nodes[sibling].parent = grandParent;
+        this->freeNode(parent);
+
+        if (grandParent != BVH_NULL_NODE)
+        {
+            this->refitAncestors(grandParent);
+        }
+    }
+
+    /// Balances and refits the node and all its ancestors.
+    void refitAncestors(int32_t nodeId)
+    {
+        while (nodeId != BVH_NULL_NODE)
+        {
+            nodeId = this->balance(nodeId);
+            this->refitNode(nodeId);
+            nodeId = this->nodes[nodeId].parent;
+        }
+    }
+
+    /// Rotates the higher grandchild up if children heights differ by more than 1.
+    /// Returns the node which is now at the position of nodeA.
+    int32_t balance(int32_t iA)
+    {
+        if (this->nodes[iA].isLeaf() || this->nodes[iA].height < 2)
+        {
+            return iA;
+        }
+
+        const int32_t iB = this->nodes[iA].child1;
+        const int32_t iC = this->nodes[iA].child2;
+        const int32_t heightDiff = this->nodes[iC].height - this->nodes[iB].height;
+
+        if (heightDiff > 1)
+        {
+            return this->rotateUp(iA, iC, false);
+        }
+        if (heightDiff < -1)
+        {
+            return this->rotateUp(iA, iB, true);
+        }
+        return iA;
+    }
+
+    /// Child "up" of A takes A's place, A becomes up's child together with up's higher child,
+    /// A keeps its other child and gets up's lower child. upIsChild1 - up was A's child1.
+    int32_t rotateUp(int32_t iA, int32_t iUp, bool upIsChild1)
+    {
+        const int32_t iF = this->nodes[iUp].child1;
+        const int32_t iG = this->nodes[iUp].child2;
+
+        const int32_t higher = this->nodes[iF].height > this->nodes[iG].height ? iF : iG;
+        const int32_t lower  = higher == iF ? iG : iF;
+
+        // Up replaces A in A's parent.
+        this->nodes[iUp].parent = this->nodes[iA].parent;
+        this->replaceChild(this->nodes[iA].parent, iA, iUp);
+
+        this->nodes[iUp].child1 = iA;
+        this->nodes[iUp].child2 = higher;
+        this->nodes[iA].parent  = iUp;
+
+        if (upIsChild1)
+        {
+            this->nodes[iA].child1 = lower;
+        }
+        else
+        {
+            this->nodes[iA].child2 = lower;
+        }
+        this->nodes[lower].parent = iA;
+
+        this->refitNode(iA);
+        this->refitNode(iUp);
+        return iUp;
+    }
+
+    std::vector<Node> nodes;
+    int32_t root     = BVH_NULL_NODE;
+    int32_t freeList = BVH_NULL_NODE;
+};
+
+} // namespace vk229
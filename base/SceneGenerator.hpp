@@ -0,0 +1,404 @@
+#pragma once
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include <HelperStructsAndFuncs.hpp>
+
+#define SCENE_GEN_MESH_REUSE        100u    // Default entities per distinct mesh...
+#define SCENE_GEN_MATERIAL_REUSE    1000u   // ...per distinct material - every one is a pipeline permutation...
+#define SCENE_GEN_TEXTURE_SET_REUSE 100u    // ...and per distinct texture set.
+#define SCENE_GEN_SEED              229u
+#define SCENE_GEN_SPACING           3.0f    // Average distance between neighbouring entities.
+#define SCENE_GEN_CLUSTER_SIZE      256u    // Entities per cluster of SceneDistribution::CLUSTERED.
+#define SCENE_REPORT_WARMUP_FRAMES  30u     // Frames not measured by SceneScalingReport - caches and clocks settle...
+#define SCENE_REPORT_FRAMES         300u    // ...and frames measured after them.
+
+namespace vk229
+{
+
+enum class SceneDistribution
+{
+    UNIFORM,    // Cube filled evenly.
+    CLUSTERED,  // Dense clusters of SCENE_GEN_CLUSTER_SIZE entities, far apart - uneven BVH, bursts of visible entities.
+    GRID,       // Flat square grid - most entities at similar depth.
+};
+
+//////////////////////////////////////
+/// Command line of examples and vk229_bench:
+/// --scene-entities <N>                  - generated scene of N entities instead of the hand-written one
+/// --scene-reuse <mesh,material,texset>  - entities per distinct mesh, material and texture set
+/// --scene-distribution <uniform|clustered|grid>
+/// --scene-seed <N>
+struct SceneGeneratorOptions
+{
+    uint32_t          entityCount     = 0u; // 0 - not generated.
+    uint32_t          meshReuse       = SCENE_GEN_MESH_REUSE;
+    uint32_t          materialReuse   = SCENE_GEN_MATERIAL_REUSE;
+    uint32_t          textureSetReuse = SCENE_GEN_TEXTURE_SET_REUSE;
+    SceneDistribution distribution    = SceneDistribution::UNIFORM;
+    uint32_t          seed            = SCENE_GEN_SEED;
+};
+
+const char* getSceneDistributionName(SceneDistribution distribution)
+{
+    switch (distribution)
+    {
+    case SceneDistribution::CLUSTERED: return "clustered";
+    case SceneDistribution::GRID:      return "grid";
+    default:                           return "uniform";
+    }
+}
+
+SceneGeneratorOptions parseSceneGeneratorOptions(const std::vector<const char*>& args)
+{
+    SceneGeneratorOptions options;
+    for (size_t i = 0; i + 1 < args.size(); i++)
+    {
+        if (strcmp(args[i], "--scene-entities") == 0)
+        {
+            options.entityCount = uint32_t(strtoul(args[++i], nullptr, 10));
+        }
+        else if (strcmp(args[i], "--scene-reuse") == 0)
+        {
+            uint32_t reuse[3] = {options.meshReuse, options.materialReuse, options.textureSetReuse};
+            std::stringstream ss(args[++i]);
+            std::string item;
+            for (uint32_t r = 0; r < 3u && std::getline(ss, item, ','); r++)
+            {
+                reuse[r] = std::max(1u, uint32_t(strtoul(item.c_str(), nullptr, 10)));
+            }
+            options.meshReuse       = reuse[0];
+            options.materialReuse   = reuse[1];
+            options.textureSetReuse = reuse[2];
+        }
+        else if (strcmp(args[i], "--scene-distribution") == 0)
+        {
+            const std::string name = args[++i];
+            options.distribution = (name == "clustered") ? SceneDistribution::CLUSTERED
+                                 : (name == "grid")      ? SceneDistribution::GRID
+                                 :                         SceneDistribution::UNIFORM;
+        }
+        else if (strcmp(args[i], "--scene-seed") == 0)
+        {
+            options.seed = uint32_t(strtoul(args[++i], nullptr, 10));
+        }
+    }
+    return options;
+}
+
+//////////////////////////////////////
+/// What generated entities are made of - distinct meshes, texture sets and materials are copies of these
+/// under new names, so they are loaded / created separately exactly as distinct assets would be.
+/// Texture sets have to be of the same size (see SceneInfo::fillTexturesSetInfoMap()), materials get
+/// different roughness per copy, so every copy is a pipeline permutation of its own.
+struct SceneGeneratorAssets
+{
+    std::vector<mesh_filename_t> meshFilenames;
+    std::vector<TextureSetInfo>  textureSets;
+    std::vector<MaterialInfo>    materials;
+    shaders_set_name_t           shadersSetName;
+    matrix_name_t                matrixName;
+};
+
+//////////////////////////////////////
+/// Scene definition for SceneInfo::fill*InfoMap() - shaders, textures and matrices are the caller's.
+/// Every entity hangs on a transform node of its own, placed at its position; meshes are in world space,
+/// so placeGeneratedEntities() moves the nodes by the mesh centers once meshes are loaded.
+struct GeneratedScene
+{
+    std::vector<MeshInfo>          meshesInfoVec;
+    std::vector<TextureSetInfo>    textureSetsInfoVec;
+    std::vector<MaterialInfo>      materialsInfoVec;
+    std::vector<Entity3dInfo>      entitiesInfoVec;
+    std::vector<TransformNodeInfo> transformNodesInfoVec; // Entity i hangs on node i.
+    float                          extent = 0.0f;         // Entities are in a cube of this size, centered at 0.
+};
+
+void generateScene(const SceneGeneratorOptions& options, const SceneGeneratorAssets& assets, GeneratedScene& out)
+{
+    assert(false == assets.meshFilenames.empty() && false == assets.textureSets.empty() && false == assets.materials.empty());
+
+    const uint32_t entityCount     = options.entityCount;
+    const uint32_t meshCount       = std::max(1u, (entityCount + options.meshReuse       - 1u) / options.meshReuse);
+    const uint32_t materialCount   = std::max(1u, (entityCount + options.materialReuse   - 1u) / options.materialReuse);
+    const uint32_t textureSetCount = std::max(1u, (entityCount + options.textureSetReuse - 1u) / options.textureSetReuse);
+
+    out = GeneratedScene();
+
+    for (uint32_t m = 0; m < meshCount; m++)
+    {
+        MeshInfo meshInfo;
+        meshInfo.meshName     = "gen_mesh" + std::to_string(m);
+        meshInfo.meshFilename = assets.meshFilenames[m % assets.meshFilenames.size()];
+        out.meshesInfoVec.push_back(meshInfo);
+    }
+
+    for (uint32_t t = 0; t < textureSetCount; t++)
+    {
+        TextureSetInfo texSetInfo;
+        texSetInfo.texturesSetName = "GEN_TEX" + std::to_string(t);
+        texSetInfo.texturesNames   = assets.textureSets[t % assets.textureSets.size()].texturesNames;
+        out.textureSetsInfoVec.push_back(texSetInfo);
+    }
+
+    const uint32_t copiesPerMaterial = (materialCount + assets.materials.size() - 1u) / assets.materials.size();
+    for (uint32_t k = 0; k < materialCount; k++)
+    {
+        MaterialInfo materialInfo = assets.materials[k % assets.materials.size()];
+        materialInfo.materialName    = "GEN_MAT" + std::to_string(k);
+        materialInfo.coeffs.roughness = float(k / assets.materials.size()) / float(copiesPerMaterial);
+        out.materialsInfoVec.push_back(materialInfo);
+    }
+
+    // Positions
+    std::mt19937 rndGenerator(options.seed);
+    std::uniform_real_distribution<float> uniformDist(-0.5f, 0.5f);
+    std::normal_distribution<float> normalDist(0.0f, 1.0f);
+
+    out.extent = SCENE_GEN_SPACING * cbrtf(float(std::max(1u, entityCount)));
+
+    std::vector<glm::vec3> clusterCenters;
+    if (options.distribution == SceneDistribution::CLUSTERED)
+    {
+        out.extent *= 2.0f; // Clusters are dense, space between them is empty.
+        const uint32_t clusterCount = (entityCount + SCENE_GEN_CLUSTER_SIZE - 1u) / SCENE_GEN_CLUSTER_SIZE;
+        for (uint32_t c = 0; c < clusterCount; c++)
+        {
+            clusterCenters.push_back(glm::vec3(uniformDist(rndGenerator), uniformDist(rndGenerator), uniformDist(rndGenerator)) * out.extent);
+        }
+    }
+    const uint32_t gridSide = uint32_t(ceilf(sqrtf(float(std::max(1u, entityCount)))));
+    if (options.distribution == SceneDistribution::GRID)
+    {
+        out.extent = SCENE_GEN_SPACING * float(gridSide);
+    }
+    const float clusterRadius = 0.5f * SCENE_GEN_SPACING * cbrtf(float(SCENE_GEN_CLUSTER_SIZE));
+
+    for (uint32_t e = 0; e < entityCount; e++)
+    {
+        glm::vec3 position;
+        switch (options.distribution)
+        {
+        case SceneDistribution::CLUSTERED:
+            position = clusterCenters[e / SCENE_GEN_CLUSTER_SIZE]
+                     + glm::vec3(normalDist(rndGenerator), normalDist(rndGenerator), normalDist(rndGenerator)) * clusterRadius;
+            break;
+        case SceneDistribution::GRID:
+            position = glm::vec3((float(e % gridSide) + 0.5f) / float(gridSide) - 0.5f, 0.0f,
+                                 (float(e / gridSide) + 0.5f) / float(gridSide) - 0.5f) * out.extent;
+            break;
+        default:
+            position = glm::vec3(uniformDist(rndGenerator), uniformDist(rndGenerator), uniformDist(rndGenerator)) * out.extent;
+            break;
+        }
+
+        const std::string id = std::to_string(e);
+        out.transformNodesInfoVec.push_back({"GenPos" + id, "", position});
+
+        // Neighbours differ in mesh, textures and material - reuse is not spatially coherent, as in real scenes.
+        out.entitiesInfoVec.push_back({
+            "Gen" + id,
+            out.meshesInfoVec[e % meshCount].meshName,
+            assets.matrixName,
+            out.textureSetsInfoVec[e % textureSetCount].texturesSetName,
+            assets.shadersSetName,
+            out.materialsInfoVec[e % materialCount].materialName,
+            out.transformNodesInfoVec.back().nodeName
+        });
+    }
+
+    std::cout << " >>> generateScene: " << entityCount << " entities (" << getSceneDistributionName(options.distribution) << "), "
+              << meshCount << " meshes, " << materialCount << " materials, " << textureSetCount << " texture sets, extent " << out.extent << "\n";
+}
+
+/// Moves nodes of generated entities so that mesh centers (meshes are in world space) land at entity positions.
+/// Requires SceneData::loadModels() and prepareTransforms().
+void placeGeneratedEntities(SceneData& sceneData, const GeneratedScene& scene)
+{
+    for (size_t e = 0; e < scene.entitiesInfoVec.size(); e++)
+    {
+        const BoundingSphere& sphere = sceneData.sceneInfo.meshesInfoMap[scene.entitiesInfoVec[e].meshName].boundingSphere;
+        const glm::vec3 center(sphere.center[0], sphere.center[1], sphere.center[2]);
+        const TransformNodeInfo& nodeInfo = scene.transformNodesInfoVec[e];
+        sceneData.transforms.setTranslation(sceneData.transformNodeMap[nodeInfo.nodeName], nodeInfo.translation - center);
+    }
+    sceneData.updateTransforms();
+}
+
+//////////////////////////////////////
+/// How the engine copes with a scene - one run, one row of a CSV which collects runs of different scene sizes:
+/// * beginPhase() / endPhase() - wall time of preparation steps (load, descriptors, pipelines...), <name>_ms columns
+/// * setValue() - anything else worth a column (entity count, pipelines...)
+/// * addRecordTime() - every command buffer recording
+/// * addFrame() - CPU time of every frame, first SCENE_REPORT_WARMUP_FRAMES are skipped
+/// isComplete() after SCENE_REPORT_FRAMES measured frames; finish() turns records and frames into columns.
+class SceneScalingReport
+{
+public:
+    /// Origin of getElapsedMs().
+    void start()
+    {
+        this->startTime = steady_clock_t::now();
+    }
+
+    double getElapsedMs() const
+    {
+        return std::chrono::duration<double, std::milli>(steady_clock_t::now() - this->startTime).count();
+    }
+
+    void beginPhase(const std::string& name)
+    {
+        this->phaseName  = name;
+        this->phaseStart = steady_clock_t::now();
+    }
+
+    void endPhase()
+    {
+        this->setValue(this->phaseName + "_ms", std::chrono::duration<double, std::milli>(steady_clock_t::now() - this->phaseStart).count());
+    }
+
+    void setValue(const std::string& name, double value)
+    {
+        for (auto& nameValue : this->values)
+        {
+            if (nameValue.first == name)
+            {
+                nameValue.second = value;
+                return;
+            }
+        }
+        this->values.push_back(std::make_pair(name, value));
+    }
+
+    bool hasValue(const std::string& name) const
+    {
+        for (const auto& nameValue : this->values)
+        {
+            if (nameValue.first == name)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void addRecordTime(double ms)
+    {
+        this->recordMs.push_back(ms);
+    }
+
+    void addFrame(double cpuMs)
+    {
+        if (this->skippedFrames < SCENE_REPORT_WARMUP_FRAMES)
+        {
+            this->skippedFrames++;
+            return;
+        }
+        this->frameMs.push_back(cpuMs);
+    }
+
+    uint32_t getFrameCount() const
+    {
+        return this->frameMs.size();
+    }
+
+    bool isComplete() const
+    {
+        return this->frameMs.size() >= SCENE_REPORT_FRAMES;
+    }
+
+    void finish()
+    {
+        double recordSum = 0.0, recordMax = 0.0;
+        for (double ms : this->recordMs)
+        {
+            recordSum += ms;
+            recordMax  = std::max(recordMax, ms);
+        }
+        this->setValue("records",        this->recordMs.size());
+        this->setValue("record_avg_ms",  this->recordMs.empty() ? 0.0 : recordSum / this->recordMs.size());
+        this->setValue("record_max_ms",  recordMax);
+
+        std::vector<double> sorted = this->frameMs;
+        std::sort(sorted.begin(), sorted.end());
+        double frameSum = 0.0;
+        for (double ms : sorted)
+        {
+            frameSum += ms;
+        }
+        this->setValue("frame_cpu_avg_ms", sorted.empty() ? 0.0 : frameSum / sorted.size());
+        this->setValue("frame_cpu_p95_ms", sorted.empty() ? 0.0 : sorted[std::min(sorted.size() - 1u, size_t(0.95 * sorted.size()))]);
+        this->setValue("frame_cpu_max_ms", sorted.empty() ? 0.0 : sorted.back());
+    }
+
+    std::vector<std::string> getReportLines() const
+    {
+        std::vector<std::string> lines;
+        lines.push_back(" >>> SceneScalingReport:");
+        for (const auto& nameValue : this->values)
+        {
+            std::ostringstream line;
+            line << std::fixed << std::setprecision(nameValue.second == floor(nameValue.second) ? 0 : 3)
+                 << "    " << std::left << std::setw(20) << nameValue.first << " " << nameValue.second;
+            lines.push_back(line.str());
+        }
+        return lines;
+    }
+
+    /// One row per run - the header is written if the file is new, columns are in order of first setValue().
+    bool appendCsv(const std::string& filename) const
+    {
+        const bool isNew = (false == std::ifstream(filename.c_str()).good());
+
+        std::ofstream file(filename.c_str(), std::ios::app);
+        if (!file)
+        {
+            std::cout << " >>> SceneScalingReport::appendCsv: could not open " << filename << "\n";
+            return false;
+        }
+
+        if (isNew)
+        {
+            for (size_t v = 0; v < this->values.size(); v++)
+            {
+                file << (v ? "," : "") << this->values[v].first;
+            }
+            file << "\n";
+        }
+        for (size_t v = 0; v < this->values.size(); v++)
+        {
+            file << (v ? "," : "") << this->values[v].second;
+        }
+        file << "\n";
+
+        std::cout << " >>> SceneScalingReport::appendCsv: run appended to " << filename << "\n";
+        return true;
+    }
+
+private:
+    using steady_clock_t = std::chrono::steady_clock;
+
+    steady_clock_t::time_point                   startTime = steady_clock_t::now();
+    steady_clock_t::time_point                   phaseStart;
+    std::string                                  phaseName;
+    std::vector<std::pair<std::string, double>>  values;
+    std::vector<double>                          recordMs;
+    std::vector<double>                          frameMs;
+    uint32_t                                     skippedFrames = 0u;
+};
+
+} // namespace vk229
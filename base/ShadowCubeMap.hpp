@@ -0,0 +1,315 @@
+#pragma once
+
+#include <assert.h>
+#include <vulkan/vulkan.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <VulkanTools.h>
+#include <VulkanInitializers.hpp>
+#include <VulkanDevice.hpp>
+
+namespace vk229
+{
+
+//////////////////////////////////////
+/// Omnidirectional shadow map of a point light.
+/// Every face of an R32_SFLOAT cube map is rendered separately (beginFacePass() / draw casters / endFacePass())
+/// and keeps distance from the light to the nearest caster - receivers compare it with their own distance,
+/// sampling the cube with the light-to-fragment vector.
+/// Faces are cleared to getFar(), so texels without casters never shadow.
+/// Contents stay valid until the next render - callers decide when it is worth to refresh it.
+class ShadowCubeMap
+{
+public:
+    void prepare(vks::VulkanDevice* dev, VkFormat depthFormat, uint32_t faceSize, float nearPlane, float farPlane)
+    {
+        this->device      = dev;
+        this->depthFormat = depthFormat;
+        this->faceSize    = faceSize;
+        this->nearPlane   = nearPlane;
+        this->farPlane    = farPlane;
+
+        std::cout << " >>> ShadowCubeMap::prepare: " << faceSize << "x" << faceSize << " x 6, range " << nearPlane << " - " << farPlane << "\n";
+
+        this->prepareRenderPass();
+        this->prepareImages();
+
+        // Sampler - nearest, distances must not be filtered across caster edges.
+        VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+        samplerCI.magFilter    = VK_FILTER_NEAREST;
+        samplerCI.minFilter    = VK_FILTER_NEAREST;
+        samplerCI.mipmapMode   = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerCI.minLod       = 0.0f;
+        samplerCI.maxLod       = 0.0f;
+        samplerCI.borderColor  = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+        VK_CHECK_RESULT(vkCreateSampler(dev->logicalDevice, &samplerCI, nullptr, &this->sampler));
+    }
+
+    void destroy()
+    {
+        if (this->device == nullptr)
+        {
+            return;
+        }
+
+        VkDevice dev = this->device->logicalDevice;
+
+        for (uint32_t face = 0; face < 6u; face++)
+        {
+            vkDestroyFramebuffer(dev, this->framebuffers[face], nullptr);
+            vkDestroyImageView(dev, this->faceViews[face], nullptr);
+        }
+        vkDestroyImageView(dev, this->cubeView, nullptr);
+        vkDestroyImage(dev, this->cubeImage, nullptr);
+        vkFreeMemory(dev, this->cubeMemory, nullptr);
+
+        vkDestroyImageView(dev, this->depthView, nullptr);
+        vkDestroyImage(dev, this->depthImage, nullptr);
+        vkFreeMemory(dev, this->depthMemory, nullptr);
+
+        vkDestroySampler(dev, this->sampler, nullptr);
+        vkDestroyRenderPass(dev, this->renderPass, nullptr);
+
+        this->device = nullptr;
+    }
+
+    /// Render pass of all faces - for caster pipelines (R32_SFLOAT color + depth).
+    VkRenderPass getRenderPass() const
+    {
+        return this->renderPass;
+    }
+
+    /// Whole cube, SHADER_READ_ONLY_OPTIMAL, nearest sampler.
+    VkDescriptorImageInfo getDescriptor() const
+    {
+        return vks::initializers::descriptorImageInfo(this->sampler, this->cubeView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+
+    float getFar() const
+    {
+        return this->farPlane;
+    }
+
+    /// Projection * view of a face for a light at lightPos, in cube map face order (+X, -X, +Y, -Y, +Z, -Z).
+    /// Orientation matches cube map sampling, so the face can be rendered without any flipping.
+    glm::mat4 getFaceViewProj(const glm::vec3& lightPos, uint32_t face) const
+    {
+        assert(face < 6u);
+
+        static const glm::vec3 dirs[6] = {
+            {  1.0f,  0.0f,  0.0f }, { -1.0f,  0.0f,  0.0f },
+            {  0.0f,  1.0f,  0.0f }, {  0.0f, -1.0f,  0.0f },
+            {  0.0f,  0.0f,  1.0f }, {  0.0f,  0.0f, -1.0f },
+        };
+        static const glm::vec3 ups[6] = {
+            {  0.0f, -1.0f,  0.0f }, {  0.0f, -1.0f,  0.0f },
+            {  0.0f,  0.0f,  1.0f }, {  0.0f,  0.0f, -1.0f },
+            {  0.0f, -1.0f,  0.0f }, {  0.0f, -1.0f,  0.0f },
+        };
+
+        const glm::mat4 proj = glm::perspective(glm::radians(90.0f), 1.0f, this->nearPlane, this->farPlane);
+        const glm::mat4 view = glm::lookAt(lightPos, lightPos + dirs[face], ups[face]);
+        return proj * view;
+    }
+
+    void beginFacePass(VkCommandBuffer cmd, uint32_t face)
+    {
+        assert(face < 6u);
+
+        VkClearValue clearValues[2];
+        clearValues[0].color        = { { this->farPlane, 0.0f, 0.0f, 0.0f } };
+        clearValues[1].depthStencil = { 1.0f, 0u };
+
+        VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+        renderPassBeginInfo.renderPass               = this->renderPass;
+        renderPassBeginInfo.framebuffer              = this->framebuffers[face];
+        renderPassBeginInfo.renderArea.extent.width  = this->faceSize;
+        renderPassBeginInfo.renderArea.extent.height = this->faceSize;
+        renderPassBeginInfo.clearValueCount          = 2;
+        renderPassBeginInfo.pClearValues             = clearValues;
+
+        vkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        VkViewport viewport = vks::initializers::viewport((float)this->faceSize, (float)this->faceSize, 0.0f, 1.0f);
+        vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+        VkRect2D scissor = vks::initializers::rect2D(this->faceSize, this->faceSize, 0, 0);
+        vkCmdSetScissor(cmd, 0, 1, &scissor);
+    }
+
+    void endFacePass(VkCommandBuffer cmd)
+    {
+        vkCmdEndRenderPass(cmd); // Render pass dependency makes the face visible to fragment shaders.
+    }
+
+private:
+    void prepareRenderPass()
+    {
+        std::vector<VkAttachmentDescription> attachments(2);
+        // Distance - sampled by receivers afterwards.
+        attachments[0].format         = VK_FORMAT_R32_SFLOAT;
+        attachments[0].samples        = VK_SAMPLE_COUNT_1_BIT;
+        attachments[0].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        attachments[0].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
+        attachments[0].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachments[0].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
+        attachments[0].finalLayout    = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        // Depth - only for nearest caster selection, shared by all faces.
+        attachments[1].format         = this->depthFormat;
+        attachments[1].samples        = VK_SAMPLE_COUNT_1_BIT;
+        attachments[1].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        attachments[1].storeOp        = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachments[1].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachments[1].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
+        attachments[1].finalLayout    = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+        VkAttachmentReference depthReference = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+        VkSubpassDescription subpass = {};
+        subpass.pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount    = 1;
+        subpass.pColorAttachments       = &colorReference;
+        subpass.pDepthStencilAttachment = &depthReference;
+
+        std::vector<VkSubpassDependency> dependencies(2);
+        // Receivers of earlier frames read the cube - write after read. Also orders shared depth between faces.
+        dependencies[0].srcSubpass      = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass      = 0;
+        dependencies[0].srcStageMask    = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[0].dstStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependencies[0].srcAccessMask   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[0].dstAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[0].dependencyFlags = 0;
+        // Distances are read by receivers' fragment shaders.
+        dependencies[1].srcSubpass      = 0;
+        dependencies[1].dstSubpass      = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[1].dstStageMask    = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependencies[1].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstAccessMask   = VK_ACCESS_SHADER_READ_BIT;
+        dependencies[1].dependencyFlags = 0;
+
+        VkRenderPassCreateInfo renderPassCI = vks::initializers::renderPassCreateInfo();
+        renderPassCI.attachmentCount = attachments.size();
+        renderPassCI.pAttachments    = attachments.data();
+        renderPassCI.subpassCount    = 1;
+        renderPassCI.pSubpasses      = &subpass;
+        renderPassCI.dependencyCount = dependencies.size();
+        renderPassCI.pDependencies   = dependencies.data();
+        VK_CHECK_RESULT(vkCreateRenderPass(this->device->logicalDevice, &renderPassCI, nullptr, &this->renderPass));
+    }
+
+    void allocateImageMemory(VkImage image, VkDeviceMemory& outMemory)
+    {
+        VkMemoryRequirements memReqs;
+        vkGetImageMemoryRequirements(this->device->logicalDevice, image, &memReqs);
+
+        VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+        memAlloc.allocationSize  = memReqs.size;
+        memAlloc.memoryTypeIndex = this->device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        VK_CHECK_RESULT(vkAllocateMemory(this->device->logicalDevice, &memAlloc, nullptr, &outMemory));
+        VK_CHECK_RESULT(vkBindImageMemory(this->device->logicalDevice, image, outMemory, 0));
+    }
+
+    void prepareImages()
+    {
+        VkDevice dev = this->device->logicalDevice;
+
+        // Distance cube.
+        VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+        imageCI.imageType   = VK_IMAGE_TYPE_2D;
+        imageCI.format      = VK_FORMAT_R32_SFLOAT;
+        imageCI.extent      = { this->faceSize, this->faceSize, 1 };
+        imageCI.mipLevels   = 1;
+        imageCI.arrayLayers = 6;
+        imageCI.samples     = VK_SAMPLE_COUNT_1_BIT;
+        imageCI.tiling      = VK_IMAGE_TILING_OPTIMAL;
+        imageCI.usage       = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        imageCI.flags       = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+        VK_CHECK_RESULT(vkCreateImage(dev, &imageCI, nullptr, &this->cubeImage));
+        this->allocateImageMemory(this->cubeImage, this->cubeMemory);
+
+        VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+        viewCI.viewType                        = VK_IMAGE_VIEW_TYPE_CUBE;
+        viewCI.format                          = VK_FORMAT_R32_SFLOAT;
+        viewCI.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewCI.subresourceRange.baseMipLevel   = 0;
+        viewCI.subresourceRange.levelCount     = 1;
+        viewCI.subresourceRange.baseArrayLayer = 0;
+        viewCI.subresourceRange.layerCount     = 6;
+        viewCI.image                           = this->cubeImage;
+        VK_CHECK_RESULT(vkCreateImageView(dev, &viewCI, nullptr, &this->cubeView));
+
+        viewCI.viewType                    = VK_IMAGE_VIEW_TYPE_2D;
+        viewCI.subresourceRange.layerCount = 1;
+        for (uint32_t face = 0; face < 6u; face++)
+        {
+            viewCI.subresourceRange.baseArrayLayer = face;
+            VK_CHECK_RESULT(vkCreateImageView(dev, &viewCI, nullptr, &this->faceViews[face]));
+        }
+
+        // Depth.
+        VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+        if (this->depthFormat >= VK_FORMAT_D16_UNORM_S8_UINT)
+        {
+            depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+        }
+
+        imageCI.format      = this->depthFormat;
+        imageCI.arrayLayers = 1;
+        imageCI.usage       = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        imageCI.flags       = 0;
+        VK_CHECK_RESULT(vkCreateImage(dev, &imageCI, nullptr, &this->depthImage));
+        this->allocateImageMemory(this->depthImage, this->depthMemory);
+
+        viewCI.format                          = this->depthFormat;
+        viewCI.subresourceRange.aspectMask     = depthAspect;
+        viewCI.subresourceRange.baseArrayLayer = 0;
+        viewCI.image                           = this->depthImage;
+        VK_CHECK_RESULT(vkCreateImageView(dev, &viewCI, nullptr, &this->depthView));
+
+        for (uint32_t face = 0; face < 6u; face++)
+        {
+            VkImageView attachments[2] = { this->faceViews[face], this->depthView };
+
+            VkFramebufferCreateInfo framebufferCI = vks::initializers::framebufferCreateInfo();
+            framebufferCI.renderPass      = this->renderPass;
+            framebufferCI.attachmentCount = 2;
+            framebufferCI.pAttachments    = attachments;
+            framebufferCI.width           = this->faceSize;
+            framebufferCI.height          = this->faceSize;
+            framebufferCI.layers          = 1;
+            VK_CHECK_RESULT(vkCreateFramebuffer(dev, &framebufferCI, nullptr, &this->framebuffers[face]));
+        }
+    }
+
+    vks::VulkanDevice* device      = nullptr;
+    VkFormat           depthFormat = VK_FORMAT_UNDEFINED;
+    uint32_t           faceSize    = 0u;
+    float              nearPlane   = 0.1f;
+    float              farPlane    = 1.0f;
+
+    VkRenderPass   renderPass      = VK_NULL_HANDLE;
+    VkFramebuffer  framebuffers[6] = {};
+    VkSampler      sampler         = VK_NULL_HANDLE;
+
+    VkImage        cubeImage    = VK_NULL_HANDLE;
+    VkDeviceMemory cubeMemory   = VK_NULL_HANDLE;
+    VkImageView    cubeView     = VK_NULL_HANDLE;
+    VkImageView    faceViews[6] = {};
+
+    VkImage        depthImage  = VK_NULL_HANDLE;
+    VkDeviceMemory depthMemory = VK_NULL_HANDLE;
+    VkImageView    depthView   = VK_NULL_HANDLE;
+};
+
+} // namespace vk229
@@ -0,0 +1,952 @@
+#pragma once
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <gli/gli.hpp>
+#include <VulkanTools.h>
+#include <ThreadPool.hpp>
+#include <BlockCompression.hpp>
+
+namespace vk229
+{
+/////////////////////////////////////////
+/// Load-time texture processing:
+/// * equirectangular (cylindrical) env. map -> cubemap (optionally BC7)
+/// * equirectangular env. map (8-bit or HDR) -> GGX prefiltered cubemap, RGB9E5 (roughness per mip level)
+/// * uncompressed normal map -> BC5
+/// * channels of several (baked) maps -> one packed RGBA texture (optionally BC7)
+/// Results are cached on disk next to the source file
+/// and regenerated only when the source is newer than the cache.
+/// prepare*() functions only convert (if the cache is stale) and return name of the cache file,
+/// which is then uploaded by TextureResidencyManager::loadTexture().
+/////////////////////////////////////////
+
+/// Samples per texel of prefiltered env. map levels (roughness > 0).
+#define ENV_PREFILTER_SAMPLES  128u
+/// Bump when prefiltering output changes - invalidates prefiltered env. map caches.
+#define ENV_PREFILTER_VERSION  1u
+
+/// True if cache file exists and is not older than the source file.
+bool isCacheFresh(const std::string& cacheFilename, const std::string& sourceFilename)
+{
+    struct stat cacheStat;
+    struct stat sourceStat;
+    if (stat(cacheFilename.c_str(), &cacheStat) != 0)
+    {
+        return false;
+    }
+    if (stat(sourceFilename.c_str(), &sourceStat) != 0)
+    {
+        return true; // Only cache shipped - use it.
+    }
+    return cacheStat.st_mtime >= sourceStat.st_mtime;
+}
+
+/// "dir/name_bgra_2kx1k.dds" + "_cube512.dds" -> "dir/name_bgra_2kx1k_cube512.dds"
+std::string getCacheFilename(const std::string& sourceFilename, const std::string& suffix)
+{
+    const size_t dotPos = sourceFilename.find_last_of('.');
+    return sourceFilename.substr(0, dotPos) + suffix;
+}
+
+/// Level 0 size from DDS or KTX header, without loading the texture. Returns false if the file can not be read.
+bool readTextureExtent(const std::string& filename, uint32_t& outWidth, uint32_t& outHeight)
+{
+    std::ifstream file(filename, std::ios::binary);
+    uint8_t header[44];
+    if (false == file.read(reinterpret_cast<char*>(header), sizeof(header)).good())
+    {
+        return false;
+    }
+
+    auto readU32 = [&header](uint32_t offset, bool swapBytes)
+    {
+        uint32_t value;
+        memcpy(&value, header + offset, sizeof(value));
+        return swapBytes ? (value >> 24u) | ((value >> 8u) & 0xFF00u) | ((value << 8u) & 0xFF0000u) | (value << 24u) : value;
+    };
+
+    static const uint8_t KTX_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+    if (memcmp(header, "DDS ", 4u) == 0)
+    {
+        outHeight = readU32(12u, false); // DDS_HEADER::dwHeight, dwWidth - after the magic and dwSize, dwFlags.
+        outWidth  = readU32(16u, false);
+        return true;
+    }
+    if (memcmp(header, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) == 0)
+    {
+        const bool swapBytes = readU32(12u, false) != 0x04030201u;
+        outWidth  = readU32(36u, swapBytes);
+        outHeight = readU32(40u, swapBytes);
+        return true;
+    }
+    return false;
+}
+
+// EQUIRECT_TO_CUBEMAP {
+
+/// Direction of texel center of a cubemap face, Vulkan face order: +X, -X, +Y, -Y, +Z, -Z.
+/// sc, tc are in -1..1, as in the cube map face selection table of the spec.
+void getCubeFaceDirection(uint32_t face, float sc, float tc, float outDir[3])
+{
+    switch (face)
+    {
+    case 0: outDir[0] =  1.0f; outDir[1] = -tc;   outDir[2] = -sc;   break; // +X
+    case 1: outDir[0] = -1.0f; outDir[1] = -tc;   outDir[2] =  sc;   break; // -X
+    case 2: outDir[0] =  sc;   outDir[1] =  1.0f; outDir[2] =  tc;   break; // +Y
+    case 3: outDir[0] =  sc;   outDir[1] = -1.0f; outDir[2] = -tc;   break; // -Y
+    case 4: outDir[0] =  sc;   outDir[1] = -tc;   outDir[2] =  1.0f; break; // +Z
+    default:outDir[0] = -sc;   outDir[1] = -tc;   outDir[2] = -1.0f; break; // -Z
+    }
+
+    const float len = sqrtf(outDir[0]*outDir[0] + outDir[1]*outDir[1] + outDir[2]*outDir[2]);
+    outDir[0] /= len;
+    outDir[1] /= len;
+    outDir[2] /= len;
+}
+
+/// Same mapping as used before by default_material.frag for its equirectangular lookup:
+/// theta = acos(R.y), phi = atan(R.x, -R.z), with map content scaled by uvScale and centered.
+void getEquirectUV(const float dir[3], float uvScale, float& outU, float& outV)
+{
+    const float y     = fmaxf(-1.0f, fminf(1.0f, dir[1]));
+    const float theta = acosf(y);
+    const float phi   = atan2f(dir[0], -dir[2]);
+
+    outU = (0.5f - phi/(2.0f*float(M_PI))) * uvScale + (1.0f - uvScale)/2.0f;
+    outV = (1.0f - theta/float(M_PI))      * uvScale + (1.0f - uvScale)/2.0f;
+}
+
+/// Bilinear fetch of 4 x 8-bit texel, U wraps around, V is clamped. Channel order is kept.
+void sampleBilinear4x8(const uint8_t* src, uint32_t width, uint32_t height, float u, float v, uint8_t out[4])
+{
+    const float x = u * width  - 0.5f;
+    const float y = v * height - 0.5f;
+
+    const float fx0 = floorf(x);
+    const float fy0 = floorf(y);
+    const float wx  = x - fx0;
+    const float wy  = y - fy0;
+
+    auto wrapX  = [width](int32_t xi)  { xi %= int32_t(width); return uint32_t(xi < 0 ? xi + int32_t(width) : xi); };
+    auto clampY = [height](int32_t yi) { return uint32_t(yi < 0 ? 0 : (yi >= int32_t(height) ? int32_t(height) - 1 : yi)); };
+
+    const uint32_t x0 = wrapX(int32_t(fx0));
+    const uint32_t x1 = wrapX(int32_t(fx0) + 1);
+    const uint32_t y0 = clampY(int32_t(fy0));
+    const uint32_t y1 = clampY(int32_t(fy0) + 1);
+
+    const uint8_t* t00 = src + 4u*(y0*width + x0);
+    const uint8_t* t10 = src + 4u*(y0*width + x1);
+    const uint8_t* t01 = src + 4u*(y1*width + x0);
+    const uint8_t* t11 = src + 4u*(y1*width + x1);
+
+    for (uint32_t c = 0; c < 4u; c++)
+    {
+        const float top    = t00[c] + (t10[c] - t00[c]) * wx;
+        const float bottom = t01[c] + (t11[c] - t01[c]) * wx;
+        out[c] = uint8_t(top + (bottom - top) * wy + 0.5f);
+    }
+}
+
+/// 2x2 box filter of 4 x 8-bit image, dst is (srcSize/2)^2.
+void downsample4x8(const uint8_t* src, uint32_t srcSize, uint8_t* dst)
+{
+    const uint32_t dstSize = srcSize / 2u;
+    for (uint32_t y = 0; y < dstSize; y++)
+    {
+        for (uint32_t x = 0; x < dstSize; x++)
+        {
+            const uint8_t* s0 = src + 4u*((2u*y)     *srcSize + 2u*x);
+            const uint8_t* s1 = src + 4u*((2u*y + 1u)*srcSize + 2u*x);
+            uint8_t*       d  = dst + 4u*(y*dstSize + x);
+            for (uint32_t c = 0; c < 4u; c++)
+            {
+                d[c] = uint8_t((s0[c] + s0[c + 4u] + s1[c] + s1[c + 4u] + 2u) / 4u);
+            }
+        }
+    }
+}
+
+/// Converts equirectangular 4 x 8-bit map into a cubemap with full mip chain.
+/// Faces are computed on multiple threads. faceSize has to be a power of two.
+gli::texture_cube convertEquirectToCubemap(const gli::texture2d& equirect, uint32_t faceSize, float uvScale)
+{
+    assert(gli::block_size(equirect.format()) == 4u);
+    assert((faceSize & (faceSize - 1u)) == 0u);
+
+    const uint32_t srcWidth  = equirect.extent(0).x;
+    const uint32_t srcHeight = equirect.extent(0).y;
+    const uint8_t* srcData   = static_cast<const uint8_t*>(equirect.data(0, 0, 0));
+
+    uint32_t levels = 1u;
+    while ((faceSize >> levels) > 0u)
+    {
+        levels++;
+    }
+
+    gli::texture_cube cube(equirect.format(), gli::extent2d(faceSize, faceSize), levels);
+
+    // Level 0 - every row of every face is a separate work item.
+    parallelFor(6u * faceSize, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t item = begin; item < end; item++)
+        {
+            const uint32_t face = item / faceSize;
+            const uint32_t y    = item % faceSize;
+            uint8_t* dstRow = static_cast<uint8_t*>(cube.data(0, face, 0)) + 4u*y*faceSize;
+
+            for (uint32_t x = 0; x < faceSize; x++)
+            {
+                const float sc = 2.0f * (x + 0.5f) / faceSize - 1.0f;
+                const float tc = 2.0f * (y + 0.5f) / faceSize - 1.0f;
+
+                float dir[3];
+                float u, v;
+                getCubeFaceDirection(face, sc, tc, dir);
+                getEquirectUV(dir, uvScale, u, v);
+                sampleBilinear4x8(srcData, srcWidth, srcHeight, u, v, dstRow + 4u*x);
+            }
+        }
+    });
+
+    // Mip chain - faces in parallel.
+    parallelFor(6u, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t face = begin; face < end; face++)
+        {
+            for (uint32_t level = 1u; level < levels; level++)
+            {
+                downsample4x8(static_cast<const uint8_t*>(cube.data(0, face, level - 1u)),
+                              faceSize >> (level - 1u),
+                              static_cast<uint8_t*>(cube.data(0, face, level)));
+            }
+        }
+    });
+
+    return cube;
+}
+
+/// Default face size of a cubemap converted from equirectangular env. map - half of the source height
+/// (rounded down to power of 2), same texel density at the horizon. Read from the file header only,
+/// so cache hits do not decode the source.
+uint32_t getEquirectCubeFaceSize(const std::string& sourceFilename)
+{
+    uint32_t width  = 0u;
+    uint32_t height = 0u;
+    if (false == readTextureExtent(sourceFilename, width, height) || height < 2u)
+    {
+        vks::tools::exitFatal("Could not read env. map: " + sourceFilename, "Error");
+    }
+
+    uint32_t faceSize = 1u;
+    while (faceSize * 2u <= height / 2u)
+    {
+        faceSize *= 2u;
+    }
+    return faceSize;
+}
+
+/// Equirectangular env. map for conversion - exits if it can not be loaded.
+gli::texture2d loadEquirect(const std::string& sourceFilename)
+{
+    gli::texture2d equirect(gli::load(sourceFilename.c_str()));
+    if (equirect.empty())
+    {
+        vks::tools::exitFatal("Could not load env. map: " + sourceFilename, "Error");
+    }
+    return equirect;
+}
+
+/// Converts equirectangular env. map to a cubemap.
+/// Conversion result is cached in "<source>_cube<faceSize>.dds" ("..._bc7.dds" if compressBC7), next to the source.
+/// Face size defaults to getEquirectCubeFaceSize().
+std::string prepareEquirectAsCubemap(const std::string& sourceFilename,
+                                     float uvScale,
+                                     uint32_t faceSize = 0u,
+                                     bool compressBC7 = false)
+{
+    if (faceSize == 0u)
+    {
+        faceSize = getEquirectCubeFaceSize(sourceFilename);
+    }
+
+    const std::string cacheFilename = getCacheFilename(sourceFilename, "_cube" + std::to_string(faceSize) + (compressBC7 ? "_bc7.dds" : ".dds"));
+
+    if (false == isCacheFresh(cacheFilename, sourceFilename))
+    {
+        std::cout << " >>> prepareEquirectAsCubemap: converting " << sourceFilename << " -> " << cacheFilename << "\n";
+
+        gli::texture_cube cube = convertEquirectToCubemap(loadEquirect(sourceFilename), faceSize, uvScale);
+        if (compressBC7)
+        {
+            cube = compressTextureBC7(cube);
+        }
+        if (false == gli::save(cube, cacheFilename.c_str()))
+        {
+            std::cout << " >>> prepareEquirectAsCubemap: could not write cache " << cacheFilename << "\n";
+        }
+    }
+
+    return cacheFilename;
+}
+
+// } // EQUIRECT_TO_CUBEMAP
+
+// PREFILTERED_ENVIRONMENT {
+
+/// FNV-1a, 64 bit.
+uint64_t hashFnv1a(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/// FNV-1a of file content. Returns false if the file can not be read.
+bool hashFile(const std::string& filename, uint64_t& outHash)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (false == file.is_open())
+    {
+        return false;
+    }
+
+    std::vector<char> chunk(1u << 20u);
+    outHash = hashFnv1a(nullptr, 0u);
+    while (file)
+    {
+        file.read(chunk.data(), chunk.size());
+        outHash = hashFnv1a(chunk.data(), size_t(file.gcount()), outHash);
+    }
+    return true;
+}
+
+float halfToFloat(uint16_t h)
+{
+    const uint32_t sign     = uint32_t(h >> 15u) << 31u;
+    const uint32_t exponent = (h >> 10u) & 31u;
+    const uint32_t mantissa = h & 1023u;
+
+    float value;
+    if (exponent == 0u)
+    {
+        value = ldexpf(float(mantissa), -24); // Denormal.
+    }
+    else if (exponent == 31u)
+    {
+        value = mantissa ? NAN : INFINITY;
+    }
+    else
+    {
+        value = ldexpf(float(mantissa | 1024u), int32_t(exponent) - 25);
+    }
+    return sign ? -value : value;
+}
+
+/// Shared exponent format (VK_FORMAT_E5B9G9R9_UFLOAT_PACK32): 9-bit mantissas, 5-bit exponent, no sign.
+uint32_t encodeRgb9e5(const float rgb[3])
+{
+    const float maxValue = 65408.0f; // (511 / 512) * 2^16
+    float c[3];
+    for (uint32_t i = 0; i < 3u; i++)
+    {
+        c[i] = (rgb[i] > 0.0f) ? fminf(rgb[i], maxValue) : 0.0f; // Also NaN -> 0.
+    }
+
+    const float maxC = fmaxf(c[0], fmaxf(c[1], c[2]));
+    int32_t exponent = std::max(-16, int32_t(floorf(log2f(fmaxf(maxC, 1e-30f))))) + 1 + 15;
+    float scale = ldexpf(1.0f, exponent - 15 - 9);
+    if (uint32_t(floorf(maxC / scale + 0.5f)) == 512u)
+    {
+        exponent++;
+        scale *= 2.0f;
+    }
+
+    uint32_t packed = uint32_t(exponent) << 27u;
+    for (uint32_t i = 0; i < 3u; i++)
+    {
+        packed |= std::min(511u, uint32_t(floorf(c[i] / scale + 0.5f))) << (9u*i);
+    }
+    return packed;
+}
+
+void decodeRgb9e5(uint32_t packed, float outRgb[3])
+{
+    const float scale = ldexpf(1.0f, int32_t(packed >> 27u) - 15 - 9);
+    for (uint32_t i = 0; i < 3u; i++)
+    {
+        outRgb[i] = float((packed >> (9u*i)) & 511u) * scale;
+    }
+}
+
+/// Level 0 of 8-bit (as 0..1), half float, float or RGB9E5 texture -> RGBA floats.
+std::vector<float> decodeToLinearRgba(const gli::texture2d& src)
+{
+    const uint32_t texelCount = src.extent(0).x * src.extent(0).y;
+    const gli::format format  = src.format();
+    std::vector<float> rgba(4u*texelCount, 1.0f);
+
+    if (format == gli::FORMAT_RGBA32_SFLOAT_PACK32 || format == gli::FORMAT_RGB32_SFLOAT_PACK32)
+    {
+        const uint32_t channels = (format == gli::FORMAT_RGBA32_SFLOAT_PACK32) ? 4u : 3u;
+        const float* data = static_cast<const float*>(src.data(0, 0, 0));
+        for (uint32_t i = 0; i < texelCount; i++)
+        {
+            memcpy(&rgba[4u*i], data + channels*i, channels*sizeof(float));
+        }
+    }
+    else if (format == gli::FORMAT_RGBA16_SFLOAT_PACK16 || format == gli::FORMAT_RGB16_SFLOAT_PACK16)
+    {
+        const uint32_t channels = (format == gli::FORMAT_RGBA16_SFLOAT_PACK16) ? 4u : 3u;
+        const uint16_t* data = static_cast<const uint16_t*>(src.data(0, 0, 0));
+        for (uint32_t i = 0; i < texelCount; i++)
+        {
+            for (uint32_t c = 0; c < channels; c++)
+            {
+                rgba[4u*i + c] = halfToFloat(data[channels*i + c]);
+            }
+        }
+    }
+    else if (format == gli::FORMAT_RGB9E5_UFLOAT_PACK32)
+    {
+        const uint32_t* data = static_cast<const uint32_t*>(src.data(0, 0, 0));
+        for (uint32_t i = 0; i < texelCount; i++)
+        {
+            decodeRgb9e5(data[i], &rgba[4u*i]);
+        }
+    }
+    else
+    {
+        const std::vector<uint8_t> rgba8 = decodeTextureLevel(src, 0u);
+        for (uint32_t i = 0; i < 4u*texelCount; i++)
+        {
+            rgba[i] = rgba8[i] / 255.0f;
+        }
+    }
+
+    return rgba;
+}
+
+/// Float RGBA cubemap with full mip chain, Vulkan face order, levels[level][face] is faceSize >> level squared.
+struct FloatCubemap
+{
+    uint32_t faceSize;
+    std::vector<std::vector<std::vector<float>>> levels;
+
+    uint32_t getLevelSize(uint32_t level) const
+    {
+        return std::max(1u, this->faceSize >> level);
+    }
+};
+
+/// Face and texel coordinates (0..1) of a direction, inverse of getCubeFaceDirection().
+void getCubeFaceCoords(const float dir[3], uint32_t& outFace, float& outS, float& outT)
+{
+    const float ax = fabsf(dir[0]);
+    const float ay = fabsf(dir[1]);
+    const float az = fabsf(dir[2]);
+
+    float sc, tc, ma;
+    if (ax >= ay && ax >= az)
+    {
+        outFace = dir[0] > 0.0f ? 0u : 1u;
+        sc = dir[0] > 0.0f ? -dir[2] : dir[2];
+        tc = -dir[1];
+        ma = ax;
+    }
+    else if (ay >= az)
+    {
+        outFace = dir[1] > 0.0f ? 2u : 3u;
+        sc = dir[0];
+        tc = dir[1] > 0.0f ? dir[2] : -dir[2];
+        ma = ay;
+    }
+    else
+    {
+        outFace = dir[2] > 0.0f ? 4u : 5u;
+        sc = dir[2] > 0.0f ? dir[0] : -dir[0];
+        tc = -dir[1];
+        ma = az;
+    }
+
+    outS = 0.5f * (sc / ma + 1.0f);
+    outT = 0.5f * (tc / ma + 1.0f);
+}
+
+/// Bilinear fetch within one face (clamped at face edges), lod is blended between two levels.
+void sampleCubemapLod(const FloatCubemap& cube, const float dir[3], float lod, float out[4])
+{
+    uint32_t face;
+    float s, t;
+    getCubeFaceCoords(dir, face, s, t);
+
+    const float maxLod = float(cube.levels.size() - 1u);
+    lod = fmaxf(0.0f, fminf(lod, maxLod));
+    const uint32_t level0 = uint32_t(lod);
+    const uint32_t level1 = std::min(level0 + 1u, uint32_t(cube.levels.size() - 1u));
+    const float    wLevel = lod - float(level0);
+
+    out[0] = out[1] = out[2] = out[3] = 0.0f;
+    for (uint32_t l = 0; l < 2u; l++)
+    {
+        const uint32_t level  = l ? level1 : level0;
+        const float    weight = l ? wLevel : 1.0f - wLevel;
+        if (weight <= 0.0f)
+        {
+            continue;
+        }
+
+        const uint32_t size = cube.getLevelSize(level);
+        const float*   data = cube.levels[level][face].data();
+
+        const float x  = fmaxf(0.0f, fminf(s * size - 0.5f, size - 1.0f));
+        const float y  = fmaxf(0.0f, fminf(t * size - 0.5f, size - 1.0f));
+        const uint32_t x0 = uint32_t(x);
+        const uint32_t y0 = uint32_t(y);
+        const uint32_t x1 = std::min(x0 + 1u, size - 1u);
+        const uint32_t y1 = std::min(y0 + 1u, size - 1u);
+        const float    wx = x - float(x0);
+        const float    wy = y - float(y0);
+
+        for (uint32_t c = 0; c < 4u; c++)
+        {
+            const float top    = data[4u*(y0*size + x0) + c] * (1.0f - wx) + data[4u*(y0*size + x1) + c] * wx;
+            const float bottom = data[4u*(y1*size + x0) + c] * (1.0f - wx) + data[4u*(y1*size + x1) + c] * wx;
+            out[c] += weight * (top * (1.0f - wy) + bottom * wy);
+        }
+    }
+}
+
+/// Equirectangular float map -> float cubemap, levels 1.. are 2x2 box filtered.
+FloatCubemap convertEquirectToFloatCubemap(const std::vector<float>& equirect, uint32_t srcWidth, uint32_t srcHeight,
+                                           uint32_t faceSize, float uvScale)
+{
+    FloatCubemap cube;
+    cube.faceSize = faceSize;
+
+    uint32_t levels = 1u;
+    while ((faceSize >> levels) > 0u)
+    {
+        levels++;
+    }
+    cube.levels.resize(levels);
+    for (uint32_t level = 0; level < levels; level++)
+    {
+        const uint32_t size = cube.getLevelSize(level);
+        cube.levels[level].assign(6u, std::vector<float>(4u*size*size));
+    }
+
+    parallelFor(6u * faceSize, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t item = begin; item < end; item++)
+        {
+            const uint32_t face = item / faceSize;
+            const uint32_t y    = item % faceSize;
+            float* dstRow = cube.levels[0][face].data() + 4u*y*faceSize;
+
+            for (uint32_t x = 0; x < faceSize; x++)
+            {
+                float dir[3];
+                float u, v;
+                getCubeFaceDirection(face, 2.0f*(x + 0.5f)/faceSize - 1.0f, 2.0f*(y + 0.5f)/faceSize - 1.0f, dir);
+                getEquirectUV(dir, uvScale, u, v);
+
+                // Bilinear, U wraps around, V is clamped - as sampleBilinear4x8().
+                const float sx  = u * srcWidth  - 0.5f;
+                const float sy  = fmaxf(0.0f, fminf(v * srcHeight - 0.5f, srcHeight - 1.0f));
+                const float fx0 = floorf(sx);
+                const float wx  = sx - fx0;
+                const uint32_t y0 = uint32_t(sy);
+                const uint32_t y1 = std::min(y0 + 1u, srcHeight - 1u);
+                const float    wy = sy - float(y0);
+                const uint32_t x0 = uint32_t((int32_t(fx0) % int32_t(srcWidth) + int32_t(srcWidth)) % int32_t(srcWidth));
+                const uint32_t x1 = (x0 + 1u) % srcWidth;
+
+                for (uint32_t c = 0; c < 4u; c++)
+                {
+                    const float top    = equirect[4u*(y0*srcWidth + x0) + c] * (1.0f - wx) + equirect[4u*(y0*srcWidth + x1) + c] * wx;
+                    const float bottom = equirect[4u*(y1*srcWidth + x0) + c] * (1.0f - wx) + equirect[4u*(y1*srcWidth + x1) + c] * wx;
+                    dstRow[4u*x + c] = top * (1.0f - wy) + bottom * wy;
+                }
+            }
+        }
+    });
+
+    for (uint32_t level = 1u; level < levels; level++)
+    {
+        const uint32_t srcSize = cube.getLevelSize(level - 1u);
+        const uint32_t dstSize = cube.getLevelSize(level);
+        for (uint32_t face = 0; face < 6u; face++)
+        {
+            const float* src = cube.levels[level - 1u][face].data();
+            float*       dst = cube.levels[level][face].data();
+            for (uint32_t y = 0; y < dstSize; y++)
+            {
+                for (uint32_t x = 0; x < dstSize; x++)
+                {
+                    for (uint32_t c = 0; c < 4u; c++)
+                    {
+                        dst[4u*(y*dstSize + x) + c] = 0.25f * (src[4u*((2u*y)     *srcSize + 2u*x) + c] + src[4u*((2u*y)     *srcSize + 2u*x + 1u) + c]
+                                                             + src[4u*((2u*y + 1u)*srcSize + 2u*x) + c] + src[4u*((2u*y + 1u)*srcSize + 2u*x + 1u) + c]);
+                    }
+                }
+            }
+        }
+    }
+
+    return cube;
+}
+
+/// Low discrepancy 2D sequence point i of count.
+void getHammersleyPoint(uint32_t i, uint32_t count, float& outU, float& outV)
+{
+    uint32_t bits = i;
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+
+    outU = float(i) / float(count);
+    outV = float(bits) * 2.3283064365386963e-10f; // / 2^32
+}
+
+/// Roughness of prefiltered env. map level, linear in level - matches default_material.frag lookup.
+float getPrefilterRoughness(uint32_t level, uint32_t levelCount)
+{
+    return (levelCount > 1u) ? float(level) / float(levelCount - 1u) : 0.0f;
+}
+
+/// GGX prefiltering with N = V = R (split sum approximation), one mip level per roughness.
+/// Samples come from mip levels of the source picked by sample's solid angle (filtered importance sampling),
+/// so ENV_PREFILTER_SAMPLES is enough without visible noise. Level 0 (roughness 0) is the source itself.
+/// Rows of all faces are computed on multiple threads.
+FloatCubemap prefilterCubemapGGX(const FloatCubemap& source)
+{
+    FloatCubemap result;
+    result.faceSize = source.faceSize;
+    result.levels.resize(source.levels.size());
+    result.levels[0] = source.levels[0];
+
+    const uint32_t levelCount    = source.levels.size();
+    const float    texelSolidAng = 4.0f * float(M_PI) / (6.0f * source.faceSize * source.faceSize);
+
+    for (uint32_t level = 1u; level < levelCount; level++)
+    {
+        const uint32_t size  = result.getLevelSize(level);
+        const float    alpha = getPrefilterRoughness(level, levelCount) * getPrefilterRoughness(level, levelCount);
+        const float    alpha2 = alpha * alpha;
+        result.levels[level].assign(6u, std::vector<float>(4u*size*size));
+
+        parallelFor(6u * size, [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t item = begin; item < end; item++)
+            {
+                const uint32_t face = item / size;
+                const uint32_t y    = item % size;
+                float* dstRow = result.levels[level][face].data() + 4u*y*size;
+
+                for (uint32_t x = 0; x < size; x++)
+                {
+                    float n[3];
+                    getCubeFaceDirection(face, 2.0f*(x + 0.5f)/size - 1.0f, 2.0f*(y + 0.5f)/size - 1.0f, n);
+
+                    // Tangent frame around N.
+                    const float up[3] = {0.0f, fabsf(n[2]) < 0.999f ? 0.0f : 1.0f, fabsf(n[2]) < 0.999f ? 1.0f : 0.0f};
+                    float tx[3] = {up[1]*n[2] - up[2]*n[1], up[2]*n[0] - up[0]*n[2], up[0]*n[1] - up[1]*n[0]};
+                    const float txLen = sqrtf(tx[0]*tx[0] + tx[1]*tx[1] + tx[2]*tx[2]);
+                    tx[0] /= txLen; tx[1] /= txLen; tx[2] /= txLen;
+                    const float ty[3] = {n[1]*tx[2] - n[2]*tx[1], n[2]*tx[0] - n[0]*tx[2], n[0]*tx[1] - n[1]*tx[0]};
+
+                    float sum[4]  = {0.0f, 0.0f, 0.0f, 0.0f};
+                    float weights = 0.0f;
+                    for (uint32_t i = 0; i < ENV_PREFILTER_SAMPLES; i++)
+                    {
+                        float xi0, xi1;
+                        getHammersleyPoint(i, ENV_PREFILTER_SAMPLES, xi0, xi1);
+
+                        // Half vector from GGX distribution.
+                        const float phi      = 2.0f * float(M_PI) * xi0;
+                        const float cosTheta = sqrtf((1.0f - xi1) / (1.0f + (alpha2 - 1.0f) * xi1));
+                        const float sinTheta = sqrtf(1.0f - cosTheta*cosTheta);
+                        const float hx = sinTheta * cosf(phi);
+                        const float hy = sinTheta * sinf(phi);
+
+                        float h[3];
+                        for (uint32_t c = 0; c < 3u; c++)
+                        {
+                            h[c] = tx[c]*hx + ty[c]*hy + n[c]*cosTheta;
+                        }
+
+                        // L = reflect(-V, H), V = N.
+                        const float nDotH = cosTheta;
+                        float l[3];
+                        for (uint32_t c = 0; c < 3u; c++)
+                        {
+                            l[c] = 2.0f * nDotH * h[c] - n[c];
+                        }
+                        const float nDotL = l[0]*n[0] + l[1]*n[1] + l[2]*n[2];
+                        if (nDotL <= 0.0f)
+                        {
+                            continue;
+                        }
+
+                        // pdf(L) = D(H) * NdotH / (4 * VdotH) = D(H) / 4 with V = N.
+                        const float d = alpha2 / (float(M_PI) * powf(nDotH*nDotH * (alpha2 - 1.0f) + 1.0f, 2.0f));
+                        const float sampleSolidAng = 1.0f / (ENV_PREFILTER_SAMPLES * d * 0.25f + 1e-6f);
+                        const float lod = 0.5f * log2f(sampleSolidAng / texelSolidAng) + 1.0f;
+
+                        float texel[4];
+                        sampleCubemapLod(source, l, lod, texel);
+                        for (uint32_t c = 0; c < 4u; c++)
+                        {
+                            sum[c] += texel[c] * nDotL;
+                        }
+                        weights += nDotL;
+                    }
+
+                    for (uint32_t c = 0; c < 4u; c++)
+                    {
+                        dstRow[4u*x + c] = sum[c] / fmaxf(weights, 1e-6f);
+                    }
+                }
+            }
+        });
+    }
+
+    return result;
+}
+
+/// Prefilters equirectangular env. map (8-bit or HDR: 16/32-bit float, RGB9E5) into a GGX cubemap in RGB9E5.
+/// Mip level m holds roughness m / (levels - 1), so shader does one textureLod() per fragment.
+/// Result is cached in "<source>_ggx<faceSize>_<hash>.dds", next to the source - hash covers source content,
+/// face size, uvScale and ENV_PREFILTER_VERSION, so edited sources or changed parameters are never served stale.
+/// Face size defaults to getEquirectCubeFaceSize().
+std::string prepareEquirectAsPrefilteredCubemap(const std::string& sourceFilename,
+                                                float uvScale,
+                                                uint32_t faceSize = 0u)
+{
+    if (faceSize == 0u)
+    {
+        faceSize = getEquirectCubeFaceSize(sourceFilename);
+    }
+
+    uint64_t hash = 0u;
+    if (false == hashFile(sourceFilename, hash))
+    {
+        vks::tools::exitFatal("Could not read env. map: " + sourceFilename, "Error");
+    }
+    const uint32_t params[3] = {faceSize, ENV_PREFILTER_VERSION, ENV_PREFILTER_SAMPLES};
+    hash = hashFnv1a(params,   sizeof(params),  hash);
+    hash = hashFnv1a(&uvScale, sizeof(uvScale), hash);
+
+    std::ostringstream suffix;
+    suffix << "_ggx" << faceSize << "_" << std::hex << std::setw(16) << std::setfill('0') << hash << ".dds";
+    const std::string cacheFilename = getCacheFilename(sourceFilename, suffix.str());
+
+    struct stat cacheStat;
+    if (stat(cacheFilename.c_str(), &cacheStat) != 0)
+    {
+        std::cout << " >>> prepareEquirectAsPrefilteredCubemap: prefiltering " << sourceFilename << " -> " << cacheFilename << "\n";
+
+        const gli::texture2d equirect = loadEquirect(sourceFilename);
+        const FloatCubemap source = convertEquirectToFloatCubemap(decodeToLinearRgba(equirect),
+                                                                  equirect.extent(0).x, equirect.extent(0).y,
+                                                                  faceSize, uvScale);
+        const FloatCubemap prefiltered = prefilterCubemapGGX(source);
+
+        gli::texture_cube cube(gli::FORMAT_RGB9E5_UFLOAT_PACK32, gli::extent2d(faceSize, faceSize), prefiltered.levels.size());
+        for (uint32_t level = 0; level < prefiltered.levels.size(); level++)
+        {
+            const uint32_t size = prefiltered.getLevelSize(level);
+            for (uint32_t face = 0; face < 6u; face++)
+            {
+                uint32_t*    dst = static_cast<uint32_t*>(cube.data(0, face, level));
+                const float* src = prefiltered.levels[level][face].data();
+                for (uint32_t i = 0; i < size*size; i++)
+                {
+                    dst[i] = encodeRgb9e5(src + 4u*i);
+                }
+            }
+        }
+
+        if (false == gli::save(cube, cacheFilename.c_str()))
+        {
+            std::cout << " >>> prepareEquirectAsPrefilteredCubemap: could not write cache " << cacheFilename << "\n";
+        }
+    }
+
+    return cacheFilename;
+}
+
+// } // PREFILTERED_ENVIRONMENT
+
+// BLOCK_COMPRESSION {
+
+/// Compresses 4 x 8-bit normal map to BC5 (X, Y only - Z has to be reconstructed in shader).
+/// Compression result is cached in "<source>_bc5.dds", next to the source.
+std::string prepareNormalMapAsBC5(const std::string& sourceFilename)
+{
+    const std::string cacheFilename = getCacheFilename(sourceFilename, "_bc5.dds");
+
+    if (false == isCacheFresh(cacheFilename, sourceFilename))
+    {
+        std::cout << " >>> prepareNormalMapAsBC5: compressing " << sourceFilename << " -> " << cacheFilename << "\n";
+
+        gli::texture2d source(gli::load(sourceFilename.c_str()));
+        assert(!source.empty());
+
+        gli::texture2d compressed = compressTextureBC5(source);
+        if (false == gli::save(compressed, cacheFilename.c_str()))
+        {
+            std::cout << " >>> prepareNormalMapAsBC5: could not write cache " << cacheFilename << "\n";
+        }
+    }
+
+    return cacheFilename;
+}
+
+// } // BLOCK_COMPRESSION
+
+// TEXTURE_PACKING {
+
+/// Source of one channel of a packed texture.
+struct PackedChannelSource
+{
+    std::string sourceFilename; // Empty - unused channel, filled with 255.
+    uint32_t    sourceChannel;  // 0..3 - R, G, B, A as sampled (BC4 gives (R, 0, 0, 1)).
+};
+
+/// Merges channels of up to 4 textures into one RGBA8 texture with full mip chain.
+/// Sources are decoded (see decodeTextureLevel()) and resampled to the size of the largest one,
+/// which has to be square, power of two.
+gli::texture2d packTextureChannels(const std::vector<PackedChannelSource>& channels)
+{
+    assert(channels.size() <= 4u);
+
+    struct DecodedSource
+    {
+        std::vector<uint8_t> rgba;
+        uint32_t width;
+        uint32_t height;
+    };
+    std::map<std::string, DecodedSource> decoded; // Sources with several packed channels are decoded once.
+
+    uint32_t size = 1u;
+    for (const PackedChannelSource& ch : channels)
+    {
+        if (ch.sourceFilename.empty() || decoded.count(ch.sourceFilename) > 0)
+        {
+            continue;
+        }
+
+        gli::texture2d source(gli::load(ch.sourceFilename.c_str()));
+        assert(!source.empty());
+
+        DecodedSource& ds = decoded[ch.sourceFilename];
+        ds.rgba   = decodeTextureLevel(source, 0u);
+        ds.width  = source.extent(0).x;
+        ds.height = source.extent(0).y;
+        size = std::max(size, std::max(ds.width, ds.height));
+    }
+    assert((size & (size - 1u)) == 0u);
+
+    uint32_t levels = 1u;
+    while ((size >> levels) > 0u)
+    {
+        levels++;
+    }
+
+    gli::texture2d packed(gli::FORMAT_RGBA8_UNORM_PACK8, gli::extent2d(size, size), levels);
+    uint8_t* dst = static_cast<uint8_t*>(packed.data(0, 0, 0));
+
+    parallelFor(size, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t y = begin; y < end; y++)
+        {
+            for (uint32_t x = 0; x < size; x++)
+            {
+                uint8_t* texel = dst + 4u*(y*size + x);
+                for (uint32_t c = 0; c < 4u; c++)
+                {
+                    texel[c] = 255u;
+                    if (c >= channels.size() || channels[c].sourceFilename.empty())
+                    {
+                        continue;
+                    }
+
+                    const DecodedSource& ds = decoded.at(channels[c].sourceFilename);
+                    if (ds.width == size && ds.height == size)
+                    {
+                        texel[c] = ds.rgba[4u*(y*size + x) + channels[c].sourceChannel];
+                    }
+                    else
+                    {
+                        uint8_t sample[4];
+                        sampleBilinear4x8(ds.rgba.data(), ds.width, ds.height, (x + 0.5f)/size, (y + 0.5f)/size, sample);
+                        texel[c] = sample[channels[c].sourceChannel];
+                    }
+                }
+            }
+        }
+    });
+
+    for (uint32_t level = 1u; level < levels; level++)
+    {
+        downsample4x8(static_cast<const uint8_t*>(packed.data(0, 0, level - 1u)), size >> (level - 1u),
+                      static_cast<uint8_t*>(packed.data(0, 0, level)));
+    }
+
+    return packed;
+}
+
+/// Packs channels of other textures into one texture, RGBA8 or BC7 (compressBC7).
+/// Packing result is cached in "<packedFilename>" ("..._bc7.dds" if compressBC7) and redone when any source is newer.
+std::string preparePackedTexture(const std::string& packedFilename,
+                                 const std::vector<PackedChannelSource>& channels,
+                                 bool compressBC7 = false)
+{
+    const std::string cacheFilename = getCacheFilename(packedFilename, compressBC7 ? "_bc7.dds" : ".dds");
+
+    bool cacheFresh = true;
+    for (const PackedChannelSource& ch : channels)
+    {
+        cacheFresh = cacheFresh && (ch.sourceFilename.empty() || isCacheFresh(cacheFilename, ch.sourceFilename));
+    }
+
+    if (false == cacheFresh)
+    {
+        std::cout << " >>> preparePackedTexture: packing " << channels.size() << " channels -> " << cacheFilename << "\n";
+
+        gli::texture2d packed = packTextureChannels(channels);
+        if (compressBC7)
+        {
+            packed = compressTextureBC7(packed);
+        }
+        if (false == gli::save(packed, cacheFilename.c_str()))
+        {
+            std::cout << " >>> preparePackedTexture: could not write cache " << cacheFilename << "\n";
+        }
+    }
+
+    return cacheFilename;
+}
+
+// } // TEXTURE_PACKING
+
+} // namespace vk229
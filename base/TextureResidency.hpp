@@ -0,0 +1,785 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <gli/gli.hpp>
+#include <VulkanTools.h>
+#include <VulkanInitializers.hpp>
+#include <VulkanDevice.hpp>
+#include <VulkanTexture.hpp>
+#include <ThreadPool.hpp>
+
+namespace vk229
+{
+
+/// Without VK_EXT_memory_budget: part of heap size assumed to be available, usage = textures tracked here.
+#define RESIDENCY_FALLBACK_HEAP_FRACTION  0.8f
+/// Eviction starts above this part of the budget...
+#define RESIDENCY_HIGH_WATERMARK          0.9f
+/// ...and stops below this one.
+#define RESIDENCY_LOW_WATERMARK           0.8f
+/// Textures not visible for this many frames can lose mip levels (ones never visible - at any time).
+#define RESIDENCY_MIN_IDLE_FRAMES         120u
+/// Evicted textures keep mip levels up to this size (never less than one level).
+#define RESIDENCY_MIN_RESIDENT_SIZE       64u
+
+//////////////////////////////////////
+/// Per-heap memory usage and budget.
+/// With VK_EXT_memory_budget values come from the driver (all allocations of the process),
+/// otherwise budget is RESIDENCY_FALLBACK_HEAP_FRACTION of heap size and usage is what was reported by addUsage().
+/// The extension is queried through vkGetPhysicalDeviceMemoryProperties2, which may only be called if the instance
+/// (and the device) are Vulkan 1.1+ or the instance enabled VK_KHR_get_physical_device_properties2 - otherwise it is estimated too.
+class MemoryBudget
+{
+public:
+    /// instanceApiVersion and instanceExtensions - as given in VkInstanceCreateInfo.
+    void prepare(VkInstance instance, VkPhysicalDevice physicalDevice, uint32_t instanceApiVersion, const std::vector<const char*>& instanceExtensions)
+    {
+        this->physicalDevice = physicalDevice;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &this->memoryProperties);
+
+        this->trackedUsage.assign(this->memoryProperties.memoryHeapCount, 0u);
+        this->heapBudget.assign(this->memoryProperties.memoryHeapCount, 0u);
+        this->heapUsage.assign(this->memoryProperties.memoryHeapCount, 0u);
+
+#ifdef VK_EXT_memory_budget
+        uint32_t extCount = 0u;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extCount, nullptr);
+        std::vector<VkExtensionProperties> extensions(extCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extCount, extensions.data());
+
+        bool budgetExtSupported = false;
+        for (const VkExtensionProperties& ext : extensions)
+        {
+            budgetExtSupported = budgetExtSupported || (std::string(ext.extensionName) == VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+
+        VkPhysicalDeviceProperties deviceProps;
+        vkGetPhysicalDeviceProperties(physicalDevice, &deviceProps);
+        const bool core11 = instanceApiVersion >= VK_MAKE_VERSION(1, 1, 0) && deviceProps.apiVersion >= VK_MAKE_VERSION(1, 1, 0);
+
+        bool props2ExtEnabled = false;
+        for (const char* ext : instanceExtensions)
+        {
+            props2ExtEnabled = props2ExtEnabled || (std::string(ext) == VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+        }
+
+        // A non-null pointer from vkGetInstanceProcAddr does not mean the call is allowed - loaders export both names anyway.
+        if (budgetExtSupported && core11)
+        {
+            this->getMemoryProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2>(
+                vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2"));
+        }
+        else if (budgetExtSupported && props2ExtEnabled)
+        {
+            this->getMemoryProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2>(
+                vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR"));
+        }
+        else if (budgetExtSupported)
+        {
+            std::cout << " >>> MemoryBudget: VK_EXT_memory_budget needs Vulkan 1.1 or " << VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME << " on the instance\n";
+        }
+#else
+        (void)instance;
+        (void)instanceApiVersion;
+        (void)instanceExtensions;
+#endif
+
+        std::cout << " >>> MemoryBudget: " << (this->isBudgetExtAvailable() ? "VK_EXT_memory_budget" : "estimated from heap sizes") << "\n";
+        this->update();
+    }
+
+    bool isBudgetExtAvailable() const
+    {
+#ifdef VK_EXT_memory_budget
+        return this->getMemoryProperties2 != nullptr;
+#else
+        return false;
+#endif
+    }
+
+    /// Refreshes budget and usage of all heaps, cheap enough to be called every frame.
+    void update()
+    {
+#ifdef VK_EXT_memory_budget
+        if (this->getMemoryProperties2 != nullptr)
+        {
+            VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProps = {};
+            budgetProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+            VkPhysicalDeviceMemoryProperties2 props2 = {};
+            props2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+            props2.pNext = &budgetProps;
+            this->getMemoryProperties2(this->physicalDevice, &props2);
+
+            for (uint32_t heap = 0; heap < this->memoryProperties.memoryHeapCount; heap++)
+            {
+                this->heapBudget[heap] = budgetProps.heapBudget[heap];
+                this->heapUsage[heap]  = budgetProps.heapUsage[heap];
+            }
+            return;
+        }
+#endif
+        for (uint32_t heap = 0; heap < this->memoryProperties.memoryHeapCount; heap++)
+        {
+            this->heapBudget[heap] = VkDeviceSize(this->memoryProperties.memoryHeaps[heap].size * RESIDENCY_FALLBACK_HEAP_FRACTION);
+            this->heapUsage[heap]  = this->trackedUsage[heap];
+        }
+    }
+
+    /// Memory allocated (bytes > 0) or freed (bytes < 0) by the caller - used only without VK_EXT_memory_budget.
+    void addUsage(uint32_t heap, int64_t bytes)
+    {
+        this->trackedUsage[heap] = VkDeviceSize(int64_t(this->trackedUsage[heap]) + bytes);
+    }
+
+    uint32_t getHeapIndex(uint32_t memoryTypeIndex) const
+    {
+        return this->memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    }
+
+    uint32_t     getHeapCount()            const { return this->memoryProperties.memoryHeapCount; }
+    VkDeviceSize getBudget(uint32_t heap)  const { return this->heapBudget[heap]; }
+    VkDeviceSize getUsage(uint32_t heap)   const { return this->heapUsage[heap]; }
+    bool isDeviceLocal(uint32_t heap) const
+    {
+        return (this->memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0u;
+    }
+
+private:
+    VkPhysicalDevice                 physicalDevice = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    std::vector<VkDeviceSize>        trackedUsage;
+    std::vector<VkDeviceSize>        heapBudget;
+    std::vector<VkDeviceSize>        heapUsage;
+#ifdef VK_EXT_memory_budget
+    PFN_vkGetPhysicalDeviceMemoryProperties2 getMemoryProperties2 = nullptr;
+#endif
+};
+
+//////////////////////////////////////
+/// Keeps textures within the memory budget.
+/// Textures are loaded through loadTexture() (top levels which do not fit are skipped) and touched every frame they are visible.
+/// Under pressure, textures not visible for RESIDENCY_MIN_IDLE_FRAMES (or never visible yet) lose their top mip level
+/// (least recently visible first, on the GPU - remaining levels are copied to a smaller image),
+/// down to RESIDENCY_MIN_RESIDENT_SIZE. Visible textures missing levels are read from disk on a worker
+/// thread and uploaded on the render thread, with as many levels as the budget allows.
+/// Texture objects are replaced in place, the sampler is kept - the owner has to switch to new descriptors
+/// of textures returned by applyChanges(). Replaced images are destroyed by completeFrame() once every frame
+/// which may still read them is done, so the queue is never drained for it.
+class TextureResidencyManager
+{
+public:
+    /// Counters shown in the overlay.
+    struct Stats
+    {
+        VkDeviceSize residentBytes   = 0u;
+        uint32_t     textureCount    = 0u;
+        uint32_t     reducedCount    = 0u; // Textures with evicted mip levels.
+        uint32_t     evictedLevels   = 0u; // Total, since start.
+        uint32_t     reloadedCount   = 0u; // Total, since start.
+        uint32_t     pendingLoads    = 0u;
+        VkDeviceSize retiredBytes    = 0u; // Replaced images waiting for frames in flight.
+    };
+
+    TextureResidencyManager() :
+        loadPool(1u) // Loads are disk bound - one worker, render thread keeps its core.
+    {
+    }
+
+    ~TextureResidencyManager()
+    {
+        this->loadPool.waitIdle();
+    }
+
+    /// frameCount - frames which can be in flight (swapchain images), see completeFrame().
+    /// textureBudget > 0 - textures must also fit in it (to test eviction on large GPUs), 0 - heap budget only.
+    /// instanceApiVersion and instanceExtensions - see MemoryBudget::prepare().
+    void prepare(vks::VulkanDevice* dev, VkQueue queue, uint32_t frameCount, VkInstance instance, uint32_t instanceApiVersion,
+                 const std::vector<const char*>& instanceExtensions, VkDeviceSize textureBudget = 0u)
+    {
+        assert(frameCount > 0u && frameCount <= 32u);
+
+        this->device        = dev;
+        this->queue         = queue;
+        this->frameCount    = frameCount;
+        this->textureBudget = textureBudget;
+        this->budget.prepare(instance, dev->physicalDevice, instanceApiVersion, instanceExtensions);
+    }
+
+    /// Loads texture from filename (DDS or KTX, it is read again on reloads) into texture - image, view and sampler.
+    /// Only levels which fit in the budget are uploaded (never less than getMinResidentFirstLevel()),
+    /// the rest is streamed in by update() when the texture is visible.
+    void loadTexture(const std::string& name, const std::string& filename, VkFormat format, bool isCube, vks::Texture& texture)
+    {
+        gli::texture data = gli::load(filename.c_str());
+        if (data.empty())
+        {
+            vks::tools::exitFatal("Could not load texture: " + filename, "Error");
+        }
+
+        ResidentTexture& rt = this->textures[name];
+        rt.filename   = filename;
+        rt.format     = format;
+        rt.isCube     = isCube;
+        rt.texture    = &texture;
+        rt.fullWidth  = uint32_t(data.extent(0).x);
+        rt.fullHeight = uint32_t(data.extent(0).y);
+        rt.fullLevels = uint32_t(data.levels());
+        rt.firstLevel = 0u;
+        rt.bytes      = 0u;
+        rt.heap       = 0u;
+        rt.loading    = false;
+        rt.lastVisibleFrame = 0u;
+
+        texture.device       = this->device;
+        texture.layerCount   = isCube ? 6u : 1u;
+        texture.image        = VK_NULL_HANDLE;
+        texture.deviceMemory = VK_NULL_HANDLE;
+        texture.view         = VK_NULL_HANDLE;
+
+        // Sampler covers the full chain - it is kept when levels are evicted or reloaded.
+        VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+        samplerCI.magFilter        = VK_FILTER_LINEAR;
+        samplerCI.minFilter        = VK_FILTER_LINEAR;
+        samplerCI.mipmapMode       = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        samplerCI.addressModeU     = isCube ? VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE : VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerCI.addressModeV     = samplerCI.addressModeU;
+        samplerCI.addressModeW     = samplerCI.addressModeU;
+        samplerCI.compareOp        = VK_COMPARE_OP_NEVER;
+        samplerCI.minLod           = 0.0f;
+        samplerCI.maxLod           = float(rt.fullLevels);
+        samplerCI.anisotropyEnable = this->device->enabledFeatures.samplerAnisotropy;
+        samplerCI.maxAnisotropy    = this->device->enabledFeatures.samplerAnisotropy ? this->device->properties.limits.maxSamplerAnisotropy : 1.0f;
+        samplerCI.borderColor      = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+        VK_CHECK_RESULT(vkCreateSampler(this->device->logicalDevice, &samplerCI, nullptr, &texture.sampler));
+
+        uint32_t firstLevel = 0u;
+        while (firstLevel < this->getMinResidentFirstLevel(rt) && this->isOverBudget(int64_t(this->getLevelsSize(data, firstLevel))))
+        {
+            firstLevel++;
+        }
+        if (firstLevel > 0u)
+        {
+            std::cout << " >>> TextureResidencyManager: " << name << " over budget, loaded from mip level " << firstLevel << "\n";
+        }
+
+        this->upload(rt, data, firstLevel);
+        this->flushCopies();
+    }
+
+    /// Marks texture as visible in given frame.
+    void touch(const std::string& name, uint64_t frame)
+    {
+        auto it = this->textures.find(name);
+        if (it != this->textures.end())
+        {
+            it->second.lastVisibleFrame = frame;
+        }
+    }
+
+    /// Decides about evictions and reloads. Cheap - does not touch the GPU.
+    /// Returns true if applyChanges() has work to do.
+    bool update(uint64_t frame)
+    {
+        this->currentFrame = frame;
+        this->budget.update();
+
+        // Visible textures with missing levels are requested from disk, if at least one more level
+        // (about 3x of what is resident) can fit - by itself or after evicting idle textures.
+        for (auto& texIt : this->textures)
+        {
+            ResidentTexture& rt = texIt.second;
+            if (rt.firstLevel > 0u && rt.loading == false && rt.lastVisibleFrame == frame &&
+                (false == this->isOverBudget(3 * int64_t(rt.bytes)) || false == this->findEvictionCandidate(texIt.first).empty()))
+            {
+                this->requestLoad(texIt.first, rt);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(this->loadedMtx);
+        return false == this->loadedTextures.empty()
+            || (this->isOverBudget(0) && false == this->findEvictionCandidate("").empty());
+    }
+
+    /// Evicts (if over budget) and uploads finished loads - all copies go to the queue in one submit.
+    /// Frames in flight may still read the replaced images, they are kept until completeFrame() of every frame.
+    /// Returns names of textures whose vks::Texture objects changed.
+    std::vector<std::string> applyChanges()
+    {
+        std::vector<std::string> changed;
+
+        // Uploads of finished loads - levels which fit in the budget (at least what is resident now).
+        std::vector<LoadedTexture> loaded;
+        {
+            std::lock_guard<std::mutex> lock(this->loadedMtx);
+            loaded.swap(this->loadedTextures);
+        }
+        for (LoadedTexture& lt : loaded)
+        {
+            ResidentTexture& rt = this->textures[lt.name];
+            rt.loading = false;
+            if (lt.data == nullptr || lt.data->empty())
+            {
+                std::cout << " >>> TextureResidencyManager: could not load " << rt.filename << "\n";
+                continue;
+            }
+
+            // Room is made by evicting idle textures first, then fewer levels are uploaded.
+            uint32_t firstLevel = 0u;
+            while (firstLevel < rt.firstLevel && this->isOverBudget(int64_t(this->getLevelsSize(*lt.data, firstLevel)) - int64_t(rt.bytes)))
+            {
+                if (false == this->evictLeastRecentlyVisible(lt.name, changed))
+                {
+                    firstLevel++;
+                }
+            }
+            if (firstLevel >= rt.firstLevel)
+            {
+                continue; // Nothing better fits.
+            }
+
+            this->upload(rt, *lt.data, firstLevel);
+            this->stats.reloadedCount++;
+            changed.push_back(lt.name);
+        }
+
+        // Evictions - until everything left is visible or at minimum size.
+        while (this->isOverBudget(0, RESIDENCY_LOW_WATERMARK) && this->evictLeastRecentlyVisible("", changed))
+        {
+        }
+
+        this->flushCopies();
+
+        std::sort(changed.begin(), changed.end());
+        changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+        return changed;
+    }
+
+    /// The last submit of frame frameIndex is done - images replaced before it which no other frame
+    /// can read anymore are destroyed.
+    void completeFrame(uint32_t frameIndex)
+    {
+        assert(frameIndex < this->frameCount);
+
+        bool freed = false;
+        for (auto retiredIt = this->retiredImages.begin(); retiredIt != this->retiredImages.end(); )
+        {
+            retiredIt->pendingFrames &= ~(1u << frameIndex);
+            if (retiredIt->pendingFrames == 0u)
+            {
+                this->destroyRetired(*retiredIt);
+                retiredIt = this->retiredImages.erase(retiredIt);
+                freed = true;
+            }
+            else
+            {
+                ++retiredIt;
+            }
+        }
+
+        if (freed)
+        {
+            this->budget.update();
+        }
+    }
+
+    /// Destroys images still waiting in completeFrame() - the device has to be idle.
+    /// Textures themselves are owned (and destroyed) by the caller.
+    void destroy()
+    {
+        this->loadPool.waitIdle();
+        for (RetiredImage& retired : this->retiredImages)
+        {
+            this->destroyRetired(retired);
+        }
+        this->retiredImages.clear();
+    }
+
+    Stats getStats() const
+    {
+        Stats s = this->stats;
+        for (const auto& texIt : this->textures)
+        {
+            s.residentBytes += texIt.second.bytes;
+            s.textureCount++;
+            s.reducedCount  += (texIt.second.firstLevel > 0u) ? 1u : 0u;
+            s.pendingLoads  += texIt.second.loading ? 1u : 0u;
+        }
+        for (const RetiredImage& retired : this->retiredImages)
+        {
+            s.retiredBytes += retired.bytes;
+        }
+        return s;
+    }
+
+    const MemoryBudget& getBudget() const
+    {
+        return this->budget;
+    }
+
+private:
+    struct ResidentTexture
+    {
+        std::string   filename;
+        VkFormat      format;
+        bool          isCube;
+        vks::Texture* texture;
+        uint32_t      fullWidth;
+        uint32_t      fullHeight;
+        uint32_t      fullLevels;
+        uint32_t      firstLevel;       // Of the full mip chain, 0 - fully resident.
+        VkDeviceSize  bytes;
+        uint32_t      heap;
+        uint64_t      lastVisibleFrame;
+        bool          loading;
+    };
+
+    /// Image replaced by an eviction or reload - destroyed when no frame in flight can read it.
+    struct RetiredImage
+    {
+        VkImage        image;
+        VkImageView    view;
+        VkDeviceMemory memory;
+        VkDeviceSize   bytes;
+        uint32_t       heap;
+        uint32_t       pendingFrames;   // Bit i - completeFrame(i) not called since the image was replaced.
+    };
+
+    struct LoadedTexture
+    {
+        std::string                   name;
+        std::shared_ptr<gli::texture> data;
+    };
+
+    /// True if usage (+ extraBytes) is above watermark of heap budget or of textureBudget.
+    /// Retired images are not counted - they are freed within a few frames whatever is decided now.
+    bool isOverBudget(int64_t extraBytes, float watermark = RESIDENCY_HIGH_WATERMARK) const
+    {
+        VkDeviceSize texturesBytes = 0u;
+        for (const auto& texIt : this->textures)
+        {
+            texturesBytes += texIt.second.bytes;
+        }
+
+        if (this->textureBudget > 0u && int64_t(texturesBytes) + extraBytes > int64_t(this->textureBudget * watermark))
+        {
+            return true;
+        }
+
+        for (uint32_t heap = 0; heap < this->budget.getHeapCount(); heap++)
+        {
+            int64_t retiredBytes = 0;
+            for (const RetiredImage& retired : this->retiredImages)
+            {
+                retiredBytes += (retired.heap == heap) ? int64_t(retired.bytes) : 0;
+            }
+
+            if (this->budget.isDeviceLocal(heap) &&
+                int64_t(this->budget.getUsage(heap)) - retiredBytes + extraBytes > int64_t(this->budget.getBudget(heap) * watermark))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Mip level of the full chain, below which levels are kept when evicting.
+    uint32_t getMinResidentFirstLevel(const ResidentTexture& rt) const
+    {
+        uint32_t level = 0u;
+        while (level + 1u < rt.fullLevels && std::max(rt.fullWidth >> level, rt.fullHeight >> level) > RESIDENCY_MIN_RESIDENT_SIZE)
+        {
+            level++;
+        }
+        return level;
+    }
+
+    /// Approximate device size of levels [firstLevel, levels) of loaded data.
+    VkDeviceSize getLevelsSize(const gli::texture& data, uint32_t firstLevel) const
+    {
+        VkDeviceSize size = 0u;
+        for (size_t level = firstLevel; level < data.levels(); level++)
+        {
+            size += data.size(level) * data.faces() * data.layers();
+        }
+        return size;
+    }
+
+    /// Least recently visible idle texture which can still lose a level (largest on ties), empty if none.
+    std::string findEvictionCandidate(const std::string& except) const
+    {
+        const ResidentTexture* victim = nullptr;
+        std::string            victimName;
+        for (const auto& texIt : this->textures)
+        {
+            const ResidentTexture& rt = texIt.second;
+            const bool idle = rt.lastVisibleFrame == 0u || rt.lastVisibleFrame + RESIDENCY_MIN_IDLE_FRAMES < this->currentFrame;
+            if (texIt.first == except || rt.loading || !idle || rt.firstLevel >= this->getMinResidentFirstLevel(rt))
+            {
+                continue;
+            }
+            if (victim == nullptr || rt.lastVisibleFrame < victim->lastVisibleFrame ||
+                (rt.lastVisibleFrame == victim->lastVisibleFrame && rt.bytes > victim->bytes))
+            {
+                victim     = &rt;
+                victimName = texIt.first;
+            }
+        }
+        return victimName;
+    }
+
+    /// Drops the top level of findEvictionCandidate(), its name is added to inOutChanged. False if there is none.
+    bool evictLeastRecentlyVisible(const std::string& except, std::vector<std::string>& inOutChanged)
+    {
+        const std::string victimName = this->findEvictionCandidate(except);
+        if (victimName.empty())
+        {
+            return false;
+        }
+
+        this->dropTopLevel(this->textures[victimName]);
+        this->stats.evictedLevels++;
+        inOutChanged.push_back(victimName);
+        return true;
+    }
+
+    void requestLoad(const std::string& name, ResidentTexture& rt)
+    {
+        rt.loading = true;
+        const std::string filename = rt.filename;
+        this->loadPool.push([this, name, filename](uint32_t)
+        {
+            LoadedTexture lt;
+            lt.name = name;
+            lt.data = std::make_shared<gli::texture>(gli::load(filename.c_str()));
+
+            std::lock_guard<std::mutex> lock(this->loadedMtx);
+            this->loadedTextures.push_back(std::move(lt));
+        });
+    }
+
+    /// New image for levels [firstLevel, fullLevels) of rt - image and memory (in heap outHeap), no data.
+    void createImage(const ResidentTexture& rt, uint32_t firstLevel, VkImage& outImage, VkDeviceMemory& outMemory, VkDeviceSize& outSize,
+                     uint32_t& outHeap)
+    {
+        VkDevice dev = this->device->logicalDevice;
+
+        VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+        imageCI.imageType     = VK_IMAGE_TYPE_2D;
+        imageCI.format        = rt.format;
+        imageCI.extent        = { std::max(1u, rt.fullWidth >> firstLevel), std::max(1u, rt.fullHeight >> firstLevel), 1u };
+        imageCI.mipLevels     = rt.fullLevels - firstLevel;
+        imageCI.arrayLayers   = rt.isCube ? 6u : 1u;
+        imageCI.samples       = VK_SAMPLE_COUNT_1_BIT;
+        imageCI.tiling        = VK_IMAGE_TILING_OPTIMAL;
+        imageCI.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+        imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageCI.usage         = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        imageCI.flags         = rt.isCube ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0u;
+        VK_CHECK_RESULT(vkCreateImage(dev, &imageCI, nullptr, &outImage));
+
+        VkMemoryRequirements memReqs;
+        vkGetImageMemoryRequirements(dev, outImage, &memReqs);
+        VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+        memAlloc.allocationSize  = memReqs.size;
+        memAlloc.memoryTypeIndex = this->device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        VK_CHECK_RESULT(vkAllocateMemory(dev, &memAlloc, nullptr, &outMemory));
+        VK_CHECK_RESULT(vkBindImageMemory(dev, outImage, outMemory, 0));
+        outSize = memReqs.size;
+        outHeap = this->budget.getHeapIndex(memAlloc.memoryTypeIndex);
+    }
+
+    /// Replaces image, memory and view of rt.texture (sampler is kept) and updates its descriptor.
+    /// The old ones are retired - frames in flight may still read them, see completeFrame().
+    void replaceImage(ResidentTexture& rt, uint32_t firstLevel, VkImage image, VkDeviceMemory memory, VkDeviceSize size, uint32_t heap)
+    {
+        VkDevice dev = this->device->logicalDevice;
+        vks::Texture& tex = *rt.texture;
+
+        if (tex.image != VK_NULL_HANDLE)
+        {
+            RetiredImage retired;
+            retired.image         = tex.image;
+            retired.view          = tex.view;
+            retired.memory        = tex.deviceMemory;
+            retired.bytes         = rt.bytes;
+            retired.heap          = rt.heap;
+            retired.pendingFrames = (this->frameCount == 32u) ? ~0u : ((1u << this->frameCount) - 1u);
+            this->retiredImages.push_back(retired);
+        }
+        this->budget.addUsage(heap, int64_t(size));
+        this->budget.update(); // Next eviction decision sees the new image, retired ones are discounted by isOverBudget().
+
+        tex.image        = image;
+        tex.deviceMemory = memory;
+        tex.width        = std::max(1u, rt.fullWidth  >> firstLevel);
+        tex.height       = std::max(1u, rt.fullHeight >> firstLevel);
+        tex.mipLevels    = rt.fullLevels - firstLevel;
+        tex.imageLayout  = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+        viewCI.viewType         = rt.isCube ? VK_IMAGE_VIEW_TYPE_CUBE : VK_IMAGE_VIEW_TYPE_2D;
+        viewCI.format           = rt.format;
+        viewCI.components       = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+        viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, tex.mipLevels, 0, rt.isCube ? 6u : 1u };
+        viewCI.image            = image;
+        VK_CHECK_RESULT(vkCreateImageView(dev, &viewCI, nullptr, &tex.view));
+        tex.updateDescriptor();
+
+        rt.firstLevel = firstLevel;
+        rt.bytes      = size;
+        rt.heap       = heap;
+    }
+
+    void destroyRetired(const RetiredImage& retired)
+    {
+        VkDevice dev = this->device->logicalDevice;
+        vkDestroyImageView(dev, retired.view, nullptr);
+        vkDestroyImage(dev, retired.image, nullptr);
+        vkFreeMemory(dev, retired.memory, nullptr);
+        this->budget.addUsage(retired.heap, -int64_t(retired.bytes));
+    }
+
+    /// Command buffer collecting copies of dropTopLevel() and upload() until flushCopies().
+    VkCommandBuffer getCopyCommandBuffer()
+    {
+        if (this->copyCmdBuffer == VK_NULL_HANDLE)
+        {
+            this->copyCmdBuffer = this->device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+        }
+        return this->copyCmdBuffer;
+    }
+
+    /// Submits recorded copies at once and waits for them, then frees their staging buffers.
+    /// Copies are ordered after frames submitted before (image layout barriers wait for all commands),
+    /// so sources still read by those frames are not changed under them.
+    void flushCopies()
+    {
+        if (this->copyCmdBuffer == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        this->device->flushCommandBuffer(this->copyCmdBuffer, this->queue);
+        this->copyCmdBuffer = VK_NULL_HANDLE;
+
+        for (vks::Buffer& staging : this->copyStagingBuffers)
+        {
+            staging.destroy();
+        }
+        this->copyStagingBuffers.clear();
+    }
+
+    /// Records a copy of levels [firstLevel + 1, fullLevels) to a new, smaller image - see flushCopies().
+    void dropTopLevel(ResidentTexture& rt)
+    {
+        const uint32_t newFirstLevel = rt.firstLevel + 1u;
+        const uint32_t layers        = rt.isCube ? 6u : 1u;
+
+        VkImage        image;
+        VkDeviceMemory memory;
+        VkDeviceSize   size;
+        uint32_t       heap;
+        this->createImage(rt, newFirstLevel, image, memory, size, heap);
+
+        VkCommandBuffer copyCmd = this->getCopyCommandBuffer();
+        const uint32_t levelCount = rt.fullLevels - newFirstLevel;
+        VkImageSubresourceRange srcRange = { VK_IMAGE_ASPECT_COLOR_BIT, 1, levelCount, 0, layers };
+        VkImageSubresourceRange dstRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, layers };
+        vks::tools::setImageLayout(copyCmd, rt.texture->image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, srcRange);
+        vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, dstRange);
+
+        std::vector<VkImageCopy> regions(levelCount);
+        for (uint32_t level = 0; level < levelCount; level++)
+        {
+            VkImageCopy& region = regions[level];
+            region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level + 1u, 0, layers };
+            region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level,      0, layers };
+            region.srcOffset      = { 0, 0, 0 };
+            region.dstOffset      = { 0, 0, 0 };
+            region.extent         = { std::max(1u, rt.fullWidth >> (newFirstLevel + level)), std::max(1u, rt.fullHeight >> (newFirstLevel + level)), 1u };
+        }
+        vkCmdCopyImage(copyCmd, rt.texture->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       regions.size(), regions.data());
+
+        vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, dstRange);
+
+        this->replaceImage(rt, newFirstLevel, image, memory, size, heap);
+    }
+
+    /// Records upload of levels [firstLevel, fullLevels) of loaded data to a new image - see flushCopies().
+    void upload(ResidentTexture& rt, const gli::texture& data, uint32_t firstLevel)
+    {
+        assert(data.levels() == rt.fullLevels);
+        const uint32_t layers = rt.isCube ? 6u : 1u;
+
+        // Staging: levels of every face, regions point into it.
+        std::vector<uint8_t>           staged;
+        std::vector<VkBufferImageCopy> regions;
+        for (uint32_t face = 0; face < layers; face++)
+        {
+            for (uint32_t level = firstLevel; level < rt.fullLevels; level++)
+            {
+                VkBufferImageCopy region = {};
+                region.bufferOffset      = staged.size();
+                region.imageSubresource  = { VK_IMAGE_ASPECT_COLOR_BIT, level - firstLevel, face, 1 };
+                region.imageExtent       = { uint32_t(data.extent(level).x), uint32_t(data.extent(level).y), 1u };
+                regions.push_back(region);
+
+                const uint8_t* levelData = static_cast<const uint8_t*>(data.data(0, face, level));
+                staged.insert(staged.end(), levelData, levelData + data.size(level));
+            }
+        }
+
+        vks::Buffer staging;
+        VK_CHECK_RESULT(this->device->createBuffer(
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            &staging,
+            staged.size(),
+            staged.data()));
+
+        VkImage        image;
+        VkDeviceMemory memory;
+        VkDeviceSize   size;
+        uint32_t       heap;
+        this->createImage(rt, firstLevel, image, memory, size, heap);
+
+        VkCommandBuffer copyCmd = this->getCopyCommandBuffer();
+        VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, rt.fullLevels - firstLevel, 0, layers };
+        vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, range);
+        vkCmdCopyBufferToImage(copyCmd, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, regions.size(), regions.data());
+        vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, range);
+        this->copyStagingBuffers.push_back(staging); // Read by the copy - freed by flushCopies().
+
+        this->replaceImage(rt, firstLevel, image, memory, size, heap);
+    }
+
+    vks::VulkanDevice* device = nullptr;
+    VkQueue            queue  = VK_NULL_HANDLE;
+    uint32_t           frameCount    = 1u;
+    VkDeviceSize       textureBudget = 0u;
+    uint64_t           currentFrame  = 0u;
+    MemoryBudget       budget;
+    Stats              stats;
+
+    VkCommandBuffer          copyCmdBuffer = VK_NULL_HANDLE; // Copies of one applyChanges() or loadTexture().
+    std::vector<vks::Buffer> copyStagingBuffers;
+
+    std::map<std::string, ResidentTexture> textures;
+    std::vector<RetiredImage>              retiredImages;
+
+    ThreadPool                 loadPool;
+    std::mutex                 loadedMtx;
+    std::vector<LoadedTexture> loadedTextures; // Filled by loadPool, consumed by applyChanges().
+};
+
+} // namespace vk229
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace vk229
+{
+
+/// Number of workers used when none is given explicitly.
+/// One hardware thread is left for the main (render) thread.
+static uint32_t getDefaultWorkerCount()
+{
+    const uint32_t hwThreads = std::thread::hardware_concurrency();
+    return (hwThreads > 1u) ? (hwThreads - 1u) : 1u;
+}
+
+//////////////////////////////////////
+/// Simple pool of worker threads with a FIFO job queue.
+/// Every job gets id of the worker which runs it, so per-worker
+/// resources (ie. VkPipelineCache) can be indexed without locking.
+class ThreadPool
+{
+public:
+    using job_t = std::function<void(uint32_t workerId)>;
+
+    explicit ThreadPool(uint32_t workerCount = 0u)
+    {
+        if (workerCount == 0u)
+        {
+            workerCount = getDefaultWorkerCount();
+        }
+
+        for (uint32_t i = 0u; i < workerCount; i++)
+        {
+            this->workers.emplace_back(&ThreadPool::workerLoop, this, i);
+        }
+    }
+
+    ~ThreadPool()
+    {
+        this->stop();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    uint32_t getWorkerCount() const
+    {
+        return this->workers.size();
+    }
+
+    void push(job_t job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mtx);
+            this->jobs.push_back(std::move(job));
+        }
+        this->jobAvailable.notify_one();
+    }
+
+    /// Blocks until the queue is empty and no job is running.
+    void waitIdle()
+    {
+        std::unique_lock<std::mutex> lock(this->mtx);
+        this->jobsDone.wait(lock, [this] { return this->jobs.empty() && this->activeJobs == 0u; });
+    }
+
+    /// Finishes queued jobs and joins all workers.
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mtx);
+            if (this->stopping)
+            {
+                return;
+            }
+            this->stopping = true;
+        }
+        this->jobAvailable.notify_all();
+
+        for (std::thread& worker : this->workers)
+        {
+            worker.join();
+        }
+        this->workers.clear();
+    }
+
+private:
+    void workerLoop(uint32_t workerId)
+    {
+        for (;;)
+        {
+            job_t job;
+            {
+                std::unique_lock<std::mutex> lock(this->mtx);
+                this->jobAvailable.wait(lock, [this] { return this->stopping || !this->jobs.empty(); });
+
+                if (this->jobs.empty()) // Stopping and nothing left to do.
+                {
+                    return;
+                }
+
+                job = std::move(this->jobs.front());
+                this->jobs.pop_front();
+                this->activeJobs++;
+            }
+
+            job(workerId);
+
+            {
+                std::lock_guard<std::mutex> lock(this->mtx);
+                this->activeJobs--;
+            }
+            this->jobsDone.notify_all();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<job_t>        jobs;
+    std::mutex               mtx;
+    std::condition_variable  jobAvailable;
+    std::condition_variable  jobsDone;
+    uint32_t                 activeJobs = 0u;
+    bool                     stopping   = false;
+};
+
+/// Splits range [0, count) into contiguous chunks and runs fn(begin, end) for every chunk on its own thread.
+/// Blocks until all chunks are done. For load-time processing, not for per-frame work.
+template <typename Fn>
+void parallelFor(uint32_t count, Fn fn, uint32_t threadCount = 0u)
+{
+    if (threadCount == 0u)
+    {
+        threadCount = getDefaultWorkerCount() + 1u; // Calling thread is waiting anyway.
+    }
+    if (threadCount > count)
+    {
+        threadCount = count;
+    }
+    if (threadCount <= 1u)
+    {
+        fn(0u, count);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    const uint32_t chunk = (count + threadCount - 1u) / threadCount;
+    for (uint32_t begin = 0u; begin < count; begin += chunk)
+    {
+        const uint32_t end = (begin + chunk < count) ? (begin + chunk) : count;
+        threads.emplace_back([&fn, begin, end] { fn(begin, end); });
+    }
+
+    for (std::thread& t : threads)
+    {
+        t.join();
+    }
+}
+
+} // namespace vk229
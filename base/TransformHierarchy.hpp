@@ -0,0 +1,532 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <ThreadPool.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define TRANSFORM_USE_SSE 1
+#else
+#define TRANSFORM_USE_SSE 0
+#endif
+
+namespace vk229
+{
+/////////////////////////////////////////
+/// Hierarchy of transforms - translation, rotation and scale relative to the parent, world matrices computed from them.
+/// * nodes are stored breadth-first in SoA arrays: level by level, children of a node next to each other,
+///   in the order of their parents - so descendants of a range of nodes are a range on every deeper level
+/// * changing a node's local transform marks it dirty, update() recomputes only dirty nodes and their descendants -
+///   on every level it visits the marked nodes and children ranges of nodes updated on the level above, nothing else
+/// * world = parent's world * local, 4x4 multiply with SSE (scalar fallback otherwise)
+/// * levels with TRANSFORM_PARALLEL_MIN_NODES nodes or more to visit are split between workers of an own thread pool
+/// World matrices stay in hierarchy order (getIndex()), so they can be copied to a GPU buffer as they are -
+/// getUpdatedRange() is the part that changed in the last update().
+/// Node handles are stable. Indices change when nodes are created (hierarchy is reordered in the next update()).
+/////////////////////////////////////////
+
+#define TRANSFORM_NULL_NODE             -1
+#define TRANSFORM_PARALLEL_MIN_NODES    8192    // Nodes to visit on a level for it to be split between workers.
+#define TRANSFORM_PARALLEL_CHUNK        2048    // Nodes per job.
+
+using transform_node_t = int32_t;
+
+/// out = a * b, column-major (glm) 4x4 matrices. out must not alias a or b.
+void multiplyMat4(const float* a, const float* b, float* out)
+{
+#if TRANSFORM_USE_SSE
+    const __m128 a0 = _mm_loadu_ps(a);
+    const __m128 a1 = _mm_loadu_ps(a + 4);
+    const __m128 a2 = _mm_loadu_ps(a + 8);
+    const __m128 a3 = _mm_loadu_ps(a + 12);
+
+    for (uint32_t c = 0; c < 4u; c++)
+    {
+        // Column c of the result is a's columns weighted by column c of b.
+        const float* bc = b + 4u * c;
+        __m128 r = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+        _mm_storeu_ps(out + 4u * c, r);
+    }
+#else
+    for (uint32_t c = 0; c < 4u; c++)
+    {
+        for (uint32_t r = 0; r < 4u; r++)
+        {
+            out[4u * c + r] = a[r] * b[4u * c] + a[4u + r] * b[4u * c + 1u] + a[8u + r] * b[4u * c + 2u] + a[12u + r] * b[4u * c + 3u];
+        }
+    }
+#endif
+}
+
+class TransformHierarchy
+{
+public:
+    struct Stats
+    {
+        uint32_t nodeCount      = 0u;
+        uint32_t levelCount     = 0u;
+        uint32_t visitedCount   = 0u; ///< Nodes checked by the last update().
+        uint32_t updatedCount   = 0u; ///< World matrices recomputed by the last update().
+        uint32_t parallelLevels = 0u; ///< Levels split between workers in the last update().
+    };
+
+    TransformHierarchy()
+    {
+    }
+
+    TransformHierarchy(const TransformHierarchy&) = delete;
+    TransformHierarchy& operator=(const TransformHierarchy&) = delete;
+
+    /// New node with identity local transform. Parent has to exist already.
+    transform_node_t createNode(transform_node_t parent = TRANSFORM_NULL_NODE)
+    {
+        assert(parent == TRANSFORM_NULL_NODE || (parent >= 0 && parent < (transform_node_t)this->parentHandles.size()));
+
+        const transform_node_t node  = this->parentHandles.size();
+        const uint32_t         index = this->translations.size();
+        this->parentHandles.push_back(parent);
+        this->handleToIndex.push_back(index);
+        this->indexToHandle.push_back(node);
+
+        // Appended out of order - update() reorders the hierarchy first.
+        this->parents.push_back(TRANSFORM_NULL_NODE);
+        this->firstChildren.push_back(0u);
+        this->childCounts.push_back(0u);
+        this->levels.push_back(0u);
+        this->translations.push_back(glm::vec3(0.0f));
+        this->rotations.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+        this->scales.push_back(glm::vec3(1.0f));
+        this->worlds.push_back(glm::mat4(1.0f));
+        this->dirtyFlags.push_back(1u);
+        this->updateStamps.push_back(0u);
+
+        this->topologyChanged = true;
+        return node;
+    }
+
+    void setLocal(transform_node_t node, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+    {
+        const uint32_t index = this->handleToIndex[node];
+        this->translations[index] = translation;
+        this->rotations[index]    = rotation;
+        this->scales[index]       = scale;
+        this->markDirty(index);
+    }
+
+    void setTranslation(transform_node_t node, const glm::vec3& translation)
+    {
+        const uint32_t index = this->handleToIndex[node];
+        this->translations[index] = translation;
+        this->markDirty(index);
+    }
+
+    void setRotation(transform_node_t node, const glm::quat& rotation)
+    {
+        const uint32_t index = this->handleToIndex[node];
+        this->rotations[index] = rotation;
+        this->markDirty(index);
+    }
+
+    void setScale(transform_node_t node, const glm::vec3& scale)
+    {
+        const uint32_t index = this->handleToIndex[node];
+        this->scales[index] = scale;
+        this->markDirty(index);
+    }
+
+    const glm::vec3& getTranslation(transform_node_t node) const { return this->translations[this->handleToIndex[node]]; }
+    const glm::quat& getRotation(transform_node_t node)    const { return this->rotations[this->handleToIndex[node]]; }
+    const glm::vec3& getScale(transform_node_t node)       const { return this->scales[this->handleToIndex[node]]; }
+    transform_node_t getParent(transform_node_t node)      const { return this->parentHandles[node]; }
+
+    /// World matrix as of the last update().
+    const glm::mat4& getWorld(transform_node_t node) const
+    {
+        return this->worlds[this->handleToIndex[node]];
+    }
+
+    /// Position of node's world matrix in getWorldMatrices(). Changes only when nodes are created.
+    uint32_t getIndex(transform_node_t node) const
+    {
+        return this->handleToIndex[node];
+    }
+
+    /// Node whose world matrix is at index of getWorldMatrices().
+    transform_node_t getNode(uint32_t index) const
+    {
+        return this->indexToHandle[index];
+    }
+
+    /// All world matrices, in hierarchy order.
+    const std::vector<glm::mat4>& getWorldMatrices() const
+    {
+        return this->worlds;
+    }
+
+    uint32_t getNodeCount() const
+    {
+        return this->parentHandles.size();
+    }
+
+    /// True if node's world matrix was recomputed by the last update().
+    bool wasUpdated(transform_node_t node) const
+    {
+        return this->updateStamps[this->handleToIndex[node]] == this->updateStamp;
+    }
+
+    /// Indices [first, first + count) contain all world matrices recomputed by the last update(), count = 0 - none.
+    void getUpdatedRange(uint32_t& outFirst, uint32_t& outCount) const
+    {
+        outFirst = this->updatedFirst;
+        outCount = this->updatedEnd > this->updatedFirst ? this->updatedEnd - this->updatedFirst : 0u;
+    }
+
+    const Stats& getStats() const
+    {
+        return this->stats;
+    }
+
+    /// Recomputes world matrices of dirty nodes and their descendants, level by level.
+    /// Returns true if any world matrix changed.
+    bool update()
+    {
+        const bool updateAll = this->topologyChanged;
+        if (this->topologyChanged)
+        {
+            this->rebuildOrder();
+        }
+
+        this->updateStamp++;
+        this->stats.nodeCount      = this->getNodeCount();
+        this->stats.levelCount     = this->levelStarts.empty() ? 0u : this->levelStarts.size() - 1u;
+        this->stats.visitedCount   = 0u;
+        this->stats.updatedCount   = 0u;
+        this->stats.parallelLevels = 0u;
+        this->updatedFirst = UINT32_MAX;
+        this->updatedEnd   = 0u;
+
+        std::vector<Range> ranges;
+        std::vector<Range> visitedRanges;
+        std::vector<Range> propagated; // Children of nodes updated on the previous level, sorted.
+        for (uint32_t level = 0; level < this->stats.levelCount; level++)
+        {
+            ranges.clear();
+            if (updateAll)
+            {
+                ranges.push_back({this->levelStarts[level], this->levelStarts[level + 1u]});
+            }
+            else
+            {
+                std::vector<uint32_t>& marked = this->levelMarked[level];
+                std::sort(marked.begin(), marked.end());
+                mergeRanges(marked, propagated, ranges);
+            }
+            this->levelMarked[level].clear();
+
+            uint32_t rangesNodeCount = 0u;
+            for (const Range& range : ranges)
+            {
+                rangesNodeCount += range.end - range.begin;
+            }
+
+            RangeResult result;
+            if (rangesNodeCount >= TRANSFORM_PARALLEL_MIN_NODES)
+            {
+                this->updateRangesParallel(ranges, result);
+                this->stats.parallelLevels++;
+            }
+            else
+            {
+                for (const Range& range : ranges)
+                {
+                    this->updateRange(range, result);
+                }
+            }
+
+            visitedRanges.insert(visitedRanges.end(), ranges.begin(), ranges.end());
+            this->stats.visitedCount += rangesNodeCount;
+            this->stats.updatedCount += result.updatedCount;
+            this->updatedFirst = std::min(this->updatedFirst, result.updatedFirst);
+            this->updatedEnd   = std::max(this->updatedEnd,   result.updatedEnd);
+            propagated.swap(result.children);
+        }
+
+        // Flags are read by children until their level is done.
+        for (const Range& range : visitedRanges)
+        {
+            std::fill(this->dirtyFlags.begin() + range.begin, this->dirtyFlags.begin() + range.end, 0u);
+        }
+
+        return this->stats.updatedCount > 0u;
+    }
+
+private:
+    struct Range
+    {
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    struct RangeResult
+    {
+        std::vector<Range> children;     // Sorted, coalesced.
+        uint32_t           updatedFirst = UINT32_MAX;
+        uint32_t           updatedEnd   = 0u;
+        uint32_t           updatedCount = 0u;
+
+        void merge(const RangeResult& other)
+        {
+            for (const Range& range : other.children)
+            {
+                appendRange(this->children, range);
+            }
+            this->updatedFirst  = std::min(this->updatedFirst, other.updatedFirst);
+            this->updatedEnd    = std::max(this->updatedEnd,   other.updatedEnd);
+            this->updatedCount += other.updatedCount;
+        }
+    };
+
+    // Per handle.
+    std::vector<transform_node_t> parentHandles;
+    std::vector<uint32_t>         handleToIndex;
+
+    // Per index - hierarchy order.
+    std::vector<transform_node_t> indexToHandle;
+    std::vector<int32_t>          parents;        // Index of the parent, TRANSFORM_NULL_NODE for roots.
+    std::vector<uint32_t>         firstChildren;
+    std::vector<uint32_t>         childCounts;
+    std::vector<uint32_t>         levels;
+    std::vector<glm::vec3>        translations;
+    std::vector<glm::quat>        rotations;
+    std::vector<glm::vec3>        scales;
+    std::vector<glm::mat4>        worlds;
+    std::vector<uint8_t>          dirtyFlags;
+    std::vector<uint32_t>         updateStamps;
+
+    std::vector<uint32_t>              levelStarts; // First index of every level, plus the node count.
+    std::vector<std::vector<uint32_t>> levelMarked; // Nodes marked dirty since the last update(), per level.
+
+    bool     topologyChanged = false;
+    uint32_t updateStamp     = 0u;
+    uint32_t updatedFirst    = UINT32_MAX;
+    uint32_t updatedEnd      = 0u;
+    Stats    stats;
+
+    std::unique_ptr<ThreadPool> pool; // Created on the first level big enough.
+
+    /// Appends to sorted ranges, coalescing with the last one if they touch.
+    static void appendRange(std::vector<Range>& ranges, const Range& range)
+    {
+        if (false == ranges.empty() && range.begin <= ranges.back().end)
+        {
+            ranges.back().end = std::max(ranges.back().end, range.end);
+            return;
+        }
+        ranges.push_back(range);
+    }
+
+    /// Sorted single nodes and sorted ranges into sorted, coalesced ranges.
+    static void mergeRanges(const std::vector<uint32_t>& nodes, const std::vector<Range>& ranges, std::vector<Range>& outRanges)
+    {
+        uint32_t n = 0u;
+        uint32_t r = 0u;
+        while (n < nodes.size() || r < ranges.size())
+        {
+            if (r == ranges.size() || (n < nodes.size() && nodes[n] < ranges[r].begin))
+            {
+                appendRange(outRanges, {nodes[n], nodes[n] + 1u});
+                n++;
+            }
+            else
+            {
+                appendRange(outRanges, ranges[r]);
+                r++;
+            }
+        }
+    }
+
+    void markDirty(uint32_t index)
+    {
+        if (this->dirtyFlags[index])
+        {
+            return; // Already marked, or everything is updated after reordering anyway.
+        }
+        this->dirtyFlags[index] = 1u;
+        this->levelMarked[this->levels[index]].push_back(index);
+    }
+
+    /// Puts nodes in breadth-first order - roots, then children of every node of a level, node after node.
+    /// Every node is dirty afterwards.
+    void rebuildOrder()
+    {
+        const uint32_t count = this->parentHandles.size();
+
+        std::vector<std::vector<transform_node_t>> children(count);
+        std::vector<transform_node_t> order;
+        for (transform_node_t node = 0; node < (transform_node_t)count; node++)
+        {
+            if (this->parentHandles[node] == TRANSFORM_NULL_NODE)
+            {
+                order.push_back(node);
+            }
+            else
+            {
+                children[this->parentHandles[node]].push_back(node);
+            }
+        }
+
+        std::vector<uint32_t> firstChildren(count, 0u);
+        std::vector<uint32_t> childCounts(count, 0u);
+        std::vector<uint32_t> levels(count, 0u);
+        this->levelStarts.assign(1u, 0u);
+        for (uint32_t levelBegin = 0; levelBegin < order.size(); )
+        {
+            const uint32_t levelEnd = order.size();
+            for (uint32_t i = levelBegin; i < levelEnd; i++)
+            {
+                firstChildren[i] = order.size();
+                childCounts[i]   = children[order[i]].size();
+                for (transform_node_t child : children[order[i]])
+                {
+                    levels[order.size()] = this->levelStarts.size();
+                    order.push_back(child);
+                }
+            }
+            this->levelStarts.push_back(levelEnd);
+            levelBegin = levelEnd;
+        }
+        assert(order.size() == count);
+
+        std::vector<glm::vec3> translations(count);
+        std::vector<glm::quat> rotations(count);
+        std::vector<glm::vec3> scales(count);
+        std::vector<uint32_t>  handleToIndex(count);
+        for (uint32_t index = 0; index < count; index++)
+        {
+            const uint32_t oldIndex = this->handleToIndex[order[index]];
+            translations[index]         = this->translations[oldIndex];
+            rotations[index]            = this->rotations[oldIndex];
+            scales[index]               = this->scales[oldIndex];
+            handleToIndex[order[index]] = index;
+        }
+
+        this->parents.resize(count);
+        for (uint32_t index = 0; index < count; index++)
+        {
+            const transform_node_t parent = this->parentHandles[order[index]];
+            this->parents[index] = (parent == TRANSFORM_NULL_NODE) ? TRANSFORM_NULL_NODE : (int32_t)handleToIndex[parent];
+        }
+
+        this->indexToHandle.swap(order);
+        this->handleToIndex.swap(handleToIndex);
+        this->firstChildren.swap(firstChildren);
+        this->childCounts.swap(childCounts);
+        this->levels.swap(levels);
+        this->translations.swap(translations);
+        this->rotations.swap(rotations);
+        this->scales.swap(scales);
+        this->dirtyFlags.assign(count, 1u);
+        this->levelMarked.assign(this->levelStarts.size() - 1u, std::vector<uint32_t>());
+
+        this->topologyChanged = false;
+    }
+
+    /// Nodes of one level - recomputes the dirty ones and those with a dirty parent.
+    void updateRange(const Range& range, RangeResult& outResult)
+    {
+        for (uint32_t i = range.begin; i < range.end; i++)
+        {
+            const int32_t parent = this->parents[i];
+            if (parent != TRANSFORM_NULL_NODE && this->dirtyFlags[parent])
+            {
+                this->dirtyFlags[i] = 1u;
+            }
+            if (0u == this->dirtyFlags[i])
+            {
+                continue;
+            }
+
+            glm::mat4 local = glm::mat4_cast(this->rotations[i]);
+            local[0] *= this->scales[i].x;
+            local[1] *= this->scales[i].y;
+            local[2] *= this->scales[i].z;
+            local[3]  = glm::vec4(this->translations[i], 1.0f);
+
+            if (parent == TRANSFORM_NULL_NODE)
+            {
+                this->worlds[i] = local;
+            }
+            else
+            {
+                multiplyMat4(&this->worlds[parent][0][0], &local[0][0], &this->worlds[i][0][0]);
+            }
+
+            this->updateStamps[i] = this->updateStamp;
+            outResult.updatedFirst = std::min(outResult.updatedFirst, i);
+            outResult.updatedEnd   = i + 1u;
+            outResult.updatedCount++;
+            if (this->childCounts[i] > 0u)
+            {
+                appendRange(outResult.children, {this->firstChildren[i], this->firstChildren[i] + this->childCounts[i]});
+            }
+        }
+    }
+
+    /// updateRange() on workers, in jobs of about TRANSFORM_PARALLEL_CHUNK nodes. Nodes of one level do not depend on each other.
+    void updateRangesParallel(const std::vector<Range>& ranges, RangeResult& outResult)
+    {
+        if (false == bool(this->pool))
+        {
+            this->pool.reset(new ThreadPool());
+        }
+
+        // Ranges cut into jobs, in order - so results can be merged in order.
+        std::vector<std::vector<Range>> jobRanges(1u);
+        uint32_t jobNodeCount = 0u;
+        for (Range range : ranges)
+        {
+            while (range.begin < range.end)
+            {
+                if (jobNodeCount == TRANSFORM_PARALLEL_CHUNK)
+                {
+                    jobRanges.emplace_back();
+                    jobNodeCount = 0u;
+                }
+                const uint32_t end = std::min(range.end, range.begin + TRANSFORM_PARALLEL_CHUNK - jobNodeCount);
+                jobRanges.back().push_back({range.begin, end});
+                jobNodeCount += end - range.begin;
+                range.begin = end;
+            }
+        }
+
+        std::vector<RangeResult> jobResults(jobRanges.size());
+        for (uint32_t job = 0; job < jobRanges.size(); job++)
+        {
+            const std::vector<Range>* rangesOfJob = &jobRanges[job];
+            RangeResult*              result      = &jobResults[job];
+            this->pool->push([this, rangesOfJob, result](uint32_t) {
+                for (const Range& range : *rangesOfJob)
+                {
+                    this->updateRange(range, *result);
+                }
+            });
+        }
+        this->pool->waitIdle();
+
+        for (const RangeResult& jobResult : jobResults)
+        {
+            outResult.merge(jobResult);
+        }
+    }
+};
+
+} // namespace vk229
@@ -0,0 +1,777 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vulkan/vulkan.h>
+
+#ifdef VK229_CALL_STATS
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+#endif
+
+#define VK_CALL_STATS_WINDOW        600     // Frames per report.
+#define VK_CALL_STATS_TOP_ENTRIES   8       // Entry points with most driver time listed in a report.
+#define VK_CALL_STATS_MAX_SETS      8       // Descriptor set slots tracked per bind point for redundant bind detection.
+
+namespace vk229
+{
+
+/////////////////////////////////////////
+/// Counts and times Vulkan calls, per frame and per phase.
+///
+/// Enabled at build time (cmake -DVK229_CALL_STATS=ON) - then this header is force-included in every translation unit
+/// (EngineSW's too) and every Vulkan 1.0 entry point is redirected by a macro to a wrapper, which counts the call,
+/// measures time spent in the loader and the driver, and calls the real function. Without VK229_CALL_STATS nothing
+/// is redirected and all methods below are empty.
+///
+/// Calls are attributed to the current phase (PhaseScope) and counted per frame (endFrame()). Every VK_CALL_STATS_WINDOW
+/// frames a report goes to stdout: binds, draws, descriptor updates, allocations and submits per frame (mean and max),
+/// redundant binds (same pipeline or same descriptor sets bound again in a command buffer), entry points with most
+/// driver time, and a warning when allocations happen in the frame loop (UPDATE or SUBMIT phase).
+///
+/// Extension functions called through pointers (swapchain, debug markers) are not counted.
+/////////////////////////////////////////
+class VkCallStats
+{
+public:
+    enum class phase_t
+    {
+        OTHER,      ///< Not marked - init, base class, text overlay.
+        PREPARE,    ///< Resources, pipelines.
+        BUILD,      ///< Recording of command buffers.
+        UPDATE,     ///< Per-frame CPU updates - uniforms, draw lists, streaming.
+        SUBMIT,     ///< Frame submission.
+        COUNT
+    };
+
+    enum class category_t
+    {
+        BIND,
+        DRAW,
+        DESCRIPTOR_UPDATE,
+        ALLOCATION,
+        SUBMIT,
+        COMMAND,    ///< Other vkCmd*.
+        OTHER,
+        COUNT
+    };
+
+    /// Sets the phase of calls made until the end of the scope (then the previous phase is back).
+    class PhaseScope
+    {
+    public:
+        PhaseScope(phase_t phase)
+        {
+#ifdef VK229_CALL_STATS
+            this->previous = VkCallStats::state().phase.exchange(phase);
+#else
+            (void)phase;
+#endif
+        }
+
+        ~PhaseScope()
+        {
+#ifdef VK229_CALL_STATS
+            VkCallStats::state().phase.store(this->previous);
+#endif
+        }
+
+    private:
+#ifdef VK229_CALL_STATS
+        phase_t previous;
+#endif
+    };
+
+    static bool isEnabled()
+    {
+#ifdef VK229_CALL_STATS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /// Closes the frame - call once per frame, after submission.
+    static void endFrame()
+    {
+#ifdef VK229_CALL_STATS
+        State& s = state();
+
+        for (size_t c = 0; c < size_t(category_t::COUNT); c++)
+        {
+            const uint64_t count = s.frameCategories[c].exchange(0);
+            s.windowSum[c] += count;
+            s.windowMax[c]  = std::max(s.windowMax[c], count);
+        }
+        const uint64_t redundant = s.frameRedundantBinds.exchange(0);
+        s.windowRedundantSum += redundant;
+        s.windowRedundantMax  = std::max(s.windowRedundantMax, redundant);
+        s.windowFrameLoopAllocations += s.frameLoopAllocations.exchange(0);
+
+        s.frameCount++;
+        s.windowFrameCount++;
+
+        if (s.windowFrameCount >= VK_CALL_STATS_WINDOW)
+        {
+            report(s);
+        }
+#endif
+    }
+
+    /// Per-frame counts of the last report, for the overlay ("" before the first report).
+    static std::string getSummaryLine()
+    {
+#ifdef VK229_CALL_STATS
+        return state().summaryLine;
+#else
+        return std::string();
+#endif
+    }
+
+    /// Writes totals since start - one row per phase and entry point that has been called.
+    static bool exportCsv(const std::string& filename)
+    {
+#ifdef VK229_CALL_STATS
+        State& s = state();
+
+        std::ofstream file(filename.c_str());
+        if (false == file.is_open())
+        {
+            std::cout << " >>> VkCallStats::exportCsv: cannot open " << filename << std::endl;
+            return false;
+        }
+
+        const double frames = double(std::max<uint64_t>(s.frameCount, 1u));
+
+        file << "phase,function,category,calls,calls_per_frame,total_ms,mean_ns" << std::endl;
+        for (size_t p = 0; p < size_t(phase_t::COUNT); p++)
+        {
+            for (uint32_t id = 0; id < CALL_COUNT; id++)
+            {
+                const uint64_t calls = s.calls[p][id].load();
+                if (calls == 0) continue;
+
+                const uint64_t ns = s.nanoseconds[p][id].load();
+                file << getPhaseName(phase_t(p)) << "," << getCallName(id) << "," << getCategoryName(getCallCategory(id)) << ","
+                     << calls << "," << calls / frames << "," << ns * 1e-6 << "," << ns / calls << std::endl;
+            }
+        }
+
+        std::cout << " >>> VkCallStats::exportCsv: " << s.frameCount << " frames written to " << filename << std::endl;
+        return true;
+#else
+        (void)filename;
+        return false;
+#endif
+    }
+
+#ifdef VK229_CALL_STATS
+// ENTRY POINTS {
+
+    #define VK_CALL_STATS_ENTRY_POINTS(X) \
+        X(vkCreateInstance,                                 ALLOCATION) \
+        X(vkDestroyInstance,                                OTHER) \
+        X(vkEnumeratePhysicalDevices,                       OTHER) \
+        X(vkGetPhysicalDeviceFeatures,                      OTHER) \
+        X(vkGetPhysicalDeviceFormatProperties,              OTHER) \
+        X(vkGetPhysicalDeviceImageFormatProperties,         OTHER) \
+        X(vkGetPhysicalDeviceProperties,                    OTHER) \
+        X(vkGetPhysicalDeviceQueueFamilyProperties,         OTHER) \
+        X(vkGetPhysicalDeviceMemoryProperties,              OTHER) \
+        X(vkGetPhysicalDeviceSparseImageFormatProperties,   OTHER) \
+        X(vkGetInstanceProcAddr,                            OTHER) \
+        X(vkGetDeviceProcAddr,                              OTHER) \
+        X(vkCreateDevice,                                   ALLOCATION) \
+        X(vkDestroyDevice,                                  OTHER) \
+        X(vkEnumerateInstanceExtensionProperties,           OTHER) \
+        X(vkEnumerateDeviceExtensionProperties,             OTHER) \
+        X(vkEnumerateInstanceLayerProperties,               OTHER) \
+        X(vkEnumerateDeviceLayerProperties,                 OTHER) \
+        X(vkGetDeviceQueue,                                 OTHER) \
+        X(vkQueueSubmit,                                    SUBMIT) \
+        X(vkQueueWaitIdle,                                  OTHER) \
+        X(vkQueueBindSparse,                                SUBMIT) \
+        X(vkDeviceWaitIdle,                                 OTHER) \
+        X(vkAllocateMemory,                                 ALLOCATION) \
+        X(vkFreeMemory,                                     OTHER) \
+        X(vkMapMemory,                                      OTHER) \
+        X(vkUnmapMemory,                                    OTHER) \
+        X(vkFlushMappedMemoryRanges,                        OTHER) \
+        X(vkInvalidateMappedMemoryRanges,                   OTHER) \
+        X(vkGetDeviceMemoryCommitment,                      OTHER) \
+        X(vkBindBufferMemory,                               OTHER) \
+        X(vkBindImageMemory,                                OTHER) \
+        X(vkGetBufferMemoryRequirements,                    OTHER) \
+        X(vkGetImageMemoryRequirements,                     OTHER) \
+        X(vkGetImageSparseMemoryRequirements,               OTHER) \
+        X(vkCreateFence,                                    ALLOCATION) \
+        X(vkDestroyFence,                                   OTHER) \
+        X(vkResetFences,                                    OTHER) \
+        X(vkGetFenceStatus,                                 OTHER) \
+        X(vkWaitForFences,                                  OTHER) \
+        X(vkCreateSemaphore,                                ALLOCATION) \
+        X(vkDestroySemaphore,                               OTHER) \
+        X(vkCreateEvent,                                    ALLOCATION) \
+        X(vkDestroyEvent,                                   OTHER) \
+        X(vkGetEventStatus,                                 OTHER) \
+        X(vkSetEvent,                                       OTHER) \
+        X(vkResetEvent,                                     OTHER) \
+        X(vkCreateQueryPool,                                ALLOCATION) \
+        X(vkDestroyQueryPool,                               OTHER) \
+        X(vkGetQueryPoolResults,                            OTHER) \
+        X(vkCreateBuffer,                                   ALLOCATION) \
+        X(vkDestroyBuffer,                                  OTHER) \
+        X(vkCreateBufferView,                               ALLOCATION) \
+        X(vkDestroyBufferView,                              OTHER) \
+        X(vkCreateImage,                                    ALLOCATION) \
+        X(vkDestroyImage,                                   OTHER) \
+        X(vkGetImageSubresourceLayout,                      OTHER) \
+        X(vkCreateImageView,                                ALLOCATION) \
+        X(vkDestroyImageView,                               OTHER) \
+        X(vkCreateShaderModule,                             ALLOCATION) \
+        X(vkDestroyShaderModule,                            OTHER) \
+        X(vkCreatePipelineCache,                            ALLOCATION) \
+        X(vkDestroyPipelineCache,                           OTHER) \
+        X(vkGetPipelineCacheData,                           OTHER) \
+        X(vkMergePipelineCaches,                            OTHER) \
+        X(vkCreateGraphicsPipelines,                        ALLOCATION) \
+        X(vkCreateComputePipelines,                         ALLOCATION) \
+        X(vkDestroyPipeline,                                OTHER) \
+        X(vkCreatePipelineLayout,                           ALLOCATION) \
+        X(vkDestroyPipelineLayout,                          OTHER) \
+        X(vkCreateSampler,                                  ALLOCATION) \
+        X(vkDestroySampler,                                 OTHER) \
+        X(vkCreateDescriptorSetLayout,                      ALLOCATION) \
+        X(vkDestroyDescriptorSetLayout,                     OTHER) \
+        X(vkCreateDescriptorPool,                           ALLOCATION) \
+        X(vkDestroyDescriptorPool,                          OTHER) \
+        X(vkResetDescriptorPool,                            OTHER) \
+        X(vkAllocateDescriptorSets,                         ALLOCATION) \
+        X(vkFreeDescriptorSets,                             OTHER) \
+        X(vkUpdateDescriptorSets,                           DESCRIPTOR_UPDATE) \
+        X(vkCreateFramebuffer,                              ALLOCATION) \
+        X(vkDestroyFramebuffer,                             OTHER) \
+        X(vkCreateRenderPass,                               ALLOCATION) \
+        X(vkDestroyRenderPass,                              OTHER) \
+        X(vkGetRenderAreaGranularity,                       OTHER) \
+        X(vkCreateCommandPool,                              ALLOCATION) \
+        X(vkDestroyCommandPool,                             OTHER) \
+        X(vkResetCommandPool,                               OTHER) \
+        X(vkAllocateCommandBuffers,                         ALLOCATION) \
+        X(vkFreeCommandBuffers,                             OTHER) \
+        X(vkBeginCommandBuffer,                             OTHER) \
+        X(vkEndCommandBuffer,                               OTHER) \
+        X(vkResetCommandBuffer,                             OTHER) \
+        X(vkCmdBindPipeline,                                BIND) \
+        X(vkCmdSetViewport,                                 COMMAND) \
+        X(vkCmdSetScissor,                                  COMMAND) \
+        X(vkCmdSetLineWidth,                                COMMAND) \
+        X(vkCmdSetDepthBias,                                COMMAND) \
+        X(vkCmdSetBlendConstants,                           COMMAND) \
+        X(vkCmdSetDepthBounds,                              COMMAND) \
+        X(vkCmdSetStencilCompareMask,                       COMMAND) \
+        X(vkCmdSetStencilWriteMask,                         COMMAND) \
+        X(vkCmdSetStencilReference,                         COMMAND) \
+        X(vkCmdBindDescriptorSets,                          BIND) \
+        X(vkCmdBindIndexBuffer,                             BIND) \
+        X(vkCmdBindVertexBuffers,                           BIND) \
+        X(vkCmdDraw,                                        DRAW) \
+        X(vkCmdDrawIndexed,                                 DRAW) \
+        X(vkCmdDrawIndirect,                                DRAW) \
+        X(vkCmdDrawIndexedIndirect,                         DRAW) \
+        X(vkCmdDispatch,                                    DRAW) \
+        X(vkCmdDispatchIndirect,                            DRAW) \
+        X(vkCmdCopyBuffer,                                  COMMAND) \
+        X(vkCmdCopyImage,                                   COMMAND) \
+        X(vkCmdBlitImage,                                   COMMAND) \
+        X(vkCmdCopyBufferToImage,                           COMMAND) \
+        X(vkCmdCopyImageToBuffer,                           COMMAND) \
+        X(vkCmdUpdateBuffer,                                COMMAND) \
+        X(vkCmdFillBuffer,                                  COMMAND) \
+        X(vkCmdClearColorImage,                             COMMAND) \
+        X(vkCmdClearDepthStencilImage,                      COMMAND) \
+        X(vkCmdClearAttachments,                            COMMAND) \
+        X(vkCmdResolveImage,                                COMMAND) \
+        X(vkCmdSetEvent,                                    COMMAND) \
+        X(vkCmdResetEvent,                                  COMMAND) \
+        X(vkCmdWaitEvents,                                  COMMAND) \
+        X(vkCmdPipelineBarrier,                             COMMAND) \
+        X(vkCmdBeginQuery,                                  COMMAND) \
+        X(vkCmdEndQuery,                                    COMMAND) \
+        X(vkCmdResetQueryPool,                              COMMAND) \
+        X(vkCmdWriteTimestamp,                              COMMAND) \
+        X(vkCmdCopyQueryPoolResults,                        COMMAND) \
+        X(vkCmdPushConstants,                               COMMAND) \
+        X(vkCmdBeginRenderPass,                             COMMAND) \
+        X(vkCmdNextSubpass,                                 COMMAND) \
+        X(vkCmdEndRenderPass,                               COMMAND) \
+        X(vkCmdExecuteCommands,                             COMMAND)
+
+    #define VK_CALL_STATS_ID(name, category)        ID_##name,
+    #define VK_CALL_STATS_NAME(name, category)      #name,
+    #define VK_CALL_STATS_CATEGORY(name, category)  category_t::category,
+
+    enum : uint32_t
+    {
+        VK_CALL_STATS_ENTRY_POINTS(VK_CALL_STATS_ID)
+        CALL_COUNT
+    };
+
+    static const char* getCallName(uint32_t id)
+    {
+        static const char* names[] = { VK_CALL_STATS_ENTRY_POINTS(VK_CALL_STATS_NAME) };
+        return names[id];
+    }
+
+    static category_t getCallCategory(uint32_t id)
+    {
+        static const category_t categories[] = { VK_CALL_STATS_ENTRY_POINTS(VK_CALL_STATS_CATEGORY) };
+        return categories[id];
+    }
+
+// } // ENTRY POINTS
+
+// WRAPPERS {
+
+    /// Counts and times one call of entry point id - for the lifetime of the object.
+    class CallTimer
+    {
+    public:
+        CallTimer(uint32_t id)
+            : id(id)
+            , start(std::chrono::steady_clock::now())
+        {
+        }
+
+        ~CallTimer()
+        {
+            const uint64_t ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->start).count());
+            VkCallStats::record(this->id, ns);
+        }
+
+    private:
+        uint32_t                              id;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    /// Real entry point with its exact parameter types - so arguments convert as in a direct call (0 to a handle, etc.).
+    template <typename Ret, typename... Params>
+    struct Call
+    {
+        uint32_t id;
+        Ret (VKAPI_PTR *fn)(Params...);
+
+        Ret operator()(Params... args) const
+        {
+            CallTimer timer(this->id);
+            return this->fn(args...);
+        }
+    };
+
+    template <typename Ret, typename... Params>
+    static Call<Ret, Params...> wrap(uint32_t id, Ret (VKAPI_PTR *fn)(Params...))
+    {
+        return { id, fn };
+    }
+
+    // Entry points with bind tracking.
+
+    static VkResult beginCommandBuffer(VkCommandBuffer commandBuffer, const VkCommandBufferBeginInfo* pBeginInfo)
+    {
+        {
+            State& s = state();
+            std::lock_guard<std::mutex> lock(s.bindMutex);
+            s.bindStates[commandBuffer] = BindState();
+        }
+        return wrap(ID_vkBeginCommandBuffer, ::vkBeginCommandBuffer)(commandBuffer, pBeginInfo);
+    }
+
+    static void cmdBindPipeline(VkCommandBuffer commandBuffer, VkPipelineBindPoint pipelineBindPoint, VkPipeline pipeline)
+    {
+        {
+            State& s = state();
+            std::lock_guard<std::mutex> lock(s.bindMutex);
+            VkPipeline& bound = s.bindStates[commandBuffer].pipelines[bindPointIndex(pipelineBindPoint)];
+            if (bound == pipeline)
+            {
+                s.frameRedundantBinds++;
+            }
+            bound = pipeline;
+        }
+        wrap(ID_vkCmdBindPipeline, ::vkCmdBindPipeline)(commandBuffer, pipelineBindPoint, pipeline);
+    }
+
+    /// Redundant when every set is already bound in its slot with the same layout. Dynamic offsets are not tracked -
+    /// binds with them always count as needed.
+    static void cmdBindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint pipelineBindPoint, VkPipelineLayout layout,
+                                      uint32_t firstSet, uint32_t descriptorSetCount, const VkDescriptorSet* pDescriptorSets,
+                                      uint32_t dynamicOffsetCount, const uint32_t* pDynamicOffsets)
+    {
+        {
+            State& s = state();
+            std::lock_guard<std::mutex> lock(s.bindMutex);
+            BindState& bindState = s.bindStates[commandBuffer];
+            const uint32_t bp = bindPointIndex(pipelineBindPoint);
+
+            bool redundant = (dynamicOffsetCount == 0) && (bindState.layouts[bp] == layout);
+            for (uint32_t i = 0; i < descriptorSetCount; i++)
+            {
+                const uint32_t slot = firstSet + i;
+                if (slot >= VK_CALL_STATS_MAX_SETS)
+                {
+                    redundant = false;
+                    continue;
+                }
+                redundant = redundant && (bindState.sets[bp][slot] == pDescriptorSets[i]);
+                bindState.sets[bp][slot] = (dynamicOffsetCount == 0) ? pDescriptorSets[i] : VK_NULL_HANDLE;
+            }
+            bindState.layouts[bp] = layout;
+
+            if (redundant)
+            {
+                s.frameRedundantBinds++;
+            }
+        }
+        wrap(ID_vkCmdBindDescriptorSets, ::vkCmdBindDescriptorSets)(commandBuffer, pipelineBindPoint, layout, firstSet,
+                                                                    descriptorSetCount, pDescriptorSets, dynamicOffsetCount, pDynamicOffsets);
+    }
+
+// } // WRAPPERS
+
+private:
+    struct BindState
+    {
+        VkPipeline       pipelines[2]                     = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+        VkPipelineLayout layouts[2]                       = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+        VkDescriptorSet  sets[2][VK_CALL_STATS_MAX_SETS]  = {};
+    };
+
+    struct State
+    {
+        std::atomic<phase_t>  phase;
+
+        // Totals since start.
+        std::atomic<uint64_t> calls[size_t(phase_t::COUNT)][CALL_COUNT];
+        std::atomic<uint64_t> nanoseconds[size_t(phase_t::COUNT)][CALL_COUNT];
+
+        // Current frame.
+        std::atomic<uint64_t> frameCategories[size_t(category_t::COUNT)];
+        std::atomic<uint64_t> frameRedundantBinds;
+        std::atomic<uint64_t> frameLoopAllocations;
+
+        // Current report window - main thread only.
+        uint64_t frameCount                 = 0;
+        uint64_t windowFrameCount           = 0;
+        uint64_t windowSum[size_t(category_t::COUNT)] = {};
+        uint64_t windowMax[size_t(category_t::COUNT)] = {};
+        uint64_t windowRedundantSum         = 0;
+        uint64_t windowRedundantMax         = 0;
+        uint64_t windowFrameLoopAllocations = 0;
+        std::vector<uint64_t> windowStartCalls;
+        std::vector<uint64_t> windowStartNanoseconds;
+        std::string summaryLine;
+
+        std::mutex bindMutex;
+        std::unordered_map<VkCommandBuffer, BindState> bindStates;
+
+        State()
+            : phase(phase_t::OTHER)
+            , frameRedundantBinds(0)
+            , frameLoopAllocations(0)
+            , windowStartCalls(CALL_COUNT, 0)
+            , windowStartNanoseconds(CALL_COUNT, 0)
+        {
+            for (size_t p = 0; p < size_t(phase_t::COUNT); p++)
+            {
+                for (uint32_t id = 0; id < CALL_COUNT; id++)
+                {
+                    this->calls[p][id].store(0);
+                    this->nanoseconds[p][id].store(0);
+                }
+            }
+            for (size_t c = 0; c < size_t(category_t::COUNT); c++)
+            {
+                this->frameCategories[c].store(0);
+            }
+        }
+    };
+
+    static State& state()
+    {
+        static State s;
+        return s;
+    }
+
+    static uint32_t bindPointIndex(VkPipelineBindPoint pipelineBindPoint)
+    {
+        return (pipelineBindPoint == VK_PIPELINE_BIND_POINT_COMPUTE) ? 1u : 0u;
+    }
+
+    static void record(uint32_t id, uint64_t ns)
+    {
+        State& s = state();
+        const phase_t    phase    = s.phase.load(std::memory_order_relaxed);
+        const category_t category = getCallCategory(id);
+
+        s.calls[size_t(phase)][id].fetch_add(1, std::memory_order_relaxed);
+        s.nanoseconds[size_t(phase)][id].fetch_add(ns, std::memory_order_relaxed);
+        s.frameCategories[size_t(category)].fetch_add(1, std::memory_order_relaxed);
+
+        if (category == category_t::ALLOCATION && (phase == phase_t::UPDATE || phase == phase_t::SUBMIT))
+        {
+            s.frameLoopAllocations.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    static const char* getPhaseName(phase_t phase)
+    {
+        static const char* names[] = { "other", "prepare", "build", "update", "submit" };
+        return names[size_t(phase)];
+    }
+
+    static const char* getCategoryName(category_t category)
+    {
+        static const char* names[] = { "binds", "draws", "descriptor updates", "allocations", "submits", "other commands", "other" };
+        return names[size_t(category)];
+    }
+
+    /// Prints the window's per-frame counts and top entry points, then starts a new window.
+    static void report(State& s)
+    {
+        const double frames = double(s.windowFrameCount);
+
+        std::ostringstream summary;
+        summary << std::fixed << std::setprecision(1) << "vk calls/frame:";
+        std::cout << " >>> VkCallStats::report: frames " << s.frameCount - s.windowFrameCount << " - " << s.frameCount
+                  << ", per frame (mean / max):" << std::endl;
+        for (size_t c = 0; c < size_t(category_t::COUNT); c++)
+        {
+            std::cout << "     " << std::setw(20) << std::left << getCategoryName(category_t(c)) << std::right
+                      << std::fixed << std::setprecision(1) << std::setw(10) << s.windowSum[c] / frames << " / " << s.windowMax[c] << std::endl;
+        }
+        std::cout << "     " << std::setw(20) << std::left << "redundant binds" << std::right
+                  << std::setw(10) << s.windowRedundantSum / frames << " / " << s.windowRedundantMax << std::endl;
+
+        summary << " bind " << s.windowSum[size_t(category_t::BIND)] / frames
+                << ", draw " << s.windowSum[size_t(category_t::DRAW)] / frames
+                << ", desc " << s.windowSum[size_t(category_t::DESCRIPTOR_UPDATE)] / frames
+                << ", alloc " << s.windowSum[size_t(category_t::ALLOCATION)] / frames
+                << ", submit " << s.windowSum[size_t(category_t::SUBMIT)] / frames;
+        s.summaryLine = summary.str();
+
+        // Entry points with most driver time in the window, all phases.
+        std::vector<uint64_t> windowCalls(CALL_COUNT, 0);
+        std::vector<uint64_t> windowNanoseconds(CALL_COUNT, 0);
+        std::vector<uint32_t> order;
+        for (uint32_t id = 0; id < CALL_COUNT; id++)
+        {
+            uint64_t calls = 0;
+            uint64_t ns    = 0;
+            for (size_t p = 0; p < size_t(phase_t::COUNT); p++)
+            {
+                calls += s.calls[p][id].load();
+                ns    += s.nanoseconds[p][id].load();
+            }
+            windowCalls[id]       = calls - s.windowStartCalls[id];
+            windowNanoseconds[id] = ns - s.windowStartNanoseconds[id];
+            s.windowStartCalls[id]       = calls;
+            s.windowStartNanoseconds[id] = ns;
+
+            if (windowCalls[id] > 0)
+            {
+                order.push_back(id);
+            }
+        }
+        std::sort(order.begin(), order.end(), [&windowNanoseconds](uint32_t a, uint32_t b) {
+            return windowNanoseconds[a] > windowNanoseconds[b];
+        });
+        if (order.size() > VK_CALL_STATS_TOP_ENTRIES)
+        {
+            order.resize(VK_CALL_STATS_TOP_ENTRIES);
+        }
+
+        std::cout << " >>> VkCallStats::report: most driver time (calls per frame, us per frame):" << std::endl;
+        for (uint32_t id : order)
+        {
+            std::cout << "     " << std::setw(36) << std::left << getCallName(id) << std::right
+                      << std::setprecision(1) << std::setw(10) << windowCalls[id] / frames
+                      << std::setw(10) << windowNanoseconds[id] * 1e-3 / frames << std::endl;
+        }
+
+        if (s.windowFrameLoopAllocations > 0)
+        {
+            std::cout << " >>> VkCallStats::report: WARNING: " << s.windowFrameLoopAllocations
+                      << " allocations in the frame loop (update / submit phase) - per-frame allocations?" << std::endl;
+        }
+        if (s.windowRedundantSum > 0)
+        {
+            std::cout << " >>> VkCallStats::report: WARNING: " << s.windowRedundantSum
+                      << " redundant binds recorded - same pipeline or descriptor sets bound again" << std::endl;
+        }
+
+        s.windowFrameCount = 0;
+        std::fill(s.windowSum, s.windowSum + size_t(category_t::COUNT), 0);
+        std::fill(s.windowMax, s.windowMax + size_t(category_t::COUNT), 0);
+        s.windowRedundantSum         = 0;
+        s.windowRedundantMax         = 0;
+        s.windowFrameLoopAllocations = 0;
+    }
+#endif // VK229_CALL_STATS
+};
+
+} // namespace vk229
+
+#ifdef VK229_CALL_STATS
+// REDIRECTS {
+// Function-like macros - taking an entry point's address (vkGetInstanceProcAddr as a value, etc.) still gives the real one.
+
+#define VK_CALL_STATS_WRAP(name, ...) vk229::VkCallStats::wrap(vk229::VkCallStats::ID_##name, ::name)(__VA_ARGS__)
+
+#define vkCreateInstance(...)                               VK_CALL_STATS_WRAP(vkCreateInstance, __VA_ARGS__)
+#define vkDestroyInstance(...)                              VK_CALL_STATS_WRAP(vkDestroyInstance, __VA_ARGS__)
+#define vkEnumeratePhysicalDevices(...)                     VK_CALL_STATS_WRAP(vkEnumeratePhysicalDevices, __VA_ARGS__)
+#define vkGetPhysicalDeviceFeatures(...)                    VK_CALL_STATS_WRAP(vkGetPhysicalDeviceFeatures, __VA_ARGS__)
+#define vkGetPhysicalDeviceFormatProperties(...)            VK_CALL_STATS_WRAP(vkGetPhysicalDeviceFormatProperties, __VA_ARGS__)
+#define vkGetPhysicalDeviceImageFormatProperties(...)       VK_CALL_STATS_WRAP(vkGetPhysicalDeviceImageFormatProperties, __VA_ARGS__)
+#define vkGetPhysicalDeviceProperties(...)                  VK_CALL_STATS_WRAP(vkGetPhysicalDeviceProperties, __VA_ARGS__)
+#define vkGetPhysicalDeviceQueueFamilyProperties(...)       VK_CALL_STATS_WRAP(vkGetPhysicalDeviceQueueFamilyProperties, __VA_ARGS__)
+#define vkGetPhysicalDeviceMemoryProperties(...)            VK_CALL_STATS_WRAP(vkGetPhysicalDeviceMemoryProperties, __VA_ARGS__)
+#define vkGetPhysicalDeviceSparseImageFormatProperties(...) VK_CALL_STATS_WRAP(vkGetPhysicalDeviceSparseImageFormatProperties, __VA_ARGS__)
+#define vkGetInstanceProcAddr(...)                          VK_CALL_STATS_WRAP(vkGetInstanceProcAddr, __VA_ARGS__)
+#define vkGetDeviceProcAddr(...)                            VK_CALL_STATS_WRAP(vkGetDeviceProcAddr, __VA_ARGS__)
+#define vkCreateDevice(...)                                 VK_CALL_STATS_WRAP(vkCreateDevice, __VA_ARGS__)
+#define vkDestroyDevice(...)                                VK_CALL_STATS_WRAP(vkDestroyDevice, __VA_ARGS__)
+#define vkEnumerateInstanceExtensionProperties(...)         VK_CALL_STATS_WRAP(vkEnumerateInstanceExtensionProperties, __VA_ARGS__)
+#define vkEnumerateDeviceExtensionProperties(...)           VK_CALL_STATS_WRAP(vkEnumerateDeviceExtensionProperties, __VA_ARGS__)
+#define vkEnumerateInstanceLayerProperties(...)             VK_CALL_STATS_WRAP(vkEnumerateInstanceLayerProperties, __VA_ARGS__)
+#define vkEnumerateDeviceLayerProperties(...)               VK_CALL_STATS_WRAP(vkEnumerateDeviceLayerProperties, __VA_ARGS__)
+#define vkGetDeviceQueue(...)                               VK_CALL_STATS_WRAP(vkGetDeviceQueue, __VA_ARGS__)
+#define vkQueueSubmit(...)                                  VK_CALL_STATS_WRAP(vkQueueSubmit, __VA_ARGS__)
+#define vkQueueWaitIdle(...)                                VK_CALL_STATS_WRAP(vkQueueWaitIdle, __VA_ARGS__)
+#define vkQueueBindSparse(...)                              VK_CALL_STATS_WRAP(vkQueueBindSparse, __VA_ARGS__)
+#define vkDeviceWaitIdle(...)                               VK_CALL_STATS_WRAP(vkDeviceWaitIdle, __VA_ARGS__)
+#define vkAllocateMemory(...)                               VK_CALL_STATS_WRAP(vkAllocateMemory, __VA_ARGS__)
+#define vkFreeMemory(...)                                   VK_CALL_STATS_WRAP(vkFreeMemory, __VA_ARGS__)
+#define vkMapMemory(...)                                    VK_CALL_STATS_WRAP(vkMapMemory, __VA_ARGS__)
+#define vkUnmapMemory(...)                                  VK_CALL_STATS_WRAP(vkUnmapMemory, __VA_ARGS__)
+#define vkFlushMappedMemoryRanges(...)                      VK_CALL_STATS_WRAP(vkFlushMappedMemoryRanges, __VA_ARGS__)
+#define vkInvalidateMappedMemoryRanges(...)                 VK_CALL_STATS_WRAP(vkInvalidateMappedMemoryRanges, __VA_ARGS__)
+#define vkGetDeviceMemoryCommitment(...)                    VK_CALL_STATS_WRAP(vkGetDeviceMemoryCommitment, __VA_ARGS__)
+#define vkBindBufferMemory(...)                             VK_CALL_STATS_WRAP(vkBindBufferMemory, __VA_ARGS__)
+#define vkBindImageMemory(...)                              VK_CALL_STATS_WRAP(vkBindImageMemory, __VA_ARGS__)
+#define vkGetBufferMemoryRequirements(...)                  VK_CALL_STATS_WRAP(vkGetBufferMemoryRequirements, __VA_ARGS__)
+#define vkGetImageMemoryRequirements(...)                   VK_CALL_STATS_WRAP(vkGetImageMemoryRequirements, __VA_ARGS__)
+#define vkGetImageSparseMemoryRequirements(...)             VK_CALL_STATS_WRAP(vkGetImageSparseMemoryRequirements, __VA_ARGS__)
+#define vkCreateFence(...)                                  VK_CALL_STATS_WRAP(vkCreateFence, __VA_ARGS__)
+#define vkDestroyFence(...)                                 VK_CALL_STATS_WRAP(vkDestroyFence, __VA_ARGS__)
+#define vkResetFences(...)                                  VK_CALL_STATS_WRAP(vkResetFences, __VA_ARGS__)
+#define vkGetFenceStatus(...)                               VK_CALL_STATS_WRAP(vkGetFenceStatus, __VA_ARGS__)
+#define vkWaitForFences(...)                                VK_CALL_STATS_WRAP(vkWaitForFences, __VA_ARGS__)
+#define vkCreateSemaphore(...)                              VK_CALL_STATS_WRAP(vkCreateSemaphore, __VA_ARGS__)
+#define vkDestroySemaphore(...)                             VK_CALL_STATS_WRAP(vkDestroySemaphore, __VA_ARGS__)
+#define vkCreateEvent(...)                                  VK_CALL_STATS_WRAP(vkCreateEvent, __VA_ARGS__)
+#define vkDestroyEvent(...)                                 VK_CALL_STATS_WRAP(vkDestroyEvent, __VA_ARGS__)
+#define vkGetEventStatus(...)                               VK_CALL_STATS_WRAP(vkGetEventStatus, __VA_ARGS__)
+#define vkSetEvent(...)                                     VK_CALL_STATS_WRAP(vkSetEvent, __VA_ARGS__)
+#define vkResetEvent(...)                                   VK_CALL_STATS_WRAP(vkResetEvent, __VA_ARGS__)
+#define vkCreateQueryPool(...)                              VK_CALL_STATS_WRAP(vkCreateQueryPool, __VA_ARGS__)
+#define vkDestroyQueryPool(...)                             VK_CALL_STATS_WRAP(vkDestroyQueryPool, __VA_ARGS__)
+#define vkGetQueryPoolResults(...)                          VK_CALL_STATS_WRAP(vkGetQueryPoolResults, __VA_ARGS__)
+#define vkCreateBuffer(...)                                 VK_CALL_STATS_WRAP(vkCreateBuffer, __VA_ARGS__)
+#define vkDestroyBuffer(...)                                VK_CALL_STATS_WRAP(vkDestroyBuffer, __VA_ARGS__)
+#define vkCreateBufferView(...)                             VK_CALL_STATS_WRAP(vkCreateBufferView, __VA_ARGS__)
+#define vkDestroyBufferView(...)                            VK_CALL_STATS_WRAP(vkDestroyBufferView, __VA_ARGS__)
+#define vkCreateImage(...)                                  VK_CALL_STATS_WRAP(vkCreateImage, __VA_ARGS__)
+#define vkDestroyImage(...)                                 VK_CALL_STATS_WRAP(vkDestroyImage, __VA_ARGS__)
+#define vkGetImageSubresourceLayout(...)                    VK_CALL_STATS_WRAP(vkGetImageSubresourceLayout, __VA_ARGS__)
+#define vkCreateImageView(...)                              VK_CALL_STATS_WRAP(vkCreateImageView, __VA_ARGS__)
+#define vkDestroyImageView(...)                             VK_CALL_STATS_WRAP(vkDestroyImageView, __VA_ARGS__)
+#define vkCreateShaderModule(...)                           VK_CALL_STATS_WRAP(vkCreateShaderModule, __VA_ARGS__)
+#define vkDestroyShaderModule(...)                          VK_CALL_STATS_WRAP(vkDestroyShaderModule, __VA_ARGS__)
+#define vkCreatePipelineCache(...)                          VK_CALL_STATS_WRAP(vkCreatePipelineCache, __VA_ARGS__)
+#define vkDestroyPipelineCache(...)                         VK_CALL_STATS_WRAP(vkDestroyPipelineCache, __VA_ARGS__)
+#define vkGetPipelineCacheData(...)                         VK_CALL_STATS_WRAP(vkGetPipelineCacheData, __VA_ARGS__)
+#define vkMergePipelineCaches(...)                          VK_CALL_STATS_WRAP(vkMergePipelineCaches, __VA_ARGS__)
+#define vkCreateGraphicsPipelines(...)                      VK_CALL_STATS_WRAP(vkCreateGraphicsPipelines, __VA_ARGS__)
+#define vkCreateComputePipelines(...)                       VK_CALL_STATS_WRAP(vkCreateComputePipelines, __VA_ARGS__)
+#define vkDestroyPipeline(...)                              VK_CALL_STATS_WRAP(vkDestroyPipeline, __VA_ARGS__)
+#define vkCreatePipelineLayout(...)                         VK_CALL_STATS_WRAP(vkCreatePipelineLayout, __VA_ARGS__)
+#define vkDestroyPipelineLayout(...)                        VK_CALL_STATS_WRAP(vkDestroyPipelineLayout, __VA_ARGS__)
+#define vkCreateSampler(...)                                VK_CALL_STATS_WRAP(vkCreateSampler, __VA_ARGS__)
+#define vkDestroySampler(...)                               VK_CALL_STATS_WRAP(vkDestroySampler, __VA_ARGS__)
+#define vkCreateDescriptorSetLayout(...)                    VK_CALL_STATS_WRAP(vkCreateDescriptorSetLayout, __VA_ARGS__)
+#define vkDestroyDescriptorSetLayout(...)                   VK_CALL_STATS_WRAP(vkDestroyDescriptorSetLayout, __VA_ARGS__)
+#define vkCreateDescriptorPool(...)                         VK_CALL_STATS_WRAP(vkCreateDescriptorPool, __VA_ARGS__)
+#define vkDestroyDescriptorPool(...)                        VK_CALL_STATS_WRAP(vkDestroyDescriptorPool, __VA_ARGS__)
+#define vkResetDescriptorPool(...)                          VK_CALL_STATS_WRAP(vkResetDescriptorPool, __VA_ARGS__)
+#define vkAllocateDescriptorSets(...)                       VK_CALL_STATS_WRAP(vkAllocateDescriptorSets, __VA_ARGS__)
+#define vkFreeDescriptorSets(...)                           VK_CALL_STATS_WRAP(vkFreeDescriptorSets, __VA_ARGS__)
+#define vkUpdateDescriptorSets(...)                         VK_CALL_STATS_WRAP(vkUpdateDescriptorSets, __VA_ARGS__)
+#define vkCreateFramebuffer(...)                            VK_CALL_STATS_WRAP(vkCreateFramebuffer, __VA_ARGS__)
+#define vkDestroyFramebuffer(...)                           VK_CALL_STATS_WRAP(vkDestroyFramebuffer, __VA_ARGS__)
+#define vkCreateRenderPass(...)                             VK_CALL_STATS_WRAP(vkCreateRenderPass, __VA_ARGS__)
+#define vkDestroyRenderPass(...)                            VK_CALL_STATS_WRAP(vkDestroyRenderPass, __VA_ARGS__)
+#define vkGetRenderAreaGranularity(...)                     VK_CALL_STATS_WRAP(vkGetRenderAreaGranularity, __VA_ARGS__)
+#define vkCreateCommandPool(...)                            VK_CALL_STATS_WRAP(vkCreateCommandPool, __VA_ARGS__)
+#define vkDestroyCommandPool(...)                           VK_CALL_STATS_WRAP(vkDestroyCommandPool, __VA_ARGS__)
+#define vkResetCommandPool(...)                             VK_CALL_STATS_WRAP(vkResetCommandPool, __VA_ARGS__)
+#define vkAllocateCommandBuffers(...)                       VK_CALL_STATS_WRAP(vkAllocateCommandBuffers, __VA_ARGS__)
+#define vkFreeCommandBuffers(...)                           VK_CALL_STATS_WRAP(vkFreeCommandBuffers, __VA_ARGS__)
+#define vkBeginCommandBuffer(...)                           vk229::VkCallStats::beginCommandBuffer(__VA_ARGS__)
+#define vkEndCommandBuffer(...)                             VK_CALL_STATS_WRAP(vkEndCommandBuffer, __VA_ARGS__)
+#define vkResetCommandBuffer(...)                           VK_CALL_STATS_WRAP(vkResetCommandBuffer, __VA_ARGS__)
+#define vkCmdBindPipeline(...)                              vk229::VkCallStats::cmdBindPipeline(__VA_ARGS__)
+#define vkCmdSetViewport(...)                               VK_CALL_STATS_WRAP(vkCmdSetViewport, __VA_ARGS__)
+#define vkCmdSetScissor(...)                                VK_CALL_STATS_WRAP(vkCmdSetScissor, __VA_ARGS__)
+#define vkCmdSetLineWidth(...)                              VK_CALL_STATS_WRAP(vkCmdSetLineWidth, __VA_ARGS__)
+#define vkCmdSetDepthBias(...)                              VK_CALL_STATS_WRAP(vkCmdSetDepthBias, __VA_ARGS__)
+#define vkCmdSetBlendConstants(...)                         VK_CALL_STATS_WRAP(vkCmdSetBlendConstants, __VA_ARGS__)
+#define vkCmdSetDepthBounds(...)                            VK_CALL_STATS_WRAP(vkCmdSetDepthBounds, __VA_ARGS__)
+#define vkCmdSetStencilCompareMask(...)                     VK_CALL_STATS_WRAP(vkCmdSetStencilCompareMask, __VA_ARGS__)
+#define vkCmdSetStencilWriteMask(...)                       VK_CALL_STATS_WRAP(vkCmdSetStencilWriteMask, __VA_ARGS__)
+#define vkCmdSetStencilReference(...)                       VK_CALL_STATS_WRAP(vkCmdSetStencilReference, __VA_ARGS__)
+#define vkCmdBindDescriptorSets(...)                        vk229::VkCallStats::cmdBindDescriptorSets(__VA_ARGS__)
+#define vkCmdBindIndexBuffer(...)                           VK_CALL_STATS_WRAP(vkCmdBindIndexBuffer, __VA_ARGS__)
+#define vkCmdBindVertexBuffers(...)                         VK_CALL_STATS_WRAP(vkCmdBindVertexBuffers, __VA_ARGS__)
+#define vkCmdDraw(...)                                      VK_CALL_STATS_WRAP(vkCmdDraw, __VA_ARGS__)
+#define vkCmdDrawIndexed(...)                               VK_CALL_STATS_WRAP(vkCmdDrawIndexed, __VA_ARGS__)
+#define vkCmdDrawIndirect(...)                              VK_CALL_STATS_WRAP(vkCmdDrawIndirect, __VA_ARGS__)
+#define vkCmdDrawIndexedIndirect(...)                       VK_CALL_STATS_WRAP(vkCmdDrawIndexedIndirect, __VA_ARGS__)
+#define vkCmdDispatch(...)                                  VK_CALL_STATS_WRAP(vkCmdDispatch, __VA_ARGS__)
+#define vkCmdDispatchIndirect(...)                          VK_CALL_STATS_WRAP(vkCmdDispatchIndirect, __VA_ARGS__)
+#define vkCmdCopyBuffer(...)                                VK_CALL_STATS_WRAP(vkCmdCopyBuffer, __VA_ARGS__)
+#define vkCmdCopyImage(...)                                 VK_CALL_STATS_WRAP(vkCmdCopyImage, __VA_ARGS__)
+#define vkCmdBlitImage(...)                                 VK_CALL_STATS_WRAP(vkCmdBlitImage, __VA_ARGS__)
+#define vkCmdCopyBufferToImage(...)                         VK_CALL_STATS_WRAP(vkCmdCopyBufferToImage, __VA_ARGS__)
+#define vkCmdCopyImageToBuffer(...)                         VK_CALL_STATS_WRAP(vkCmdCopyImageToBuffer, __VA_ARGS__)
+#define vkCmdUpdateBuffer(...)                              VK_CALL_STATS_WRAP(vkCmdUpdateBuffer, __VA_ARGS__)
+#define vkCmdFillBuffer(...)                                VK_CALL_STATS_WRAP(vkCmdFillBuffer, __VA_ARGS__)
+#define vkCmdClearColorImage(...)                           VK_CALL_STATS_WRAP(vkCmdClearColorImage, __VA_ARGS__)
+#define vkCmdClearDepthStencilImage(...)                    VK_CALL_STATS_WRAP(vkCmdClearDepthStencilImage, __VA_ARGS__)
+#define vkCmdClearAttachments(...)                          VK_CALL_STATS_WRAP(vkCmdClearAttachments, __VA_ARGS__)
+#define vkCmdResolveImage(...)                              VK_CALL_STATS_WRAP(vkCmdResolveImage, __VA_ARGS__)
+#define vkCmdSetEvent(...)                                  VK_CALL_STATS_WRAP(vkCmdSetEvent, __VA_ARGS__)
+#define vkCmdResetEvent(...)                                VK_CALL_STATS_WRAP(vkCmdResetEvent, __VA_ARGS__)
+#define vkCmdWaitEvents(...)                                VK_CALL_STATS_WRAP(vkCmdWaitEvents, __VA_ARGS__)
+#define vkCmdPipelineBarrier(...)                           VK_CALL_STATS_WRAP(vkCmdPipelineBarrier, __VA_ARGS__)
+#define vkCmdBeginQuery(...)                                VK_CALL_STATS_WRAP(vkCmdBeginQuery, __VA_ARGS__)
+#define vkCmdEndQuery(...)                                  VK_CALL_STATS_WRAP(vkCmdEndQuery, __VA_ARGS__)
+#define vkCmdResetQueryPool(...)                            VK_CALL_STATS_WRAP(vkCmdResetQueryPool, __VA_ARGS__)
+#define vkCmdWriteTimestamp(...)                            VK_CALL_STATS_WRAP(vkCmdWriteTimestamp, __VA_ARGS__)
+#define vkCmdCopyQueryPoolResults(...)                      VK_CALL_STATS_WRAP(vkCmdCopyQueryPoolResults, __VA_ARGS__)
+#define vkCmdPushConstants(...)                             VK_CALL_STATS_WRAP(vkCmdPushConstants, __VA_ARGS__)
+#define vkCmdBeginRenderPass(...)                           VK_CALL_STATS_WRAP(vkCmdBeginRenderPass, __VA_ARGS__)
+#define vkCmdNextSubpass(...)                               VK_CALL_STATS_WRAP(vkCmdNextSubpass, __VA_ARGS__)
+#define vkCmdEndRenderPass(...)                             VK_CALL_STATS_WRAP(vkCmdEndRenderPass, __VA_ARGS__)
+#define vkCmdExecuteCommands(...)                           VK_CALL_STATS_WRAP(vkCmdExecuteCommands, __VA_ARGS__)
+
+// } // REDIRECTS
+#endif // VK229_CALL_STATS
@@ -5,10 +5,26 @@
 
 #define SOFTEN_AO     25.0f
 #define AMBIENT_COEFF 0.001f
-#define PLANET_RADIUS 2.5f
-#define LIGHT_RADIUS 0.4f
+#define SHADOW_BIAS          0.05f
+#define SHADOW_NORMAL_OFFSET 0.02f
+#define SHADOW_TEXEL_ANGLE   (2.0f / 1024.0f) // Has to match SHADOW_MAP_SIZE
 
 layout (binding = 1) uniform sampler2D samplerColorMap;
+layout (binding = 2) uniform samplerCube samplerShadowMap; // Distance to the nearest rock from the light, see shadow.frag
+
+layout (binding = 0) uniform UBO 
+{
+    mat4 view;
+    mat4 projection;
+    vec4 lightPos;
+    vec4 camPos;
+    float lightInt;
+    float locSpeed;
+    float globSpeed;
+    vec4 lightPosNear;   // xyz - near edge of the light towards the planet, w - planet's angular radius from there
+    vec4 lightPosFar;    // xyz - far edge, w - planet's angular radius from there
+    vec4 shadowLightPos; // xyz - light position of the cached shadow cube map, w - its far distance
+} ubo;
 
 layout (location = 0) in vec3  inNormal;
 layout (location = 1) in vec3  inColor;
@@ -35,50 +51,39 @@ float fuzzNot(float f)
     return 1.0f - f;
 }
 
-float isFragShadedByObstacle(vec3 obstaclePos, vec3 fragPos, vec3 lightVec)
+// Soft shadow of the planet (obstacle at origin) - penumbra angles are computed on the CPU once per frame.
+float getPlanetShadow(vec3 fragPos)
 {
-    vec3  lightPos = fragPos.xyz + lightVec;
-
-    vec3  vecLiPl = obstaclePos - lightPos;  // vec from light to planet
+    vec3  vecLiPl = -ubo.lightPos.xyz;          // vec from light to planet
     float lenLiPl = length(vecLiPl);
 
-    vec3  vecLiRo = -lightVec;  // vec from light to rock
+    vec3  vecLiRo = fragPos - ubo.lightPos.xyz; // vec from light to rock
     float lenLiRo = length(vecLiRo);
 
-    float k = LIGHT_RADIUS/(LIGHT_RADIUS + PLANET_RADIUS);
-    vec3  lightPosNearF = lightPos + k*normalize(vec3(0.0f) - lightPos)*lenLiPl;
-    vec3  lightPosFarF  = lightPos - k*normalize(vec3(0.0f) - lightPos)*lenLiPl;
-
-    // Light pos near.
-    vec3  vecLiPlNear = obstaclePos - lightPosNearF;  // vec from light to planet
-    float lenLiPlNear = length(vecLiPlNear);
-
-    vec3  vecLiRoNear = fragPos-lightPosNearF;  // vec from light to rock
-    float lenLiRoNear = length(vecLiRoNear);
-
-    float cosFiRoPlNear = dot(vecLiPlNear, vecLiRoNear) / (lenLiPlNear * lenLiRoNear);
-    float fiRoPlNear = acos(cosFiRoPlNear);             // rock-planet angular distance from light point of view
-    float fiPlRadNear = asin(PLANET_RADIUS/lenLiPlNear); // angular size of planet from light point of view
-
-
-    // Light pos near.
-    vec3  vecLiPlFar = obstaclePos - lightPosFarF;  // vec from light to planet
-    float lenLiPlFar = length(vecLiPlFar);
-
-    vec3  vecLiRoFar = fragPos-lightPosFarF;  // vec from light to rock
-    float lenLiRoFar = length(vecLiRoFar);
-
-    float cosFiRoPlFar = dot(vecLiPlFar, vecLiRoFar) / (lenLiPlFar * lenLiRoFar);
-    float fiRoPlFar = acos(cosFiRoPlFar);             // rock-planet angular distance from light point of view
-    float fiPlRadFar = asin(PLANET_RADIUS/lenLiPlFar); // angular size of planet from light point of view
-
-    // Light pos center of light.
     float cosFiRoPl = dot(vecLiPl, vecLiRo) / (lenLiPl * lenLiRo);
-    float fiRoPl = acos(cosFiRoPl);             // rock-planet angular distance from light point of view
-    float fiPlRad = asin(PLANET_RADIUS/lenLiPl); // angular size of planet from light point of view
+    float fiRoPl    = acos(clamp(cosFiRoPl, -1.0f, 1.0f)); // rock-planet angular distance from light point of view
 
-//    return ((fiRoPl < fiPlRad) && (lenLiRo > lenLiPl)) ? 1.0f : 0.0f;
-    return min(max((fiPlRadNear - fiRoPl)/(fiPlRadNear - fiPlRadFar), 0.0f), 1.0f);
+    return min(max((ubo.lightPosNear.w - fiRoPl)/(ubo.lightPosNear.w - ubo.lightPosFar.w), 0.0f), 1.0f);
+}
+
+// Lit fraction from the cached shadow cube map of the rocks, 2x2 taps around the lookup direction.
+float getRockShadow(vec3 fragPos, vec3 N)
+{
+    vec3  lightToFrag = fragPos + N*SHADOW_NORMAL_OFFSET - ubo.shadowLightPos.xyz;
+    float dist        = length(lightToFrag);
+    float refDist     = dist - SHADOW_BIAS;
+
+    vec3  dir = lightToFrag / dist;
+    vec3  t   = normalize(cross(dir, (abs(dir.y) < 0.99f) ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f)));
+    vec3  b   = cross(dir, t);
+    float r   = dist * SHADOW_TEXEL_ANGLE;
+
+    float lit = 0.0f;
+    lit += float(texture(samplerShadowMap, lightToFrag + ( t + b)*r).r >= refDist);
+    lit += float(texture(samplerShadowMap, lightToFrag + ( t - b)*r).r >= refDist);
+    lit += float(texture(samplerShadowMap, lightToFrag + (-t + b)*r).r >= refDist);
+    lit += float(texture(samplerShadowMap, lightToFrag + (-t - b)*r).r >= refDist);
+    return 0.25f * lit;
 }
 
 void main() 
@@ -92,7 +97,7 @@ void main()
     vec3 ambient = inLightInt * AMBIENT_COEFF * vec3(1.0f) / (length(inLightVec) + SOFTEN_AO);
 	vec3 diffuse = max(dot(N, L), 0.0) * inColor;
 	vec3 specular = pow(max(dot(R, V), 0.0), 24.0) * vec3(1.0) * color.r;
-    float shadow = fuzzNot( isFragShadedByObstacle(vec3(0.0f), intWorldPos, inLightVec) );
+    float shadow = fuzzAnd( fuzzNot( getPlanetShadow(intWorldPos) ), getRockShadow(intWorldPos, N) );
 
     outFragColor = vec4((diffuse * shadow + ambient) * color.rgb + specular * shadow, 1.0);
 	outFragColor *= inLightInt;
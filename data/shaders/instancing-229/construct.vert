@@ -17,6 +17,9 @@ layout (binding = 0) uniform UBO
     float lightInt;
     float locSpeed;
     float globSpeed;
+    vec4 lightPosNear;   // xyz - near edge of the light towards the planet, w - planet's angular radius from there
+    vec4 lightPosFar;    // xyz - far edge, w - planet's angular radius from there
+    vec4 shadowLightPos; // xyz - light position of the cached shadow cube map, w - its far distance
 } ubo;
 
 layout (location = 0) out vec3 outNormal;
@@ -2,7 +2,7 @@
 
 # glslc way (from LunarSDK) - these spvs are somewhat bigger in size
 
-for type in vert frag; do
+for type in vert tesc tese frag comp; do
     for i in $(ls -d *$type); do
         cmd="glslc $i -o $i.spv"
         printf "\n    >>> $cmd\n"
@@ -3,6 +3,7 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
+#define PI            3.14159265f
 #define SOFTEN_AO     25.0f
 #define AMBIENT_COEFF 0.01f
 
@@ -10,16 +11,26 @@ layout (binding = 1) uniform sampler2D samplerColorMap;
 
 layout (location = 0) in vec3  inNormal;
 layout (location = 1) in vec3  inColor;
-layout (location = 2) in vec2  inUV;
+layout (location = 2) in vec3  inSphereDir; // Procedural sphere, see sphere.tese
 layout (location = 3) in vec3  inViewVec;
 layout (location = 4) in vec3  inLightVec;
 layout (location = 5) in float inLightInt;
 
 layout (location = 0) out vec4 outFragColor;
 
+// Equirectangular UV of the sphere direction. Its u is continuous either everywhere but -x or everywhere but +x,
+// the one without the jump in this pixel quad is used, so the seam does not take the smallest mip level.
+vec2 getSphereUv(vec3 dir)
+{
+    float u0 = atan(dir.z, dir.x) / (2.0f * PI) + 0.5f; // Jumps at -x
+    float u1 = fract(u0 + 0.5f) - 0.5f;                 // Jumps at +x, same texels with repeat addressing
+    float u  = (fwidth(u0) <= fwidth(u1)) ? u0 : u1;
+    return vec2(u, acos(clamp(dir.y, -1.0f, 1.0f)) / PI);
+}
+
 void main() 
 {
-    vec4 color = texture(samplerColorMap, inUV) * vec4(inColor, 1.0) * (inLightInt);
+    vec4 color = texture(samplerColorMap, getSphereUv(normalize(inSphereDir)) * vec2(5.0f, 3.0f)) * vec4(inColor, 1.0) * (inLightInt);
 
 	outFragColor = color;
 }
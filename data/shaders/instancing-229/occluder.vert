@@ -0,0 +1,28 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Depth-only occluder pass (construct) - source of the Hi-Z pyramid, the planet is drawn into it by sphere.vert/tesc/tese.
+// Position has to be computed the same way as in construct.vert.
+
+layout (location = 0) in vec3 inPos;
+
+layout (binding = 0) uniform UBO 
+{
+    mat4 view;
+    mat4 projection;
+    vec4 lightPos;
+    vec4 camPos;
+    float lightInt;
+    float locSpeed;
+    float globSpeed;
+    vec4 lightPosNear;   // xyz - near edge of the light towards the planet, w - planet's angular radius from there
+    vec4 lightPosFar;    // xyz - far edge, w - planet's angular radius from there
+    vec4 shadowLightPos; // xyz - light position of the cached shadow cube map, w - its far distance
+} ubo;
+
+void main() 
+{
+	gl_Position = ubo.projection * ubo.view * vec4(inPos, 1.0);
+}
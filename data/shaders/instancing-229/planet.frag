@@ -3,23 +3,73 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
+#define PI            3.14159265f
 #define SOFTEN_AO     25.0f
 #define AMBIENT_COEFF 0.001f
+#define SHADOW_BIAS          0.05f
+#define SHADOW_NORMAL_OFFSET 0.02f
+#define SHADOW_TEXEL_ANGLE   (2.0f / 1024.0f) // Has to match SHADOW_MAP_SIZE
 
 layout (binding = 1) uniform sampler2D samplerColorMap;
+layout (binding = 2) uniform samplerCube samplerShadowMap; // Distance to the nearest rock from the light, see shadow.frag
+
+layout (binding = 0) uniform UBO 
+{
+    mat4 view;
+    mat4 projection;
+    vec4 lightPos;
+    vec4 camPos;
+    float lightInt;
+    float locSpeed;
+    float globSpeed;
+    vec4 lightPosNear;   // xyz - near edge of the light towards the planet, w - planet's angular radius from there
+    vec4 lightPosFar;    // xyz - far edge, w - planet's angular radius from there
+    vec4 shadowLightPos; // xyz - light position of the cached shadow cube map, w - its far distance
+} ubo;
 
 layout (location = 0) in vec3  inNormal;
 layout (location = 1) in vec3  inColor;
-layout (location = 2) in vec2  inUV;
+layout (location = 2) in vec3  inSphereDir; // Procedural sphere, see sphere.tese
 layout (location = 3) in vec3  inViewVec;
 layout (location = 4) in vec3  inLightVec;
 layout (location = 5) in float inLightInt;
+layout (location = 6) in vec3  intWorldPos;
 
 layout (location = 0) out vec4 outFragColor;
 
+// Lit fraction from the cached shadow cube map of the rocks, 2x2 taps around the lookup direction.
+float getRockShadow(vec3 fragPos, vec3 N)
+{
+    vec3  lightToFrag = fragPos + N*SHADOW_NORMAL_OFFSET - ubo.shadowLightPos.xyz;
+    float dist        = length(lightToFrag);
+    float refDist     = dist - SHADOW_BIAS;
+
+    vec3  dir = lightToFrag / dist;
+    vec3  t   = normalize(cross(dir, (abs(dir.y) < 0.99f) ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f)));
+    vec3  b   = cross(dir, t);
+    float r   = dist * SHADOW_TEXEL_ANGLE;
+
+    float lit = 0.0f;
+    lit += float(texture(samplerShadowMap, lightToFrag + ( t + b)*r).r >= refDist);
+    lit += float(texture(samplerShadowMap, lightToFrag + ( t - b)*r).r >= refDist);
+    lit += float(texture(samplerShadowMap, lightToFrag + (-t + b)*r).r >= refDist);
+    lit += float(texture(samplerShadowMap, lightToFrag + (-t - b)*r).r >= refDist);
+    return 0.25f * lit;
+}
+
+// Equirectangular UV of the sphere direction. Its u is continuous either everywhere but -x or everywhere but +x,
+// the one without the jump in this pixel quad is used, so the seam does not take the smallest mip level.
+vec2 getSphereUv(vec3 dir)
+{
+    float u0 = atan(dir.z, dir.x) / (2.0f * PI) + 0.5f; // Jumps at -x
+    float u1 = fract(u0 + 0.5f) - 0.5f;                 // Jumps at +x, same texels with repeat addressing
+    float u  = (fwidth(u0) <= fwidth(u1)) ? u0 : u1;
+    return vec2(u, acos(clamp(dir.y, -1.0f, 1.0f)) / PI);
+}
+
 void main() 
 {
-	vec4 color = texture(samplerColorMap, inUV) * vec4(inColor, 1.0);
+	vec4 color = texture(samplerColorMap, getSphereUv(normalize(inSphereDir))) * vec4(inColor, 1.0);
 	vec3 N = normalize(inNormal);
 	vec3 L = normalize(inLightVec);
 	vec3 V = normalize(inViewVec);
@@ -28,8 +78,9 @@ void main()
     vec3 ambient = inLightInt * AMBIENT_COEFF * vec3(1.0f) / (length(inLightVec) + SOFTEN_AO);
 	vec3 diffuse = max(dot(N, L), 0.0) * inColor;
 	vec3 specular = pow(max(dot(R, V), 0.0), 24.0) * vec3(1.0) * color.r;
+    float shadow = getRockShadow(intWorldPos, N); // Planet's own shadow is given by N.L
 	
-	outFragColor = vec4((diffuse + ambient) * color.rgb + specular, 1.0);
+	outFragColor = vec4((diffuse * shadow + ambient) * color.rgb + specular * shadow, 1.0);
 	outFragColor *= inLightInt;
     outFragColor /= length(inLightVec);
 }
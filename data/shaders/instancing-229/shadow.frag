@@ -0,0 +1,23 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Distance from the light to the nearest caster - compared by receivers in getRockShadow().
+
+layout (binding = 0) uniform ShadowUBO 
+{
+    mat4 faceViewProj[6];
+    vec4 lightPos;    // w - far distance
+    float locSpeed;
+    float globSpeed;
+} shadowUbo;
+
+layout (location = 0) in vec3 inWorldPos;
+
+layout (location = 0) out float outDistance;
+
+void main() 
+{
+	outDistance = length(inWorldPos - shadowUbo.lightPos.xyz);
+}
@@ -0,0 +1,90 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Ring rocks into one face of the light's shadow cube map (vk229::ShadowCubeMap).
+// Position has to be computed the same way as in instancing.vert, with the rock motion of the shadow's snapshot.
+
+// Vertex attributes
+layout (location = 0) in vec3 inPos;
+
+// Instanced attributes
+layout (location = 4) in vec3 instancePos;
+layout (location = 5) in vec3 instanceRot;
+layout (location = 6) in float instanceScale;
+
+layout (binding = 0) uniform ShadowUBO 
+{
+    mat4 faceViewProj[6];
+    vec4 lightPos;    // w - far distance
+    float locSpeed;
+    float globSpeed;
+} shadowUbo;
+
+layout (push_constant) uniform PushConsts
+{
+    uint face;
+} pushConsts;
+
+layout (location = 0) out vec3 outWorldPos;
+
+mat4 getLocalRotMat(float loc_speed) 
+{
+    mat4 mx, my, mz;
+	
+	// rotate around x
+	float s = sin(instanceRot.x + loc_speed);
+	float c = cos(instanceRot.x + loc_speed);
+
+	mx[0] = vec4( c,   s,  0.0, 0.0);
+	mx[1] = vec4(-s,   c,  0.0, 0.0);
+	mx[2] = vec4(0.0, 0.0, 1.0, 0.0);
+	mx[3] = vec4(0.0, 0.0, 0.0, 1.0);
+	
+	// rotate around y
+	s = sin(instanceRot.y + loc_speed);
+	c = cos(instanceRot.y + loc_speed);
+
+	my[0] = vec4( c,  0.0,  s,  0.0);
+	my[1] = vec4(0.0, 1.0, 0.0, 0.0);
+	my[2] = vec4(-s,  0.0,  c,  0.0);
+	my[3] = vec4(0.0, 0.0, 0.0, 1.0);
+	
+	// rot around z
+	s = sin(instanceRot.z + loc_speed);
+	c = cos(instanceRot.z + loc_speed);	
+	
+	mz[0] = vec4(1.0, 0.0, 0.0, 0.0);
+	mz[1] = vec4(0.0,  c,   s,  0.0);
+	mz[2] = vec4(0.0, -s,   c,  0.0);
+	mz[3] = vec4(0.0, 0.0, 0.0, 1.0);
+	
+	return mz * my * mx;
+}
+
+mat4 getGlobalRotMat(float glob_speed) 
+{
+    mat4 globRotMat;
+    
+	float s = sin(instanceRot.y + glob_speed);
+	float c = cos(instanceRot.y + glob_speed);
+	
+	globRotMat[0] = vec4( c,  0.0,  s,  0.0);
+	globRotMat[1] = vec4(0.0, 1.0, 0.0, 0.0);
+	globRotMat[2] = vec4(-s,  0.0,  c,  0.0);
+	globRotMat[3] = vec4(0.0, 0.0, 0.0, 1.0);
+	
+	return globRotMat;
+}
+
+void main() 
+{
+	mat4 locRotMat  = getLocalRotMat(shadowUbo.locSpeed);
+	mat4 globRotMat = getGlobalRotMat(shadowUbo.globSpeed);
+
+	vec4 posWorld = globRotMat * (locRotMat * vec4(inPos.xyz * instanceScale, 1.0) + vec4(instancePos, 0.0f));
+
+	outWorldPos = posWorld.xyz;
+	gl_Position = shadowUbo.faceViewProj[pushConsts.face] * posWorld;
+}
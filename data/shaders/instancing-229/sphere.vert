@@ -0,0 +1,29 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Procedural sphere (planet, light, planet occluder) - no vertex buffer, vkCmdDraw of 60 vertices.
+// Corners of icosahedron patches come from the tables below (vk229::ICOSAHEDRON_VERTICES / ICOSAHEDRON_INDICES),
+// sphere.tesc and sphere.tese refine them.
+
+const vec3 VERTICES[12] = vec3[](
+    vec3(-0.525731,  0.850651,  0.0), vec3( 0.525731,  0.850651,  0.0), vec3(-0.525731, -0.850651,  0.0), vec3( 0.525731, -0.850651,  0.0),
+    vec3( 0.0,      -0.525731,  0.850651), vec3( 0.0,  0.525731,  0.850651), vec3( 0.0, -0.525731, -0.850651), vec3( 0.0,  0.525731, -0.850651),
+    vec3( 0.850651,  0.0,      -0.525731), vec3( 0.850651,  0.0,  0.525731), vec3(-0.850651,  0.0, -0.525731), vec3(-0.850651,  0.0,  0.525731)
+);
+
+// Counter-clockwise seen from outside.
+const int INDICES[60] = int[](
+    0, 11,  5,   0,  5,  1,   0,  1,  7,   0,  7, 10,   0, 10, 11,
+    1,  5,  9,   5, 11,  4,  11, 10,  2,  10,  7,  6,   7,  1,  8,
+    3,  9,  4,   3,  4,  2,   3,  2,  6,   3,  6,  8,   3,  8,  9,
+    4,  9,  5,   2,  4, 11,   6,  2, 10,   8,  6,  7,   9,  8,  1
+);
+
+layout (location = 0) out vec3 outDir;
+
+void main() 
+{
+    outDir = VERTICES[INDICES[gl_VertexIndex]];
+}
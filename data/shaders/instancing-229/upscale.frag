@@ -0,0 +1,59 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Upscale of the dynamic resolution target ("scene-color" transient of the render graph) to the swapchain.
+// Catmull-Rom bicubic filter from 9 bilinear taps - sharper than bilinear, which matters most at low scales.
+// Only the top-left vk229::getScaledExtent() part of the target is rendered (uvScale - vk229::getUvScale()), taps are clamped to it.
+
+layout (binding = 0) uniform sampler2D samplerScene;
+
+layout (push_constant) uniform PushConsts
+{
+    vec2 uvScale;
+} pushConsts;
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main() 
+{
+    vec2 texSize    = vec2(textureSize(samplerScene, 0));
+    vec2 invTexSize = 1.0f / texSize;
+    vec2 uvMin      = 0.5f * invTexSize;
+    vec2 uvMax      = pushConsts.uvScale - 0.5f * invTexSize;
+
+    vec2 samplePos = inUV * pushConsts.uvScale * texSize;
+    vec2 texPos1   = floor(samplePos - 0.5f) + 0.5f;
+    vec2 f         = samplePos - texPos1;
+
+    // Catmull-Rom weights.
+    vec2 w0 = f * (-0.5f + f * (1.0f - 0.5f * f));
+    vec2 w1 = 1.0f + f * f * (-2.5f + 1.5f * f);
+    vec2 w2 = f * (0.5f + f * (2.0f - 1.5f * f));
+    vec2 w3 = f * f * (-0.5f + 0.5f * f);
+
+    // Two middle taps merged into one bilinear fetch.
+    vec2 w12      = w1 + w2;
+    vec2 texPos0  = clamp((texPos1 - 1.0f) * invTexSize,       uvMin, uvMax);
+    vec2 texPos3  = clamp((texPos1 + 2.0f) * invTexSize,       uvMin, uvMax);
+    vec2 texPos12 = clamp((texPos1 + w2 / w12) * invTexSize,    uvMin, uvMax);
+
+    vec3 color = vec3(0.0f);
+    color += textureLod(samplerScene, vec2(texPos0.x,  texPos0.y),  0.0f).rgb * w0.x  * w0.y;
+    color += textureLod(samplerScene, vec2(texPos12.x, texPos0.y),  0.0f).rgb * w12.x * w0.y;
+    color += textureLod(samplerScene, vec2(texPos3.x,  texPos0.y),  0.0f).rgb * w3.x  * w0.y;
+
+    color += textureLod(samplerScene, vec2(texPos0.x,  texPos12.y), 0.0f).rgb * w0.x  * w12.y;
+    color += textureLod(samplerScene, vec2(texPos12.x, texPos12.y), 0.0f).rgb * w12.x * w12.y;
+    color += textureLod(samplerScene, vec2(texPos3.x,  texPos12.y), 0.0f).rgb * w3.x  * w12.y;
+
+    color += textureLod(samplerScene, vec2(texPos0.x,  texPos3.y),  0.0f).rgb * w0.x  * w3.y;
+    color += textureLod(samplerScene, vec2(texPos12.x, texPos3.y),  0.0f).rgb * w12.x * w3.y;
+    color += textureLod(samplerScene, vec2(texPos3.x,  texPos3.y),  0.0f).rgb * w3.x  * w3.y;
+
+    // Negative lobes can ring below zero around bright edges.
+    outFragColor = vec4(max(color, vec3(0.0f)), 1.0f);
+}
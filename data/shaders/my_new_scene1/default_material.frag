@@ -4,15 +4,14 @@
 #extension GL_ARB_shading_language_420pack : enable
 
 // Starts from 1 because vert shader has binding 0 on uniform buffer.
-// Layout of these bindings is defined in setupDescriptorSetLayout().
-// Pool for these bindings is created in setupDescriptorPool().
-// Descriptor sets are created in setupDescriptorSet().
+// Layout of these bindings is defined in vk229::SceneData::setupDescriptorSetLayout().
+// Pools and sets come from vk229::DescriptorAllocator - sets are shared through getCachedSet() in SceneData::setupDescriptorSets().
+// Order and channels are vk229::DEFAULT_MATERIAL_TEXTURE_ROLES - change both together, texture sets are checked against it.
 layout (binding = 1) uniform sampler2D samplerColor;
-layout (binding = 2) uniform sampler2D samplerDiffuseDI;
-layout (binding = 3) uniform sampler2D samplerAO;
-layout (binding = 4) uniform sampler2D samplerEmit;
-layout (binding = 5) uniform sampler2D samplerNormal;
-layout (binding = 6) uniform sampler2D samplerReflection;
+layout (binding = 2) uniform sampler2D samplerBaked;      // Packed at load time: DIFFUSE_DI in .rgb, AO in .a.
+layout (binding = 3) uniform sampler2D samplerEmit;
+layout (binding = 4) uniform sampler2D samplerNormal;
+layout (binding = 5) uniform samplerCube samplerReflection; // Converted from equirect. map at load time.
 
 layout (location = 0) in vec3 inNormal;
 layout (location = 1) in vec3 inTan;
@@ -23,55 +22,70 @@ layout (location = 5) in vec3 inViewVec;
 
 layout (location = 0) out vec4 outFragColor;
 
-#define PI            3.14159265359f
-#define AO_COEFF      0.25f
-#define EMIT_COEFF    1.0f
-#define DIFF_DI_COEFF 3.0f
-#define REFL_COEFF    2.0f
-#define REFL_BIAS     0.0f
-#define UV_SCALE      0.9375f
+// Material permutation - values are given by the pipeline (MaterialSpecData in HelperStructsAndFuncs.hpp).
+// Defaults here match getDefaultMaterial(). Disabled features are removed when the pipeline is compiled.
+layout (constant_id = 0) const bool  USE_NORMAL_MAP = true;
+layout (constant_id = 1) const bool  USE_REFLECTION = true;
+layout (constant_id = 2) const bool  USE_EMISSION   = true;
+layout (constant_id = 3) const bool  USE_AO         = true;
+layout (constant_id = 4) const float AO_COEFF       = 0.25f;
+layout (constant_id = 5) const float EMIT_COEFF     = 1.0f;
+layout (constant_id = 6) const float DIFF_DI_COEFF  = 3.0f;
+layout (constant_id = 7) const float REFL_COEFF     = 2.0f;
+layout (constant_id = 8) const float ROUGHNESS      = 0.0f; // Reflection cubemap mip level = ROUGHNESS * last level.
+layout (constant_id = 9) const float METALNESS      = 0.25f;
 
 void main() 
 {
     // Computing textures colors {
         vec4 COL  = texture(samplerColor,     inUV);
-        vec4 DDI  = texture(samplerDiffuseDI, inUV); // This is light received directly or indirectly
-        vec4 AO   = texture(samplerAO,        inUV);
-        vec4 EMIT = texture(samplerEmit,      inUV);
-        vec4 NORM = vec4(texture(samplerNormal, inUV).xyz*2.0f - 1.0f, 1.0f); // Mapping from 0..1 to -1..1; in tangent space.
+        vec4 BAKED = texture(samplerBaked,    inUV);
+        vec4 DDI  = vec4(BAKED.rgb, 1.0f);                                  // This is light received directly or indirectly
+        vec4 AO   = USE_AO       ? vec4(BAKED.a, 0.0f, 0.0f, 1.0f) : vec4(0.0f); // Same as sampled from BC4 before packing.
+        vec4 EMIT = USE_EMISSION ? texture(samplerEmit, inUV) : vec4(0.0f);
         vec4 REFLECT; // COORDS TO COMPUTE, TEXTURE TO SAMPLE.
     // }
 
     // Computing vectors {
-        // vec3 N = normalize(inNormal);
-        vec3 N = normalize(inTan*NORM.x - inBiTan*NORM.y + inNormal*NORM.z); // Computing normal in world pos.
+        vec3 N;
+        if (USE_NORMAL_MAP)
+        {
+            // Only X, Y are used (BC5 normal maps have no Z), Z is reconstructed - tangent space normals point outwards.
+            vec2 NORM_XY = texture(samplerNormal, inUV).xy*2.0f - 1.0f; // Mapping from 0..1 to -1..1; in tangent space.
+            vec3 NORM    = vec3(NORM_XY, sqrt(max(0.0f, 1.0f - dot(NORM_XY, NORM_XY))));
+            N = normalize(inTan*NORM.x - inBiTan*NORM.y + inNormal*NORM.z); // Computing normal in world pos.
+        }
+        else
+        {
+            N = normalize(inNormal);
+        }
         vec3 V = normalize(inViewVec);
-        vec3 R = reflect(-V, N);
     // }
 
-    // Computing UV coords for reflection texture {
-        float reflTh = acos(R.y);       // Theta //     0 .. pi
-        float reflFi = atan(R.x, -R.z); // Phi   //   -pi .. pi // Between -pi and pi value there is visible seam on object's reflection - it is less visible when taking negative LOD bias. 
-        vec2  reflUV = vec2(0.5f-reflFi/(2.0f*PI), // Computing U coord.
-                            1.0f-reflTh/PI)        // Computing V coord.
-                       * UV_SCALE                  // UV scaling according to map's content.
-                       + (1.0f-UV_SCALE)/2.0f;     // UV padding to center UV for map's content.
-    // }
+    float fresnel = 0.0f;
+    REFLECT = vec4(0.0f);
+    if (USE_REFLECTION)
+    {
+        vec3 R = reflect(-V, N);
 
-    // Computing textures colors - reflection {
-        REFLECT = texture(samplerReflection, reflUV, REFL_BIAS);
-    // }
+        // Computing textures colors - reflection {
+            // Prefiltered at load time - mip level m holds GGX roughness m / (levels - 1), one lookup, no filtering here.
+            // Never sharper than the footprint of the fragment, as with implicit LOD.
+            float lod = max(ROUGHNESS * float(textureQueryLevels(samplerReflection) - 1), textureQueryLod(samplerReflection, R).x);
+            REFLECT = textureLod(samplerReflection, R, lod);
+        // }
 
-    // Computing fresnel coefficient {
-        float met = 0.25f; // metalness
-        float dot = max( 0.0f, dot( N, V ) );
-        float fresnel = min(met*4.0f, met + ( 1.0f - met ) * pow( ( 1.0f - dot ), 5.0f ));
-    // }
+        // Computing fresnel coefficient {
+            float met = METALNESS;
+            float dot = max( 0.0f, dot( N, V ) );
+            fresnel = min(met*4.0f, met + ( 1.0f - met ) * pow( ( 1.0f - dot ), 5.0f ));
+        // }
+    }
 
     // Compositing final fragment color {
         outFragColor =
-                (1.0f - met) * COL * (DDI*DIFF_DI_COEFF + AO*AO_COEFF) // COLOR * LIGHT
-                + EMIT*EMIT_COEFF                                      // EMISSION
-                + REFLECT*REFL_COEFF*fresnel;                          // REFLECTION
+                (1.0f - METALNESS) * COL * (DDI*DIFF_DI_COEFF + AO*AO_COEFF) // COLOR * LIGHT
+                + EMIT*EMIT_COEFF                                            // EMISSION
+                + REFLECT*REFL_COEFF*fresnel;                                // REFLECTION
     // }
 }
@@ -4,12 +4,28 @@
 #extension GL_ARB_shading_language_420pack : enable
 
 // Layout of these vertex attributes is defined in preparePipelines().
+#ifdef COMPACT_VERTEX
+// CompactVertex (MeshData.hpp) - built as default_transforms_compact.vert.spv.
+layout (location = 0) in vec4 inPosQ;    // SNORM16, w = bitangent sign
+layout (location = 1) in vec2 inNormalQ; // Octahedral SNORM16
+layout (location = 2) in vec2 inTanQ;    // Octahedral SNORM16
+layout (location = 4) in vec2 inUV;      // Half float
+#else
 layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec3 inTan;
 layout (location = 3) in vec3 inBiTan;
 layout (location = 4) in vec2 inUV;
 layout (location = 5) in vec3 inColor;
+#endif
+
+// EntityPushConstants - per-mesh position dequantization (only for compact vertices) and entity's world matrix index.
+layout (push_constant) uniform EntityPushConstants
+{
+    vec4 posScale;
+    vec4 posOffset;
+    uint transformIndex;
+} mesh;
 
 // Layout of these bindings is defined in setupDescriptorSetLayout().
 layout (binding = 0) uniform UBO 
@@ -19,6 +35,12 @@ layout (binding = 0) uniform UBO
 //    vec4 camPos;
 } ubo;
 
+// World matrices of transform nodes, see SceneData::updateTransforms().
+layout (std430, set = 1, binding = 0) readonly buffer Transforms
+{
+    mat4 world[];
+} transforms;
+
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec3 outTan;
 layout (location = 2) out vec3 outBiTan;
@@ -26,17 +48,42 @@ layout (location = 3) out vec2 outUV;
 layout (location = 4) out vec3 outColor;
 layout (location = 5) out vec3 outViewVec;
 
+// Same depth as in depth_prepass.vert - required by VK_COMPARE_OP_EQUAL after the pre-pass.
+invariant gl_Position;
+
+#ifdef COMPACT_VERTEX
+// Inverse of octEncode() in MeshData.hpp.
+vec3 octDecode(vec2 e)
+{
+    vec3  v = vec3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0f);
+    v.xy += mix(vec2(t), vec2(-t), greaterThanEqual(v.xy, vec2(0.0f)));
+    return normalize(v);
+}
+#endif
 
 void main() 
 {
+#ifdef COMPACT_VERTEX
+    vec3 inPos    = inPosQ.xyz * mesh.posScale.xyz + mesh.posOffset.xyz;
+    vec3 inNormal = octDecode(inNormalQ);
+    vec3 inTan    = octDecode(inTanQ);
+    vec3 inBiTan  = cross(inNormal, inTan) * inPosQ.w;
+    vec3 inColor  = vec3(1.0f);
+#endif
+
     vec4 camPos = inverse(ubo.view) * vec4(0.0f, 0.0f, 0.0f, 1.0f);
 
-    gl_Position = ubo.projection * ubo.view * vec4(inPos, 1.0);
-    outNormal   = inNormal;
+    mat4 model    = transforms.world[mesh.transformIndex];
+    vec4 worldPos = model * vec4(inPos, 1.0);
+    mat3 rotScale = mat3(model); // Uniform scale only - no inverse transpose for normals.
+
+    gl_Position = ubo.projection * ubo.view * worldPos;
+    outNormal   = normalize(rotScale * inNormal);
     outColor    = inColor;
     outUV       = inUV * vec2(1.0, -1.0);
-    outViewVec  = camPos.xyz - inPos;
-    outTan      = inTan;
-    outBiTan    = inBiTan;
+    outViewVec  = camPos.xyz - worldPos.xyz;
+    outTan      = normalize(rotScale * inTan);
+    outBiTan    = normalize(rotScale * inBiTan);
 
 }
@@ -0,0 +1,41 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Depth-only pre-pass, position-only vertex stream (PositionVertex / CompactPositionVertex).
+// Position math has to stay identical to default_transforms.vert.
+#ifdef COMPACT_VERTEX
+layout (location = 0) in vec4 inPosQ; // SNORM16, w unused here
+#else
+layout (location = 0) in vec3 inPos;
+#endif
+
+layout (push_constant) uniform EntityPushConstants
+{
+    vec4 posScale;
+    vec4 posOffset;
+    uint transformIndex;
+} mesh;
+
+layout (binding = 0) uniform UBO 
+{
+    mat4 view;
+    mat4 projection;
+} ubo;
+
+layout (std430, set = 1, binding = 0) readonly buffer Transforms
+{
+    mat4 world[];
+} transforms;
+
+invariant gl_Position;
+
+void main() 
+{
+#ifdef COMPACT_VERTEX
+    vec3 inPos = inPosQ.xyz * mesh.posScale.xyz + mesh.posOffset.xyz;
+#endif
+
+    gl_Position = ubo.projection * ubo.view * (transforms.world[mesh.transformIndex] * vec4(inPos, 1.0));
+}
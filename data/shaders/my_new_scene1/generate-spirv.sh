@@ -10,6 +10,13 @@ for type in vert frag; do
     done
 done
 
+# Compact vertex format variants (SceneInfo::useCompactVertices).
+for i in default_transforms depth_prepass; do
+    cmd="glslc -DCOMPACT_VERTEX $i.vert -o ${i}_compact.vert.spv"
+    printf "\n    >>> $cmd\n"
+    eval $cmd
+done
+
 # pyshaderc way (installable by python's PIP)
 #../../../tools/compile_shaders_glsl_to_spv_here.py vert ./*vert
 #../../../tools/compile_shaders_glsl_to_spv_here.py frag ./*frag
@@ -11,8 +11,12 @@
 #include <string.h>
 #include <assert.h>
 #include <time.h> 
+#include <stddef.h>
+#include <algorithm>
 #include <vector>
 #include <random>
+#include <sstream>
+#include <iomanip>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -24,17 +28,47 @@
 #include "VulkanBuffer.hpp"
 #include "VulkanTexture.hpp"
 #include "VulkanModel.hpp"
+#include <PipelineCompiler.hpp>
+#include <HiZPyramid.hpp>
+#include <DynamicResolution.hpp>
+#include <ShadowCubeMap.hpp>
+#include <RenderGraph.hpp>
+#include <RockField.hpp>
+#include <InstanceRing.hpp>
+#include <CameraPath.hpp>
+#include <ProceduralSphere.hpp>
+#include <DescriptorAllocator.hpp>
+#include <GpuProfiler.hpp>
+#include <VkCallStats.hpp>
 
 #define VERTEX_BUFFER_BIND_ID   0
 #define INSTANCE_BUFFER_BIND_ID 1
-#define DESCRIPTOR_COUNT        4
 #define ENABLE_VALIDATION       false
 #define LIGHT_INTENSITY         100
 #define INSTANCE_COUNT          2048
-#define PLANET_SCALE            2.5f
-#define LIGHT_SCALE             0.025f
+#define PLANET_SCALE            2.5f    // Radius of the planet
+#define PLANET_DISPLACEMENT     0.05f   // Relief from planet's texture, relative to the radius - 0 for a smooth sphere
+#define LIGHT_SPHERE_RADIUS     0.5f    // Radius of light's sphere
+#define SPHERE_SHADER_STAGES    (VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT)
 #define CONSTRUCT_SCALE         16.0f
 #define INSTANCE_SCALE          0.15f
+#define CULL_GROUP_SIZE         64
+#define DYNRES_TARGET_MS        (1000.0f / 60.0f * 0.9f) // GPU time per frame, with some headroom for 60 FPS
+#define LIGHT_RADIUS            0.4f    // Size of the light for planet's penumbra - not the size of light's model
+#define SHADOW_MAP_SIZE         1024    // SHADOW_TEXEL_ANGLE in receivers' shaders has to match
+#define SHADOW_FAR              128.0f
+#define SHADOW_LIGHT_THRESHOLD  0.1f    // Shadow cube map is refreshed when the light moves by more than this...
+#define SHADOW_SPIN_THRESHOLD   0.05f   // ...or rocks spin by more than this (rad)...
+#define SHADOW_ORBIT_THRESHOLD  0.001f  // ...or rings turn by more than this (rad).
+#define ENABLE_GPU_PROFILER     false   // GPU cost per draw and pass at start, F3 switches it at runtime, see vk229::GpuProfiler
+#define GPU_PROFILER_ROWS       8
+#define GPU_PROFILER_CSV        "gpu_profile_instancing-229.csv"
+#define VK_CALL_STATS_CSV       "vk_calls_instancing-229.csv"   // Written at exit when built with VK229_CALL_STATS.
+#define ROCK_CHURN_RUNS         8       // Runs of rocks respawned every frame when rock churn (T) is on...
+#define ROCK_CHURN_RUN_LENGTH   4       // ...of this many consecutive rocks.
+#define CAMERA_PATH_ROCK_SEED   229u    // Rocks of runs recording or playing a camera path, random otherwise.
+#define CAMERA_PATH_CSV         "camera_path_instancing-229.csv"  // Frames of camera path playback.
+#define CAMERA_PATH_WORST       5       // Slowest frames of playback printed with their camera pose.
 
 /////////////////////////////////////////////////
 /// ADDING AN OBJECT:
@@ -48,11 +82,7 @@
 ///     * vkCmdBindVertexBuffers
 ///     * vkCmdBindIndexBuffer
 ///     * vkCmdDraw
-/// * resize descriptor pool size for:
-///     * uniform buffers
-///     * image samplers
-///     * create correct VkDescriptorPoolCreateInfo
-/// * allocate descriptor sets, and update them
+/// * get object's descriptor set from descriptorAllocator (getCachedSet), pools grow on their own
 /// * create graphics pipeline using shaders, pipeline create info and object's pipeline
 /// * destroy:
 ///     * pipeline
@@ -81,25 +111,145 @@ public:
 
     struct {
         vks::Model rockModel;
-        vks::Model planetModel;
-        vks::Model lightModel;
         vks::Model constructModel;
     } models;
 
+    /////////////////////////////////////////////////
+    /// PROCEDURAL SPHERES:
+    /// * planet and light have no meshes - sphere.vert emits the 20 patches of an icosahedron from a table,
+    ///   sphere.tesc picks their tessellation from screen-space error (vk229::SpherePushConstants in push constants)
+    /// * sphere.tese projects vertices onto the sphere and displaces the planet by its texture (PLANET_DISPLACEMENT)
+    /// * triangle count follows projected size of the sphere, patches behind the horizon are dropped
+    /////////////////////////////////////////////////
+
     // Per-instance data block
-    struct InstanceData {
-        glm::vec3 pos;
-        glm::vec3 rot;
-        float scale;
-        uint32_t texIndex;
+    using InstanceData = vk229::RockInstance;
+
+    /////////////////////////////////////////////////
+    /// DYNAMIC ROCKS:
+    /// * instance data is a vk229::InstanceRing with a slot per swapchain image, command buffers of image i read slot i
+    ///   (vertex buffer offset in the shadow pass, dynamic storage buffer offset in the cull pass)
+    /// * rocks can be added, removed (zero scale) or moved on the CPU at any time - draw() uploads only the changed
+    ///   ranges to the slot of the frame, after the frame which used the slot before has finished
+    /// * T switches rock churn - ROCK_CHURN_RUNS runs of rocks are respawned at new places every frame
+    /////////////////////////////////////////////////
+    struct {
+        vk229::InstanceRing ring;
+        std::mt19937 rndGenerator;
+        bool churnEnabled = false;
+    } rocks;
+
+    /////////////////////////////////////////////////
+    /// GPU CULLING OF ROCKS:
+    /// * planet and construct are drawn depth-only into the occluder depth (render graph transient)
+    /// * hiZ pyramid is built from it (hiz_reduce.comp)
+    /// * cull_instances.comp tests every rock's bounding sphere against frustum and pyramid,
+    ///   visible ones are compacted into culledInstances and counted in indirectDraw
+    /// * rocks are drawn with vkCmdDrawIndexedIndirect
+    /// Everything runs on the GPU, so prebuilt command buffers stay valid while the camera moves.
+    /////////////////////////////////////////////////
+    struct CullParams {
+        uint32_t instanceCount;
+        float modelRadius;
+        uint32_t hiZMipCount;
+        uint32_t occlusionEnabled;
+    };
+
+    struct {
+        vk229::HiZPyramid hiZ;
+        VkPipelineShaderStageCreateInfo hiZReduceShaderStage;
+        vks::Buffer culledInstances;      // Instance data of visible rocks
+        vks::Buffer indirectDraw;         // VkDrawIndexedIndirectCommand, instanceCount is written by the cull shader
+        vks::Buffer visibleCountReadback; // instanceCount of the last frame, for the overlay
+        VkDescriptorSetLayout descriptorSetLayout;
+        VkPipelineLayout pipelineLayout;
+        VkPipeline pipeline;
+        VkDescriptorSet descriptorSet;
+        float rockRadius = 0.0f;
+        bool occlusionEnabled = true;
+    } culling;
+
+    /////////////////////////////////////////////////
+    /// DYNAMIC RESOLUTION:
+    /// * scene is rendered into the top-left part of full size scene color, at controller's scale of the window size
+    /// * upscale.frag filters it (bicubic) into the swapchain image
+    /// * GPU time of every frame is measured with timestamps and fed to the controller,
+    ///   command buffers are rebuilt when the (quantized) scale changes
+    /////////////////////////////////////////////////
+    struct {
+        vk229::FrameTimeController controller;
+        vk229::GpuFrameTimer gpuTimer;
+        VkSampler sampler;                // Linear, bicubic upscale is built from bilinear taps
+        VkDescriptorSetLayout descriptorSetLayout; // Set per command buffer, from its frame's pools - see recordUpscale()
+        VkPipelineLayout pipelineLayout;
+        VkPipeline pipeline;
+        float lastFrameMs = 0.0f;
+        bool enabled = true;
+    } dynamicResolution;
+
+    /////////////////////////////////////////////////
+    /// FRAME GRAPH:
+    /// * whole frame except the cached shadow pass is a vk229::RenderGraph, see setupRenderGraph() for passes
+    /// * graph records barriers between them, occluder depth, scene color and scene depth are its transients
+    ///   (occluder and scene depth share memory)
+    /// * it is recompiled on resize and when occlusion culling is switched - without occlusion culling
+    ///   nothing reads the Hi-Z pyramid, so occluder and Hi-Z passes are culled
+    /////////////////////////////////////////////////
+    struct {
+        vk229::RenderGraph graph;
+        vk229::RenderGraph::pass_id_t occluderPass;
+        vk229::RenderGraph::pass_id_t scenePass;
+        vk229::RenderGraph::pass_id_t upscalePass;
+        vk229::RenderGraph::resource_id_t sceneColor;
+        uint32_t width  = 0;              // Window size the graph has been compiled for
+        uint32_t height = 0;
+    } frameGraph;
+
+    // GPU time and pipeline statistics of every draw / pass of the frame graph (not of the shadow pass).
+    vk229::GpuProfiler gpuProfiler;
+
+    /////////////////////////////////////////////////
+    /// CAMERA PATHS (command line, see vk229::parseCameraPathOptions):
+    /// * --camera-record <file> - camera is recorded every frame, N starts a new segment, saved at exit
+    /// * --camera-play <file> - camera follows the path at a fixed time step, which also drives the light and rocks;
+    ///   rocks come from a fixed seed and dynamic resolution is off, so runs render the same frames.
+    ///   When the path ends, frame times per segment and the slowest frames are printed, all frames are
+    ///   exported to CAMERA_PATH_CSV and the example quits.
+    /////////////////////////////////////////////////
+    struct {
+        vk229::CameraPathOptions options;
+        vk229::CameraPath path;
+        vk229::CameraPathPlayback playback;
+        float recordTime = 0.0f;
+    } cameraPath;
+
+    /////////////////////////////////////////////////
+    /// ROCK SHADOWS:
+    /// * all rocks are drawn from the light into vk229::ShadowCubeMap (shadow.vert/frag), in a separate command buffer
+    /// * it is submitted only when the light or rocks have moved by more than SHADOW_*_THRESHOLD since the last one,
+    ///   otherwise receivers keep using the cached map (and the light position it was rendered from)
+    /// * planet's shadow stays analytic - its penumbra constants are computed once per frame on the CPU
+    /////////////////////////////////////////////////
+    struct ShadowUBO {
+        glm::mat4 faceViewProj[6];
+        glm::vec4 lightPos;           // w - far distance
+        float locSpeed  = 0.0f;
+        float globSpeed = 0.0f;
     };
-    // Contains the instanced data
-    struct InstanceBuffer {
-        VkBuffer buffer       = VK_NULL_HANDLE;
-        VkDeviceMemory memory = VK_NULL_HANDLE;
-        size_t size           = 0;
-        VkDescriptorBufferInfo descriptor;
-    } instanceBuffer;
+
+    struct {
+        vk229::ShadowCubeMap cubeMap;
+        ShadowUBO ubo;
+        vks::Buffer uniformBuffer;
+        VkDescriptorSetLayout descriptorSetLayout;
+        VkPipelineLayout pipelineLayout;
+        VkPipeline pipeline;
+        VkDescriptorSet descriptorSet;
+        std::vector<VkCommandBuffer> cmdBuffers; // Per ring slot of rocks
+        bool dirty = true;
+        uint32_t refreshCount = 0;
+        uint32_t framesSinceRefresh = 0;
+    } shadow;
 
     // M V P
     // M - MODEL MAT      - model space -> world space
@@ -116,8 +266,14 @@ public:
         float lightInt  = 0.0f;
         float locSpeed  = 0.0f;
         float globSpeed = 0.0f;
+        float pad0      = 0.0f;       // std140 - vec4 below starts at 16 bytes boundary
+        glm::vec4 lightPosNear;       // w - planet's angular radius from there, see updatePlanetShadowConstants()
+        glm::vec4 lightPosFar;        // w - planet's angular radius from there
+        glm::vec4 shadowLightPos;     // w - far distance of the shadow cube map
     } uboVS;
 
+    vk229::LightOrbit lightOrbit;
+
     struct {
         vks::Buffer scene;
     } uniformBuffers;
@@ -128,8 +284,14 @@ public:
         VkPipeline planetVkPipeline;
         VkPipeline lightVkPipeline;
         VkPipeline constructVkPipeline;
+        VkPipeline occluderVkPipeline;
+        VkPipeline planetOccluderVkPipeline;
     } pipelines;
 
+    /// All set layouts and descriptor sets of the example - pools grow on demand, immutable sets are cached by contents,
+    /// sets recorded into command buffer i come from frame i pools, which are reset when it is rebuilt.
+    vk229::DescriptorAllocator descriptorAllocator;
+
     VkDescriptorSetLayout descriptorSetLayout;
     struct {
         VkDescriptorSet instancedRocksVkDescrSet;
@@ -148,26 +310,81 @@ public:
         zoom = -48.0f;
         rotationSpeed = 0.25f;
         camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 1024.0f);
+
+        cameraPath.options = vk229::parseCameraPathOptions(args);
+        if (false == cameraPath.options.playFile.empty() && cameraPath.path.load(cameraPath.options.playFile))
+        {
+            cameraPath.playback.start(&cameraPath.path, cameraPath.options.timeStep);
+            dynamicResolution.enabled = false;
+        }
+    }
+
+    /// Pipeline statistics queries of the GPU profiler need a feature, procedural spheres need tessellation.
+    void getEnabledFeatures() override
+    {
+        if (deviceFeatures.pipelineStatisticsQuery)
+        {
+            enabledFeatures.pipelineStatisticsQuery = VK_TRUE;
+        }
+        if (deviceFeatures.tessellationShader)
+        {
+            enabledFeatures.tessellationShader = VK_TRUE;
+        }
+        else
+        {
+            vks::tools::exitFatal("Selected GPU does not support tessellation shaders, planet and light cannot be drawn!", "Error");
+        }
     }
 
     ~VulkanExample()
     {
+        if (vk229::VkCallStats::isEnabled())
+        {
+            vk229::VkCallStats::exportCsv(VK_CALL_STATS_CSV);
+        }
+        if (false == cameraPath.options.recordFile.empty())
+        {
+            cameraPath.path.save(cameraPath.options.recordFile);
+        }
+
         vkDestroyPipeline(device, pipelines.instancedRocksVkPipeline, nullptr);
         vkDestroyPipeline(device, pipelines.planetVkPipeline, nullptr);
         vkDestroyPipeline(device, pipelines.lightVkPipeline, nullptr);
         vkDestroyPipeline(device, pipelines.constructVkPipeline, nullptr);
+        vkDestroyPipeline(device, pipelines.occluderVkPipeline, nullptr);
+        vkDestroyPipeline(device, pipelines.planetOccluderVkPipeline, nullptr);
+        vkDestroyPipeline(device, culling.pipeline, nullptr);
+        vkDestroyPipeline(device, dynamicResolution.pipeline, nullptr);
+        vkDestroyPipeline(device, shadow.pipeline, nullptr);
 
         vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        vkDestroyPipelineLayout(device, culling.pipelineLayout, nullptr);
+        vkDestroyPipelineLayout(device, dynamicResolution.pipelineLayout, nullptr);
+        vkDestroyPipelineLayout(device, shadow.pipelineLayout, nullptr);
+
+        descriptorAllocator.destroy();
 
-        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+        frameGraph.graph.reset();
 
-        vkDestroyBuffer(device, instanceBuffer.buffer, nullptr);
+        vkDestroySampler(device, dynamicResolution.sampler, nullptr);
+        dynamicResolution.gpuTimer.destroy();
+        gpuProfiler.destroy();
 
-        vkFreeMemory(device, instanceBuffer.memory, nullptr);
+        if (false == shadow.cmdBuffers.empty())
+        {
+            vkFreeCommandBuffers(device, cmdPool, shadow.cmdBuffers.size(), shadow.cmdBuffers.data());
+        }
+        shadow.cubeMap.destroy();
+        shadow.uniformBuffer.destroy();
+
+        culling.hiZ.destroy();
+        culling.culledInstances.destroy();
+        culling.indirectDraw.destroy();
+        culling.visibleCountReadback.destroy();
+
+        rocks.ring.destroy();
 
         models.rockModel.destroy();
-        models.planetModel.destroy();
-        models.lightModel.destroy();
         models.constructModel.destroy();
 
         textures.rocksTex2DArr.destroy();
@@ -180,81 +397,283 @@ public:
 
     void buildCommandBuffers() override
     {
-        VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+        vk229::VkCallStats::PhaseScope callStatsPhase(vk229::VkCallStats::phase_t::BUILD);
 
-        VkClearValue clearValues[2];
-        clearValues[0].color = { { 0.005f, 0.005f, 0.005f, 0.0f } };
-        clearValues[1].depthStencil = { 1.0f, 0u };
+        // Base class rebuilds command buffers right after the swapchain has been recreated, before windowResized().
+        if (frameGraph.width != width || frameGraph.height != height)
+        {
+            resizeFrameResources();
+        }
 
-        VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-        renderPassBeginInfo.renderPass = renderPass;
-        renderPassBeginInfo.renderArea.extent.width = width;
-        renderPassBeginInfo.renderArea.extent.height = height;
-        renderPassBeginInfo.clearValueCount = 2;
-        renderPassBeginInfo.pClearValues = clearValues;
+        VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
         for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
         {
-            // Set target frame buffer
-            renderPassBeginInfo.framebuffer = frameBuffers[i];
+            // Callers wait for the queue before rebuilding, sets of the old command buffer are not used anymore.
+            descriptorAllocator.resetFrame(i);
 
             VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
-            vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+            dynamicResolution.gpuTimer.writeBegin(drawCmdBuffers[i], i);
+            gpuProfiler.beginFrame(drawCmdBuffers[i], i);
+
+            frameGraph.graph.record(drawCmdBuffers[i], i);
+
+            dynamicResolution.gpuTimer.writeEnd(drawCmdBuffers[i], i);
+
+            VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+        }
+    }
+
+    /// Frame passes, in execution order. Barriers between them come from declared accesses.
+    void setupRenderGraph()
+    {
+        using PassType = vk229::RenderGraph::PassType;
+        using Usage    = vk229::RenderGraph::ResourceUsage;
 
-            VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-            vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+        const VkClearColorValue        clearColor = { { 0.005f, 0.005f, 0.005f, 0.0f } };
+        const VkClearDepthStencilValue clearDepth = { 1.0f, 0u };
 
-            VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-            vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+        vk229::RenderGraph& graph = frameGraph.graph;
+        graph.reset();
 
-            VkDeviceSize offsets[1] = { 0 };
+        std::vector<VkImage>     swapchainImages;
+        std::vector<VkImageView> swapchainViews;
+        for (uint32_t i = 0; i < swapChain.imageCount; i++)
+        {
+            swapchainImages.push_back(swapChain.buffers[i].image);
+            swapchainViews.push_back(swapChain.buffers[i].view);
+        }
 
-            // Planet
-            vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.planetVkDescrSet, 0, NULL);
-            vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.planetVkPipeline);
-            vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &models.planetModel.vertices.buffer, offsets);
-            vkCmdBindIndexBuffer(drawCmdBuffers[i], models.planetModel.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-            vkCmdDrawIndexed(drawCmdBuffers[i], models.planetModel.indexCount, 1, 0, 0, 0);
+        const auto swapchain       = graph.importSwapchain("swapchain", swapchainImages, swapchainViews, swapChain.colorFormat, width, height);
+        const auto occluderDepth   = graph.createImage("occluder-depth", depthFormat, width, height);
+        const auto sceneDepth      = graph.createImage("scene-depth", depthFormat, width, height);
+        frameGraph.sceneColor      = graph.createImage("scene-color", swapChain.colorFormat, width, height);
+        const auto hiZPyramid      = graph.importImage("hiz-pyramid", culling.hiZ.getImage(), culling.hiZ.getView(), VK_FORMAT_R32_SFLOAT,
+                                                       culling.hiZ.getPyramidWidth(), culling.hiZ.getPyramidHeight());
+        const auto culledInstances = graph.importBuffer("culled-instances", culling.culledInstances.buffer);
+        const auto indirectDraw    = graph.importBuffer("indirect-draw", culling.indirectDraw.buffer);
+        const auto countReadback   = graph.importBuffer("count-readback", culling.visibleCountReadback.buffer);
+
+        // Reset visible instance count
+        graph.addPass("cull-reset", PassType::TRANSFER, [this](VkCommandBuffer cmd, uint32_t) {
+            const uint32_t zero = 0;
+            vkCmdUpdateBuffer(cmd, culling.indirectDraw.buffer, offsetof(VkDrawIndexedIndirectCommand, instanceCount), sizeof(uint32_t), &zero);
+        })
+            .write(indirectDraw, Usage::TRANSFER_WRITE);
+
+        frameGraph.occluderPass = graph.addPass("occluders", PassType::RASTER, [this](VkCommandBuffer cmd, uint32_t frameIndex) {
+            gpuProfiler.beginScope(cmd, frameIndex, "occluders");
+            recordOccluders(cmd);
+            gpuProfiler.endScope(cmd, frameIndex);
+        })
+            .depthAttachment(occluderDepth, &clearDepth)
+            .getId();
+
+        graph.addPass("hiz-build", PassType::COMPUTE, [this](VkCommandBuffer cmd, uint32_t frameIndex) {
+            gpuProfiler.beginScope(cmd, frameIndex, "hiz-build");
+            culling.hiZ.recordBuild(cmd);
+            gpuProfiler.endScope(cmd, frameIndex);
+        })
+            .read(occluderDepth, Usage::SAMPLED_COMPUTE)
+            .write(hiZPyramid, Usage::SHADER_WRITE_COMPUTE);
+
+        vk229::RenderGraph::PassBuilder cullPass = graph.addPass("cull", PassType::COMPUTE, [this](VkCommandBuffer cmd, uint32_t frameIndex) {
+            gpuProfiler.beginScope(cmd, frameIndex, "cull");
+            recordCulling(cmd, frameIndex);
+            gpuProfiler.endScope(cmd, frameIndex);
+        })
+            .write(culledInstances, Usage::SHADER_WRITE_COMPUTE)
+            .write(indirectDraw, Usage::SHADER_WRITE_COMPUTE);
+        if (culling.occlusionEnabled)
+        {
+            cullPass.read(hiZPyramid, Usage::SHADER_READ_COMPUTE);
+        }
 
-            // Light
-            vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.lightVkDescrSet, 0, NULL);
-            vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.lightVkPipeline);
-            vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &models.lightModel.vertices.buffer, offsets);
-            vkCmdBindIndexBuffer(drawCmdBuffers[i], models.lightModel.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-            vkCmdDrawIndexed(drawCmdBuffers[i], models.lightModel.indexCount, 1, 0, 0, 0);
+        // Visible count for the overlay, read by the host after the frame has been waited for
+        graph.addPass("count-readback", PassType::TRANSFER, [this](VkCommandBuffer cmd, uint32_t) {
+            VkBufferCopy countCopy = {};
+            countCopy.srcOffset = offsetof(VkDrawIndexedIndirectCommand, instanceCount);
+            countCopy.size      = sizeof(uint32_t);
+            vkCmdCopyBuffer(cmd, culling.indirectDraw.buffer, culling.visibleCountReadback.buffer, 1, &countCopy);
+        })
+            .read(indirectDraw, Usage::TRANSFER_READ)
+            .write(countReadback, Usage::TRANSFER_WRITE)
+            .sideEffect();
+
+        frameGraph.scenePass = graph.addPass("scene", PassType::RASTER, [this](VkCommandBuffer cmd, uint32_t frameIndex) { recordScene(cmd, frameIndex); })
+            .colorAttachment(frameGraph.sceneColor, &clearColor)
+            .depthAttachment(sceneDepth, &clearDepth)
+            .read(indirectDraw, Usage::INDIRECT_READ)
+            .read(culledInstances, Usage::VERTEX_READ)
+            .getId();
+
+        frameGraph.upscalePass = graph.addPass("upscale", PassType::RASTER, [this](VkCommandBuffer cmd, uint32_t frameIndex) {
+            gpuProfiler.beginScope(cmd, frameIndex, "upscale");
+            recordUpscale(cmd, frameIndex);
+            gpuProfiler.endScope(cmd, frameIndex);
+        })
+            .colorAttachment(swapchain, &clearColor)
+            .read(frameGraph.sceneColor, Usage::SAMPLED_FRAGMENT)
+            .getId();
+
+        graph.compile(vulkanDevice);
+
+        const VkImageView occluderDepthView = graph.getImageView(occluderDepth);
+        if (occluderDepthView != VK_NULL_HANDLE)
+        {
+            culling.hiZ.setOccluderDepth(occluderDepthView);
+        }
 
-            // Construct
-            vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.constructVkDescrSet, 0, NULL);
-            vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.constructVkPipeline);
-            vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &models.constructModel.vertices.buffer, offsets);
-            vkCmdBindIndexBuffer(drawCmdBuffers[i], models.constructModel.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-            vkCmdDrawIndexed(drawCmdBuffers[i], models.constructModel.indexCount, 1, 0, 0, 0);
+        frameGraph.width  = width;
+        frameGraph.height = height;
+    }
 
-            // Instanced rocks
-            vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.instancedRocksVkDescrSet, 0, NULL);
-            vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.instancedRocksVkPipeline);
-            // Binding point 0 : Mesh vertex buffer
-            vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &models.rockModel.vertices.buffer, offsets);
-            // Binding point 1 : Instance data buffer
-            vkCmdBindVertexBuffers(drawCmdBuffers[i], INSTANCE_BUFFER_BIND_ID, 1, &instanceBuffer.buffer, offsets);
+    /// Window size dependent resources - Hi-Z pyramid and the graph (with its transients).
+    void resizeFrameResources()
+    {
+        culling.hiZ.resize(width, height);
 
-            vkCmdBindIndexBuffer(drawCmdBuffers[i], models.rockModel.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+        VkDescriptorImageInfo hiZDescriptor = culling.hiZ.getDescriptor();
+        VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(culling.descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &hiZDescriptor);
+        vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, NULL);
 
-            // Render instances
-            vkCmdDrawIndexed(drawCmdBuffers[i], models.rockModel.indexCount, INSTANCE_COUNT, 0, 0, 0);
+        setupRenderGraph();
+    }
 
-            vkCmdEndRenderPass(drawCmdBuffers[i]);
+    /// Planet at the origin, displaced by its texture - tessellated for a render target of viewportHeight pixels.
+    vk229::SpherePushConstants getPlanetSphere(uint32_t viewportHeight) const
+    {
+        vk229::SpherePushConstants sphere;
+        sphere.centerRadius   = glm::vec4(0.0f, 0.0f, 0.0f, PLANET_SCALE);
+        sphere.displacement   = PLANET_DISPLACEMENT;
+        sphere.viewportHeight = float(viewportHeight);
+        return sphere;
+    }
 
-            VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
-        }
+    /// Light's sphere follows lightPos of the uniform buffer, so command buffers stay valid while it moves.
+    vk229::SpherePushConstants getLightSphere(uint32_t viewportHeight) const
+    {
+        vk229::SpherePushConstants sphere;
+        sphere.centerRadius   = glm::vec4(0.0f, 0.0f, 0.0f, LIGHT_SPHERE_RADIUS);
+        sphere.followsLight   = 1u;
+        sphere.viewportHeight = float(viewportHeight);
+        return sphere;
+    }
+
+    /// Planet and construct, depth only.
+    void recordOccluders(VkCommandBuffer cmd)
+    {
+        VkDeviceSize offsets[1] = { 0 };
+
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.planetVkDescrSet, 0, NULL);
+
+        const vk229::SpherePushConstants planetSphere = getPlanetSphere(height);
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.planetOccluderVkPipeline);
+        vkCmdPushConstants(cmd, pipelineLayout, SPHERE_SHADER_STAGES, 0, sizeof(planetSphere), &planetSphere);
+        vkCmdDraw(cmd, SPHERE_PATCH_VERTEX_COUNT, 1, 0, 0);
+
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.occluderVkPipeline);
+        vkCmdBindVertexBuffers(cmd, VERTEX_BUFFER_BIND_ID, 1, &models.constructModel.vertices.buffer, offsets);
+        vkCmdBindIndexBuffer(cmd, models.constructModel.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+        vkCmdDrawIndexed(cmd, models.constructModel.indexCount, 1, 0, 0, 0);
+    }
+
+    /// Cull dispatch - frustum, and Hi-Z pyramid if occlusion culling is on. Reads rocks from the ring slot of the frame.
+    void recordCulling(VkCommandBuffer cmd, uint32_t frameIndex)
+    {
+        const uint32_t instancesOffset = uint32_t(rocks.ring.getSlotOffset(frameIndex));
+
+        CullParams cullParams;
+        cullParams.instanceCount    = INSTANCE_COUNT;
+        cullParams.modelRadius      = culling.rockRadius;
+        cullParams.hiZMipCount      = culling.hiZ.getMipCount();
+        cullParams.occlusionEnabled = culling.occlusionEnabled ? 1u : 0u;
+
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, culling.pipeline);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, culling.pipelineLayout, 0, 1, &culling.descriptorSet, 1, &instancesOffset);
+        vkCmdPushConstants(cmd, culling.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullParams), &cullParams);
+        vkCmdDispatch(cmd, (INSTANCE_COUNT + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+    }
+
+    /// Scene, at scaled resolution - into the top-left part of scene color. Every draw is a profiler scope.
+    void recordScene(VkCommandBuffer cmd, uint32_t frameIndex)
+    {
+        VkDeviceSize offsets[1] = { 0 };
+
+        const VkExtent2D extent = vk229::getScaledExtent(width, height, dynamicResolution.controller.getScale());
+
+        VkViewport viewport = vks::initializers::viewport((float)extent.width, (float)extent.height, 0.0f, 1.0f);
+        vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+        VkRect2D scissor = vks::initializers::rect2D(extent.width, extent.height, 0, 0);
+        vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+        // Planet - procedural sphere, tessellated for the scaled extent
+        const vk229::SpherePushConstants planetSphere = getPlanetSphere(extent.height);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.planetVkDescrSet, 0, NULL);
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.planetVkPipeline);
+        vkCmdPushConstants(cmd, pipelineLayout, SPHERE_SHADER_STAGES, 0, sizeof(planetSphere), &planetSphere);
+        gpuProfiler.beginScope(cmd, frameIndex, "planet");
+        vkCmdDraw(cmd, SPHERE_PATCH_VERTEX_COUNT, 1, 0, 0);
+        gpuProfiler.endScope(cmd, frameIndex);
+
+        // Light - procedural sphere around the light position of the uniform buffer
+        const vk229::SpherePushConstants lightSphere = getLightSphere(extent.height);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.lightVkDescrSet, 0, NULL);
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.lightVkPipeline);
+        vkCmdPushConstants(cmd, pipelineLayout, SPHERE_SHADER_STAGES, 0, sizeof(lightSphere), &lightSphere);
+        gpuProfiler.beginScope(cmd, frameIndex, "light");
+        vkCmdDraw(cmd, SPHERE_PATCH_VERTEX_COUNT, 1, 0, 0);
+        gpuProfiler.endScope(cmd, frameIndex);
+
+        // Construct
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.constructVkDescrSet, 0, NULL);
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.constructVkPipeline);
+        vkCmdBindVertexBuffers(cmd, VERTEX_BUFFER_BIND_ID, 1, &models.constructModel.vertices.buffer, offsets);
+        vkCmdBindIndexBuffer(cmd, models.constructModel.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+        gpuProfiler.beginScope(cmd, frameIndex, "construct");
+        vkCmdDrawIndexed(cmd, models.constructModel.indexCount, 1, 0, 0, 0);
+        gpuProfiler.endScope(cmd, frameIndex);
+
+        // Instanced rocks
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.instancedRocksVkDescrSet, 0, NULL);
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.instancedRocksVkPipeline);
+        // Binding point 0 : Mesh vertex buffer
+        vkCmdBindVertexBuffers(cmd, VERTEX_BUFFER_BIND_ID, 1, &models.rockModel.vertices.buffer, offsets);
+        // Binding point 1 : Instance data buffer - only the instances which survived culling
+        vkCmdBindVertexBuffers(cmd, INSTANCE_BUFFER_BIND_ID, 1, &culling.culledInstances.buffer, offsets);
+
+        vkCmdBindIndexBuffer(cmd, models.rockModel.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+        // Render instances, instance count comes from cull_instances.comp
+        gpuProfiler.beginScope(cmd, frameIndex, "rocks");
+        vkCmdDrawIndexedIndirect(cmd, culling.indirectDraw.buffer, 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+        gpuProfiler.endScope(cmd, frameIndex);
+    }
+
+    /// Scaled scene color to the swapchain image, fullscreen triangle.
+    /// Scene color changes with the graph, so its descriptor set is written while recording, in the frame's pools.
+    void recordUpscale(VkCommandBuffer cmd, uint32_t frameIndex)
+    {
+        float uvScale[2];
+        vk229::getUvScale(width, height, dynamicResolution.controller.getScale(), uvScale);
+
+        VkDescriptorSet descriptorSet = descriptorAllocator.allocateFrame(dynamicResolution.descriptorSetLayout, frameIndex);
+        VkDescriptorImageInfo sceneDescriptor = vks::initializers::descriptorImageInfo(
+            dynamicResolution.sampler, frameGraph.graph.getImageView(frameGraph.sceneColor), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &sceneDescriptor);
+        vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, NULL);
+
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, dynamicResolution.pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, dynamicResolution.pipeline);
+        vkCmdPushConstants(cmd, dynamicResolution.pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uvScale), uvScale);
+        vkCmdDraw(cmd, 3, 1, 0, 0);
     }
 
     void loadAssets()
     {
         models.rockModel.loadFromFile(getAssetPath()   + "models/rock01.dae",             vertexLayout, INSTANCE_SCALE, vulkanDevice, queue);
-        models.planetModel.loadFromFile(getAssetPath() + "models/sphere_nonideal.obj",    vertexLayout, PLANET_SCALE,   vulkanDevice, queue);
-        models.lightModel.loadFromFile(getAssetPath()  + "models/sphere.obj",             vertexLayout, LIGHT_SCALE,    vulkanDevice, queue);
         models.constructModel.loadFromFile(getAssetPath()  + "models/cage_construct.obj", vertexLayout, CONSTRUCT_SCALE,    vulkanDevice, queue);
 
         // Textures
@@ -283,166 +702,135 @@ public:
         textures.constructTex2D.loadFromFile(getAssetPath()    + "textures/lava_from_gimp_planet_bc3_unorm.dds", VK_FORMAT_BC3_UNORM_BLOCK, vulkanDevice, queue);
     }
 
-    void setupDescriptorPool()
-    {
-        // Example uses one ubo
-        std::vector<VkDescriptorPoolSize> poolSizes =
-        {
-            vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, DESCRIPTOR_COUNT),
-            vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, DESCRIPTOR_COUNT),
-        };
-
-        VkDescriptorPoolCreateInfo descriptorPoolInfo =
-            vks::initializers::descriptorPoolCreateInfo(
-                poolSizes.size(),
-                poolSizes.data(),
-                DESCRIPTOR_COUNT);
-
-        VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
-    }
-
     void setupDescriptorSetLayout()
     {
         std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
         {
-            // Binding 0 : Vertex shader uniform buffer
+            // Binding 0 : Vertex shader uniform buffer (fragment shaders read shadow constants, sphere shaders the camera)
             vks::initializers::descriptorSetLayoutBinding(
                 VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                VK_SHADER_STAGE_VERTEX_BIT,
+                VK_SHADER_STAGE_VERTEX_BIT | SPHERE_SHADER_STAGES | VK_SHADER_STAGE_FRAGMENT_BIT,
                 0),
-            // Binding 1 : Fragment shader combined sampler
+            // Binding 1 : Fragment shader combined sampler (planet's displacement reads it in sphere.tese)
             vks::initializers::descriptorSetLayoutBinding(
                 VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                VK_SHADER_STAGE_FRAGMENT_BIT,
+                VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
                 1),
+            // Binding 2 : Fragment shader shadow cube map
+            vks::initializers::descriptorSetLayoutBinding(
+                VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                VK_SHADER_STAGE_FRAGMENT_BIT,
+                2),
         };
 
-        VkDescriptorSetLayoutCreateInfo descriptorLayout =
-            vks::initializers::descriptorSetLayoutCreateInfo(
-                setLayoutBindings.data(),
-                setLayoutBindings.size());
-
-        VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayout));
+        descriptorSetLayout = descriptorAllocator.getLayout(setLayoutBindings);
 
+        // Procedural spheres (planet, light) get their vk229::SpherePushConstants
+        VkPushConstantRange spherePushConstantRange = vks::initializers::pushConstantRange(SPHERE_SHADER_STAGES, sizeof(vk229::SpherePushConstants), 0);
         VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo =
             vks::initializers::pipelineLayoutCreateInfo(
                 &descriptorSetLayout,
                 1);
+        pPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+        pPipelineLayoutCreateInfo.pPushConstantRanges    = &spherePushConstantRange;
 
         VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pPipelineLayoutCreateInfo, nullptr, &pipelineLayout));
-    }
 
-    void setupDescriptorSet()
-    {
-        VkDescriptorSetAllocateInfo descripotrSetAllocInfo;
-        std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+        // Culling
+        setLayoutBindings =
+        {
+            vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         VK_SHADER_STAGE_COMPUTE_BIT, 0), // Scene uniform buffer
+            vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 1), // Hi-Z pyramid
+            vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT, 2), // All instances, ring slot of the frame
+            vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         VK_SHADER_STAGE_COMPUTE_BIT, 3), // Visible instances
+            vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         VK_SHADER_STAGE_COMPUTE_BIT, 4), // Indirect draw
+        };
 
-        descripotrSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);;
+        culling.descriptorSetLayout = descriptorAllocator.getLayout(setLayoutBindings);
 
-        // Instanced rocks
-        VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descripotrSetAllocInfo, &descriptorSets.instancedRocksVkDescrSet));
-        writeDescriptorSets = {
-            vks::initializers::writeDescriptorSet(descriptorSets.instancedRocksVkDescrSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,	0, &uniformBuffers.scene.descriptor),	// Binding 0 : Vertex shader uniform buffer
-            vks::initializers::writeDescriptorSet(descriptorSets.instancedRocksVkDescrSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &textures.rocksTex2DArr.descriptor)	// Binding 1 : Color map
-        };
-        vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+        VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(CullParams), 0);
+        pPipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&culling.descriptorSetLayout, 1);
+        pPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+        pPipelineLayoutCreateInfo.pPushConstantRanges    = &pushConstantRange;
+        VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pPipelineLayoutCreateInfo, nullptr, &culling.pipelineLayout));
 
-        // Planet
-        VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descripotrSetAllocInfo, &descriptorSets.planetVkDescrSet));
-        writeDescriptorSets = {
-            vks::initializers::writeDescriptorSet(descriptorSets.planetVkDescrSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,	0, &uniformBuffers.scene.descriptor),			// Binding 0 : Vertex shader uniform buffer
-            vks::initializers::writeDescriptorSet(descriptorSets.planetVkDescrSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &textures.planetTex2D.descriptor)			// Binding 1 : Color map
+        // Upscale: scaled scene color, uv scale as push constant
+        setLayoutBindings =
+        {
+            vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),
         };
-        vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
 
-        // Light
-        VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descripotrSetAllocInfo, &descriptorSets.lightVkDescrSet));
-        writeDescriptorSets = {
-            vks::initializers::writeDescriptorSet(descriptorSets.lightVkDescrSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,	0, &uniformBuffers.scene.descriptor),			// Binding 0 : Vertex shader uniform buffer
-            vks::initializers::writeDescriptorSet(descriptorSets.lightVkDescrSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &textures.lightTex2D.descriptor)			// Binding 1 : Color map
+        dynamicResolution.descriptorSetLayout = descriptorAllocator.getLayout(setLayoutBindings);
+
+        pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_FRAGMENT_BIT, 2 * sizeof(float), 0);
+        pPipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&dynamicResolution.descriptorSetLayout, 1);
+        pPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+        pPipelineLayoutCreateInfo.pPushConstantRanges    = &pushConstantRange;
+        VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pPipelineLayoutCreateInfo, nullptr, &dynamicResolution.pipelineLayout));
+
+        // Shadow: shadow uniform buffer, cube face as push constant
+        setLayoutBindings =
+        {
+            vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0),
         };
-        vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
 
-        // Construct descriptor sets
-        VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descripotrSetAllocInfo, &descriptorSets.constructVkDescrSet));
-        writeDescriptorSets = {
-            vks::initializers::writeDescriptorSet(descriptorSets.constructVkDescrSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,	0, &uniformBuffers.scene.descriptor),			// Binding 0 : Vertex shader uniform buffer
-            vks::initializers::writeDescriptorSet(descriptorSets.constructVkDescrSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &textures.constructTex2D.descriptor)			// Binding 1 : Color map
+        shadow.descriptorSetLayout = descriptorAllocator.getLayout(setLayoutBindings);
+
+        pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(uint32_t), 0);
+        pPipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&shadow.descriptorSetLayout, 1);
+        pPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+        pPipelineLayoutCreateInfo.pPushConstantRanges    = &pushConstantRange;
+        VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pPipelineLayoutCreateInfo, nullptr, &shadow.pipelineLayout));
+    }
+
+    void setupDescriptorSet()
+    {
+        using Binding = vk229::DescriptorAllocator::Binding;
+
+        const VkDescriptorImageInfo shadowDescriptor = shadow.cubeMap.getDescriptor();
+
+        // Objects - immutable, Binding 0 : Vertex shader uniform buffer, Binding 1 : Color map, Binding 2 : Shadow cube map
+        auto getObjectSet = [&](const VkDescriptorImageInfo& colorMap) {
+            return descriptorAllocator.getCachedSet(descriptorSetLayout, {
+                Binding::buffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         uniformBuffers.scene.descriptor),
+                Binding::image(1,  VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, colorMap),
+                Binding::image(2,  VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, shadowDescriptor),
+            });
+        };
+        descriptorSets.instancedRocksVkDescrSet = getObjectSet(textures.rocksTex2DArr.descriptor);
+        descriptorSets.planetVkDescrSet         = getObjectSet(textures.planetTex2D.descriptor);
+        descriptorSets.lightVkDescrSet          = getObjectSet(textures.lightTex2D.descriptor);
+        descriptorSets.constructVkDescrSet      = getObjectSet(textures.constructTex2D.descriptor);
+
+        // Culling descriptor set - Hi-Z pyramid binding is rewritten on resize, so it is not a cached one
+        culling.descriptorSet = descriptorAllocator.allocate(culling.descriptorSetLayout);
+        VkDescriptorImageInfo hiZDescriptor = culling.hiZ.getDescriptor();
+        VkDescriptorBufferInfo instancesDescriptor = rocks.ring.getDescriptor();
+        std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+            vks::initializers::writeDescriptorSet(culling.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         0, &uniformBuffers.scene.descriptor),
+            vks::initializers::writeDescriptorSet(culling.descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &hiZDescriptor),
+            vks::initializers::writeDescriptorSet(culling.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 2, &instancesDescriptor),
+            vks::initializers::writeDescriptorSet(culling.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         3, &culling.culledInstances.descriptor),
+            vks::initializers::writeDescriptorSet(culling.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         4, &culling.indirectDraw.descriptor),
         };
         vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
 
+        // Shadow descriptor set
+        shadow.descriptorSet = descriptorAllocator.getCachedSet(shadow.descriptorSetLayout, {
+            Binding::buffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, shadow.uniformBuffer.descriptor),
+        });
+
+        // Upscale descriptor sets are written by recordUpscale()
     }
 
     void preparePipelines()
     {
-        VkPipelineInputAssemblyStateCreateInfo inputAssemblyState =
-            vks::initializers::pipelineInputAssemblyStateCreateInfo(
-                VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-                0,
-                VK_FALSE);
-
-        VkPipelineRasterizationStateCreateInfo rasterizationState =
-            vks::initializers::pipelineRasterizationStateCreateInfo(
-                VK_POLYGON_MODE_FILL,
-                VK_CULL_MODE_BACK_BIT,
-                VK_FRONT_FACE_CLOCKWISE,
-                0);
-
-        VkPipelineColorBlendAttachmentState blendAttachmentState =
-            vks::initializers::pipelineColorBlendAttachmentState(
-                0xf,
-                VK_FALSE);
-
-        VkPipelineColorBlendStateCreateInfo colorBlendState =
-            vks::initializers::pipelineColorBlendStateCreateInfo(
-                1,
-                &blendAttachmentState);
-
-        VkPipelineDepthStencilStateCreateInfo depthStencilState =
-            vks::initializers::pipelineDepthStencilStateCreateInfo(
-                VK_TRUE,
-                VK_TRUE,
-                VK_COMPARE_OP_LESS_OR_EQUAL);
-
-        VkPipelineViewportStateCreateInfo viewportState =
-            vks::initializers::pipelineViewportStateCreateInfo(1, 1, 0);
-
-        VkPipelineMultisampleStateCreateInfo multisampleState =
-            vks::initializers::pipelineMultisampleStateCreateInfo(
-                VK_SAMPLE_COUNT_1_BIT,
-                0);
-
-        std::vector<VkDynamicState> dynamicStateEnables = {
-            VK_DYNAMIC_STATE_VIEWPORT,
-            VK_DYNAMIC_STATE_SCISSOR
-        };
-        VkPipelineDynamicStateCreateInfo dynamicState =
-            vks::initializers::pipelineDynamicStateCreateInfo(
-                dynamicStateEnables.data(),
-                dynamicStateEnables.size(),
-                0);
-
-        // Load shaders
-        std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
-
-        VkGraphicsPipelineCreateInfo pipelineCreateInfo =
-            vks::initializers::pipelineCreateInfo(
-                pipelineLayout,
-                renderPass,
-                0);
-
-        pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
-        pipelineCreateInfo.pRasterizationState = &rasterizationState;
-        pipelineCreateInfo.pColorBlendState = &colorBlendState;
-        pipelineCreateInfo.pMultisampleState = &multisampleState;
-        pipelineCreateInfo.pViewportState = &viewportState;
-        pipelineCreateInfo.pDepthStencilState = &depthStencilState;
-        pipelineCreateInfo.pDynamicState = &dynamicState;
-        pipelineCreateInfo.stageCount = shaderStages.size();
-        pipelineCreateInfo.pStages = shaderStages.data();
+        // All the pipelines share fixed function state (see vk229::GraphicsPipelineDesc defaults),
+        // they are compiled in parallel by vk229::PipelineCompiler.
+        // Render passes come from the frame graph - pipelines stay compatible with them when it is recompiled.
+        vk229::GraphicsPipelineDesc pipelineDesc(pipelineLayout, frameGraph.graph.getRenderPass(frameGraph.scenePass));
 
         // This example uses two different input states, one for the instanced part and one for non-instanced rendering
-        VkPipelineVertexInputStateCreateInfo inputState = vks::initializers::pipelineVertexInputStateCreateInfo();
         std::vector<VkVertexInputBindingDescription> bindingDescriptions;
         std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
 
@@ -475,136 +863,303 @@ public:
             vks::initializers::vertexInputAttributeDescription(INSTANCE_BUFFER_BIND_ID, 6, VK_FORMAT_R32_SFLOAT,sizeof(float) * 6),			// Location 6: Scale
             vks::initializers::vertexInputAttributeDescription(INSTANCE_BUFFER_BIND_ID, 7, VK_FORMAT_R32_SINT, sizeof(float) * 7),			// Location 7: Texture array layer index
         };
-        inputState.pVertexBindingDescriptions = bindingDescriptions.data();
-        inputState.pVertexAttributeDescriptions = attributeDescriptions.data();
 
-        pipelineCreateInfo.pVertexInputState = &inputState;
+        // Order of descriptors here is the order of output pipelines.
+        std::vector<vk229::GraphicsPipelineDesc> pipelineDescs(8, pipelineDesc);
+
+        // Procedural spheres - icosahedron patches from sphere.vert, no vertex input
+        const std::vector<VkPipelineShaderStageCreateInfo> sphereShaderStages = {
+            loadShader(getAssetPath() + "shaders/instancing-229/sphere.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+            loadShader(getAssetPath() + "shaders/instancing-229/sphere.tesc.spv", VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT),
+            loadShader(getAssetPath() + "shaders/instancing-229/sphere.tese.spv", VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT),
+        };
+        for (uint32_t i : {1u, 2u, 7u})
+        {
+            pipelineDescs[i].shaderStages = sphereShaderStages;
+            pipelineDescs[i].inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
+            pipelineDescs[i].tessellationState.patchControlPoints = 3;
+        }
 
         // Instancing pipeline
-        shaderStages[0] = loadShader(getAssetPath() + "shaders/instancing-229/instancing.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-        shaderStages[1] = loadShader(getAssetPath() + "shaders/instancing-229/instancing.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
         // Use all input bindings and attribute descriptions
-        inputState.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
-        inputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-        VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.instancedRocksVkPipeline));
+        pipelineDescs[0].shaderStages = {
+            loadShader(getAssetPath() + "shaders/instancing-229/instancing.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+            loadShader(getAssetPath() + "shaders/instancing-229/instancing.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT),
+        };
+        pipelineDescs[0].bindingDescriptions   = bindingDescriptions;
+        pipelineDescs[0].attributeDescriptions = attributeDescriptions;
 
         // Planet rendering pipeline
-        shaderStages[0] = loadShader(getAssetPath() + "shaders/instancing-229/planet.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-        shaderStages[1] = loadShader(getAssetPath() + "shaders/instancing-229/planet.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-        // Only use the non-instanced input bindings and attribute descriptions
-        inputState.vertexBindingDescriptionCount = 1;
-        inputState.vertexAttributeDescriptionCount = 4;
-        VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.planetVkPipeline));
+        // Procedural sphere
+        pipelineDescs[1].shaderStages.push_back(
+            loadShader(getAssetPath() + "shaders/instancing-229/planet.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT));
 
         // Light rendering pipeline
-        shaderStages[0] = loadShader(getAssetPath() + "shaders/instancing-229/light.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-        shaderStages[1] = loadShader(getAssetPath() + "shaders/instancing-229/light.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-        // Only use the non-instanced input bindings and attribute descriptions
-        inputState.vertexBindingDescriptionCount = 1;
-        inputState.vertexAttributeDescriptionCount = 4;
-        VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.lightVkPipeline));
+        // Procedural sphere
+        pipelineDescs[2].shaderStages.push_back(
+            loadShader(getAssetPath() + "shaders/instancing-229/light.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT));
 
         // Construct rendering pipeline
-        shaderStages[0] = loadShader(getAssetPath() + "shaders/instancing-229/construct.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-        shaderStages[1] = loadShader(getAssetPath() + "shaders/instancing-229/construct.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
         // Only use the non-instanced input bindings and attribute descriptions
-        inputState.vertexBindingDescriptionCount = 1;
-        inputState.vertexAttributeDescriptionCount = 4;
-        VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.constructVkPipeline));
-    }
-
-    float rnd(float range)
-    {
-        return range * (rand() / double(RAND_MAX));
+        pipelineDescs[3].shaderStages = {
+            loadShader(getAssetPath() + "shaders/instancing-229/construct.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+            loadShader(getAssetPath() + "shaders/instancing-229/construct.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT),
+        };
+        pipelineDescs[3].bindingDescriptions.assign(bindingDescriptions.begin(), bindingDescriptions.begin() + 1);
+        pipelineDescs[3].attributeDescriptions.assign(attributeDescriptions.begin(), attributeDescriptions.begin() + 4);
+
+        // Occluder pipeline (construct) - depth only, into occluder depth for Hi-Z
+        // Only position is used
+        pipelineDescs[4].renderPass   = frameGraph.graph.getRenderPass(frameGraph.occluderPass);
+        pipelineDescs[4].shaderStages = {
+            loadShader(getAssetPath() + "shaders/instancing-229/occluder.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+        };
+        pipelineDescs[4].bindingDescriptions.assign(bindingDescriptions.begin(), bindingDescriptions.begin() + 1);
+        pipelineDescs[4].attributeDescriptions.assign(attributeDescriptions.begin(), attributeDescriptions.begin() + 1);
+        pipelineDescs[4].blendAttachmentStates.clear();
+
+        // Upscale pipeline - fullscreen triangle into the swapchain image, no vertex input
+        pipelineDescs[5].layout       = dynamicResolution.pipelineLayout;
+        pipelineDescs[5].renderPass   = frameGraph.graph.getRenderPass(frameGraph.upscalePass);
+        pipelineDescs[5].shaderStages = {
+            loadShader(getAssetPath() + "shaders/instancing-229/upscale.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+            loadShader(getAssetPath() + "shaders/instancing-229/upscale.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT),
+        };
+        pipelineDescs[5].rasterizationState.cullMode = VK_CULL_MODE_NONE;
+        pipelineDescs[5].depthStencilState.depthTestEnable  = VK_FALSE;
+        pipelineDescs[5].depthStencilState.depthWriteEnable = VK_FALSE;
+
+        // Shadow pipeline - all rocks into a face of the shadow cube map
+        // Uses instanced input bindings, only position and instance transform are read
+        pipelineDescs[6].layout       = shadow.pipelineLayout;
+        pipelineDescs[6].renderPass   = shadow.cubeMap.getRenderPass();
+        pipelineDescs[6].shaderStages = {
+            loadShader(getAssetPath() + "shaders/instancing-229/shadow.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+            loadShader(getAssetPath() + "shaders/instancing-229/shadow.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT),
+        };
+        pipelineDescs[6].bindingDescriptions   = bindingDescriptions;
+        pipelineDescs[6].attributeDescriptions = attributeDescriptions;
+        pipelineDescs[6].rasterizationState.cullMode = VK_CULL_MODE_NONE; // Face matrices flip handedness
+
+        // Planet occluder pipeline - procedural sphere, depth only, into occluder depth for Hi-Z
+        pipelineDescs[7].renderPass = frameGraph.graph.getRenderPass(frameGraph.occluderPass);
+        pipelineDescs[7].blendAttachmentStates.clear();
+
+        // Worker caches get merged into pipelineCache when compiler goes out of scope.
+        vk229::PipelineCompiler pipelineCompiler(device, pipelineCache);
+        std::vector<VkPipeline> compiledPipelines;
+        pipelineCompiler.compile(pipelineDescs, compiledPipelines);
+
+        pipelines.instancedRocksVkPipeline = compiledPipelines[0];
+        pipelines.planetVkPipeline         = compiledPipelines[1];
+        pipelines.lightVkPipeline          = compiledPipelines[2];
+        pipelines.constructVkPipeline      = compiledPipelines[3];
+        pipelines.occluderVkPipeline       = compiledPipelines[4];
+        dynamicResolution.pipeline         = compiledPipelines[5];
+        shadow.pipeline                    = compiledPipelines[6];
+        pipelines.planetOccluderVkPipeline = compiledPipelines[7];
+
+        // Culling compute pipeline
+        VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(culling.pipelineLayout, 0);
+        computePipelineCreateInfo.stage = loadShader(getAssetPath() + "shaders/instancing-229/cull_instances.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+        VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &culling.pipeline));
     }
 
     void prepareInstanceData()
     {
+        // Distribute rocks randomly on rings around the planet
+        const bool     usesCameraPath = (false == cameraPath.options.recordFile.empty()) || (false == cameraPath.options.playFile.empty());
+        const uint32_t seed           = usesCameraPath ? CAMERA_PATH_ROCK_SEED : time(NULL);
         std::vector<InstanceData> instanceData;
-        instanceData.resize(INSTANCE_COUNT);
+        vk229::generateRockInstances(INSTANCE_COUNT, textures.rocksTex2DArr.layerCount, seed, instanceData);
+        rocks.rndGenerator.seed(seed + 1u);
 
-        std::mt19937 rndGenerator(time(NULL));
-        std::uniform_real_distribution<float> uniformDist(0.0, 1.0);
-
-        // Distribute rocks randomly on two different rings
+        // Also read by cull_instances.comp
+        rocks.ring.prepare(vulkanDevice, drawCmdBuffers.size(), sizeof(InstanceData), INSTANCE_COUNT,
+                           VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        rocks.ring.write(0, INSTANCE_COUNT, instanceData.data());
+    }
 
-        std::vector<glm::vec2> rings = {
-            {   5.0f,   7.0f },
-            {   8.0f,  11.0f },
-            {  13.0f,  17.0f },
-            {  20.0f,  26.0f },
-            {  30.0f,  40.0f },
-            {  48.0f,  60.0f }
-        };
-        const auto numOfChunks = rings.size();
-        const auto numInChunk  = INSTANCE_COUNT / rings.size();
-        float rho, theta;
+    /// Respawns ROCK_CHURN_RUNS runs of rocks at new places on their rings - removed from one place, added to another.
+    void churnRocks()
+    {
+        const uint32_t numInChunk = INSTANCE_COUNT / vk229::ROCK_RING_COUNT;
+        std::uniform_int_distribution<uint32_t> firstDist(0, INSTANCE_COUNT - ROCK_CHURN_RUN_LENGTH);
 
-        for (auto instIdInChunk = 0; instIdInChunk < numInChunk; instIdInChunk++)
+        InstanceData run[ROCK_CHURN_RUN_LENGTH];
+        for (uint32_t runId = 0; runId < ROCK_CHURN_RUNS; runId++)
         {
-            for (auto ringId = 0; ringId < numOfChunks; ringId++)
+            const uint32_t first = firstDist(rocks.rndGenerator);
+            for (uint32_t i = 0; i < ROCK_CHURN_RUN_LENGTH; i++)
             {
-                const auto instanceId    = instIdInChunk + ringId*numInChunk;
-                auto& currentInstanceRef = instanceData[instanceId];
-
-                rho   = sqrt((pow(rings.at(ringId)[1], 2.0f) - pow(rings.at(ringId)[0], 2.0f)) * uniformDist(rndGenerator) + pow(rings.at(ringId)[0], 2.0f));
-                theta = 2.0 * M_PI * uniformDist(rndGenerator);
-
-                currentInstanceRef.pos      = glm::vec3(rho*cos(theta), uniformDist(rndGenerator) * 0.05f - 0.25f, rho*sin(theta));
-                currentInstanceRef.rot      = glm::vec3(M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator));
-                currentInstanceRef.scale    = 1.5f + uniformDist(rndGenerator) - uniformDist(rndGenerator);
-                currentInstanceRef.texIndex = rnd(textures.rocksTex2DArr.layerCount);
-                currentInstanceRef.scale    *= 0.75f;
+                const uint32_t ringId = std::min(vk229::ROCK_RING_COUNT - 1u, (first + i) / numInChunk);
+                vk229::generateRockInstance(ringId, textures.rocksTex2DArr.layerCount, rocks.rndGenerator, run[i]);
             }
+            rocks.ring.write(first, ROCK_CHURN_RUN_LENGTH, run);
         }
+        shadow.dirty = true;
+    }
 
-        instanceBuffer.size = instanceData.size() * sizeof(InstanceData);
-
-        // Staging
-        // Instanced data is static, copy to device local memory
-        // This results in better performance
+    void prepareCulling()
+    {
+        // Visible instances, written by cull_instances.comp, read as vertex input
+        VK_CHECK_RESULT(vulkanDevice->createBuffer(
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            &culling.culledInstances,
+            INSTANCE_COUNT * sizeof(InstanceData)));
 
-        struct {
-            VkDeviceMemory memory;
-            VkBuffer buffer;
-        } stagingBuffer;
+        // Indirect draw command, instanceCount is reset every frame
+        VkDrawIndexedIndirectCommand indirectCmd = {};
+        indirectCmd.indexCount = models.rockModel.indexCount;
+        VK_CHECK_RESULT(vulkanDevice->createBuffer(
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            &culling.indirectDraw,
+            sizeof(indirectCmd)));
 
+        vks::Buffer stagingBuffer;
         VK_CHECK_RESULT(vulkanDevice->createBuffer(
             VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            instanceBuffer.size,
-            &stagingBuffer.buffer,
-            &stagingBuffer.memory,
-            instanceData.data()));
+            &stagingBuffer,
+            sizeof(indirectCmd),
+            &indirectCmd));
+        vulkanDevice->copyBuffer(&stagingBuffer, &culling.indirectDraw, queue);
+        stagingBuffer.destroy();
 
         VK_CHECK_RESULT(vulkanDevice->createBuffer(
-            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            instanceBuffer.size,
-            &instanceBuffer.buffer,
-            &instanceBuffer.memory));
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            &culling.visibleCountReadback,
+            sizeof(uint32_t)));
+        VK_CHECK_RESULT(culling.visibleCountReadback.map());
+        *static_cast<uint32_t*>(culling.visibleCountReadback.mapped) = INSTANCE_COUNT;
+
+        // Rock's bounding sphere around its origin (model is already scaled by INSTANCE_SCALE)
+        culling.rockRadius = std::max(glm::length(models.rockModel.dim.min), glm::length(models.rockModel.dim.max));
+
+        // Occluder depth is sampled by the pyramid build
+        VkFormatProperties formatProps;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, depthFormat, &formatProps);
+        if (!(formatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT))
+        {
+            vks::tools::exitFatal("Depth format does not support sampling, Hi-Z culling is not possible!", "Error");
+        }
+
+        culling.hiZReduceShaderStage = loadShader(getAssetPath() + "shaders/instancing-229/hiz_reduce.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+        culling.hiZ.prepare(vulkanDevice, queue, pipelineCache, culling.hiZReduceShaderStage);
+        culling.hiZ.resize(width, height);
+    }
+
+    void prepareDynamicResolution()
+    {
+        // Sampler - linear, bicubic upscale is built from bilinear taps.
+        VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+        samplerCI.magFilter    = VK_FILTER_LINEAR;
+        samplerCI.minFilter    = VK_FILTER_LINEAR;
+        samplerCI.mipmapMode   = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerCI.minLod       = 0.0f;
+        samplerCI.maxLod       = 0.0f;
+        samplerCI.borderColor  = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+        VK_CHECK_RESULT(vkCreateSampler(device, &samplerCI, nullptr, &dynamicResolution.sampler));
+
+        dynamicResolution.gpuTimer.prepare(vulkanDevice, drawCmdBuffers.size());
+        dynamicResolution.controller.setTarget(DYNRES_TARGET_MS);
+    }
 
-        // Copy to staging buffer
-        VkCommandBuffer copyCmd = VulkanExampleBase::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    /// Feeds last frame's GPU time to the controller, returns true if the scale has changed.
+    bool updateDynamicResolution()
+    {
+        // Without timestamps whole frame time is used - it includes waiting for vsync, so the scale never grows back above it.
+        float frameMs = frameTimer * 1000.0f;
+        dynamicResolution.gpuTimer.getFrameMs(currentBuffer, frameMs);
+        dynamicResolution.lastFrameMs = frameMs;
 
-        VkBufferCopy copyRegion = { };
-        copyRegion.size = instanceBuffer.size;
-        vkCmdCopyBuffer(
-            copyCmd,
-            stagingBuffer.buffer,
-            instanceBuffer.buffer,
-            1,
-            &copyRegion);
+        if (!dynamicResolution.enabled)
+        {
+            return false;
+        }
+        return dynamicResolution.controller.update(frameMs);
+    }
 
-        VulkanExampleBase::flushCommandBuffer(copyCmd, queue, true);
+    void prepareShadow()
+    {
+        shadow.cubeMap.prepare(vulkanDevice, depthFormat, SHADOW_MAP_SIZE, 0.1f, SHADOW_FAR);
 
-        instanceBuffer.descriptor.range = instanceBuffer.size;
-        instanceBuffer.descriptor.buffer = instanceBuffer.buffer;
-        instanceBuffer.descriptor.offset = 0;
+        VK_CHECK_RESULT(vulkanDevice->createBuffer(
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            &shadow.uniformBuffer,
+            sizeof(ShadowUBO)));
 
-        // Destroy staging resources
-        vkDestroyBuffer(device, stagingBuffer.buffer, nullptr);
-        vkFreeMemory(device, stagingBuffer.memory, nullptr);
+        // Map persistent
+        VK_CHECK_RESULT(shadow.uniformBuffer.map());
+    }
+
+    /// All six faces, recorded once per ring slot - only submitted when the cached map is stale.
+    void buildShadowCommandBuffers()
+    {
+        VkDeviceSize offsets[1] = { 0 };
+
+        shadow.cmdBuffers.resize(rocks.ring.getSlotCount());
+        for (uint32_t slot = 0; slot < shadow.cmdBuffers.size(); slot++)
+        {
+            VkCommandBuffer cmd = VulkanExampleBase::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+            shadow.cmdBuffers[slot] = cmd;
+
+            const VkBuffer     instanceBuffer     = rocks.ring.getBuffer();
+            const VkDeviceSize instanceOffsets[1] = { rocks.ring.getSlotOffset(slot) };
+
+            for (uint32_t face = 0; face < 6; face++)
+            {
+                shadow.cubeMap.beginFacePass(cmd, face);
+
+                vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, shadow.pipelineLayout, 0, 1, &shadow.descriptorSet, 0, NULL);
+                vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, shadow.pipeline);
+                vkCmdPushConstants(cmd, shadow.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &face);
+
+                // All instances - camera culling results do not apply to the light
+                vkCmdBindVertexBuffers(cmd, VERTEX_BUFFER_BIND_ID, 1, &models.rockModel.vertices.buffer, offsets);
+                vkCmdBindVertexBuffers(cmd, INSTANCE_BUFFER_BIND_ID, 1, &instanceBuffer, instanceOffsets);
+                vkCmdBindIndexBuffer(cmd, models.rockModel.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+                vkCmdDrawIndexed(cmd, models.rockModel.indexCount, INSTANCE_COUNT, 0, 0, 0);
+
+                shadow.cubeMap.endFacePass(cmd);
+            }
+
+            VK_CHECK_RESULT(vkEndCommandBuffer(cmd));
+        }
+    }
+
+    /// True if the light or rocks have moved too far from the state the shadow cube map was rendered with.
+    bool isShadowStale() const
+    {
+        return shadow.dirty
+            || glm::distance(glm::vec3(uboVS.lightPos), glm::vec3(shadow.ubo.lightPos)) > SHADOW_LIGHT_THRESHOLD
+            || fabsf(uboVS.locSpeed  - shadow.ubo.locSpeed)  > SHADOW_SPIN_THRESHOLD
+            || fabsf(uboVS.globSpeed - shadow.ubo.globSpeed) > SHADOW_ORBIT_THRESHOLD;
+    }
+
+    /// Snapshot of current light and rock motion for the shadow pass, receivers switch to it in the same frame.
+    void updateShadowUniformBuffer()
+    {
+        const glm::vec3 lightPos = glm::vec3(uboVS.lightPos);
+
+        for (uint32_t face = 0; face < 6; face++)
+        {
+            shadow.ubo.faceViewProj[face] = shadow.cubeMap.getFaceViewProj(lightPos, face);
+        }
+        shadow.ubo.lightPos  = glm::vec4(lightPos, shadow.cubeMap.getFar());
+        shadow.ubo.locSpeed  = uboVS.locSpeed;
+        shadow.ubo.globSpeed = uboVS.globSpeed;
+        memcpy(shadow.uniformBuffer.mapped, &shadow.ubo, sizeof(shadow.ubo));
+
+        uboVS.shadowLightPos = shadow.ubo.lightPos;
+        memcpy(uniformBuffers.scene.mapped, &uboVS, sizeof(uboVS));
     }
 
     void prepareUniformBuffers()
@@ -623,25 +1178,29 @@ public:
 
     void updateLight()
     {
-        static float     G  = 2.5f;
-        static float     mi = 10.0f;
-        static float     mp = 100.0f;
-        static glm::vec3 pi = { 45.0f, 0.0f, 10.0f };
-        static glm::vec3 pp = { 0.0f,  0.0f, 0.0f };
-        static glm::vec3 vi = { -1.0f, -0.3f, 1.0f };
-        static glm::vec3 ai = { 0.0f,  0.0f, 0.0f };
-        static glm::vec3 fi = { 0.0f,  0.0f, 0.0f };
-
-        float r = glm::distance(pi, pp);
-        glm::vec3 dirVec = glm::normalize(pi - pp);
-        fi = -dirVec * G*mp*mi/(r*r);
-        ai = fi/mi;
-        vi = vi + ai*frameTimer;
-        pi = pi + vi*frameTimer;
+        lightOrbit.step(frameTimer);
 
         const float k = 0.25f * frameTimer;
         uboVS.lightInt = LIGHT_INTENSITY*k + uboVS.lightInt*(1.0f - k);
-        uboVS.lightPos = glm::vec4(pi, 1.0f);
+        uboVS.lightPos = glm::vec4(lightOrbit.getPosition(), 1.0f);
+
+        updatePlanetShadowConstants();
+    }
+
+    /// Planet's penumbra (see getPlanetShadow() in receivers' shaders) only depends on the light -
+    /// near and far edges of the light, as seen from the planet, and planet's angular radius from them.
+    void updatePlanetShadowConstants()
+    {
+        const glm::vec3 lightPos = glm::vec3(uboVS.lightPos);
+        const float     lenLiPl  = glm::length(lightPos);
+        const glm::vec3 dirLiPl  = -lightPos / lenLiPl;
+        const float     k        = LIGHT_RADIUS / (LIGHT_RADIUS + PLANET_SCALE);
+
+        const glm::vec3 lightPosNear = lightPos + k * dirLiPl * lenLiPl;
+        const glm::vec3 lightPosFar  = lightPos - k * dirLiPl * lenLiPl;
+
+        uboVS.lightPosNear = glm::vec4(lightPosNear, asinf(std::min(1.0f, PLANET_SCALE / glm::length(lightPosNear))));
+        uboVS.lightPosFar  = glm::vec4(lightPosFar,  asinf(std::min(1.0f, PLANET_SCALE / glm::length(lightPosFar))));
     }
 
     void updateUniformBuffer(bool viewChanged)
@@ -676,28 +1235,66 @@ public:
 
     void draw()
     {
+        vk229::VkCallStats::PhaseScope callStatsPhase(vk229::VkCallStats::phase_t::SUBMIT);
+
         VulkanExampleBase::prepareFrame();
 
-        // Command buffer to be sumitted to the queue
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
+        if (rocks.churnEnabled && !paused)
+        {
+            churnRocks();
+        }
+
+        // Rocks changed since this slot was used - waits for its last frame, staged copies come back as a command buffer.
+        const VkCommandBuffer uploadCmdBuffer = rocks.ring.flush(currentBuffer);
+
+        // Command buffers to be sumitted to the queue - rock uploads and shadow pass first, if needed
+        std::vector<VkCommandBuffer> commandBuffers;
+        if (uploadCmdBuffer != VK_NULL_HANDLE)
+        {
+            commandBuffers.push_back(uploadCmdBuffer);
+        }
+        if (isShadowStale())
+        {
+            updateShadowUniformBuffer();
+            shadow.dirty = false;
+            shadow.refreshCount++;
+            shadow.framesSinceRefresh = 0;
+
+            commandBuffers.push_back(shadow.cmdBuffers[currentBuffer]);
+        }
+        else
+        {
+            shadow.framesSinceRefresh++;
+        }
+        commandBuffers.push_back(drawCmdBuffers[currentBuffer]);
+
+        submitInfo.commandBufferCount = commandBuffers.size();
+        submitInfo.pCommandBuffers = commandBuffers.data();
 
-        // Submit to queue
-        VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+        // Submit to queue, the fence tells when the ring slot can be written again
+        VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, rocks.ring.getFence(currentBuffer)));
 
         VulkanExampleBase::submitFrame();
     }
 
     void prepare() override
     {
+        vk229::VkCallStats::PhaseScope callStatsPhase(vk229::VkCallStats::phase_t::PREPARE);
+
         VulkanExampleBase::prepare();
         loadAssets();
         prepareInstanceData();
         prepareUniformBuffers();
+        prepareCulling();
+        prepareDynamicResolution();
+        gpuProfiler.prepare(vulkanDevice, drawCmdBuffers.size(), ENABLE_GPU_PROFILER);
+        prepareShadow();
+        setupRenderGraph();
+        descriptorAllocator.prepare(vulkanDevice, drawCmdBuffers.size());
         setupDescriptorSetLayout();
         preparePipelines();
-        setupDescriptorPool();
         setupDescriptorSet();
+        buildShadowCommandBuffers();
         buildCommandBuffers();
         prepared = true;
     }
@@ -712,10 +1309,66 @@ public:
             return;
         }
         draw();
-        if (!paused)
+
         {
-            updateUniformBuffer(false);
+            vk229::VkCallStats::PhaseScope callStatsPhase(vk229::VkCallStats::phase_t::UPDATE);
+
+            // Frame has been waited for in submitFrame(), its queries are ready.
+            gpuProfiler.collect(currentBuffer);
+            if (updateDynamicResolution())
+            {
+                // Scale is baked into render areas, viewports and push constants.
+                vkQueueWaitIdle(queue);
+                buildCommandBuffers();
+            }
+            // Next frame - camera from the path, or the live one recorded.
+            const bool cameraMoved = updateCameraPath();
+            if (!paused || cameraMoved)
+            {
+                updateUniformBuffer(cameraMoved);
+            }
         }
+        vk229::VkCallStats::endFrame();
+    }
+
+    vk229::CameraPose getCameraPose() const
+    {
+        vk229::CameraPose pose;
+        pose.position = cameraPos;
+        pose.rotation = rotation;
+        pose.zoom     = zoom;
+        return pose;
+    }
+
+    /// Playback - camera of the next frame from the path, simulation advances by the fixed step (true if the camera is set).
+    /// Recording - pose of the next frame is added to the path.
+    bool updateCameraPath()
+    {
+        if (cameraPath.playback.isPlaying())
+        {
+            vk229::CameraPose pose;
+            if (cameraPath.playback.step(pose))
+            {
+                cameraPos  = pose.position;
+                rotation   = pose.rotation;
+                zoom       = pose.zoom;
+                frameTimer = cameraPath.playback.getTimeStep();
+                return true;
+            }
+
+            for (const std::string& line : cameraPath.playback.getReportLines(CAMERA_PATH_WORST))
+            {
+                std::cout << line << "\n";
+            }
+            cameraPath.playback.exportCsv(CAMERA_PATH_CSV);
+            quit = true;
+        }
+        else if (false == cameraPath.options.recordFile.empty())
+        {
+            cameraPath.recordTime += frameTimer;
+            cameraPath.path.addKeyframe(cameraPath.recordTime, getCameraPose());
+        }
+        return false;
     }
 
     virtual void viewChanged() override
@@ -725,8 +1378,93 @@ public:
 
     virtual void getOverlayText(VulkanTextOverlay *textOverlay) override
     {
-        textOverlay->addText("Rendering " + std::to_string(INSTANCE_COUNT) + " instances", 5.0f, 85.0f, VulkanTextOverlay::alignLeft);
+        const uint32_t visibleCount = *static_cast<uint32_t*>(culling.visibleCountReadback.mapped);
+        textOverlay->addText("Rendering " + std::to_string(visibleCount) + " of " + std::to_string(INSTANCE_COUNT) + " instances", 5.0f, 85.0f, VulkanTextOverlay::alignLeft);
         textOverlay->addText("LMB to rotate, MMB to move, RMB or numpad +/- to zoom", 5.0f, 105.0f, VulkanTextOverlay::alignLeft);
+        textOverlay->addText(std::string("O - occlusion culling: ") + (culling.occlusionEnabled ? "on" : "off"), 5.0f, 125.0f, VulkanTextOverlay::alignLeft);
+
+        const vk229::FrameTimeController& controller = dynamicResolution.controller;
+        const vk229::FrameTimeController::State& state = controller.getState();
+        const VkExtent2D scaledExtent = vk229::getScaledExtent(width, height, controller.getScale());
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(2) << "F2 - dynamic resolution: " << (dynamicResolution.enabled ? "on" : "off")
+           << ", scale " << controller.getScale() << " (" << scaledExtent.width << "x" << scaledExtent.height << ")";
+        textOverlay->addText(ss.str(), 5.0f, 145.0f, VulkanTextOverlay::alignLeft);
+        ss.str("");
+        ss << std::fixed << std::setprecision(2) << (dynamicResolution.gpuTimer.isSupported() ? "GPU " : "frame ")
+           << dynamicResolution.lastFrameMs << " ms (avg " << state.measuredMs << ", target " << controller.getTargetMs() << ")"
+           << ", e " << state.error << ", de " << state.derivative << ", raw " << state.rawScale;
+        textOverlay->addText(ss.str(), 5.0f, 165.0f, VulkanTextOverlay::alignLeft);
+
+        textOverlay->addText("Shadow map: " + std::to_string(shadow.refreshCount) + " refreshes, last " + std::to_string(shadow.framesSinceRefresh) + " frames ago", 5.0f, 185.0f, VulkanTextOverlay::alignLeft);
+
+        const vk229::InstanceRing::Stats& ringStats = rocks.ring.getStats();
+        ss.str("");
+        ss << "T - rock churn: " << (rocks.churnEnabled ? "on" : "off") << ", uploads " << ringStats.uploadedBytes << " B in "
+           << ringStats.uploadedRanges << " ranges/frame, " << rocks.ring.getSlotCount() << " slots, "
+           << (rocks.ring.isDirect() ? "direct" : "staged");
+        textOverlay->addText(ss.str(), 5.0f, 205.0f, VulkanTextOverlay::alignLeft);
+
+        if (cameraPath.playback.isPlaying() || false == cameraPath.options.recordFile.empty())
+        {
+            ss.str("");
+            ss << std::fixed << std::setprecision(1);
+            if (cameraPath.playback.isPlaying())
+            {
+                ss << "Camera path: " << (cameraPath.playback.isWarmingUp() ? "warming up" : "playing") << " " << cameraPath.playback.getTime()
+                   << " of " << cameraPath.path.getDuration() << " s, segment " << cameraPath.playback.getCurrentSegment();
+            }
+            else
+            {
+                ss << "Camera path: recording " << cameraPath.recordTime << " s, segment " << std::max(1u, cameraPath.path.getSegmentCount()) - 1u
+                   << ", N - new segment";
+            }
+            textOverlay->addText(ss.str(), (float)width - 5.0f, 25.0f, VulkanTextOverlay::alignRight);
+        }
+
+        const vk229::DescriptorAllocator::Stats& descStats = descriptorAllocator.getStats();
+        ss.str("");
+        ss << "Descriptor sets: " << descStats.setCount << " in " << descStats.poolCount << " pools, "
+           << descStats.cachedSetCount << " cached (" << descStats.cacheHits << " hits)";
+        textOverlay->addText(ss.str(), (float)width - 5.0f, 45.0f, VulkanTextOverlay::alignRight);
+
+        const vk229::RenderGraph::Stats& graphStats = frameGraph.graph.getStats();
+        ss.str("");
+        ss << std::fixed << std::setprecision(1) << "Render graph: " << graphStats.passCount - graphStats.culledPassCount << " of " << graphStats.passCount << " passes, "
+           << graphStats.barrierBatches << " barriers, transients " << graphStats.transientBytes / (1024.0f * 1024.0f) << " MiB ("
+           << graphStats.unaliasedBytes / (1024.0f * 1024.0f) << " MiB unaliased)";
+        textOverlay->addText(ss.str(), 5.0f, 225.0f, VulkanTextOverlay::alignLeft);
+
+        const glm::vec3 camPos(uboVS.camPos);
+        ss.str("");
+        ss << "Spheres (tessellated): planet ~" << vk229::estimateSphereTriangles(glm::vec3(0.0f), camPos, getPlanetSphere(scaledExtent.height), uboVS.projection[1][1])
+           << ", light ~" << vk229::estimateSphereTriangles(glm::vec3(uboVS.lightPos), camPos, getLightSphere(scaledExtent.height), uboVS.projection[1][1])
+           << " triangles";
+        textOverlay->addText(ss.str(), (float)width - 5.0f, 65.0f, VulkanTextOverlay::alignRight);
+
+        if (false == gpuProfiler.isSupported())
+        {
+            textOverlay->addText("GPU profiler: not supported", 5.0f, 245.0f, VulkanTextOverlay::alignLeft);
+        }
+        else if (false == gpuProfiler.isEnabled())
+        {
+            textOverlay->addText("F3 - GPU profiler: off", 5.0f, 245.0f, VulkanTextOverlay::alignLeft);
+        }
+        else
+        {
+            textOverlay->addText("F3 - GPU profiler: on, F4 - export to " GPU_PROFILER_CSV, 5.0f, 245.0f, VulkanTextOverlay::alignLeft);
+            const std::vector<std::string> lines = gpuProfiler.getTableLines(GPU_PROFILER_ROWS);
+            for (uint32_t line = 0; line < lines.size(); line++)
+            {
+                textOverlay->addText(lines[line], 5.0f, 265.0f + 20.0f * line, VulkanTextOverlay::alignLeft);
+            }
+        }
+
+        if (vk229::VkCallStats::isEnabled())
+        {
+            const std::string callStatsLine = vk229::VkCallStats::getSummaryLine();
+            textOverlay->addText(callStatsLine.empty() ? "vk calls/frame: collecting..." : callStatsLine, (float)width - 5.0f, 5.0f, VulkanTextOverlay::alignRight);
+        }
     }
 
     virtual void keyPressed(uint32_t key) override
@@ -741,6 +1479,44 @@ public:
             zoom *= 1.41f;
             updateUniformBuffer(true);
         break;
+        case KEY_O:
+            // Occlusion switch is a push constant and changes graph's passes - it has to be recompiled.
+            culling.occlusionEnabled = !culling.occlusionEnabled;
+            vkQueueWaitIdle(queue);
+            setupRenderGraph();
+            buildCommandBuffers();
+            updateTextOverlay();
+        break;
+        case KEY_F2:
+            // Off - back to full resolution, controller starts again when switched on.
+            dynamicResolution.enabled = !dynamicResolution.enabled;
+            dynamicResolution.controller.reset();
+            vkQueueWaitIdle(queue);
+            buildCommandBuffers();
+            updateTextOverlay();
+        break;
+        case KEY_F3:
+            // Queries are recorded into command buffers.
+            gpuProfiler.setEnabled(!gpuProfiler.isEnabled());
+            vkQueueWaitIdle(queue);
+            buildCommandBuffers();
+            updateTextOverlay();
+        break;
+        case KEY_F4:
+            gpuProfiler.exportCsv(GPU_PROFILER_CSV);
+        break;
+        case KEY_N:
+            if (false == cameraPath.options.recordFile.empty())
+            {
+                cameraPath.path.startSegment();
+                updateTextOverlay();
+            }
+        break;
+        case KEY_T:
+            // Only changes what draw() uploads, command buffers stay.
+            rocks.churnEnabled = !rocks.churnEnabled;
+            updateTextOverlay();
+        break;
         }
     }
 };
@@ -11,6 +11,9 @@
 #include <map>
 #include <random>
 #include <HelperStructsAndFuncs.hpp>
+#include <VkCallStats.hpp>
+#include <CameraPath.hpp>
+#include <SceneGenerator.hpp>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -25,11 +28,49 @@
 
 #define VERTEX_BUFFER_BIND_ID   0
 #define ENABLE_VALIDATION       false
+#define USE_COMPACT_VERTICES    true    // 20 B instead of 68 B per vertex, see vk229::CompactVertex. --full-vertices switches it off.
+#define USE_DEPTH_PREPASS       true    // Depth-only pass first, then shading with VK_COMPARE_OP_EQUAL.
+#define USE_PREFILTERED_REFLECTIONS true // GGX roughness mip chain in RGB9E5, see vk229::prepareEquirectAsPrefilteredCubemap.
+#define TEXTURE_BUDGET_MB       0       // > 0 - textures have to fit in it too, see vk229::TextureResidencyManager.
+#define ENABLE_GPU_PROFILER     false   // GPU cost per entity at start, F3 switches it at runtime, see vk229::GpuProfiler.
+#define GPU_PROFILER_ROWS       8       // Most expensive entities shown in the overlay.
+#define GPU_PROFILER_CSV        "gpu_profile_my_new_scene1.csv"
+#define VK_CALL_STATS_CSV       "vk_calls_my_new_scene1.csv"     // Written at exit when built with VK229_CALL_STATS.
+#define ANIMATE_DROID           false   // Droid hovers and spins (nested transform nodes), F2 switches it at runtime.
+#define CAMERA_PATH_CSV         "camera_path_my_new_scene1.csv"  // Frames of camera path playback.
+#define CAMERA_PATH_WORST       5       // Slowest frames of playback printed with their camera pose.
+#define SCENE_SCALING_CSV       "scene_scaling_my_new_scene1.csv" // Runs of generated scenes, one row each.
 
 class VulkanExample : public VulkanExampleBase
 {
 public:
     vk229::SceneData sceneData;
+    vk229::GpuProfiler gpuProfiler;
+    bool  animateDroid = ANIMATE_DROID;
+    float droidTime    = 0.0f;
+
+    // --camera-record <file> records the camera (N - new segment), --camera-play <file> replays it at a fixed
+    // time step and reports frame times per segment, see vk229::parseCameraPathOptions.
+    vk229::CameraPathOptions  cameraPathOptions;
+    vk229::CameraPath         cameraPath;
+    vk229::CameraPathPlayback cameraPlayback;
+    float                     cameraRecordTime = 0.0f;
+
+    // --scene-entities <N> replaces the scene by a generated one of N entities, which is measured
+    // (load, descriptors, pipelines, recording, frame CPU time) and the run appended to SCENE_SCALING_CSV,
+    // see vk229::parseSceneGeneratorOptions.
+    vk229::SceneGeneratorOptions sceneGenOptions;
+    vk229::GeneratedScene        generatedScene;
+    vk229::SceneScalingReport    sceneReport;
+
+    // --full-vertices - 68 B vertices instead of USE_COMPACT_VERTICES, to compare both on the same scene or camera path.
+    bool useCompactVertices = USE_COMPACT_VERTICES;
+
+    // Scene changes (visible set, draw order, LODs, pipelines, textures) mark command buffers stale, each one is
+    // re-recorded right before its image is drawn, after a wait for its own last frame only - see draw().
+    std::vector<VkFence> drawFences;
+    std::vector<bool>    drawCmdBuffersStale;
+    double               frameRecordMs = 0.0;   // Recording of this frame, a part of its CPU time.
 
     VulkanExample() :
         VulkanExampleBase(ENABLE_VALIDATION)
@@ -50,9 +91,34 @@ public:
         camera.rotationSpeed = 0.25f;
         camera.movementSpeed = 2.0f;
 
+        cameraPathOptions = vk229::parseCameraPathOptions(args);
+        if (false == cameraPathOptions.playFile.empty() && cameraPath.load(cameraPathOptions.playFile))
+        {
+            cameraPlayback.start(&cameraPath, cameraPathOptions.timeStep);
+        }
+
+        sceneGenOptions = vk229::parseSceneGeneratorOptions(args);
+        sceneReport.start();
+
+        for (const char* arg : args)
+        {
+            if (strcmp(arg, "--full-vertices") == 0)
+            {
+                useCompactVertices = false;
+            }
+        }
+
         // INIT
         this->initSceneCreateInfo();
 
+        if (isSceneGenerated())
+        {
+            // Camera at the side of the cube the entities fill, far plane behind the opposite side.
+            camera.setPerspective(80.0f, (float)width / (float)height, 1.0f/128.0f, std::max(128.0f, 2.0f * generatedScene.extent));
+            camera.setPosition(glm::vec3(0.0f, 0.0f, -0.5f * generatedScene.extent));
+            camera.movementSpeed = std::max(2.0f, 0.05f * generatedScene.extent);
+        }
+
         this->initVulkan();    // From base class.
         // {
         //     createInstance(settings.validation);
@@ -94,8 +160,8 @@ public:
         //
         //     loadAssets();
         //     prepareUniformBuffers();
+        //     prepareDescriptorAllocator();
         //     setupDescriptorSetLayout();
-        //     setupDescriptorPool();
         //     setupDescriptorSet();
         //     preparePipelineLayout();
         //     preparePipelines();
@@ -107,6 +173,21 @@ public:
 
     ~VulkanExample()
     {
+        if (vk229::VkCallStats::isEnabled())
+        {
+            vk229::VkCallStats::exportCsv(VK_CALL_STATS_CSV);
+        }
+        if (false == cameraPathOptions.recordFile.empty())
+        {
+            cameraPath.save(cameraPathOptions.recordFile);
+        }
+
+        vkWaitForFences(device, drawFences.size(), drawFences.data(), VK_TRUE, UINT64_MAX);
+        for (VkFence fence : drawFences)
+        {
+            vkDestroyFence(device, fence, nullptr);
+        }
+        gpuProfiler.destroy();
         sceneData.destroy(device);
     }
 
@@ -140,8 +221,9 @@ public:
         };
 
         std::vector<vk229::ShaderInfo> shadersInfoVec = {
-            {"vert1", VK_SHADER_STAGE_VERTEX_BIT,   "default_transforms.vert.spv"},
+            {"vert1", VK_SHADER_STAGE_VERTEX_BIT,   useCompactVertices ? "default_transforms_compact.vert.spv" : "default_transforms.vert.spv"},
             {"frag1", VK_SHADER_STAGE_FRAGMENT_BIT, "default_material.frag.spv"},
+            {"vert_depth", VK_SHADER_STAGE_VERTEX_BIT, useCompactVertices ? "depth_prepass_compact.vert.spv" : "depth_prepass.vert.spv"},
         };
 
         std::vector<vk229::TextureInfo> texturesInfoVec = {
@@ -161,6 +243,19 @@ public:
             {"reflection_s6",       VK_FORMAT_B8G8R8A8_UNORM,  vk229::TexT::REFLECTION,   "reflection_s6_bgra_2kx1k.dds"},
         };
 
+        // Baked lighting maps share one texture - one fetch and one sampler less per fragment.
+        // Sources above are only read when the packing cache is (re)built.
+        std::vector<vk229::PackedTextureInfo> packedTexturesInfoVec = {
+            {
+                "all_baked", {
+                    {vk229::TexT::DIFFUSE_DI, "all_diffuse_DI", 0u},
+                    {vk229::TexT::DIFFUSE_DI, "all_diffuse_DI", 1u},
+                    {vk229::TexT::DIFFUSE_DI, "all_diffuse_DI", 2u},
+                    {vk229::TexT::AO,         "all_ao",         0u},
+                }
+            },
+        };
+
         std::vector<vk229::MatrixInfo> matricesInfoVec = {
             {"mat1", glm::mat4x4()}, // TODO: make it used, fill correctly.
         };
@@ -169,8 +264,7 @@ public:
             {
                 "TEX_COMMON", {
                     "all_diffuse_C",
-                    "all_diffuse_DI",
-                    "all_ao",
+                    "all_baked",
                     "all_emit",
                     "all_normal",
                     "reflection_center",
@@ -179,8 +273,7 @@ public:
             {
                 "TEX_DROID", {
                     "all_diffuse_C",
-                    "all_diffuse_DI",
-                    "all_ao",
+                    "all_baked",
                     "all_emit",
                     "all_normal",
                     "reflection_droid",
@@ -189,8 +282,7 @@ public:
             {
                 "TEX_MONKEY", {
                     "all_diffuse_C",
-                    "all_diffuse_DI",
-                    "all_ao",
+                    "all_baked",
                     "all_emit",
                     "all_normal",
                     "reflection_monkey",
@@ -199,8 +291,7 @@ public:
             {
                 "TEX_S1", {
                     "all_diffuse_C",
-                    "all_diffuse_DI",
-                    "all_ao",
+                    "all_baked",
                     "all_emit",
                     "all_normal",
                     "reflection_s1",
@@ -209,8 +300,7 @@ public:
             {
                 "TEX_S2", {
                     "all_diffuse_C",
-                    "all_diffuse_DI",
-                    "all_ao",
+                    "all_baked",
                     "all_emit",
                     "all_normal",
                     "reflection_s2",
@@ -219,8 +309,7 @@ public:
             {
                 "TEX_S3", {
                     "all_diffuse_C",
-                    "all_diffuse_DI",
-                    "all_ao",
+                    "all_baked",
                     "all_emit",
                     "all_normal",
                     "reflection_s3",
@@ -229,8 +318,7 @@ public:
             {
                 "TEX_S4", {
                     "all_diffuse_C",
-                    "all_diffuse_DI",
-                    "all_ao",
+                    "all_baked",
                     "all_emit",
                     "all_normal",
                     "reflection_s4",
@@ -239,8 +327,7 @@ public:
             {
                 "TEX_S5", {
                     "all_diffuse_C",
-                    "all_diffuse_DI",
-                    "all_ao",
+                    "all_baked",
                     "all_emit",
                     "all_normal",
                     "reflection_s5",
@@ -249,8 +336,7 @@ public:
             {
                 "TEX_S6", {
                     "all_diffuse_C",
-                    "all_diffuse_DI",
-                    "all_ao",
+                    "all_baked",
                     "all_emit",
                     "all_normal",
                     "reflection_s6",
@@ -271,38 +357,93 @@ public:
                     "vert1",
                 }
             },
+            {
+                "SHADER_SET_DEPTH", {
+                    "vert_depth",
+                }
+            },
+        };
+
+        // Every distinct material gets its own pipeline with features and coefficients as specialization constants.
+        // Entities without material use vk229::getDefaultMaterial() - everything enabled.
+        std::vector<vk229::MaterialInfo> materialsInfoVec = {
+            {"MAT_NO_EMIT", vk229::MAT_NORMAL_MAP | vk229::MAT_REFLECTION | vk229::MAT_AO, {0.25f, 1.0f, 3.0f, 2.0f, 0.0f, 0.25f}},
+            {"MAT_SCREEN",  vk229::MAT_EMISSION   | vk229::MAT_AO,                         {0.25f, 1.0f, 3.0f, 2.0f, 0.0f, 0.25f}},
         };
 
         std::vector<vk229::Entity3dInfo> entitiesInfoVec = {
-            {"Box",     "box",      "mat1", "TEX_COMMON",   "SHADER_SET0"},
+            {"Box",     "box",      "mat1", "TEX_COMMON",   "SHADER_SET0", "MAT_NO_EMIT"},
             {"Light",   "light",    "mat1", "TEX_COMMON",   "SHADER_SET0"},
-            {"Floor",   "floor",    "mat1", "TEX_COMMON",   "SHADER_SET0"},
-            {"Cube1",   "cube1",    "mat1", "TEX_MONKEY",   "SHADER_SET0"},
-            {"Cube2",   "cube2",    "mat1", "TEX_MONKEY",   "SHADER_SET0"},
-            {"Cube3",   "cube3",    "mat1", "TEX_MONKEY",   "SHADER_SET0"},
-            {"Monkey",  "monkey",   "mat1", "TEX_MONKEY",   "SHADER_SET0"},
-            {"S1",      "s1",       "mat1", "TEX_S1",       "SHADER_SET0"},
-            {"S2",      "s2",       "mat1", "TEX_S2",       "SHADER_SET0"},
-            {"S3",      "s3",       "mat1", "TEX_S3",       "SHADER_SET0"},
-            {"S4",      "s4",       "mat1", "TEX_S4",       "SHADER_SET0"},
-            {"S5",      "s5",       "mat1", "TEX_S5",       "SHADER_SET0"},
-            {"S6",      "s6",       "mat1", "TEX_S6",       "SHADER_SET0"},
-            {"Droid",   "droid",    "mat1", "TEX_DROID",    "SHADER_SET0"},
+            {"Floor",   "floor",    "mat1", "TEX_COMMON",   "SHADER_SET0", "MAT_NO_EMIT"},
+            {"Cube1",   "cube1",    "mat1", "TEX_MONKEY",   "SHADER_SET0", "MAT_NO_EMIT"},
+            {"Cube2",   "cube2",    "mat1", "TEX_MONKEY",   "SHADER_SET0", "MAT_NO_EMIT"},
+            {"Cube3",   "cube3",    "mat1", "TEX_MONKEY",   "SHADER_SET0", "MAT_NO_EMIT"},
+            {"Monkey",  "monkey",   "mat1", "TEX_MONKEY",   "SHADER_SET0", "MAT_NO_EMIT"},
+            {"S1",      "s1",       "mat1", "TEX_S1",       "SHADER_SET0", "MAT_NO_EMIT"},
+            {"S2",      "s2",       "mat1", "TEX_S2",       "SHADER_SET0", "MAT_NO_EMIT"},
+            {"S3",      "s3",       "mat1", "TEX_S3",       "SHADER_SET0", "MAT_NO_EMIT"},
+            {"S4",      "s4",       "mat1", "TEX_S4",       "SHADER_SET0", "MAT_NO_EMIT"},
+            {"S5",      "s5",       "mat1", "TEX_S5",       "SHADER_SET0", "MAT_NO_EMIT"},
+            {"S6",      "s6",       "mat1", "TEX_S6",       "SHADER_SET0", "MAT_NO_EMIT"},
+            {"Droid",   "droid",    "mat1", "TEX_DROID",    "SHADER_SET0", "", "DroidSpin"},
             {"Fluid",   "fluid",    "mat1", "TEX_COMMON",   "SHADER_SET0"},
-            {"Debugsc0","debugsc0", "mat1", "TEX_COMMON",   "SHADER_SET0"},
+            {"Debugsc0","debugsc0", "mat1", "TEX_COMMON",   "SHADER_SET0", "MAT_SCREEN"},
+        };
+
+        // Pivots for the droid - it spins around its own center while the whole hovers.
+        // Translation of DroidSpin is set to the center when the mesh is loaded, see prepareTransforms().
+        std::vector<vk229::TransformNodeInfo> transformNodesInfoVec = {
+            {"DroidHover", "",           {0.0f, 0.0f, 0.0f}},
+            {"DroidSpin",  "DroidHover", {0.0f, 0.0f, 0.0f}},
         };
 
     // } // INPUT_DATA_RETRIEVED_FROM_FILE
 
+    // GENERATED_SCENE {
+
+        // Entities made of the small meshes, texture sets and materials above - the room, the light,
+        // the fluid and the screen are not repeated.
+        if (isSceneGenerated())
+        {
+            vk229::SceneGeneratorAssets assets;
+            for (const vk229::MeshInfo& meshInfo : meshesInfoVec)
+            {
+                if (meshInfo.meshName != "box" && meshInfo.meshName != "light" && meshInfo.meshName != "floor"
+                    && meshInfo.meshName != "fluid" && meshInfo.meshName != "debugsc0")
+                {
+                    assets.meshFilenames.push_back(meshInfo.meshFilename);
+                }
+            }
+            assets.textureSets    = textureSetsInfoVec;
+            assets.materials      = materialsInfoVec;
+            assets.shadersSetName = "SHADER_SET0";
+            assets.matrixName     = "mat1";
+
+            vk229::generateScene(sceneGenOptions, assets, generatedScene);
+            meshesInfoVec         = generatedScene.meshesInfoVec;
+            textureSetsInfoVec    = generatedScene.textureSetsInfoVec;
+            materialsInfoVec      = generatedScene.materialsInfoVec;
+            entitiesInfoVec       = generatedScene.entitiesInfoVec;
+            transformNodesInfoVec = generatedScene.transformNodesInfoVec;
+        }
+
+    // } // GENERATED_SCENE
+
     // PUTTING_DATA_INTO_MAPS {
 
+        sceneData.sceneInfo.useCompactVertices = useCompactVertices;
+        sceneData.sceneInfo.depthPrepassShadersSetName = USE_DEPTH_PREPASS ? "SHADER_SET_DEPTH" : "";
+        sceneData.sceneInfo.prefilterReflectionMaps = USE_PREFILTERED_REFLECTIONS;
         sceneData.sceneInfo.fillMeshesInfoMap(meshesInfoVec);
         sceneData.sceneInfo.fillShadersInfoMap(shadersInfoVec);
         sceneData.sceneInfo.fillTexturesInfoMap(texturesInfoVec);
+        sceneData.sceneInfo.fillPackedTexturesInfoMap(packedTexturesInfoVec);
         sceneData.sceneInfo.fillMatricesInfoMap(matricesInfoVec);
         sceneData.sceneInfo.fillTexturesSetInfoMap(textureSetsInfoVec);
         sceneData.sceneInfo.fillShadersSetInfoMap(shadersSetsInfoVec);
+        sceneData.sceneInfo.fillMaterialsInfoMap(materialsInfoVec);
         sceneData.sceneInfo.fillEntities3dInfoMap(entitiesInfoVec);
+        sceneData.sceneInfo.fillTransformNodesInfoMap(transformNodesInfoVec);
 
     // } // PUTTING_DATA_INTO_MAPS
     }
@@ -313,8 +454,19 @@ public:
 
     // void VulkanExampleBase::initSwapchain();
 
+    /// Pipeline statistics queries of the GPU profiler need a feature.
+    void getEnabledFeatures() override
+    {
+        if (deviceFeatures.pipelineStatisticsQuery)
+        {
+            enabledFeatures.pipelineStatisticsQuery = VK_TRUE;
+        }
+    }
+
     void prepare() override
     {
+        vk229::VkCallStats::PhaseScope callStatsPhase(vk229::VkCallStats::phase_t::PREPARE);
+
         VulkanExampleBase::prepare();
         // {
         //     createCommandPool();
@@ -327,14 +479,28 @@ public:
         //     // Setup text overlay (shaders + whole pipeline).
         // }
 
+        sceneReport.beginPhase("load");
         loadAssets();
+        sceneReport.endPhase();
+        sceneReport.beginPhase("transforms");
+        prepareTransforms();
         prepareUniformBuffers();
+        sceneReport.endPhase();
+        sceneReport.beginPhase("descriptors");
+        prepareDescriptorAllocator();
         setupDescriptorSetLayout();
-        setupDescriptorPool();
         setupDescriptorSet();
+        sceneReport.endPhase();
+        sceneReport.beginPhase("pipelines");
         preparePipelineLayout();
         preparePipelines();
+        sceneReport.endPhase();
+        gpuProfiler.prepare(vulkanDevice, drawCmdBuffers.size(), ENABLE_GPU_PROFILER);
+        sceneData.updateDrawOrder(camera.matrices.view, camera.matrices.perspective);
+        sceneData.updateEntityLods(camera.matrices.view, camera.matrices.perspective);
+        prepareDrawFences();
         buildCommandBuffers(); // Overriden.
+        sceneReport.setValue("prepare_ms", sceneReport.getElapsedMs());
         prepared = true;
     }
 
@@ -345,29 +511,64 @@ public:
 
     void loadAssets()
     {
+        // VulkanExampleBase::createInstance() asks for Vulkan 1.0 with surface extensions only - memory budget is estimated.
+        sceneData.prepareTextureResidency(vulkanDevice, queue, drawCmdBuffers.size(), instance, VK_API_VERSION_1_0, {},
+                                          VkDeviceSize(TEXTURE_BUDGET_MB) * 1024u * 1024u);
         sceneData.loadTextures(vulkanDevice, queue, getAssetPath());
         sceneData.loadModels(vulkanDevice, queue, getAssetPath());
+        sceneData.prepareBvh();
         sceneData.loadShaders(vulkanDevice, queue, getAssetPath(), shaderModules);
     }
 
+    void prepareTransforms()
+    {
+        sceneData.prepareTransforms(vulkanDevice, drawCmdBuffers.size());
+
+        if (isSceneGenerated())
+        {
+            vk229::placeGeneratedEntities(sceneData, generatedScene);
+            return;
+        }
+
+        // Droid mesh is in world space - moved to the origin of DroidSpin, which is put back where the droid was.
+        const vk229::BoundingSphere& droidSphere = sceneData.sceneInfo.meshesInfoMap["droid"].boundingSphere;
+        const glm::vec3 droidCenter(droidSphere.center[0], droidSphere.center[1], droidSphere.center[2]);
+        sceneData.transforms.setTranslation(sceneData.transformNodeMap["DroidSpin"], droidCenter);
+        sceneData.transforms.setTranslation(sceneData.transformNodeMap["Droid"],    -droidCenter);
+        sceneData.updateTransforms();
+    }
+
+    void updateDroidAnimation()
+    {
+        if (false == animateDroid || paused || isSceneGenerated())
+        {
+            return;
+        }
+
+        // Only these two nodes and the droid below them are recomputed, the rest of the scene stays clean.
+        droidTime += frameTimer;
+        sceneData.transforms.setTranslation(sceneData.transformNodeMap["DroidHover"], glm::vec3(0.0f, 0.1f * sinf(2.0f * droidTime), 0.0f));
+        sceneData.transforms.setRotation(sceneData.transformNodeMap["DroidSpin"], glm::angleAxis(0.5f * droidTime, glm::vec3(0.0f, 1.0f, 0.0f)));
+    }
+
     void prepareUniformBuffers()
     {
         sceneData.prepareUniformBuffers(vulkanDevice, camera.matrices.view, camera.matrices.perspective);
     }
 
-    void setupDescriptorSetLayout()
+    void prepareDescriptorAllocator()
     {
-        sceneData.setupDescriptorSetLayout(vulkanDevice);
+        sceneData.prepareDescriptorAllocator(vulkanDevice, drawCmdBuffers.size());
     }
 
-    void setupDescriptorPool()
+    void setupDescriptorSetLayout()
     {
-        sceneData.setupDescriptorPool(vulkanDevice, descriptorPool);
+        sceneData.setupDescriptorSetLayout(vulkanDevice);
     }
 
     void setupDescriptorSet()
     {
-        sceneData.setupDescriptorSets(vulkanDevice, descriptorPool);
+        sceneData.setupDescriptorSets(vulkanDevice);
     }
 
     void preparePipelineLayout()
@@ -380,8 +581,32 @@ public:
         sceneData.preparePipelines(vulkanDevice, renderPass, pipelineCache, VERTEX_BUFFER_BIND_ID, getAssetPath(), shaderModules);
     }
 
+    void prepareDrawFences()
+    {
+        VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+        drawFences.resize(drawCmdBuffers.size());
+        for (VkFence& fence : drawFences)
+        {
+            VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &fence));
+        }
+        drawCmdBuffersStale.assign(drawCmdBuffers.size(), false);
+    }
+
+    /// All command buffers - callers wait for the queue first.
     void buildCommandBuffers() override
     {
+        for (uint32_t i = 0; i < drawCmdBuffers.size(); ++i)
+        {
+            recordCommandBuffer(i);
+        }
+    }
+
+    /// Command buffer of swapchain image i - it must not be in use.
+    void recordCommandBuffer(uint32_t i)
+    {
+        vk229::VkCallStats::PhaseScope callStatsPhase(vk229::VkCallStats::phase_t::BUILD);
+        const auto tStart = std::chrono::steady_clock::now();
+
         VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
         VkClearValue clearValues[2];
@@ -395,29 +620,34 @@ public:
         renderPassBeginInfo.clearValueCount = 2;
         renderPassBeginInfo.pClearValues = clearValues;
 
-        for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
-        {
-            // Set target frame buffer
-            renderPassBeginInfo.framebuffer = frameBuffers[i];
+        // Set target frame buffer
+        renderPassBeginInfo.framebuffer = frameBuffers[i];
 
-            VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+        VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
-            vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+        gpuProfiler.beginFrame(drawCmdBuffers[i], i);
 
-            VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-            vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+        vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-            VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-            vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+        VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+        vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
 
-            VkDeviceSize offsets[1] = { 0 };
+        VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+        vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-            // Scene part.
-            sceneData.recordDrawCommandsForEntities(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, offsets);
+        VkDeviceSize offsets[1] = { 0 };
 
-            vkCmdEndRenderPass(drawCmdBuffers[i]);
-            VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
-        }
+        // Scene part.
+        sceneData.recordDrawCommandsForEntities(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, offsets, gpuProfiler, i);
+
+        vkCmdEndRenderPass(drawCmdBuffers[i]);
+        VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+
+        drawCmdBuffersStale[i] = false;
+
+        const double recordMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count();
+        frameRecordMs += recordMs;
+        sceneReport.addRecordTime(recordMs);
     }
 
 // } // PREPARE
@@ -456,6 +686,10 @@ public:
     {
         switch (key)
         {
+        case KEY_F2:
+            animateDroid = !animateDroid;
+            updateTextOverlay();
+        break;
         case KEY_KPADD:
             zoom /= 1.41f;
             updateUniformBuffer(true);
@@ -464,6 +698,23 @@ public:
             zoom *= 1.41f;
             updateUniformBuffer(true);
         break;
+        case KEY_F3:
+            // Queries are recorded into command buffers.
+            gpuProfiler.setEnabled(!gpuProfiler.isEnabled());
+            vkQueueWaitIdle(queue);
+            buildCommandBuffers();
+            updateTextOverlay();
+        break;
+        case KEY_F4:
+            gpuProfiler.exportCsv(GPU_PROFILER_CSV);
+        break;
+        case KEY_N:
+            if (false == cameraPathOptions.recordFile.empty())
+            {
+                cameraPath.startSegment();
+                updateTextOverlay();
+            }
+        break;
         }
     }
 
@@ -476,34 +727,157 @@ public:
         {
             return;
         }
+
+        const auto tUpdateStart = std::chrono::steady_clock::now();
+        {
+            vk229::VkCallStats::PhaseScope callStatsPhase(vk229::VkCallStats::phase_t::UPDATE);
+
+            // Camera of this frame - from the path, or the live one recorded.
+            if (updateCameraPath())
+            {
+                updateUniformBuffer(true);
+            }
+            // Moved transform nodes - world matrices and BVH bounds, matrices are read by the shaders.
+            updateDroidAnimation();
+            sceneData.updateTransforms();
+            // Pipelines compiled in the background replace their placeholders.
+            bool rebuildNeeded = sceneData.updatePendingPipelines();
+            // Visible set, draw order and LODs follow the camera.
+            rebuildNeeded = sceneData.updateDrawOrder(camera.matrices.view, camera.matrices.perspective) || rebuildNeeded;
+            rebuildNeeded = sceneData.updateEntityLods(camera.matrices.view, camera.matrices.perspective) || rebuildNeeded;
+            // Mip levels of textures out of sight are evicted under memory pressure, visible ones are reloaded.
+            rebuildNeeded = sceneData.updateTextureResidency(vulkanDevice) || rebuildNeeded;
+            if (rebuildNeeded)
+            {
+                drawCmdBuffersStale.assign(drawCmdBuffers.size(), true);
+            }
+        }
+        const double updateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tUpdateStart).count();
+
+        frameRecordMs = 0.0;
         draw();
-        if (!paused)
+        updateSceneReport(updateMs + frameRecordMs);
+
         {
-            updateUniformBuffer(false);
+            vk229::VkCallStats::PhaseScope callStatsPhase(vk229::VkCallStats::phase_t::UPDATE);
+
+            // Frame has been waited for in submitFrame(), its queries are ready.
+            gpuProfiler.collect(currentBuffer);
+            if (!paused)
+            {
+                updateUniformBuffer(false);
+            }
         }
+        vk229::VkCallStats::endFrame();
     }
 
     void draw()
     {
+        vk229::VkCallStats::PhaseScope callStatsPhase(vk229::VkCallStats::phase_t::SUBMIT);
+
         // Acquire the next image from the swap chain
         // Recreate the swapchain if it's no longer compatible with the surface (OUT_OF_DATE) or no longer optimal for presentation (SUBOPTIMAL)
         VulkanExampleBase::prepareFrame();
 
+        // Last frame of this image has to be done before its command buffer is re-recorded or submitted again.
+        VK_CHECK_RESULT(vkWaitForFences(device, 1, &drawFences[currentBuffer], VK_TRUE, UINT64_MAX));
+        VK_CHECK_RESULT(vkResetFences(device, 1, &drawFences[currentBuffer]));
+        sceneData.completeFrame(currentBuffer);
+        sceneData.flushTransforms(currentBuffer);
+        if (drawCmdBuffersStale[currentBuffer])
+        {
+            recordCommandBuffer(currentBuffer);
+        }
+
         // Command buffer to be sumitted to the queue
         submitInfo.commandBufferCount = 1;
         submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 
         // Submit to queue
-        VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+        VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, drawFences[currentBuffer]));
 
         VulkanExampleBase::submitFrame();
     }
 
+    bool isSceneGenerated() const
+    {
+        return sceneGenOptions.entityCount > 0u;
+    }
+
+    /// CPU time of the frame before its submission - culling, LODs, residency and re-recording.
+    /// Once SCENE_REPORT_FRAMES are measured, the run of a generated scene is reported and the example quits.
+    void updateSceneReport(double frameCpuMs)
+    {
+        if (sceneData.pendingPipelinesMap.empty() && false == sceneReport.hasValue("pipelines_ready_ms"))
+        {
+            sceneReport.setValue("pipelines_ready_ms", sceneReport.getElapsedMs());
+        }
+        sceneReport.addFrame(frameCpuMs);
+
+        if (false == isSceneGenerated() || false == sceneReport.isComplete() || quit)
+        {
+            return;
+        }
+
+        sceneReport.setValue("entities",        sceneData.sceneInfo.entities3dInfoMap.size());
+        sceneReport.setValue("meshes",          sceneData.sceneInfo.meshesInfoMap.size());
+        sceneReport.setValue("materials",       sceneData.sceneInfo.materialsInfoMap.size());
+        sceneReport.setValue("texture_sets",    sceneData.sceneInfo.texturesSetInfoMap.size());
+        sceneReport.setValue("pipelines",       sceneData.pipelinesMap.size());
+        sceneReport.setValue("descriptor_sets", sceneData.descriptorAllocator.getStats().setCount);
+        sceneReport.setValue("visible",         sceneData.entityDrawOrder.size());
+        sceneReport.setValue("compact_vertices", useCompactVertices ? 1.0 : 0.0);
+        sceneReport.finish();
+
+        for (const std::string& line : sceneReport.getReportLines())
+        {
+            std::cout << line << "\n";
+        }
+        sceneReport.appendCsv(SCENE_SCALING_CSV);
+        quit = true;
+    }
+
     void updateUniformBuffer(bool viewChanged)
     {
         sceneData.updateUniformBuffers(viewChanged, camera.matrices.view, camera.matrices.perspective);
     }
 
+    /// Playback - camera from the path, animation advances by the fixed step (true if the camera is set).
+    /// Recording - current pose is added to the path.
+    bool updateCameraPath()
+    {
+        if (cameraPlayback.isPlaying())
+        {
+            vk229::CameraPose pose;
+            if (cameraPlayback.step(pose))
+            {
+                camera.setPosition(pose.position);
+                camera.setRotation(pose.rotation);
+                zoom       = pose.zoom;
+                frameTimer = cameraPlayback.getTimeStep();
+                return true;
+            }
+
+            for (const std::string& line : cameraPlayback.getReportLines(CAMERA_PATH_WORST))
+            {
+                std::cout << line << "\n";
+            }
+            cameraPlayback.exportCsv(CAMERA_PATH_CSV);
+            quit = true;
+        }
+        else if (false == cameraPathOptions.recordFile.empty())
+        {
+            vk229::CameraPose pose;
+            pose.position = camera.position;
+            pose.rotation = camera.rotation;
+            pose.zoom     = zoom;
+
+            cameraRecordTime += frameTimer;
+            cameraPath.addKeyframe(cameraRecordTime, pose);
+        }
+        return false;
+    }
+
     // Camera::update(frameTimer);
 
     // Camera::moving()
@@ -511,6 +885,111 @@ public:
     virtual void getOverlayText(VulkanTextOverlay *textOverlay) override
     {
         textOverlay->addText("LMB to rotate, WSAD to move", 5.0f, 105.0f, VulkanTextOverlay::alignLeft);
+
+        std::stringstream ss;
+        ss << "Triangles: " << sceneData.getDrawnTriangleCount();
+        textOverlay->addText(ss.str(), 5.0f, 125.0f, VulkanTextOverlay::alignLeft);
+
+        ss.str("");
+        ss << "Entities: " << sceneData.entityDrawOrder.size() << " of " << sceneData.sceneInfo.entities3dInfoMap.size() << " visible";
+        textOverlay->addText(ss.str(), 5.0f, 145.0f, VulkanTextOverlay::alignLeft);
+
+        const vk229::TextureResidencyManager::Stats texStats = sceneData.textureResidency.getStats();
+        ss.str("");
+        ss << "Textures: " << texStats.residentBytes / (1024u * 1024u) << " MB, " << texStats.reducedCount << " of " << texStats.textureCount
+           << " reduced, mips evicted: " << texStats.evictedLevels << ", reloaded: " << texStats.reloadedCount
+           << (texStats.pendingLoads > 0u ? " (loading)" : "");
+        if (texStats.retiredBytes > 0u)
+        {
+            ss << ", " << texStats.retiredBytes / (1024u * 1024u) << " MB to free";
+        }
+        textOverlay->addText(ss.str(), 5.0f, 185.0f, VulkanTextOverlay::alignLeft);
+
+        const vk229::MemoryBudget& memBudget = sceneData.textureResidency.getBudget();
+        for (uint32_t heap = 0; heap < memBudget.getHeapCount(); heap++)
+        {
+            if (memBudget.isDeviceLocal(heap))
+            {
+                ss.str("");
+                ss << "Heap " << heap << ": " << memBudget.getUsage(heap) / (1024u * 1024u) << " of " << memBudget.getBudget(heap) / (1024u * 1024u)
+                   << " MB" << (memBudget.isBudgetExtAvailable() ? "" : " (estimated)");
+                textOverlay->addText(ss.str(), 5.0f, 205.0f + 20.0f * heap, VulkanTextOverlay::alignLeft);
+            }
+        }
+
+        // Entity in the middle of the screen.
+        const glm::mat4 invView = glm::inverse(camera.matrices.view);
+        vk229::entity_name_t pickedEntity;
+        float pickedDistance;
+        if (sceneData.pickEntity(glm::vec3(invView[3]), -glm::vec3(invView[2]), pickedEntity, pickedDistance))
+        {
+            ss.str("");
+            ss << "Looking at: " << pickedEntity << " (" << pickedDistance << ")";
+            textOverlay->addText(ss.str(), 5.0f, 165.0f, VulkanTextOverlay::alignLeft);
+        }
+
+        const float transformsY = 205.0f + 20.0f * memBudget.getHeapCount();
+        const vk229::TransformHierarchy::Stats& transformStats = sceneData.transforms.getStats();
+        ss.str("");
+        ss << "F2 - droid animation: " << (animateDroid ? "on" : "off") << ", transforms updated: " << transformStats.updatedCount
+           << " of " << transformStats.nodeCount << " (" << transformStats.visitedCount << " visited)";
+        textOverlay->addText(ss.str(), 5.0f, transformsY, VulkanTextOverlay::alignLeft);
+
+        const float profilerY = transformsY + 20.0f;
+        if (false == gpuProfiler.isSupported())
+        {
+            textOverlay->addText("GPU profiler: not supported", 5.0f, profilerY, VulkanTextOverlay::alignLeft);
+        }
+        else if (false == gpuProfiler.isEnabled())
+        {
+            textOverlay->addText("F3 - GPU profiler: off", 5.0f, profilerY, VulkanTextOverlay::alignLeft);
+        }
+        else
+        {
+            textOverlay->addText("F3 - GPU profiler: on, F4 - export to " GPU_PROFILER_CSV, 5.0f, profilerY, VulkanTextOverlay::alignLeft);
+            const std::vector<std::string> lines = gpuProfiler.getTableLines(GPU_PROFILER_ROWS);
+            for (uint32_t line = 0; line < lines.size(); line++)
+            {
+                textOverlay->addText(lines[line], 5.0f, profilerY + 20.0f * (line + 1u), VulkanTextOverlay::alignLeft);
+            }
+        }
+
+        if (vk229::VkCallStats::isEnabled())
+        {
+            const std::string callStatsLine = vk229::VkCallStats::getSummaryLine();
+            textOverlay->addText(callStatsLine.empty() ? "vk calls/frame: collecting..." : callStatsLine, (float)width - 5.0f, 5.0f, VulkanTextOverlay::alignRight);
+        }
+
+        if (cameraPlayback.isPlaying() || false == cameraPathOptions.recordFile.empty())
+        {
+            ss.str("");
+            ss << std::fixed << std::setprecision(1);
+            if (cameraPlayback.isPlaying())
+            {
+                ss << "Camera path: " << (cameraPlayback.isWarmingUp() ? "warming up" : "playing") << " " << cameraPlayback.getTime()
+                   << " of " << cameraPath.getDuration() << " s, segment " << cameraPlayback.getCurrentSegment();
+            }
+            else
+            {
+                ss << "Camera path: recording " << cameraRecordTime << " s, segment " << std::max(1u, cameraPath.getSegmentCount()) - 1u
+                   << ", N - new segment";
+            }
+            textOverlay->addText(ss.str(), (float)width - 5.0f, 25.0f, VulkanTextOverlay::alignRight);
+        }
+
+        const vk229::DescriptorAllocator::Stats& descStats = sceneData.descriptorAllocator.getStats();
+        ss.str("");
+        ss << "Descriptor sets: " << descStats.setCount << " in " << descStats.poolCount << " pools, "
+           << sceneData.descriptorSetsMap.size() << " entities share " << descStats.cachedSetCount;
+        textOverlay->addText(ss.str(), (float)width - 5.0f, 45.0f, VulkanTextOverlay::alignRight);
+
+        if (isSceneGenerated())
+        {
+            ss.str("");
+            ss << "Generated scene: " << sceneGenOptions.entityCount << " entities, " << sceneData.entityDrawOrder.size() << " visible, "
+               << "measured " << sceneReport.getFrameCount() << " of " << SCENE_REPORT_FRAMES << " frames";
+            textOverlay->addText(ss.str(), (float)width - 5.0f, 65.0f, VulkanTextOverlay::alignRight);
+        }
     }
 
 // } // RUNTIME
@@ -0,0 +1,834 @@
+/*
+* CPU benchmark of the engine's hot paths - no window, no GPU.
+* Prints JSON with per case timings, see README.md.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <HelperStructsAndFuncs.hpp>
+#include <RockField.hpp>
+#include <SceneGenerator.hpp>
+
+#define BENCH_DEFAULT_REPS      5
+#define BENCH_SEED              229u
+#define BENCH_ROCK_TEX_LAYERS   8u
+#define BENCH_LIGHT_DT          (1.0f / 60.0f)
+#define BENCH_CAMERA_POSES      16u     // Camera positions per drawlist/update run.
+#define BENCH_TRANSFORM_FANOUT  4u      // Children per node of transforms/ hierarchy.
+#define BENCH_TRANSFORM_MOVED   100u    // transforms/partial moves every 100th node.
+#define BENCH_GEN_TEMPLATES     8u      // generated/ cases repeat this many texture sets and materials of the synthetic scene.
+#define BENCH_JSON_VERSION      1
+
+/////////////////////////////////////////
+/// Every case runs its setup (not timed) and body (timed) reps times, after one warm-up run.
+/// Reported times are of the body only; median is the one to compare across commits.
+/// Inputs are generated from fixed seeds, so the checksum of a case changes only when its result does.
+/////////////////////////////////////////
+
+struct BenchOptions
+{
+    std::vector<uint32_t> scales = {1000u, 10000u, 100000u};
+    uint32_t              reps   = BENCH_DEFAULT_REPS;
+    std::string           filter;  // Substring of case names, empty - all.
+    std::string           outFilename; // Empty - stdout.
+    vk229::SceneGeneratorOptions sceneGenOptions; // generated/ cases, entityCount is the scale.
+};
+
+struct BenchResult
+{
+    std::string name;
+    uint32_t    scale;
+    uint32_t    reps;
+    double      minNs;
+    double      medianNs;
+    double      meanNs;
+    double      maxNs;
+    uint64_t    checksum;
+};
+
+/// Engine code logs to std::cout - it is swallowed while cases run, so it is not timed and does not break the JSON.
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) override
+    {
+        return c;
+    }
+};
+
+// HELPERS {
+
+/// FNV-1a, used for checksums of case results.
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+uint64_t hashString(const std::string& str, uint64_t hash = 0xcbf29ce484222325ull)
+{
+    return hashBytes(str.data(), str.size(), hash);
+}
+
+std::vector<uint32_t> parseScales(const std::string& list)
+{
+    std::vector<uint32_t> scales;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        const uint32_t scale = uint32_t(strtoul(item.c_str(), nullptr, 10));
+        if (scale > 0u)
+        {
+            scales.push_back(scale);
+        }
+    }
+    return scales;
+}
+
+// } // HELPERS
+
+// SYNTHETIC_INPUTS {
+
+//////////////////////////////////////
+/// Scene definition in the shape of my_new_scene1's initSceneCreateInfo(), with entityCount entities.
+/// Every entity has its own world space mesh (as in my_new_scene1), texture sets and materials are shared.
+struct SyntheticScene
+{
+    std::vector<vk229::MeshInfo>          meshesInfoVec;
+    std::vector<vk229::ShaderInfo>        shadersInfoVec;
+    std::vector<vk229::TextureInfo>       texturesInfoVec;
+    std::vector<vk229::PackedTextureInfo> packedTexturesInfoVec;
+    std::vector<vk229::MatrixInfo>        matricesInfoVec;
+    std::vector<vk229::TextureSetInfo>    textureSetsInfoVec;
+    std::vector<vk229::ShaderSetInfo>     shadersSetsInfoVec;
+    std::vector<vk229::MaterialInfo>      materialsInfoVec;
+    std::vector<vk229::Entity3dInfo>      entitiesInfoVec;
+    float                                 extent; // Entities are in a cube of this size, centered at 0.
+};
+
+void makeSyntheticScene(uint32_t entityCount, SyntheticScene& out)
+{
+    std::mt19937 rndGenerator(BENCH_SEED);
+    std::uniform_real_distribution<float> uniformDist(0.0f, 1.0f);
+
+    const uint32_t textureSetCount = std::max(1u, entityCount / 64u);
+    const uint32_t materialCount   = 8u;
+
+    out.extent = 4.0f * cbrtf(float(entityCount));
+
+    out.shadersInfoVec = {
+        {"vert1",      VK_SHADER_STAGE_VERTEX_BIT,   "default_transforms_compact.vert.spv"},
+        {"frag1",      VK_SHADER_STAGE_FRAGMENT_BIT, "default_material.frag.spv"},
+        {"vert_depth", VK_SHADER_STAGE_VERTEX_BIT,   "depth_prepass_compact.vert.spv"},
+    };
+    out.shadersSetsInfoVec = {
+        {"SHADER_SET0",      {"frag1", "vert1"}},
+        {"SHADER_SET1",      {"frag1", "vert1"}},
+        {"SHADER_SET_DEPTH", {"vert_depth"}},
+    };
+
+    out.texturesInfoVec = {
+        {"all_diffuse_C",  VK_FORMAT_BC3_UNORM_BLOCK, vk229::TexT::COLOR,      "all_diffuse_C_bc3_1k.dds"},
+        {"all_diffuse_DI", VK_FORMAT_BC3_UNORM_BLOCK, vk229::TexT::DIFFUSE_DI, "all_diffuse_DI_bc3_2k.dds"},
+        {"all_ao",         VK_FORMAT_BC4_UNORM_BLOCK, vk229::TexT::AO,         "all_ao_bc4_2k.dds"},
+        {"all_emit",       VK_FORMAT_BC3_UNORM_BLOCK, vk229::TexT::EMIT,       "all_emit_bc3_1k.dds"},
+        {"all_normal",     VK_FORMAT_B8G8R8A8_UNORM,  vk229::TexT::NORMAL,     "all_normal_bgra_2k.dds"},
+    };
+    out.packedTexturesInfoVec = {
+        {
+            "all_baked", {
+                {vk229::TexT::DIFFUSE_DI, "all_diffuse_DI", 0u},
+                {vk229::TexT::DIFFUSE_DI, "all_diffuse_DI", 1u},
+                {vk229::TexT::DIFFUSE_DI, "all_diffuse_DI", 2u},
+                {vk229::TexT::AO,         "all_ao",         0u},
+            }
+        },
+    };
+    out.matricesInfoVec = {
+        {"mat1", glm::mat4x4()},
+    };
+
+    for (uint32_t t = 0; t < textureSetCount; t++)
+    {
+        const std::string reflName = "reflection_" + std::to_string(t);
+        out.texturesInfoVec.push_back({reflName, VK_FORMAT_B8G8R8A8_UNORM, vk229::TexT::REFLECTION, reflName + "_bgra_2kx1k.dds"});
+        out.textureSetsInfoVec.push_back({"TEX_" + std::to_string(t), {"all_diffuse_C", "all_baked", "all_emit", "all_normal", reflName}});
+    }
+
+    for (uint32_t m = 0; m < materialCount; m++)
+    {
+        const uint32_t features = vk229::MAT_ALL & ~(1u << (m % 4u));
+        out.materialsInfoVec.push_back({"MAT_" + std::to_string(m), features, {0.25f, 1.0f, 3.0f, 2.0f, 0.125f * m, 0.25f}});
+    }
+
+    for (uint32_t e = 0; e < entityCount; e++)
+    {
+        const std::string id = std::to_string(e);
+
+        // Mesh data is not loaded - only what loadModels() would fill in.
+        vk229::MeshInfo meshInfo;
+        meshInfo.meshName     = "mesh" + id;
+        meshInfo.meshFilename = "mesh" + id + ".obj";
+
+        const float radius = 0.25f + uniformDist(rndGenerator);
+        for (uint32_t c = 0; c < 3u; c++)
+        {
+            meshInfo.boundingSphere.center[c] = (uniformDist(rndGenerator) - 0.5f) * out.extent;
+            meshInfo.bounds.min[c]            = meshInfo.boundingSphere.center[c] - radius;
+            meshInfo.bounds.max[c]            = meshInfo.boundingSphere.center[c] + radius;
+        }
+        meshInfo.boundingSphere.radius = radius;
+        for (uint32_t lod = 0; lod < 4u; lod++)
+        {
+            meshInfo.lods.push_back({0u, 3072u >> lod, 0.01f * float(1u << lod)});
+        }
+        out.meshesInfoVec.push_back(meshInfo);
+
+        // Every 4th entity uses the default material.
+        out.entitiesInfoVec.push_back({
+            "Entity" + id,
+            meshInfo.meshName,
+            "mat1",
+            out.textureSetsInfoVec[e % textureSetCount].texturesSetName,
+            (e % 2u) ? "SHADER_SET1" : "SHADER_SET0",
+            (e % 4u) ? out.materialsInfoVec[e % materialCount].materialName : ""
+        });
+    }
+}
+
+void fillSceneInfo(const SyntheticScene& scene, vk229::SceneInfo& sceneInfo)
+{
+    sceneInfo.useCompactVertices = true;
+    sceneInfo.depthPrepassShadersSetName = "SHADER_SET_DEPTH";
+    sceneInfo.fillMeshesInfoMap(scene.meshesInfoVec);
+    sceneInfo.fillShadersInfoMap(scene.shadersInfoVec);
+    sceneInfo.fillTexturesInfoMap(scene.texturesInfoVec);
+    sceneInfo.fillPackedTexturesInfoMap(scene.packedTexturesInfoVec);
+    sceneInfo.fillMatricesInfoMap(scene.matricesInfoVec);
+    sceneInfo.fillTexturesSetInfoMap(scene.textureSetsInfoVec);
+    sceneInfo.fillShadersSetInfoMap(scene.shadersSetsInfoVec);
+    sceneInfo.fillMaterialsInfoMap(scene.materialsInfoVec);
+    sceneInfo.fillEntities3dInfoMap(scene.entitiesInfoVec);
+}
+
+/// Wavy grid with about triangleCount triangles, in the Wavefront OBJ format of the scene's meshes (v, vt, vn, f).
+std::string makeGridObj(uint32_t triangleCount)
+{
+    const uint32_t quads = std::max(1u, uint32_t(sqrtf(float(triangleCount) * 0.5f)));
+    const uint32_t verts = quads + 1u;
+
+    std::ostringstream obj;
+    obj.precision(6);
+    for (uint32_t y = 0; y < verts; y++)
+    {
+        for (uint32_t x = 0; x < verts; x++)
+        {
+            const float u = float(x) / float(quads);
+            const float v = float(y) / float(quads);
+            obj << "v " << u * 8.0f << " " << 0.25f * sinf(u * 12.0f) * cosf(v * 9.0f) << " " << v * 8.0f << "\n";
+            obj << "vt " << u << " " << v << "\n";
+            obj << "vn 0 1 0\n";
+        }
+    }
+    for (uint32_t y = 0; y < quads; y++)
+    {
+        for (uint32_t x = 0; x < quads; x++)
+        {
+            const uint32_t i0 = y*verts + x + 1u; // OBJ indices start at 1.
+            const uint32_t i1 = i0 + 1u;
+            const uint32_t i2 = i0 + verts;
+            const uint32_t i3 = i2 + 1u;
+            obj << "f " << i0 << "/" << i0 << "/" << i0 << " " << i2 << "/" << i2 << "/" << i2 << " " << i1 << "/" << i1 << "/" << i1 << "\n";
+            obj << "f " << i1 << "/" << i1 << "/" << i1 << " " << i2 << "/" << i2 << "/" << i2 << " " << i3 << "/" << i3 << "/" << i3 << "\n";
+        }
+    }
+    return obj.str();
+}
+
+/// Generated scene (vk229::generateScene()) of entityCount entities made of texture sets and materials of base
+/// (makeSyntheticScene() of 64 * BENCH_GEN_TEMPLATES entities) - its shaders, textures and matrices are the ones
+/// filled in by fillGeneratedSceneInfo().
+void makeGeneratedScene(const vk229::SceneGeneratorOptions& options, uint32_t entityCount, const SyntheticScene& base, vk229::GeneratedScene& out)
+{
+    vk229::SceneGeneratorAssets assets;
+    assets.meshFilenames  = {"cube1.obj", "monkey.obj", "s1.obj", "full_droid_2.obj"};
+    assets.textureSets    = base.textureSetsInfoVec;
+    assets.materials      = base.materialsInfoVec;
+    assets.shadersSetName = "SHADER_SET0";
+    assets.matrixName     = "mat1";
+
+    vk229::SceneGeneratorOptions genOptions = options;
+    genOptions.entityCount = entityCount;
+    vk229::generateScene(genOptions, assets, out);
+
+    // Mesh data is not loaded - unit spheres at the origin, as placeGeneratedEntities() would leave them.
+    for (vk229::MeshInfo& meshInfo : out.meshesInfoVec)
+    {
+        for (uint32_t c = 0; c < 3u; c++)
+        {
+            meshInfo.boundingSphere.center[c] = 0.0f;
+            meshInfo.bounds.min[c]            = -1.0f;
+            meshInfo.bounds.max[c]            =  1.0f;
+        }
+        meshInfo.boundingSphere.radius = 1.0f;
+        for (uint32_t lod = 0; lod < 4u; lod++)
+        {
+            meshInfo.lods.push_back({0u, 3072u >> lod, 0.01f * float(1u << lod)});
+        }
+    }
+}
+
+void fillGeneratedSceneInfo(const SyntheticScene& base, const vk229::GeneratedScene& scene, vk229::SceneInfo& sceneInfo)
+{
+    sceneInfo.useCompactVertices = true;
+    sceneInfo.depthPrepassShadersSetName = "SHADER_SET_DEPTH";
+    sceneInfo.fillMeshesInfoMap(scene.meshesInfoVec);
+    sceneInfo.fillShadersInfoMap(base.shadersInfoVec);
+    sceneInfo.fillTexturesInfoMap(base.texturesInfoVec);
+    sceneInfo.fillPackedTexturesInfoMap(base.packedTexturesInfoVec);
+    sceneInfo.fillMatricesInfoMap(base.matricesInfoVec);
+    sceneInfo.fillTexturesSetInfoMap(scene.textureSetsInfoVec);
+    sceneInfo.fillShadersSetInfoMap(base.shadersSetsInfoVec);
+    sceneInfo.fillMaterialsInfoMap(scene.materialsInfoVec);
+    sceneInfo.fillEntities3dInfoMap(scene.entitiesInfoVec);
+    sceneInfo.fillTransformNodesInfoMap(scene.transformNodesInfoVec);
+}
+
+/// Camera circling the scene, looking at its center, same projection as my_new_scene1.
+void getCameraPose(uint32_t poseId, float sceneExtent, glm::mat4& outView, glm::mat4& outPersp)
+{
+    const float angle  = 2.0f * float(M_PI) * float(poseId) / float(BENCH_CAMERA_POSES);
+    const float radius = 0.75f * sceneExtent + 1.0f;
+    const glm::vec3 eye(radius * cosf(angle), 0.25f * radius, radius * sinf(angle));
+
+    outView  = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    outPersp = glm::perspective(glm::radians(80.0f), 16.0f / 9.0f, 1.0f / 128.0f, 4.0f * radius);
+}
+
+// } // SYNTHETIC_INPUTS
+
+class Benchmark
+{
+public:
+    using setup_t = std::function<void()>;
+    using body_t  = std::function<uint64_t()>; // Returns checksum of the result.
+
+    explicit Benchmark(const BenchOptions& options) :
+        options(options)
+    {
+    }
+
+    bool isEnabled(const std::string& name) const
+    {
+        return this->options.filter.empty() || name.find(this->options.filter) != std::string::npos;
+    }
+
+    void run(const std::string& name, uint32_t scale, setup_t setup, body_t body)
+    {
+        if (false == this->isEnabled(name))
+        {
+            return;
+        }
+
+        std::cerr << " >>> Benchmark::run: " << name << " @ " << scale << "\n";
+
+        std::vector<double> samplesNs;
+        uint64_t checksum = 0u;
+        for (uint32_t rep = 0; rep <= this->options.reps; rep++) // Rep 0 is warm-up.
+        {
+            setup();
+
+            const auto tStart = std::chrono::steady_clock::now();
+            const uint64_t repChecksum = body();
+            const auto tEnd = std::chrono::steady_clock::now();
+
+            if (rep == 0u)
+            {
+                checksum = repChecksum;
+                continue;
+            }
+            if (repChecksum != checksum)
+            {
+                std::cerr << " >>> Benchmark::run: " << name << ": result differs between runs\n";
+            }
+            samplesNs.push_back(std::chrono::duration<double, std::nano>(tEnd - tStart).count());
+        }
+
+        std::sort(samplesNs.begin(), samplesNs.end());
+        double sumNs = 0.0;
+        for (double ns : samplesNs)
+        {
+            sumNs += ns;
+        }
+
+        BenchResult result;
+        result.name     = name;
+        result.scale    = scale;
+        result.reps     = samplesNs.size();
+        result.minNs    = samplesNs.front();
+        result.maxNs    = samplesNs.back();
+        result.meanNs   = sumNs / samplesNs.size();
+        result.medianNs = (samplesNs.size() % 2u)
+            ? samplesNs[samplesNs.size() / 2u]
+            : 0.5 * (samplesNs[samplesNs.size() / 2u - 1u] + samplesNs[samplesNs.size() / 2u]);
+        result.checksum = checksum;
+        this->results.push_back(result);
+    }
+
+    void writeJson(std::ostream& out) const
+    {
+        out << "{\n";
+        out << "  \"benchmark\": \"vk229_bench\",\n";
+        out << "  \"version\": " << BENCH_JSON_VERSION << ",\n";
+#if defined(NDEBUG)
+        out << "  \"optimized\": true,\n";
+#else
+        out << "  \"optimized\": false,\n";
+#endif
+        out << "  \"reps\": " << this->options.reps << ",\n";
+        out << "  \"results\": [\n";
+        for (size_t i = 0; i < this->results.size(); i++)
+        {
+            const BenchResult& r = this->results[i];
+            char checksum[32];
+            snprintf(checksum, sizeof(checksum), "%016llx", (unsigned long long)r.checksum);
+
+            out << "    {\"name\": \"" << r.name << "\", \"scale\": " << r.scale << ", \"reps\": " << r.reps
+                << ", \"median_ns\": " << uint64_t(r.medianNs) << ", \"min_ns\": " << uint64_t(r.minNs)
+                << ", \"mean_ns\": " << uint64_t(r.meanNs) << ", \"max_ns\": " << uint64_t(r.maxNs)
+                << ", \"median_ns_per_item\": " << r.medianNs / r.scale
+                << ", \"checksum\": \"" << checksum << "\"}" << (i + 1u < this->results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n";
+        out << "}\n";
+    }
+
+private:
+    BenchOptions             options;
+    std::vector<BenchResult> results;
+};
+
+// CASES {
+
+/// instancing-229's prepareInstanceData() without the upload.
+void benchRocks(Benchmark& bench, uint32_t scale)
+{
+    std::vector<vk229::RockInstance> instances;
+
+    bench.run("rocks/generate", scale,
+        [&]() { instances.clear(); },
+        [&]() {
+            vk229::generateRockInstances(scale, BENCH_ROCK_TEX_LAYERS, BENCH_SEED, instances);
+            return hashBytes(instances.data(), instances.size() * sizeof(vk229::RockInstance));
+        });
+}
+
+/// instancing-229's updateLight(), scale is the number of steps.
+void benchLight(Benchmark& bench, uint32_t scale)
+{
+    bench.run("light/integrate", scale,
+        []() {},
+        [&]() {
+            vk229::LightOrbit orbit;
+            for (uint32_t s = 0; s < scale; s++)
+            {
+                orbit.step(BENCH_LIGHT_DT);
+            }
+            return hashBytes(&orbit.getPosition(), sizeof(glm::vec3));
+        });
+}
+
+/// SceneInfo::fill*InfoMap() and what preparePipelines(), loadModels() and setupDescriptorSets()
+/// look up for every entity - scale is the number of entities.
+void benchScene(Benchmark& bench, uint32_t scale)
+{
+    if (false == bench.isEnabled("scene/"))
+    {
+        return;
+    }
+
+    SyntheticScene scene;
+    makeSyntheticScene(scale, scene);
+
+    std::unique_ptr<vk229::SceneInfo> sceneInfo;
+
+    bench.run("scene/fill", scale,
+        [&]() { sceneInfo.reset(new vk229::SceneInfo()); },
+        [&]() {
+            fillSceneInfo(scene, *sceneInfo);
+            return uint64_t(sceneInfo->entities3dInfoMap.size() + sceneInfo->getTextureSetSize());
+        });
+
+    sceneInfo.reset(new vk229::SceneInfo());
+    fillSceneInfo(scene, *sceneInfo);
+    std::map<vk229::entity_name_t, vk229::pipeline_key_t> entityPipelineKeyMap;
+
+    bench.run("scene/resolve", scale,
+        [&]() { entityPipelineKeyMap.clear(); },
+        [&]() {
+            std::set<vk229::pipeline_key_t> pipelineKeys;
+            uint64_t checksum = 0u;
+            for (auto& [entityName, entity3dInfo] : sceneInfo->entities3dInfoMap)
+            {
+                const vk229::ShaderSetInfo&  shadSetInfo = sceneInfo->shadersSetInfoMap[entity3dInfo.shadersSetName];
+                const vk229::TextureSetInfo& texSetInfo  = sceneInfo->texturesSetInfoMap[entity3dInfo.texturesSetName];
+                const vk229::MeshInfo&       meshInfo    = sceneInfo->meshesInfoMap[entity3dInfo.meshName];
+
+                const vk229::MaterialInfo   materialInfo   = sceneInfo->getEntityMaterial(entity3dInfo);
+                const vk229::pipeline_key_t pipelineKey    = vk229::getPipelineKey(entity3dInfo.shadersSetName, materialInfo);
+                const vk229::pipeline_key_t placeholderKey = vk229::getPipelineKey(entity3dInfo.shadersSetName, vk229::getDefaultMaterial());
+
+                entityPipelineKeyMap[entityName] = pipelineKey;
+                pipelineKeys.insert(pipelineKey);
+                pipelineKeys.insert(placeholderKey);
+
+                checksum += shadSetInfo.shadersNames.size() + texSetInfo.texturesNames.size() + meshInfo.lods.size();
+            }
+            for (const vk229::pipeline_key_t& key : pipelineKeys)
+            {
+                checksum = hashString(key, checksum);
+            }
+            return checksum;
+        });
+}
+
+/// loadModels() without the upload: parsing, optimization, LODs and compact encoding of a mesh
+/// with about scale triangles.
+void benchMesh(Benchmark& bench, uint32_t scale)
+{
+    if (false == bench.isEnabled("mesh/"))
+    {
+        return;
+    }
+
+    const std::string objFilename = "vk229_bench_grid_" + std::to_string(scale) + ".obj";
+    {
+        std::ofstream objFile(objFilename.c_str());
+        objFile << makeGridObj(scale);
+    }
+
+    vk229::MeshData mesh;
+
+    bench.run("mesh/load", scale,
+        [&]() { mesh = vk229::MeshData(); },
+        [&]() {
+            if (false == vk229::loadMeshData(objFilename, mesh))
+            {
+                return uint64_t(0u);
+            }
+            return hashBytes(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+        });
+
+    vk229::MeshData loadedMesh;
+    vk229::loadMeshData(objFilename, loadedMesh);
+    remove(objFilename.c_str());
+
+    bench.run("mesh/optimize", scale,
+        [&]() { mesh = loadedMesh; },
+        [&]() {
+            vk229::optimizeMesh(mesh, "grid");
+            return hashBytes(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+        });
+
+    vk229::MeshData optimizedMesh = loadedMesh;
+    vk229::optimizeMesh(optimizedMesh, "grid");
+    std::vector<vk229::MeshLod> lods;
+
+    bench.run("mesh/lod", scale,
+        [&]() { mesh = optimizedMesh; lods.clear(); },
+        [&]() {
+            vk229::buildLodChain(mesh, "grid", lods);
+            return hashBytes(lods.data(), lods.size() * sizeof(vk229::MeshLod));
+        });
+
+    std::vector<vk229::CompactVertex> compactVertices;
+    vk229::MeshDequant dequant;
+
+    bench.run("mesh/encode", scale,
+        [&]() { compactVertices.clear(); },
+        [&]() {
+            vk229::encodeCompactVertices(optimizedMesh, compactVertices, dequant);
+            return hashBytes(compactVertices.data(), compactVertices.size() * sizeof(vk229::CompactVertex));
+        });
+}
+
+/// SceneData::updateDrawOrder() and updateEntityLods() - BVH culling, front-to-back sort and LOD selection
+/// for BENCH_CAMERA_POSES camera positions, scale is the number of entities.
+void benchDrawList(Benchmark& bench, uint32_t scale)
+{
+    if (false == bench.isEnabled("drawlist/"))
+    {
+        return;
+    }
+
+    SyntheticScene scene;
+    makeSyntheticScene(scale, scene);
+
+    std::unique_ptr<vk229::SceneData> sceneData(new vk229::SceneData());
+    fillSceneInfo(scene, sceneData->sceneInfo);
+    sceneData->prepareBvh();
+
+    bench.run("drawlist/update", scale,
+        [&]() {
+            sceneData->resetDrawOrder();
+            sceneData->entityLodMap.clear();
+        },
+        [&]() {
+            uint64_t checksum = 0u;
+            for (uint32_t pose = 0; pose < BENCH_CAMERA_POSES; pose++)
+            {
+                glm::mat4 viewMat, perspMat;
+                getCameraPose(pose, scene.extent, viewMat, perspMat);
+
+                sceneData->updateDrawOrder(viewMat, perspMat);
+                sceneData->updateEntityLods(viewMat, perspMat);
+
+                checksum = hashString(sceneData->entityDrawOrder.empty() ? "" : sceneData->entityDrawOrder.front(), checksum + sceneData->entityDrawOrder.size());
+            }
+            return checksum;
+        });
+}
+
+/// TransformHierarchy::update() of a BENCH_TRANSFORM_FANOUT-ary tree - every node moved (full)
+/// or every BENCH_TRANSFORM_MOVED-th random node moved (partial), scale is the number of nodes.
+void benchTransforms(Benchmark& bench, uint32_t scale)
+{
+    if (false == bench.isEnabled("transforms/"))
+    {
+        return;
+    }
+
+    vk229::TransformHierarchy hierarchy;
+    for (uint32_t i = 0; i < scale; i++)
+    {
+        hierarchy.createNode(i == 0u ? TRANSFORM_NULL_NODE : vk229::transform_node_t((i - 1u) / BENCH_TRANSFORM_FANOUT));
+    }
+    hierarchy.update(); // Breadth-first order is built once.
+
+    auto moveNode = [&](vk229::transform_node_t node, float angle) {
+        hierarchy.setLocal(node, glm::vec3(0.5f, 0.0f, 0.25f * angle),
+                           glm::angleAxis(angle, glm::vec3(0.0f, 1.0f, 0.0f)), glm::vec3(1.0f));
+    };
+    auto worldChecksum = [&]() {
+        uint32_t first, count;
+        hierarchy.getUpdatedRange(first, count);
+        return hashBytes(&hierarchy.getWorldMatrices()[first], count * sizeof(glm::mat4), hierarchy.getStats().updatedCount);
+    };
+
+    bench.run("transforms/full", scale,
+        [&]() {
+            for (uint32_t i = 0; i < scale; i++)
+            {
+                moveNode(i, 0.001f * i);
+            }
+        },
+        [&]() {
+            hierarchy.update();
+            return worldChecksum();
+        });
+
+    std::mt19937 rng(BENCH_SEED);
+    bench.run("transforms/partial", scale,
+        [&]() {
+            rng.seed(BENCH_SEED);
+            for (uint32_t i = 0; i < scale / BENCH_TRANSFORM_MOVED + 1u; i++)
+            {
+                const uint32_t node = rng() % scale;
+                moveNode(node, 0.002f * node);
+            }
+        },
+        [&]() {
+            hierarchy.update();
+            return worldChecksum();
+        });
+}
+
+/// Generated scenes of my_new_scene1's --scene-entities (reuse ratios and distribution from --scene-*):
+/// generation, SceneInfo::fill*InfoMap(), and culling, sorting and LODs of entities placed by their
+/// transform nodes - prepareTransforms() without the buffer. Scale is the number of entities.
+void benchGenerated(Benchmark& bench, uint32_t scale, const vk229::SceneGeneratorOptions& options)
+{
+    if (false == bench.isEnabled("generated/"))
+    {
+        return;
+    }
+
+    SyntheticScene base;
+    makeSyntheticScene(64u * BENCH_GEN_TEMPLATES, base);
+    vk229::GeneratedScene scene;
+
+    bench.run("generated/generate", scale,
+        [&]() { scene = vk229::GeneratedScene(); },
+        [&]() {
+            makeGeneratedScene(options, scale, base, scene);
+            uint64_t checksum = 0u;
+            for (const vk229::Entity3dInfo& entityInfo : scene.entitiesInfoVec)
+            {
+                checksum = hashString(entityInfo.meshName + entityInfo.texturesSetName + entityInfo.materialName, checksum);
+            }
+            return hashBytes(&scene.transformNodesInfoVec.back().translation, sizeof(glm::vec3), checksum);
+        });
+
+    std::unique_ptr<vk229::SceneInfo> sceneInfo;
+
+    bench.run("generated/fill", scale,
+        [&]() { sceneInfo.reset(new vk229::SceneInfo()); },
+        [&]() {
+            fillGeneratedSceneInfo(base, scene, *sceneInfo);
+            return uint64_t(sceneInfo->entities3dInfoMap.size() + sceneInfo->materialsInfoMap.size() + sceneInfo->texturesSetInfoMap.size());
+        });
+
+    std::unique_ptr<vk229::SceneData> sceneData(new vk229::SceneData());
+    fillGeneratedSceneInfo(base, scene, sceneData->sceneInfo);
+    sceneData->prepareBvh();
+    for (const vk229::TransformNodeInfo& nodeInfo : scene.transformNodesInfoVec)
+    {
+        sceneData->getOrCreateTransformNode(nodeInfo.nodeName);
+    }
+    for (const vk229::Entity3dInfo& entityInfo : scene.entitiesInfoVec)
+    {
+        sceneData->getOrCreateTransformNode(entityInfo.entityName);
+    }
+    sceneData->transforms.update();
+    for (const vk229::Entity3dInfo& entityInfo : scene.entitiesInfoVec)
+    {
+        sceneData->updateEntityBounds(entityInfo.entityName, sceneData->transforms.getWorld(sceneData->transformNodeMap[entityInfo.entityName]));
+    }
+
+    bench.run("generated/drawlist", scale,
+        [&]() {
+            sceneData->resetDrawOrder();
+            sceneData->entityLodMap.clear();
+        },
+        [&]() {
+            uint64_t checksum = 0u;
+            for (uint32_t pose = 0; pose < BENCH_CAMERA_POSES; pose++)
+            {
+                glm::mat4 viewMat, perspMat;
+                getCameraPose(pose, scene.extent, viewMat, perspMat);
+
+                sceneData->updateDrawOrder(viewMat, perspMat);
+                sceneData->updateEntityLods(viewMat, perspMat);
+
+                checksum = hashString(sceneData->entityDrawOrder.empty() ? "" : sceneData->entityDrawOrder.front(), checksum + sceneData->entityDrawOrder.size());
+            }
+            return checksum;
+        });
+}
+
+// } // CASES
+
+// MAIN {
+
+void printUsage()
+{
+    std::cerr << "usage: vk229_bench [--scales N,N,...] [--reps N] [--filter NAME_PART] [--out FILE]\n"
+              << "                   [--scene-reuse MESH,MATERIAL,TEXSET] [--scene-distribution uniform|clustered|grid] [--scene-seed N]\n"
+              << "  --scales  instances / steps / entities / triangles per case (default 1000,10000,100000)\n"
+              << "  --reps    timed runs per case, after one warm-up run (default " << BENCH_DEFAULT_REPS << ")\n"
+              << "  --filter  only cases with names containing NAME_PART (ie. mesh/ or drawlist/update)\n"
+              << "  --out     JSON file, stdout if not given\n"
+              << "  --scene-* generated/ cases - entities per distinct mesh, material and texture set (default "
+              << SCENE_GEN_MESH_REUSE << "," << SCENE_GEN_MATERIAL_REUSE << "," << SCENE_GEN_TEXTURE_SET_REUSE << "), placement, seed\n";
+}
+
+int main(const int argc, const char *argv[])
+{
+    BenchOptions options;
+    std::vector<const char*> sceneGenArgs;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = (i + 1 < argc);
+        if (arg == "--scales" && hasValue)
+        {
+            options.scales = parseScales(argv[++i]);
+        }
+        else if (arg == "--reps" && hasValue)
+        {
+            options.reps = std::max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--filter" && hasValue)
+        {
+            options.filter = argv[++i];
+        }
+        else if (arg == "--out" && hasValue)
+        {
+            options.outFilename = argv[++i];
+        }
+        else if ((arg == "--scene-reuse" || arg == "--scene-distribution" || arg == "--scene-seed") && hasValue)
+        {
+            sceneGenArgs.push_back(argv[i]);
+            sceneGenArgs.push_back(argv[++i]);
+        }
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+    if (options.scales.empty())
+    {
+        printUsage();
+        return 1;
+    }
+    options.sceneGenOptions = vk229::parseSceneGeneratorOptions(sceneGenArgs);
+
+    Benchmark bench(options);
+
+    NullBuffer nullBuffer;
+    std::streambuf* coutBuffer = std::cout.rdbuf(&nullBuffer);
+
+    for (uint32_t scale : options.scales)
+    {
+        benchRocks(bench, scale);
+        benchLight(bench, scale);
+        benchScene(bench, scale);
+        benchMesh(bench, scale);
+        benchDrawList(bench, scale);
+        benchTransforms(bench, scale);
+        benchGenerated(bench, scale, options.sceneGenOptions);
+    }
+
+    std::cout.rdbuf(coutBuffer);
+
+    if (options.outFilename.empty())
+    {
+        bench.writeJson(std::cout);
+    }
+    else
+    {
+        std::ofstream outFile(options.outFilename.c_str());
+        bench.writeJson(outFile);
+    }
+
+    return 0;
+}
+
+// } // MAIN